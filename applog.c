@@ -1,10 +1,33 @@
-#define _POSIX_SOURCE
+#define _POSIX_C_SOURCE 200112L /* localtime_r, vsnprintf, pthreads */
 
 #include "applog.h"
 #include <time.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+
+/* each message is formatted whole and written with one call, so lines from
+   different threads never interleave, and nothing is held back to be lost if
+   the program is stopped.  Only the repeat counts are kept per thread. */
+
+/* longest single message, anything longer is truncated */
+#define APPLOG_MESSAGE_SIZE 1024
+
+/* number of distinct messages (by format string) counted per thread for
+   rate limiting */
+#define APPLOG_REPEAT_SLOTS 64
+
+struct ApplogRepeat {
+	const char *format;
+	const char *function_name;
+	unsigned long count;
+};
+
+struct ApplogSink {
+	struct ApplogRepeat repeats[APPLOG_REPEAT_SLOTS];
+};
 
 static struct tm *windows_localtime_r(const time_t *pt, struct tm *ptm)
 {
@@ -22,15 +45,165 @@ static struct tm *portable_localtime_r(const time_t *pt, struct tm *ptm)
 #endif
 }
 
+static const char *applog_level_names[] = {
+	"debug",
+	"info",
+	"notice",
+	"warning",
+	"error",
+	"fatal",
+	"bug"
+};
+
+/* messages less important than this are not shown */
+static enum ApplogLevel applog_level = APPLOG_NOTICE;
+
+static unsigned applog_repeat_limit = APPLOG_DEFAULT_REPEAT_LIMIT;
+
+static pthread_once_t applog_once = PTHREAD_ONCE_INIT;
+static pthread_key_t applog_sink_key;
+static int applog_sink_key_created = 0;
+static pthread_mutex_t applog_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void applog_set_level(enum ApplogLevel level)
+{
+	applog_level = level;
+}
+
+enum ApplogLevel applog_get_level(void)
+{
+	return applog_level;
+}
+
+int applog_parse_level(const char *name, enum ApplogLevel *level)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(applog_level_names) / sizeof(applog_level_names[0]); i++) {
+		if (strcmp(name, applog_level_names[i]) == 0) {
+			*level = (enum ApplogLevel)i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void applog_set_repeat_limit(unsigned limit)
+{
+	applog_repeat_limit = limit;
+}
+
+static void applog_write(const char *data, size_t size)
+{
+	FILE *file = stderr;
+
+	if (size == 0) {
+		return;
+	}
+	pthread_mutex_lock(&applog_output_mutex);
+	fwrite(data, 1, size, file);
+	fflush(file);
+	pthread_mutex_unlock(&applog_output_mutex);
+}
+
+/* report messages dropped by the repeat limit, and start counting again */
+static void applog_sink_flush(struct ApplogSink *sink)
+{
+	unsigned i;
+
+	for (i = 0; i < APPLOG_REPEAT_SLOTS; i++) {
+		struct ApplogRepeat *repeat = &sink->repeats[i];
+		if (repeat->format && applog_repeat_limit
+			&& repeat->count > applog_repeat_limit)
+		{
+			char message[APPLOG_MESSAGE_SIZE];
+			int size = snprintf(message, sizeof(message),
+				"(%lu more similar messages from %s were suppressed)\n",
+				repeat->count - applog_repeat_limit,
+				repeat->function_name
+			);
+			if (size > 0 && (size_t)size < sizeof(message)) {
+				applog_write(message, size);
+			}
+		}
+		repeat->count = 0;
+	}
+}
+
+static void applog_sink_destroy(void *sink)
+{
+	applog_sink_flush(sink);
+	free(sink);
+}
+
+static void applog_init(void)
+{
+	applog_sink_key_created =
+		pthread_key_create(&applog_sink_key, applog_sink_destroy) == 0;
+}
+
+/* this thread's sink, or NULL if one can't be made */
+static struct ApplogSink *applog_sink(void)
+{
+	struct ApplogSink *sink;
+
+	pthread_once(&applog_once, applog_init);
+	if (!applog_sink_key_created) {
+		return NULL;
+	}
+	sink = pthread_getspecific(applog_sink_key);
+	if (!sink) {
+		sink = calloc(1, sizeof(*sink));
+		if (sink && pthread_setspecific(applog_sink_key, sink) != 0) {
+			free(sink);
+			sink = NULL;
+		}
+	}
+	return sink;
+}
+
+/* count a message, returning 0 if it has been repeated too many times */
+static int applog_sink_count(struct ApplogSink *sink,
+	const char *function_name, const char *format)
+{
+	unsigned i, slot = (unsigned)(((size_t)format >> 3) % APPLOG_REPEAT_SLOTS);
+
+	for (i = 0; i < APPLOG_REPEAT_SLOTS; i++) {
+		struct ApplogRepeat *repeat = &sink->repeats[slot];
+		if (repeat->format == NULL) {
+			repeat->format = format;
+			repeat->function_name = function_name;
+		}
+		if (repeat->format == format) {
+			return ++repeat->count <= applog_repeat_limit;
+		}
+		slot = (slot + 1) % APPLOG_REPEAT_SLOTS;
+	}
+
+	/* too many different messages to keep track of, don't limit them */
+	return 1;
+}
+
 void applog(enum ApplogLevel level, const char *function_name, const char *format, ...)
 {
 	va_list args;
-	FILE *file = stderr;
 	enum OutputFormat { NONE, STRING, TIME_FUNC_STRING } output_format = STRING;
+	char message[APPLOG_MESSAGE_SIZE];
+	int size = 0, written = 0;
+	struct ApplogSink *sink = NULL;
 
-	if (level < APPLOG_NOTICE) {
+	if (level < applog_level) {
 		/* users are not interested in debugging output. */
-		/* TODO: make this dynamically configurable at run-time via an option */
+		return;
+	}
+
+	/* only errors are limited, they being what a batch of bad input repeats,
+	   while warnings and notices (such as which inputs were fixed) are each
+	   about something the user needs to know */
+	sink = applog_sink();
+	if (sink && applog_repeat_limit && level == APPLOG_ERROR
+		&& !applog_sink_count(sink, function_name, format))
+	{
 		return;
 	}
 
@@ -45,14 +218,25 @@ void applog(enum ApplogLevel level, const char *function_name, const char *forma
 			time_now = time(NULL);
 			portable_localtime_r(&time_now, &tm_localtime);
 			strftime(time_string, sizeof(time_string)-1, "%Y-%m-%dT%H:%M:%S", &tm_localtime);
-			fprintf(file, "%s|%s|", time_string, function_name);
-			vfprintf(file, format, args);
-			fprintf(file, "\n");
-			break;
+			size = snprintf(message, sizeof(message), "%s|%s|",
+				time_string, function_name);
+			if (size < 0 || (size_t)size >= sizeof(message)) {
+				size = 0;
+			}
+			/* fall through to the message itself */
 		}
 		case STRING : {
-			vfprintf(file, format, args);
-			fprintf(file, "\n");
+			written = vsnprintf(message + size, sizeof(message) - size,
+				format, args);
+			if (written < 0) {
+				written = 0;
+			}
+			size += written;
+			/* leave room for the newline, truncating if necessary */
+			if ((size_t)size > sizeof(message) - 2) {
+				size = sizeof(message) - 2;
+			}
+			message[size++] = '\n';
 			break;
 		}
 		default :
@@ -60,4 +244,20 @@ void applog(enum ApplogLevel level, const char *function_name, const char *forma
 	}
 
 	va_end(args);
+
+	applog_write(message, size);
+}
+
+void applog_flush(void)
+{
+	struct ApplogSink *sink;
+
+	pthread_once(&applog_once, applog_init);
+	if (!applog_sink_key_created) {
+		return;
+	}
+	sink = pthread_getspecific(applog_sink_key);
+	if (sink) {
+		applog_sink_flush(sink);
+	}
 }
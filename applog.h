@@ -11,9 +11,29 @@ enum ApplogLevel {
 	APPLOG_BUG
 };
 
+/* by default, only show this many of each error message (per thread) between
+   calls to applog_flush() */
+#define APPLOG_DEFAULT_REPEAT_LIMIT 10
+
+void applog_set_level(enum ApplogLevel level);
+enum ApplogLevel applog_get_level(void);
+
+/* set level from its lower case name ("debug", "info", "notice", "warning",
+   "error", "fatal" or "bug"), returning 0 if the name is unknown */
+int applog_parse_level(const char *name, enum ApplogLevel *level);
+
+/* set how many times each error message is shown before the rest are
+   counted instead, 0 for no limit.  Other levels are never limited. */
+void applog_set_repeat_limit(unsigned limit);
+
 void applog(enum ApplogLevel level,
 	const char *function_name, const char *format,
 	...
 );
 
+/* write out counts of this thread's messages suppressed by the repeat limit,
+   and start counting again.  Other threads' counts are written when they
+   exit. */
+void applog_flush(void);
+
 #endif
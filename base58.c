@@ -5,10 +5,14 @@
 #include "utility.h"
 #include "applog.h"
 #include "combination.h"
+#include "progress.h"
+#include "confusion.h"
+#include "parallel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #if defined(OS_WINDOWS)
 #include <malloc.h>
@@ -245,27 +249,669 @@ BitcoinResult Bitcoin_DecodeBase58Check(
 	return BITCOIN_SUCCESS;
 }
 
+uint64_t Bitcoin_FixBase58CheckCandidates(size_t input_size,
+	const struct BitcoinFixBase58CheckOptions *options)
+{
+	/* sum of C(n, r) * 57^r : every choice of r positions to change, with
+	every combination of the other digits in them */
+	uint64_t total = 0;
+	unsigned r, i;
+
+	for (r = 1; r <= options->change_chars; r++) {
+		uint64_t count = Combination_count(input_size, r);
+		for (i = 0; i < r && count != UINT64_MAX; i++) {
+			count = count > UINT64_MAX / 57 ? UINT64_MAX : count * 57;
+		}
+		if (count == UINT64_MAX || total > UINT64_MAX - count) {
+			return UINT64_MAX;
+		}
+		total += count;
+	}
+
+	return total;
+}
+
+/* Candidates are tested most likely first.  Every single character change
+(position, digit) is given a cost by the confusion model, and the list of
+changes is sorted by cost.  A candidate is a set of changes, held as
+ascending indexes into that list.  Each candidate taken from the priority
+queue puts back at most two more: itself with the next change appended, and
+itself with its last change replaced by the next one.  This reaches every
+set of changes exactly once, in order of total cost.
+
+The queue grows by one for nearly every candidate taken from it, so it
+would outgrow memory on long searches.  When it is full the search carries
+on in bands of cost instead, from the last candidate taken from the queue
+(everything cheaper has been tried already).  Each band is a depth first
+search, which needs no memory, and candidates are only out of order within
+a band. */
+
+/* most candidates held in the queue */
+#define FIX_BASE58_QUEUE_CAPACITY (1 << 18)
+
+/* cost range of each band once the queue is full, a factor of e in
+likelihood */
+#define FIX_BASE58_BAND_WIDTH 1.0
+
+/* allow for rounding differences between summing costs in different orders */
+#define FIX_BASE58_COST_EPSILON 1e-9
+
+struct FixBase58Change {
+	double cost;
+	uint16_t position;
+	uint8_t digit;
+};
+
+struct FixBase58Candidate {
+	double cost;
+	unsigned count;
+	uint16_t change[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+};
+
+/* binary min-heap of candidates by cost */
+struct FixBase58Queue {
+	struct FixBase58Candidate *heap;
+	size_t size, capacity;
+};
+
+static int FixBase58Queue_push(struct FixBase58Queue *queue,
+	const struct FixBase58Candidate *candidate)
+{
+	size_t i, parent;
+
+	if (queue->size == queue->capacity) {
+		size_t capacity = queue->capacity ? queue->capacity * 2 : 1024;
+		struct FixBase58Candidate *heap;
+		if (capacity > FIX_BASE58_QUEUE_CAPACITY) {
+			return 0;
+		}
+		heap = realloc(queue->heap, capacity * sizeof(*heap));
+		if (!heap) {
+			return 0;
+		}
+		queue->heap = heap;
+		queue->capacity = capacity;
+	}
+
+	i = queue->size++;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (queue->heap[parent].cost <= candidate->cost) {
+			break;
+		}
+		queue->heap[i] = queue->heap[parent];
+		i = parent;
+	}
+	queue->heap[i] = *candidate;
+	return 1;
+}
+
+static int FixBase58Queue_pop(struct FixBase58Queue *queue,
+	struct FixBase58Candidate *candidate)
+{
+	struct FixBase58Candidate *last;
+	size_t i = 0, child;
+
+	if (queue->size == 0) {
+		return 0;
+	}
+	*candidate = queue->heap[0];
+	last = &queue->heap[--queue->size];
+	while ((child = 2 * i + 1) < queue->size) {
+		if (child + 1 < queue->size
+			&& queue->heap[child + 1].cost < queue->heap[child].cost)
+		{
+			child++;
+		}
+		if (last->cost <= queue->heap[child].cost) {
+			break;
+		}
+		queue->heap[i] = queue->heap[child];
+		i = child;
+	}
+	queue->heap[i] = *last;
+	return 1;
+}
+
+static int FixBase58Change_compare(const void *a, const void *b)
+{
+	const struct FixBase58Change *x = a, *y = b;
+
+	if (x->cost != y->cost) {
+		return x->cost < y->cost ? -1 : 1;
+	}
+	if (x->position != y->position) {
+		return x->position < y->position ? -1 : 1;
+	}
+	return (int)x->digit - (int)y->digit;
+}
+
+/* Candidates are decoded without BIGNUMs.  The input is held as a number,
+with the place value of each position, in 32 bit limbs (least significant
+first), so a candidate is the input plus the difference made by each of its
+changes.  Its decoded size, version byte and flag byte can then be checked
+against the shapes allowed, before any hashing. */
+struct FixBase58Search {
+	const char *input;
+	size_t input_size;
+	char *fixed_output;
+	uint8_t *output;
+	size_t output_buffer_size;
+	const struct BitcoinFixBase58CheckOptions *options;
+
+	/* digit value of each input character, -1 if it isn't base58, and the
+	number of those, which candidates must all change */
+	int *digit_values;
+	unsigned invalid_count;
+
+	/* the input as a number, with invalid characters as 0, and the place
+	value of each position */
+	size_t limbs;
+	uint32_t *value;
+	uint32_t *place;
+
+	/* scratch space for adding up a candidate */
+	int64_t *sum;
+	uint32_t *candidate;
+
+	/* candidates tested so far, and how many of those had the right shape,
+	so only their checksums were tested */
+	uint64_t tried, plausible;
+	struct BitcoinProgress progress;
+
+	/* set when any search sharing it has found a fix, so the rest can stop */
+	volatile int *stop;
+
+	/* the changes which made the checksum valid */
+	uint16_t positions[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+	unsigned position_count;
+};
+
+static void FixBase58Search_init(struct FixBase58Search *search,
+	const char *input, size_t input_size)
+{
+	size_t i, j;
+	uint64_t carry;
+
+	search->input = input;
+	search->input_size = input_size;
+
+	/* 58 < 2^6, so each character adds less than 6 bits */
+	search->limbs = (input_size * 6) / 32 + 1;
+	search->digit_values = malloc(input_size * sizeof(*search->digit_values));
+	search->value = calloc(search->limbs, sizeof(*search->value));
+	search->place = calloc(input_size * search->limbs, sizeof(*search->place));
+	search->sum = malloc(search->limbs * sizeof(*search->sum));
+	search->candidate = malloc(search->limbs * sizeof(*search->candidate));
+
+	for (i = 0; i < input_size; i++) {
+		const char *digit = input[i] ? strchr(base58_digits, input[i]) : NULL;
+		search->digit_values[i] = digit ? (int)(digit - base58_digits) : -1;
+		if (!digit) {
+			search->invalid_count++;
+		}
+	}
+
+	/* place values from the last character (58^0) back to the first */
+	for (i = input_size; i-- > 0; ) {
+		uint32_t *place = &search->place[i * search->limbs];
+		if (i == input_size - 1) {
+			place[0] = 1;
+		} else {
+			const uint32_t *previous = place + search->limbs;
+			for (j = 0, carry = 0; j < search->limbs; j++) {
+				carry += (uint64_t)previous[j] * 58;
+				place[j] = (uint32_t)carry;
+				carry >>= 32;
+			}
+		}
+		if (search->digit_values[i] > 0) {
+			for (j = 0, carry = 0; j < search->limbs; j++) {
+				carry += search->value[j]
+					+ (uint64_t)place[j] * search->digit_values[i];
+				search->value[j] = (uint32_t)carry;
+				carry >>= 32;
+			}
+		}
+	}
+}
+
+/* a copy of 'parent' with its own scratch space, to search part of the same
+space on another thread */
+static void FixBase58Search_fork(struct FixBase58Search *child,
+	const struct FixBase58Search *parent)
+{
+	*child = *parent;
+	child->sum = malloc(parent->limbs * sizeof(*child->sum));
+	child->candidate = malloc(parent->limbs * sizeof(*child->candidate));
+	child->fixed_output = malloc(parent->input_size);
+	child->output = malloc(parent->output_buffer_size);
+	child->tried = child->plausible = 0;
+	child->position_count = 0;
+	/* only the parent reports progress */
+	child->progress.interval = 0;
+}
+
+/* add the counts of a forked search into its parent, and take its fix if it
+found one and the parent hasn't already, returning 1 if it did */
+static int FixBase58Search_join(struct FixBase58Search *parent,
+	struct FixBase58Search *child, int found)
+{
+	parent->tried += child->tried;
+	parent->plausible += child->plausible;
+	if (found && !parent->position_count) {
+		memcpy(parent->fixed_output, child->fixed_output, parent->input_size);
+		memcpy(parent->positions, child->positions,
+			child->position_count * sizeof(*child->positions));
+		parent->position_count = child->position_count;
+	}
+	free(child->output);
+	free(child->fixed_output);
+	free(child->candidate);
+	free(child->sum);
+	return found;
+}
+
+static void FixBase58Search_destroy(struct FixBase58Search *search)
+{
+	free(search->candidate);
+	free(search->sum);
+	free(search->place);
+	free(search->value);
+	free(search->digit_values);
+}
+
+/* is the decoded candidate in 'output' one of the shapes allowed? */
+static int FixBase58Search_shapeAllowed(const struct FixBase58Search *search,
+	size_t size)
+{
+	const struct BitcoinFixBase58CheckOptions *options = search->options;
+	unsigned i;
+
+	if (options->versions && !options->versions[search->output[0]]) {
+		return 0;
+	}
+	if (options->shape_count == 0) {
+		return 1;
+	}
+	for (i = 0; i < options->shape_count; i++) {
+		const struct BitcoinBase58CheckShape *shape = &options->shapes[i];
+		if (shape->size == size
+			&& (!shape->flag_offset
+				|| search->output[shape->flag_offset] == shape->flag))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* test the input with the digits at 'positions' changed, returning 1 if
+the checksum is now valid */
+static int FixBase58Search_try(struct FixBase58Search *search,
+	const uint16_t *positions, const uint8_t *digits, unsigned count)
+{
+	const size_t limbs = search->limbs;
+	struct BitcoinSHA256 hash;
+	size_t i, j, ones, bytes, size;
+	int64_t carry;
+
+	if (*search->stop) {
+		return 0;
+	}
+	search->tried++;
+
+	/* keep reading the clock off the hot path */
+	if ((search->tried & 0xfff) == 0) {
+		Progress_update(&search->progress, search->tried, search->tried);
+	}
+
+	/* every invalid character must be changed */
+	if (search->invalid_count) {
+		unsigned changed = 0;
+		for (i = 0; i < count; i++) {
+			changed += search->digit_values[positions[i]] < 0;
+		}
+		if (changed < search->invalid_count) {
+			return 0;
+		}
+	}
+
+	memcpy(search->fixed_output, search->input, search->input_size);
+	for (i = 0; i < limbs; i++) {
+		search->sum[i] = search->value[i];
+	}
+	for (i = 0; i < count; i++) {
+		const int old_value = search->digit_values[positions[i]];
+		const int64_t delta = (int64_t)digits[i] - (old_value < 0 ? 0 : old_value);
+		const uint32_t *place = &search->place[positions[i] * limbs];
+		for (j = 0; j < limbs; j++) {
+			search->sum[j] += delta * place[j];
+		}
+		search->fixed_output[positions[i]] = base58_digits[digits[i]];
+	}
+
+	/* the total is never negative, but limbs on the way can be */
+	for (i = 0, carry = 0; i < limbs; i++) {
+		const int64_t limb = search->sum[i] + carry;
+		search->candidate[i] = (uint32_t)(limb & 0xffffffff);
+		carry = (limb - (int64_t)search->candidate[i]) / ((int64_t)1 << 32);
+	}
+
+	/* leading '1's are zero bytes, then the bytes of the number */
+	for (ones = 0; ones < search->input_size
+		&& search->fixed_output[ones] == '1'; ones++)
+	{
+	}
+	for (bytes = limbs * 4; bytes > 0; bytes--) {
+		if ((search->candidate[(bytes - 1) / 4] >> ((bytes - 1) % 4 * 8)) & 0xff) {
+			break;
+		}
+	}
+	size = ones + bytes;
+	if (size <= BITCOIN_BASE58CHECK_CHECKSUM_SIZE
+		|| size > search->output_buffer_size)
+	{
+		return 0;
+	}
+
+	memset(search->output, 0, ones);
+	for (i = 0; i < bytes; i++) {
+		search->output[size - 1 - i] =
+			(uint8_t)(search->candidate[i / 4] >> (i % 4 * 8));
+	}
+
+	if (!FixBase58Search_shapeAllowed(search, size)) {
+		return 0;
+	}
+	search->plausible++;
+
+	Bitcoin_DoubleSHA256(&hash, search->output,
+		size - BITCOIN_BASE58CHECK_CHECKSUM_SIZE
+	);
+	if (memcmp(hash.data,
+		search->output + size - BITCOIN_BASE58CHECK_CHECKSUM_SIZE,
+		BITCOIN_BASE58CHECK_CHECKSUM_SIZE))
+	{
+		return 0;
+	}
+
+	memcpy(search->positions, positions, count * sizeof(*positions));
+	search->position_count = count;
+	*search->stop = 1;
+	return 1;
+}
+
+/* best-first search, returning 1 if found, 0 if every candidate was tried,
+or -1 if the queue filled up, with the cost of the last candidate tried in
+'*threshold' */
+static int FixBase58Search_bestFirst(struct FixBase58Search *search,
+	const struct FixBase58Change *changes, size_t change_total,
+	unsigned change_chars, double *threshold)
+{
+	struct FixBase58Queue queue = { NULL, 0, 0 };
+	struct FixBase58Candidate candidate, next;
+	int found = 0, full = 0;
+
+	memset(&candidate, 0, sizeof(candidate));
+	candidate.cost = changes[0].cost;
+	candidate.count = 1;
+	FixBase58Queue_push(&queue, &candidate);
+
+	while (!found && !full && FixBase58Queue_pop(&queue, &candidate)) {
+		const unsigned last = candidate.change[candidate.count - 1];
+		uint16_t positions[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+		uint8_t digits[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+		unsigned i, j;
+		int distinct = 1;
+
+		/* sets changing one position twice are only kept for their
+		successors */
+		for (i = 0; i < candidate.count && distinct; i++) {
+			const struct FixBase58Change *change = &changes[candidate.change[i]];
+			for (j = 0; j < i; j++) {
+				if (positions[j] == change->position) {
+					distinct = 0;
+					break;
+				}
+			}
+			positions[i] = change->position;
+			digits[i] = change->digit;
+		}
+		if (distinct) {
+			found = FixBase58Search_try(search, positions, digits,
+				candidate.count
+			);
+		}
+
+		*threshold = candidate.cost;
+		if (found || last + 1 >= change_total) {
+			continue;
+		}
+		if (candidate.count < change_chars) {
+			next = candidate;
+			next.change[next.count++] = last + 1;
+			next.cost += changes[last + 1].cost;
+			full = !FixBase58Queue_push(&queue, &next);
+		}
+		if (!full) {
+			next = candidate;
+			next.change[next.count - 1] = last + 1;
+			next.cost += changes[last + 1].cost - changes[last].cost;
+			full = !FixBase58Queue_push(&queue, &next);
+		}
+	}
+
+	free(queue.heap);
+	return found ? 1 : full ? -1 : 0;
+}
+
+/* One band of the search, trying every set of changes costing from 'lower'
+up to 'upper', by depth first search over positions in order and the
+alternatives at each position from cheapest up, so branches can be cut off
+as soon as they cost too much. */
+struct FixBase58Band {
+	struct FixBase58Search *search;
+
+	/* 58 alternatives for each position, cheapest first, of which 'count'
+	are changes from the input */
+	const struct FixBase58Change *alternatives;
+	const unsigned *count;
+
+	/* cheapest change at each position or any after it */
+	const double *suffix_min;
+
+	unsigned change_chars;
+	double lower, upper;
+
+	uint16_t positions[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+	uint8_t digits[BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS];
+};
+
+/* search sets whose next change is at a position from 'start' up to (but
+not including) 'end' */
+static int FixBase58Band_search(struct FixBase58Band *band, size_t start,
+	size_t end, unsigned depth, double cost)
+{
+	static const unsigned radix = 58;
+	size_t p;
+	unsigned k;
+
+	for (p = start; p < end && !*band->search->stop; p++) {
+		if (cost + band->suffix_min[p] >= band->upper) {
+			break;
+		}
+		for (k = 0; k < band->count[p]; k++) {
+			const struct FixBase58Change *alternative =
+				&band->alternatives[p * radix + k];
+			const double next_cost = cost + alternative->cost;
+			if (next_cost >= band->upper) {
+				break;
+			}
+			band->positions[depth] = p;
+			band->digits[depth] = alternative->digit;
+			if (next_cost >= band->lower - FIX_BASE58_COST_EPSILON
+				&& FixBase58Search_try(band->search, band->positions,
+					band->digits, depth + 1))
+			{
+				return 1;
+			}
+			if (depth + 1 < band->change_chars
+				&& FixBase58Band_search(band, p + 1, band->search->input_size,
+					depth + 1, next_cost))
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* a band split by first position changed, so idle workers can share it */
+struct FixBase58BandTask {
+	struct FixBase58Band band;
+	struct FixBase58Search search;
+	size_t position;
+	int found;
+};
+
+static void FixBase58BandTask_run(void *arg, unsigned thread_index)
+{
+	struct FixBase58BandTask *task = (struct FixBase58BandTask *)arg;
+
+	task->found = FixBase58Band_search(&task->band,
+		task->position, task->position + 1, 0, 0);
+}
+
+static int FixBase58Search_parallelBand(struct FixBase58Search *search,
+	const struct FixBase58Band *band)
+{
+	const size_t n = search->input_size;
+	struct FixBase58BandTask *tasks = malloc(n * sizeof(*tasks));
+	struct ParallelGroup group;
+	size_t p, task_count = 0;
+	int found = 0;
+
+	if (!tasks) {
+		struct FixBase58Band serial = *band;
+		return FixBase58Band_search(&serial, 0, n, 0, 0);
+	}
+
+	group.pending = 0;
+	for (p = 0; p < n && band->suffix_min[p] < band->upper; p++) {
+		struct FixBase58BandTask *task = &tasks[task_count++];
+		FixBase58Search_fork(&task->search, search);
+		task->band = *band;
+		task->band.search = &task->search;
+		task->position = p;
+		task->found = 0;
+		ParallelPool_submit(search->options->pool, &group,
+			FixBase58BandTask_run, task
+		);
+	}
+	ParallelPool_wait(search->options->pool, &group);
+
+	for (p = 0; p < task_count; p++) {
+		found |= FixBase58Search_join(search, &tasks[p].search, tasks[p].found);
+	}
+
+	free(tasks);
+	return found;
+}
+
+/* try every set of up to 'change_chars' changes costing at least
+'threshold', a band at a time, returning 1 if found */
+static int FixBase58Search_banded(struct FixBase58Search *search,
+	const struct FixBase58Change *changes, size_t change_total,
+	unsigned change_chars, double threshold)
+{
+	static const unsigned radix = 58;
+	const size_t n = search->input_size;
+	struct FixBase58Change *alternatives = malloc(n * radix * sizeof(*alternatives));
+	unsigned *count = calloc(n, sizeof(*count));
+	double *suffix_min = malloc(n * sizeof(*suffix_min));
+	double *max_cost = malloc(n * sizeof(*max_cost));
+	double most = 0;
+	struct FixBase58Band band;
+	size_t i;
+	unsigned r;
+	int found = 0;
+
+	/* split the sorted changes by position, keeping them sorted */
+	for (i = 0; i < change_total; i++) {
+		const uint16_t p = changes[i].position;
+		alternatives[p * radix + count[p]++] = changes[i];
+	}
+	for (i = n; i-- > 0; ) {
+		const double cheapest = count[i] ? alternatives[i * radix].cost : HUGE_VAL;
+		suffix_min[i] = i + 1 < n && suffix_min[i + 1] < cheapest ?
+			suffix_min[i + 1] : cheapest;
+		max_cost[i] = count[i] ? alternatives[i * radix + count[i] - 1].cost : 0;
+	}
+
+	/* nothing costs more than the 'change_chars' dearest positions */
+	for (r = 0; r < change_chars && r < n; r++) {
+		size_t dearest = 0;
+		for (i = 1; i < n; i++) {
+			if (max_cost[i] > max_cost[dearest]) {
+				dearest = i;
+			}
+		}
+		most += max_cost[dearest];
+		max_cost[dearest] = 0;
+	}
+
+	memset(&band, 0, sizeof(band));
+	band.search = search;
+	band.alternatives = alternatives;
+	band.count = count;
+	band.suffix_min = suffix_min;
+	band.change_chars = change_chars;
+	band.upper = threshold;
+
+	while (!found && band.upper <= most) {
+		band.lower = band.upper;
+		band.upper = band.lower + FIX_BASE58_BAND_WIDTH;
+		if (search->options->pool) {
+			found = FixBase58Search_parallelBand(search, &band);
+			Progress_update(&search->progress, search->tried, search->tried);
+		} else {
+			found = FixBase58Band_search(&band, 0, n, 0, 0);
+		}
+	}
+
+	free(max_cost);
+	free(suffix_min);
+	free(count);
+	free(alternatives);
+	return found;
+}
+
 BitcoinResult Bitcoin_FixBase58Check(
 	char *fixed_output, size_t fixed_output_buffer_size, size_t *fixed_output_size,
 	uint8_t *output, size_t output_buffer_size, size_t *decoded_output_size,
 	const char *input, size_t input_size,
-	unsigned change_chars,
-	unsigned remove_chars,
-	unsigned insert_chars
+	const struct BitcoinFixBase58CheckOptions *options
 )
 {
 	/* attempt to 'fix' an invalid base58check string by changing characters
-	until the checksum is valid */
+	until the checksum is valid, most likely changes first */
 
-	uint64_t change_count = 0;
-	size_t required_fixed_output_size = fixed_output_buffer_size + insert_chars;
-	BitcoinResult result;
 	static const unsigned radix = 58;
-	unsigned i, j, overflow;
+	const unsigned change_chars = options->change_chars;
+	size_t required_fixed_output_size = fixed_output_buffer_size + options->insert_chars;
+	struct BitcoinConfusion *builtin_confusion = NULL;
+	const struct BitcoinConfusion *confusion = options->confusion;
+	struct FixBase58Change *changes = NULL;
+	size_t change_total = 0;
+	double threshold = 0;
+	struct FixBase58Search search;
+	volatile int stop = 0;
 	char *format_output = NULL;
-	struct Combination c;
-	unsigned n, r, done = 0;
-	char *digits;
+	uint64_t total;
+	unsigned i, d;
+	int found = 0;
 
 	applog(APPLOG_NOTICE, __func__,
 		"Attempting to fix Base58Check input by changing %s%d character%s ...",
@@ -284,90 +930,147 @@ BitcoinResult Bitcoin_FixBase58Check(
 		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
 	}
 
+	if (change_chars > BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS) {
+		applog(APPLOG_ERROR, __func__,
+			"Can't change more than %u characters",
+			(unsigned)BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS
+		);
+		return BITCOIN_ERROR;
+	}
+
+	/* changes are indexed with 16 bits */
+	if (input_size == 0 || input_size > UINT16_MAX / radix) {
+		applog(APPLOG_ERROR, __func__,
+			"Input is too %s to fix (%u characters)",
+			input_size ? "long" : "short",
+			(unsigned)input_size
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	if (!confusion) {
+		builtin_confusion = malloc(sizeof(*builtin_confusion));
+		Confusion_init(builtin_confusion);
+		confusion = builtin_confusion;
+	}
+
+	/* every change from the input, sorted by cost */
+	changes = malloc(input_size * radix * sizeof(*changes));
+	for (i = 0; i < input_size; i++) {
+		for (d = 0; d < radix; d++) {
+			if (base58_digits[d] != input[i]) {
+				changes[change_total].cost = Confusion_cost(confusion,
+					base58_digits, input[i], base58_digits[d]
+				);
+				changes[change_total].position = i;
+				changes[change_total].digit = d;
+				change_total++;
+			}
+		}
+	}
+	qsort(changes, change_total, sizeof(*changes), FixBase58Change_compare);
+	free(builtin_confusion);
+
 	format_output = malloc(required_fixed_output_size + 1);
 	*fixed_output_size = input_size;
 
-	for (r = 1; r <= change_chars && !done; r++) {
+	memset(&search, 0, sizeof(search));
+	FixBase58Search_init(&search, input, input_size);
+	search.stop = &stop;
+	search.fixed_output = fixed_output;
+	search.output = output;
+	search.output_buffer_size = output_buffer_size;
+	search.options = options;
+
+	Progress_init(&search.progress, stderr, "candidates",
+		options->progress_interval
+	);
+	total = Bitcoin_FixBase58CheckCandidates(input_size, options);
+	/* too many to count is as good as unknown */
+	search.progress.total = total == UINT64_MAX ? 0 : total;
+	if (search.progress.total) {
 		applog(APPLOG_NOTICE, __func__,
-			"Changing %d character%s ...",
-			r,
-			r == 1 ? "" : "s"
+			"Search space is %llu candidates",
+			(unsigned long long)total
 		);
-		n = input_size;
-		Combination_create(&c, n, r);
-		digits = malloc(r);
-		do {
-			memcpy(fixed_output, input, input_size);
-			memset(digits, 0, r);
-			overflow = 0;
-
-			while (!overflow && !done) {
-				int carry = 0;
-
-				/* convert digits to base58 and update 'fixed' output */
-				for (i=0; i < r; i++) {
-					fixed_output[c.k[i]] = base58_digits[(int)digits[i]];
-					change_count++;
-				}
+	}
 
-				result = Bitcoin_DecodeBase58Check(output, output_buffer_size,
-					decoded_output_size, fixed_output, input_size
-				);
+	if (change_chars > 0) {
+		found = FixBase58Search_bestFirst(&search, changes, change_total,
+			change_chars, &threshold
+		);
+		if (found < 0) {
+			applog(APPLOG_NOTICE, __func__,
+				"Search queue is full after %llu candidates, trying the"
+				" remaining combinations in bands of likelihood ...",
+				(unsigned long long)search.tried
+			);
+			found = FixBase58Search_banded(&search, changes, change_total,
+				change_chars, threshold
+			);
+		}
+	}
 
-				if (result == BITCOIN_SUCCESS) {
-					memcpy(format_output, input, input_size);
-					format_output[input_size] = '\0';
-					applog(APPLOG_WARNING, __func__,
-						"from: %s", format_output
-					);
-
-					memcpy(format_output, fixed_output, *fixed_output_size);
-					format_output[*fixed_output_size] = '\0';
-					applog(APPLOG_WARNING, __func__,
-						"  to: %s", format_output
-					);
-
-					memset(format_output, ' ', *fixed_output_size);
-					format_output[*fixed_output_size] = '\0';
-					for (j=0; j < r; j++) {
-						format_output[c.k[j]] = '^';
-					}
-					applog(APPLOG_WARNING, __func__,
-						"      %s", format_output
-					);
-					done = 1;
-				}
+	if (found) {
+		/* decode the fix the usual way, for the caller */
+		if (Bitcoin_DecodeBase58Check(output, output_buffer_size,
+			decoded_output_size, fixed_output, input_size) != BITCOIN_SUCCESS)
+		{
+			applog(APPLOG_BUG, __func__,
+				"Fixed input failed to decode: %.*s",
+				(int)input_size, fixed_output
+			);
+			found = 0;
+		}
+	}
 
-				/* calculate next set of 'r' digits */
-				digits[0]++;
-				for (i=0; i < r; i++) {
-					if (carry) {
-						digits[i] += carry;
-						carry = 0;
-					}
-					if (digits[i] == radix) {
-						digits[i] = 0;
-						carry = 1;
-						overflow = i == r-1;
-					} else {
-						carry = 0;
-					}
-				}
-			}
-		} while (!done && Combination_next(&c));
-		Combination_destroy(&c);
-		free(digits);
+	if (found) {
+		memcpy(format_output, input, input_size);
+		format_output[input_size] = '\0';
+		applog(APPLOG_WARNING, __func__,
+			"from: %s", format_output
+		);
+
+		memcpy(format_output, fixed_output, *fixed_output_size);
+		format_output[*fixed_output_size] = '\0';
+		applog(APPLOG_WARNING, __func__,
+			"  to: %s", format_output
+		);
+
+		memset(format_output, ' ', *fixed_output_size);
+		format_output[*fixed_output_size] = '\0';
+		for (i = 0; i < search.position_count; i++) {
+			format_output[search.positions[i]] = '^';
+		}
+		applog(APPLOG_WARNING, __func__,
+			"      %s", format_output
+		);
 	}
 
 	free(format_output);
+	free(changes);
+	FixBase58Search_destroy(&search);
+
+	if (options->progress_interval) {
+		Progress_update(&search.progress, search.tried, search.tried);
+		Progress_report(&search.progress);
+	}
+
+	/* only candidates of the right shape had their checksums tested, each
+	with a 1 in 2^32 chance of matching by accident */
+	applog(APPLOG_NOTICE, __func__,
+		"%llu of %llu candidates decoded to the expected version and size.",
+		(long long unsigned)search.plausible,
+		(long long unsigned)search.tried
+	);
 
-	if (!done) {
+	if (!found) {
 		applog(APPLOG_WARNING, __func__,
 			"Failed to find any combination of changing the Base58Check input"
 			" that results in a valid checksum. %llu combinations were tried."
 			" (%f%% chance of error).",
-			(long long unsigned)change_count,
-			((double)change_count / ((unsigned long long)1 << 32)) * 100
+			(long long unsigned)search.tried,
+			((double)search.plausible / ((unsigned long long)1 << 32)) * 100
 		);
 		return BITCOIN_ERROR_CHECKSUM_FAILURE;
 	}
@@ -375,8 +1078,8 @@ BitcoinResult Bitcoin_FixBase58Check(
 	applog(APPLOG_WARNING, __func__,
 		"Base58Check input has been corrected after %llu combinations "
 		" (%f%% chance of error).",
-		(long long unsigned)change_count,
-		((double)change_count / ((unsigned long long)1 << 32)) * 100
+		(long long unsigned)search.tried,
+		((double)search.plausible / ((unsigned long long)1 << 32)) * 100
 	);
 
 	return BITCOIN_SUCCESS;
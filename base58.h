@@ -112,10 +112,74 @@ BitcoinResult Bitcoin_DecodeBase58Check(
 	const void *input, size_t input_size
 );
 
+/** Most characters Bitcoin_FixBase58Check() can change */
+#define BITCOIN_FIX_BASE58CHECK_MAX_CHANGE_CHARS 16
+
+struct BitcoinConfusion;
+struct ParallelPool;
+
+/** A layout a fixed Base58Check string is allowed to decode to. */
+struct BitcoinBase58CheckShape {
+	/* Decoded size in bytes, including the checksum. */
+	size_t size;
+
+	/* Offset of a byte with a fixed value, such as the compression flag of
+	   WIF private keys, or 0 for none (offset 0 is the version byte). */
+	size_t flag_offset;
+	uint8_t flag;
+};
+
+/** Options for Bitcoin_FixBase58Check(). */
+struct BitcoinFixBase58CheckOptions {
+	/* Maximum number of characters to change.  Every possible combination
+	   of characters up to this amount will be tested, most likely first,
+	   this can take a long time for large numbers. */
+	unsigned change_chars;
+
+	/* Maximum number of characters to insert.  Every possible combination
+	   of inserted characters up to this amount will be tested. */
+	unsigned insert_chars;
+
+	/* Maximum number of characters to remove.  Every possible combination
+	   of removed characters up to this amount will be tested. */
+	unsigned remove_chars;
+
+	/* Seconds between progress reports on stderr, 0 for none. */
+	unsigned progress_interval;
+
+	/* Which mistakes are most likely, NULL for the built-in model. */
+	const struct BitcoinConfusion *confusion;
+
+	/* If 'shape_count' is not 0, candidates must decode to one of these
+	   shapes, or they are rejected without computing the checksum. */
+	const struct BitcoinBase58CheckShape *shapes;
+	unsigned shape_count;
+
+	/* Flags for each allowed version (first) byte, 256 of them, or NULL to
+	   allow any version. */
+	const uint8_t *versions;
+
+	/* Pool to share long searches with, or NULL to search on the calling
+	   thread only. */
+	struct ParallelPool *pool;
+};
+
+/** @brief Number of candidate strings Bitcoin_FixBase58Check() tests, at
+ *         most, for an input of 'input_size' characters.
+ *
+ *  @return Number of candidates, or UINT64_MAX if too many to count.
+ */
+uint64_t Bitcoin_FixBase58CheckCandidates(size_t input_size,
+	const struct BitcoinFixBase58CheckOptions *options
+);
+
 /** @brief Convert a Base58Check string to its binary representation, changing
  *         characters necessary to make the checksum valid.
  *         This is a very much NOT recommended, and last-ditch, effort of
  *         fixing bad input (typos, damaged printout, etc).
+ *         Candidates are tried in order of likelihood according to the
+ *         confusion model (see confusion.h), so the first match found is
+ *         the most plausible one.
  *         The output buffer will be modified even if no recovery was possible.
  *
  *  @param[out] fixed_output Pointer to write fixed Base58Check output into.
@@ -133,16 +197,7 @@ BitcoinResult Bitcoin_DecodeBase58Check(
  *              maximum specified in output_buffer_size.
  *  @param[in] input Pointer to Base58Check string to read.
  *  @param[in] input_size Number of characters to read from 'source'.
- *  @param[in] change_chars Maximum number of characters to change.  Every
- *                          possible combination of characters up to this
- *                          amount will be tested, this can take a long time
- *                          for large numbers.
- *  @param[in] insert_chars Maximum number of characters to insert.  Every
- *                          possible combination of inserted characters up to
- *                          this amount will be tested.
- *  @param[in] remove_chars Maximum number of characters to remove.  Every
- *                          possible combination of inserted characters up to
- *                          this amount will be tested.
+ *  @param[in] options Which changes to try, and how to report progress.
  *
  *  @return BitcoinResult indicating error state :
  *          BITCOIN_SUCCESS if success.
@@ -153,9 +208,7 @@ BitcoinResult Bitcoin_FixBase58Check(
 	char *fixed_output, size_t fixed_output_buffer_size, size_t *fixed_output_size,
 	uint8_t *output, size_t output_buffer_size, size_t *decoded_output_size,
 	const char *input, size_t input_size,
-	unsigned change_chars,
-	unsigned insert_chars,
-	unsigned remove_chars
+	const struct BitcoinFixBase58CheckOptions *options
 );
 
 #endif
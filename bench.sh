@@ -0,0 +1,227 @@
+#!/usr/bin/env bash
+
+# End-to-end throughput benchmark of the --batch conversions.
+#
+# Synthetic datasets are generated from a fixed seed, so every run (and every
+# build) converts exactly the same records.  Results are written to
+# BENCH_OUTPUT as tab-separated values, and compared with BENCH_BASELINE if it
+# exists.  Any conversion which is more than BENCH_THRESHOLD percent slower
+# than the baseline fails the run.
+#
+# Environment variables :
+#   BENCH_RECORDS    : records per dataset (default 200000)
+#   BENCH_EC_RECORDS : records for conversions needing EC multiplication,
+#                      which are much slower (default 5000)
+#   BENCH_SEED       : seed for the dataset generator (default bitcoin-tool)
+#   BENCH_DATA       : directory to keep generated datasets in
+#   BENCH_OUTPUT     : results file (default bench_output.txt)
+#   BENCH_BASELINE   : baseline results file (default bench_baseline.txt)
+#   BENCH_THRESHOLD  : allowed slowdown in percent (default 10)
+
+BITCOIN_TOOL="./bitcoin-tool"
+
+BENCH_RECORDS="${BENCH_RECORDS:-200000}"
+BENCH_EC_RECORDS="${BENCH_EC_RECORDS:-5000}"
+BENCH_SEED="${BENCH_SEED:-bitcoin-tool}"
+BENCH_DATA="${BENCH_DATA:-bench-data}"
+BENCH_OUTPUT="${BENCH_OUTPUT:-bench_output.txt}"
+BENCH_BASELINE="${BENCH_BASELINE:-bench_baseline.txt}"
+BENCH_THRESHOLD="${BENCH_THRESHOLD:-10}"
+
+DATA="${BENCH_DATA}/${BENCH_SEED}-${BENCH_RECORDS}"
+
+# -----------------------------------------------------------------------------
+# Dataset generation
+# -----------------------------------------------------------------------------
+
+# Deterministic pseudo-random bytes: AES-256-CTR keystream keyed from the seed.
+# $1 = seed suffix, $2 = number of bytes
+random_bytes () {
+	openssl enc -aes-256-ctr -pbkdf2 -nosalt -pass "pass:${BENCH_SEED}-$1" \
+		< /dev/zero 2>/dev/null | head -c "$2"
+}
+
+# $1 = dataset file, remaining arguments are the bitcoin-tool conversion
+convert_dataset () {
+	local input="$1"
+	shift
+	$BITCOIN_TOOL --batch --input-file "${input}" "$@"
+}
+
+generate () {
+	mkdir -p "${DATA}" || exit 1
+	if [ -f "${DATA}/complete" ] ; then
+		return 0
+	fi
+	echo "generating ${BENCH_RECORDS} records per dataset in ${DATA} ..."
+
+	random_bytes private-key $((32 * BENCH_RECORDS)) | xxd -p -c32 \
+		> "${DATA}/private-key.hex" || exit 1
+	random_bytes hash160 $((20 * BENCH_RECORDS)) | xxd -p -c20 \
+		> "${DATA}/hash160.hex" || exit 1
+
+	convert_dataset "${DATA}/private-key.hex" \
+		--input-type private-key --input-format hex \
+		--network bitcoin --public-key-compression compressed \
+		--output-type private-key-wif --output-format base58check \
+		> "${DATA}/private-key-wif.txt" || exit 1
+
+	convert_dataset "${DATA}/hash160.hex" \
+		--input-type public-key-rmd --input-format hex \
+		--network bitcoin \
+		--output-type address --output-format base58check \
+		> "${DATA}/address.txt" || exit 1
+
+	convert_dataset "${DATA}/hash160.hex" \
+		--input-type public-key-rmd --input-format hex \
+		--network bitcoin \
+		--output-type address --output-format bech32 \
+		> "${DATA}/address-bech32.txt" || exit 1
+
+	touch "${DATA}/complete"
+}
+
+# -----------------------------------------------------------------------------
+# Measurement
+# -----------------------------------------------------------------------------
+
+# Print "<wall seconds> <user seconds> <system seconds> <peak RSS KiB>
+# <exit status>" for running the arguments as a command, with its standard
+# output written to ${DATA}/output.
+measure () {
+	if [ -x /usr/bin/time ] ; then
+		local out
+		out=$( { /usr/bin/time -f "%e %U %S %M %x" "$@" \
+			> "${DATA}/output" 2>/dev/null ; } 2>&1 )
+		echo "${out##*$'\n'}"
+		return
+	fi
+
+	# No GNU time: use the bash clock for wall time, the children times
+	# reported by 'times' for CPU, and sample the kernel's high-water mark
+	# of resident memory while the process runs.
+	local start end pid peak=0 hwm before after status
+	# 'times' has to run in this shell, not a subshell, to see the children
+	times > "${DATA}/times" ; before=$(tail -n 1 "${DATA}/times")
+	start=$(date +%s.%N)
+	"$@" > "${DATA}/output" 2>/dev/null &
+	pid=$!
+	while kill -0 "${pid}" 2>/dev/null ; do
+		hwm=$(awk '/^VmHWM:/ { print $2 }' "/proc/${pid}/status" 2>/dev/null)
+		if [ -n "${hwm}" ] && [ "${hwm}" -gt "${peak}" ] ; then
+			peak="${hwm}"
+		fi
+		sleep 0.01
+	done
+	wait "${pid}"
+	status=$?
+	end=$(date +%s.%N)
+	times > "${DATA}/times" ; after=$(tail -n 1 "${DATA}/times")
+	awk -v start="${start}" -v end="${end}" -v peak="${peak}" \
+		-v before="${before}" -v after="${after}" -v status="${status}" '
+		function seconds(t,   m) {
+			m = t; sub(/m.*/, "", m); sub(/^[0-9]+m/, "", t); sub(/s$/, "", t)
+			return m * 60 + t
+		}
+		BEGIN {
+			split(before, b, " "); split(after, a, " ")
+			printf "%.3f %.3f %.3f %d %d\n", end - start,
+				seconds(a[1]) - seconds(b[1]), seconds(a[2]) - seconds(b[2]), peak,
+				status
+		}'
+}
+
+# Stop with an error, leaving no results which could be kept as a baseline.
+# $1 = message
+fail () {
+	echo "$1" >&2
+	rm -f "${BENCH_OUTPUT}"
+	exit 1
+}
+
+# $1 = benchmark name, $2 = records, remaining arguments are the conversion,
+# which must succeed and write one line per record
+bench () {
+	local name="$1" records="$2" wall user sys rss status lines
+	shift 2
+	read -r wall user sys rss status < <(measure "$@")
+	if [ "${status}" != "0" ] ; then
+		fail "${name}: conversion failed with exit status ${status:-unknown}"
+	fi
+	lines=$(wc -l < "${DATA}/output")
+	if [ "${lines}" -ne "${records}" ] ; then
+		fail "${name}: conversion wrote ${lines} of ${records} records"
+	fi
+	awk -v name="${name}" -v records="${records}" -v wall="${wall}" \
+		-v user="${user}" -v sys="${sys}" -v rss="${rss}" '
+		BEGIN {
+			printf "%s\t%d\t%.3f\t%.0f\t%.3f\t%.3f\t%d\n", name, records, wall,
+				(wall > 0 ? records / wall : 0), user, sys, rss
+		}' >> "${BENCH_OUTPUT}"
+	tail -n 1 "${BENCH_OUTPUT}"
+}
+
+generate
+
+head -n "${BENCH_EC_RECORDS}" "${DATA}/private-key.hex" > "${DATA}/private-key-ec.hex"
+head -n "${BENCH_EC_RECORDS}" "${DATA}/private-key-wif.txt" > "${DATA}/private-key-wif-ec.txt"
+
+printf "name\trecords\tseconds\trecords_per_sec\tuser_seconds\tsystem_seconds\tpeak_rss_kb\n" \
+	> "${BENCH_OUTPUT}"
+head -n 1 "${BENCH_OUTPUT}"
+
+bench private-key-to-wif "${BENCH_RECORDS}" \
+	$BITCOIN_TOOL --batch --input-file "${DATA}/private-key.hex" \
+	--input-type private-key --input-format hex \
+	--network bitcoin --public-key-compression compressed \
+	--output-type private-key-wif --output-format base58check
+
+bench private-key-to-address "${BENCH_EC_RECORDS}" \
+	$BITCOIN_TOOL --batch --input-file "${DATA}/private-key-ec.hex" \
+	--input-type private-key --input-format hex \
+	--network bitcoin --public-key-compression compressed \
+	--output-type address --output-format base58check
+
+bench wif-to-address "${BENCH_EC_RECORDS}" \
+	$BITCOIN_TOOL --batch --input-file "${DATA}/private-key-wif-ec.txt" \
+	--input-type private-key-wif --input-format base58check \
+	--output-type address --output-format base58check
+
+bench address-to-hash160 "${BENCH_RECORDS}" \
+	$BITCOIN_TOOL --batch --input-file "${DATA}/address.txt" \
+	--input-type address --input-format base58check \
+	--output-type public-key-rmd --output-format hex
+
+bench bech32-address-to-hash160 "${BENCH_RECORDS}" \
+	$BITCOIN_TOOL --batch --input-file "${DATA}/address-bech32.txt" \
+	--input-type address --input-format bech32 \
+	--output-type public-key-rmd --output-format hex
+
+# -----------------------------------------------------------------------------
+# Baseline comparison
+# -----------------------------------------------------------------------------
+
+if [ ! -f "${BENCH_BASELINE}" ] ; then
+	echo "no baseline ${BENCH_BASELINE} to compare with"
+	echo "(use 'make bench-baseline' to keep these results as the baseline)"
+	exit 0
+fi
+
+awk -F '\t' -v threshold="${BENCH_THRESHOLD}" '
+	FNR == 1 { next }
+	NR == FNR { baseline[$1] = $4; next }
+	($1 in baseline) && baseline[$1] > 0 {
+		change = ($4 - baseline[$1]) * 100 / baseline[$1]
+		status = change < -threshold ? "REGRESSION" : "ok"
+		if (status != "ok") failed++
+		printf "%-28s %12.0f -> %12.0f records/sec (%+.1f%%) %s\n",
+			$1, baseline[$1], $4, change, status
+	}
+	END {
+		if (failed) {
+			printf "%d benchmark(s) more than %s%% slower than baseline\n",
+				failed, threshold
+			exit 1
+		}
+		print "no regressions against baseline"
+	}' "${BENCH_BASELINE}" "${BENCH_OUTPUT}"
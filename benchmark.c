@@ -0,0 +1,662 @@
+#define _POSIX_C_SOURCE 200112L /* snprintf */
+
+#include "benchmark.h"
+#include "applog.h"
+#include "base58.h"
+#include "bip38.h"
+#include "bip39.h"
+#include "hash.h"
+#include "keys.h"
+#include "message.h"
+#include "minikey.h"
+#include "parallel.h"
+#include "prefix.h"
+#include "scrypt.h"
+#include "segwit_addr.h"
+#include "timer.h"
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+
+/* number of distinct inputs each benchmark cycles through */
+#define BENCHMARK_DATASET_SIZE 64
+
+/* one set of inputs, in every representation needed by the benchmarks */
+struct BenchmarkItem {
+	struct BitcoinPrivateKey private_key;
+	char private_key_hex[BITCOIN_PRIVATE_KEY_SIZE * 2 + 1];
+	char wif[64];
+	size_t wif_size;
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 public_key_sha256;
+	struct BitcoinAddress address;
+	uint8_t address_checksum[BITCOIN_ADDRESS_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE];
+	char address_base58check[64];
+	size_t address_base58check_size;
+	char address_bech32[96];
+	uint8_t address_bech32_data[64];
+	size_t address_bech32_data_size;
+	char damaged_address[64];
+
+	/* the WIF signed as a message by the key, as signmessage would */
+	uint8_t message_signature[MESSAGE_SIGNATURE_SIZE];
+};
+
+/* per-thread buffers, so that benchmarks don't measure the allocator */
+struct BenchmarkScratch {
+	struct BitcoinPrivateKey private_key;
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	struct BitcoinAddress address;
+	uint8_t raw[256];
+	size_t raw_size;
+	char text[256];
+	size_t text_size;
+	char fixed[256];
+	size_t fixed_size;
+	struct BitcoinBIP39Mnemonic mnemonics[4];
+	struct BitcoinScryptPool *scrypt_pool;
+};
+
+struct BenchmarkCase {
+	const char *name;
+	unsigned iterations; /* operations per thread, before scaling */
+	int (*run)(const struct BenchmarkItem *item, struct BenchmarkScratch *s);
+};
+
+struct BenchmarkThreadResult {
+	uint64_t nanoseconds;
+	uint64_t cycles;
+	unsigned long errors;
+};
+
+struct BenchmarkRun {
+	const struct BenchmarkCase *bench;
+	const struct BenchmarkItem *items;
+	unsigned iterations;
+	struct BenchmarkThreadResult *results;
+};
+
+static int Benchmark_makePublicKey(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_MakePublicKeyFromPrivateKey(&s->public_key,
+		&item->private_key) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_makePublicKeyFast(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_MakePublicKeyFromPrivateKeyFast(&s->public_key,
+		&item->private_key) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_sha256(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	Bitcoin_SHA256(&s->sha256, item->public_key.data,
+		BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE);
+	return 1;
+}
+
+static int Benchmark_doubleSHA256(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	Bitcoin_DoubleSHA256(&s->sha256, item->address.data, BITCOIN_ADDRESS_SIZE);
+	return 1;
+}
+
+static int Benchmark_ripemd160(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	Bitcoin_RIPEMD160(&s->ripemd160, item->public_key_sha256.data,
+		BITCOIN_SHA256_SIZE);
+	return 1;
+}
+
+static int Benchmark_encodeBase58(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_EncodeBase58(s->text, sizeof(s->text), &s->text_size,
+		item->address_checksum, sizeof(item->address_checksum)
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_encodeBase58Check(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_EncodeBase58Check(s->text, sizeof(s->text), &s->text_size,
+		item->address.data, BITCOIN_ADDRESS_SIZE
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_decodeBase58(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_DecodeBase58(s->raw, sizeof(s->raw), &s->raw_size,
+		item->address_base58check, item->address_base58check_size
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_decodeBase58Check(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_DecodeBase58Check(s->raw, sizeof(s->raw), &s->raw_size,
+		item->address_base58check, item->address_base58check_size
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_encodeHex(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_EncodeHex(s->text, sizeof(s->text), &s->text_size,
+		item->private_key.data, BITCOIN_PRIVATE_KEY_SIZE, 1
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_decodeHex(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Bitcoin_DecodeHex(s->raw, sizeof(s->raw), &s->raw_size,
+		item->private_key_hex, BITCOIN_PRIVATE_KEY_SIZE * 2
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_bech32Encode(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return bech32_encode(s->text, "bc", item->address_bech32_data,
+		item->address_bech32_data_size);
+}
+
+static int Benchmark_segwitAddrDecode(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	char hrp[84];
+	int witver = 0;
+	return segwit_addr_decode_any(hrp, &witver, s->raw, &s->raw_size,
+		item->address_bech32);
+}
+
+static int Benchmark_fixBase58Check(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	struct BitcoinFixBase58CheckOptions options;
+
+	memset(&options, 0, sizeof(options));
+	options.change_chars = 1;
+
+	return Bitcoin_FixBase58Check(
+		s->fixed, sizeof(s->fixed), &s->fixed_size,
+		s->raw, sizeof(s->raw), &s->raw_size,
+		item->damaged_address, item->address_base58check_size,
+		&options
+	) == BITCOIN_SUCCESS;
+}
+
+/* seeds of 'count' mnemonics made together, which fills the PBKDF2 lanes
+   when there are four; the WIF stands in for the sentence, since the words
+   aren't checked and the hashing takes as long */
+static int Benchmark_bip39Seeds(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		memcpy(s->mnemonics[i].text, item->wif, item->wif_size);
+		s->mnemonics[i].size = item->wif_size;
+	}
+	return BIP39_makeSeeds(s->mnemonics, count, NULL) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_bip39Seed(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Benchmark_bip39Seeds(item, s, 1);
+}
+
+static int Benchmark_bip39Seed4(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Benchmark_bip39Seeds(item, s, 4);
+}
+
+/* the "?" check of 'count' mini key candidates, which fills the SHA256
+   lanes when there are eight; the start of the WIF stands in for each
+   candidate, since the characters aren't checked */
+static int Benchmark_miniKeyChecks(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		memcpy(s->text + i * BITCOIN_MINI_PRIVATE_KEY_SIZE, item->wif,
+			BITCOIN_MINI_PRIVATE_KEY_SIZE);
+	}
+	MiniKey_check(s->text, count, s->raw);
+	return 1;
+}
+
+static int Benchmark_miniKeyCheck(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Benchmark_miniKeyChecks(item, s, 1);
+}
+
+static int Benchmark_miniKeyCheck8(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Benchmark_miniKeyChecks(item, s, 8);
+}
+
+/* the scrypt of one BIP38 key, with the WIF as passphrase and the address
+   checksum as salt; the scratch buffer is made on the first call and then
+   reused, as it is when decrypting keys */
+static int Benchmark_bip38Scrypt(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	if (!s->scrypt_pool) {
+		s->scrypt_pool = ScryptPool_create(Scrypt_scratchSize(BIP38_SCRYPT_N,
+			BIP38_SCRYPT_R, BIP38_SCRYPT_P), 1);
+		if (!s->scrypt_pool) {
+			return 0;
+		}
+	}
+	return Scrypt_derive(s->raw, 64, item->wif, item->wif_size,
+		item->address_checksum + BITCOIN_ADDRESS_SIZE, 4,
+		BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, s->scrypt_pool
+	) == BITCOIN_SUCCESS;
+}
+
+/* recover the key which signed a message, and check it against the
+   address, as --verify-message does for each line */
+static int Benchmark_verifyMessage(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	return Message_verify(&s->public_key, &item->address, item->wif,
+		item->wif_size, item->message_signature) == BITCOIN_SUCCESS;
+}
+
+/* private key -> public key -> SHA256 -> RIPEMD160 -> address */
+static int Benchmark_privateKeyToAddressTail(struct BenchmarkScratch *s)
+{
+	if (Bitcoin_MakePublicKeyFromPrivateKey(&s->public_key, &s->private_key)
+		!= BITCOIN_SUCCESS)
+	{
+		return 0;
+	}
+	Bitcoin_MakeSHA256FromPublicKey(&s->sha256, &s->public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&s->ripemd160, &s->sha256);
+	Bitcoin_MakeAddressFromRIPEMD160(&s->address, &s->ripemd160,
+		s->private_key.network_type);
+	return Bitcoin_EncodeBase58Check(s->text, sizeof(s->text), &s->text_size,
+		s->address.data, BITCOIN_ADDRESS_SIZE
+	) == BITCOIN_SUCCESS;
+}
+
+static int Benchmark_pipelinePrivateKeyToAddress(
+	const struct BenchmarkItem *item, struct BenchmarkScratch *s)
+{
+	if (Bitcoin_DecodeHex(s->raw, sizeof(s->raw), &s->raw_size,
+		item->private_key_hex, BITCOIN_PRIVATE_KEY_SIZE * 2) != BITCOIN_SUCCESS
+		|| s->raw_size != BITCOIN_PRIVATE_KEY_SIZE)
+	{
+		return 0;
+	}
+	memcpy(s->private_key.data, s->raw, BITCOIN_PRIVATE_KEY_SIZE);
+	s->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+	s->private_key.network_type = item->private_key.network_type;
+	return Benchmark_privateKeyToAddressTail(s);
+}
+
+static int Benchmark_pipelineWIFToAddress(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	if (Bitcoin_DecodeBase58Check(s->raw, sizeof(s->raw), &s->raw_size,
+		item->wif, item->wif_size) != BITCOIN_SUCCESS
+		|| s->raw_size != BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE)
+	{
+		return 0;
+	}
+	memcpy(s->private_key.data, s->raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+		BITCOIN_PRIVATE_KEY_SIZE);
+	s->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+	s->private_key.network_type =
+		Bitcoin_GetNetworkTypeByPrivateKeyPrefix(s->raw[0]);
+	if (!s->private_key.network_type) {
+		return 0;
+	}
+	return Benchmark_privateKeyToAddressTail(s);
+}
+
+static int Benchmark_pipelineAddressToHash160(const struct BenchmarkItem *item,
+	struct BenchmarkScratch *s)
+{
+	if (Bitcoin_DecodeBase58Check(s->raw, sizeof(s->raw), &s->raw_size,
+		item->address_base58check, item->address_base58check_size
+		) != BITCOIN_SUCCESS
+		|| s->raw_size != BITCOIN_ADDRESS_SIZE)
+	{
+		return 0;
+	}
+	memcpy(s->address.data, s->raw, BITCOIN_ADDRESS_SIZE);
+	Bitcoin_MakeRIPEMD160FromAddress(&s->ripemd160, &s->address);
+	return Bitcoin_EncodeHex(s->text, sizeof(s->text), &s->text_size,
+		s->ripemd160.data, BITCOIN_RIPEMD160_SIZE, 1
+	) == BITCOIN_SUCCESS;
+}
+
+static const struct BenchmarkCase benchmark_cases[] = {
+	{ "make-public-key",                   500, Benchmark_makePublicKey },
+	{ "make-public-key-fast",             5000, Benchmark_makePublicKeyFast },
+	{ "sha256",                        1000000, Benchmark_sha256 },
+	{ "double-sha256",                  500000, Benchmark_doubleSHA256 },
+	{ "ripemd160",                      500000, Benchmark_ripemd160 },
+	{ "encode-base58",                   50000, Benchmark_encodeBase58 },
+	{ "encode-base58check",              50000, Benchmark_encodeBase58Check },
+	{ "decode-base58",                   50000, Benchmark_decodeBase58 },
+	{ "decode-base58check",              50000, Benchmark_decodeBase58Check },
+	{ "encode-hex",                    2000000, Benchmark_encodeHex },
+	{ "decode-hex",                    1000000, Benchmark_decodeHex },
+	{ "bech32-encode",                  500000, Benchmark_bech32Encode },
+	{ "segwit-addr-decode",             500000, Benchmark_segwitAddrDecode },
+	{ "fix-base58check",                    20, Benchmark_fixBase58Check },
+	{ "bip39-seed",                         50, Benchmark_bip39Seed },
+	{ "bip39-seed-x4",                      20, Benchmark_bip39Seed4 },
+	{ "mini-key-check",                 500000, Benchmark_miniKeyCheck },
+	{ "mini-key-check-x8",              100000, Benchmark_miniKeyCheck8 },
+	{ "bip38-scrypt",                        5, Benchmark_bip38Scrypt },
+	{ "verify-message",                    500, Benchmark_verifyMessage },
+	{ "pipeline-private-key-to-address",   500, Benchmark_pipelinePrivateKeyToAddress },
+	{ "pipeline-wif-to-address",           500, Benchmark_pipelineWIFToAddress },
+	{ "pipeline-address-to-hash160",     50000, Benchmark_pipelineAddressToHash160 }
+};
+
+#define BENCHMARK_CASE_COUNT (sizeof(benchmark_cases) / sizeof(benchmark_cases[0]))
+
+/* Sign the WIF as a message with the item's key, trying each header byte
+   of a compressed key until one recovers it. */
+static BitcoinResult Benchmark_signMessage(struct BenchmarkItem *item)
+{
+	uint8_t *signature = item->message_signature;
+	struct BitcoinSHA256 hash;
+	struct BitcoinPublicKey public_key;
+	EC_KEY *key = EC_KEY_new();
+	BIGNUM *d = BN_bin2bn(item->private_key.data, BITCOIN_PRIVATE_KEY_SIZE,
+		NULL);
+	ECDSA_SIG *sig = NULL;
+	const BIGNUM *r = NULL, *s = NULL;
+	unsigned header = MESSAGE_HEADER_MIN + MESSAGE_HEADER_COMPRESSED;
+	int ok;
+
+	Message_hash(&hash, item->wif, item->wif_size);
+	ok = key && d
+		&& EC_KEY_set_group(key, Bitcoin_GetSecp256k1Group())
+		&& EC_KEY_set_private_key(key, d)
+		&& (sig = ECDSA_do_sign(hash.data, BITCOIN_SHA256_SIZE, key)) != NULL;
+	if (ok) {
+		ECDSA_SIG_get0(sig, &r, &s);
+		ok = BN_bn2binpad(r, signature + 1, 32) == 32
+			&& BN_bn2binpad(s, signature + 33, 32) == 32;
+	}
+	for (; ok && header <= MESSAGE_HEADER_MAX; header++) {
+		signature[0] = (uint8_t)header;
+		if (Message_recoverPublicKey(&public_key, signature, &hash)
+			== BITCOIN_SUCCESS
+			&& memcmp(public_key.data, item->public_key.data,
+				BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE) == 0)
+		{
+			break;
+		}
+	}
+
+	ECDSA_SIG_free(sig);
+	BN_clear_free(d);
+	EC_KEY_free(key);
+	return ok && header <= MESSAGE_HEADER_MAX ?
+		BITCOIN_SUCCESS : BITCOIN_ERROR;
+}
+
+static BitcoinResult Benchmark_prepareItem(struct BenchmarkItem *item,
+	unsigned index)
+{
+	char seed[64];
+	struct BitcoinSHA256 hash;
+	struct BitcoinRIPEMD160 ripemd160;
+	uint8_t wif_raw[BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE];
+	char hrp[8];
+	size_t size = 0;
+	int witver = 0;
+	uint8_t program[40];
+	size_t program_size = 0;
+	size_t damage_at;
+	BitcoinResult result;
+
+	memset(item, 0, sizeof(*item));
+
+	/* private keys are a fixed function of their index, so every run of
+	   every build hashes and encodes exactly the same data */
+	snprintf(seed, sizeof(seed), "bitcoin-tool benchmark %u", index);
+	Bitcoin_SHA256(&hash, seed, strlen(seed));
+	memcpy(item->private_key.data, hash.data, BITCOIN_PRIVATE_KEY_SIZE);
+	item->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+	item->private_key.network_type = Bitcoin_GetNetworkTypeByName("bitcoin");
+
+	Bitcoin_EncodeHex(item->private_key_hex, sizeof(item->private_key_hex) - 1,
+		&size, item->private_key.data, BITCOIN_PRIVATE_KEY_SIZE, 1);
+
+	wif_raw[0] = BitcoinNetworkType_GetPrivateKeyPrefix(
+		item->private_key.network_type);
+	memcpy(wif_raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+		item->private_key.data, BITCOIN_PRIVATE_KEY_SIZE);
+	wif_raw[sizeof(wif_raw) - 1] =
+		BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+	result = Bitcoin_EncodeBase58Check(item->wif, sizeof(item->wif) - 1,
+		&item->wif_size, wif_raw, sizeof(wif_raw));
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	result = Bitcoin_MakePublicKeyFromPrivateKey(&item->public_key,
+		&item->private_key);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	Bitcoin_MakeSHA256FromPublicKey(&item->public_key_sha256,
+		&item->public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &item->public_key_sha256);
+	Bitcoin_MakeAddressFromRIPEMD160(&item->address, &ripemd160,
+		item->private_key.network_type);
+
+	Bitcoin_DoubleSHA256(&hash, item->address.data, BITCOIN_ADDRESS_SIZE);
+	memcpy(item->address_checksum, item->address.data, BITCOIN_ADDRESS_SIZE);
+	memcpy(item->address_checksum + BITCOIN_ADDRESS_SIZE, hash.data,
+		BITCOIN_BASE58CHECK_CHECKSUM_SIZE);
+
+	result = Bitcoin_EncodeBase58Check(item->address_base58check,
+		sizeof(item->address_base58check) - 1,
+		&item->address_base58check_size,
+		item->address.data, BITCOIN_ADDRESS_SIZE);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	if (!segwit_addr_encode(item->address_bech32, "bc", 0, ripemd160.data,
+		BITCOIN_RIPEMD160_SIZE)
+		|| !bech32_decode(hrp, item->address_bech32_data,
+			&item->address_bech32_data_size, item->address_bech32)
+		|| !segwit_addr_decode(&witver, program, &program_size, "bc",
+			item->address_bech32))
+	{
+		return BITCOIN_ERROR;
+	}
+
+	result = Benchmark_signMessage(item);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	/* damage one character (never the leading '1'), for the fixer */
+	memcpy(item->damaged_address, item->address_base58check,
+		item->address_base58check_size);
+	damage_at = 1 + index % (item->address_base58check_size - 1);
+	item->damaged_address[damage_at] =
+		item->damaged_address[damage_at] == 'x' ? 'y' : 'x';
+
+	return BITCOIN_SUCCESS;
+}
+
+static void Benchmark_thread(void *arg, unsigned thread_index)
+{
+	struct BenchmarkRun *run = (struct BenchmarkRun *)arg;
+	struct BenchmarkThreadResult *result = &run->results[thread_index];
+	struct BenchmarkScratch *scratch = calloc(1, sizeof(*scratch));
+	uint64_t start_nanoseconds, start_cycles;
+	unsigned i;
+
+	if (!scratch) {
+		result->errors = run->iterations;
+		return;
+	}
+
+	start_nanoseconds = Timer_nanoseconds();
+	start_cycles = Timer_cycles();
+
+	for (i = 0; i < run->iterations; i++) {
+		/* threads start at different items so they don't all share the
+		   same cache lines */
+		const struct BenchmarkItem *item = &run->items[
+			(i + thread_index) % BENCHMARK_DATASET_SIZE];
+		if (!run->bench->run(item, scratch)) {
+			result->errors++;
+		}
+	}
+
+	result->cycles = Timer_cycles() - start_cycles;
+	result->nanoseconds = Timer_nanoseconds() - start_nanoseconds;
+
+	ScryptPool_destroy(scratch->scrypt_pool);
+	free(scratch);
+}
+
+void Bitcoin_ListBenchmarks(FILE *output)
+{
+	static const char indent[] = "      ";
+	unsigned i;
+	for (i = 0; i < BENCHMARK_CASE_COUNT; i++) {
+		fprintf(output, "%s%s\n", indent, benchmark_cases[i].name);
+	}
+}
+
+BitcoinResult Bitcoin_RunBenchmark(FILE *output,
+	const struct BitcoinBenchmarkOptions *options)
+{
+	struct BenchmarkItem *items = NULL;
+	struct BenchmarkThreadResult *results = NULL;
+	unsigned threads = options->threads ? options->threads : 1;
+	unsigned scale = options->scale ? options->scale : 1;
+	unsigned i, t, cases_run = 0;
+	unsigned long total_errors = 0;
+	enum ApplogLevel saved_level;
+
+	items = calloc(BENCHMARK_DATASET_SIZE, sizeof(*items));
+	results = calloc(threads, sizeof(*results));
+	if (!items || !results) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to allocate benchmark data for %u threads", threads);
+		free(items);
+		free(results);
+		return BITCOIN_ERROR;
+	}
+
+	for (i = 0; i < BENCHMARK_DATASET_SIZE; i++) {
+		if (Benchmark_prepareItem(&items[i], i) != BITCOIN_SUCCESS) {
+			applog(APPLOG_BUG, __func__,
+				"failed to prepare benchmark input %u", i);
+			free(items);
+			free(results);
+			return BITCOIN_ERROR;
+		}
+	}
+
+	/* the fixer reports every successful fix, which is not what we are
+	   measuring */
+	saved_level = applog_get_level();
+	applog_set_level(APPLOG_ERROR);
+
+	fprintf(output, "%-34s %7s %10s %12s %12s %12s\n",
+		"benchmark", "threads", "ops", "ops/sec", "ns/op", "cycles/op");
+
+	for (i = 0; i < BENCHMARK_CASE_COUNT; i++) {
+		const struct BenchmarkCase *bench = &benchmark_cases[i];
+		struct BenchmarkRun run;
+		uint64_t wall_nanoseconds, thread_nanoseconds = 0, cycles = 0;
+		unsigned long errors = 0;
+		double ops;
+
+		if (options->filter && !strstr(bench->name, options->filter)) {
+			continue;
+		}
+
+		memset(results, 0, threads * sizeof(*results));
+		run.bench = bench;
+		run.items = items;
+		run.iterations = bench->iterations * scale;
+		run.results = results;
+
+		wall_nanoseconds = Timer_nanoseconds();
+		if (Parallel_run(threads, Benchmark_thread, &run) != BITCOIN_SUCCESS) {
+			applog_set_level(saved_level);
+			free(items);
+			free(results);
+			return BITCOIN_ERROR;
+		}
+		wall_nanoseconds = Timer_nanoseconds() - wall_nanoseconds;
+
+		for (t = 0; t < threads; t++) {
+			thread_nanoseconds += results[t].nanoseconds;
+			cycles += results[t].cycles;
+			errors += results[t].errors;
+		}
+
+		/* ops/sec is the throughput of all threads together, ns/op and
+		   cycles/op are the average cost of one operation on one thread */
+		ops = (double)run.iterations * threads;
+		fprintf(output, "%-34s %7u %10.0f %12.0f %12.1f %12.1f\n",
+			bench->name, threads, ops,
+			wall_nanoseconds ? ops * 1e9 / wall_nanoseconds : 0.0,
+			thread_nanoseconds / ops,
+			cycles / ops
+		);
+		fflush(output);
+
+		if (errors) {
+			applog(APPLOG_ERROR, __func__,
+				"%s: %lu of %.0f operations failed",
+				bench->name, errors, ops);
+			total_errors += errors;
+		}
+		cases_run++;
+	}
+
+	applog_set_level(saved_level);
+
+	if (cases_run == 0) {
+		applog(APPLOG_ERROR, __func__,
+			"no benchmark names contain \"%s\", must be one of:",
+			options->filter);
+		Bitcoin_ListBenchmarks(stderr);
+		total_errors++;
+	}
+
+	free(items);
+	free(results);
+
+	return total_errors ? BITCOIN_ERROR : BITCOIN_SUCCESS;
+}
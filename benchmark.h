@@ -0,0 +1,43 @@
+#ifndef BITCOIN_INCLUDE_BENCHMARK_H
+#define BITCOIN_INCLUDE_BENCHMARK_H
+
+/** @file benchmark.h
+ *  @brief Built-in microbenchmarks of each conversion primitive and of the
+ *         common end-to-end conversion pipelines.
+ *
+ *  Every benchmark runs a fixed, deterministic workload so that results from
+ *  different builds or machines can be compared directly.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stdio.h> /* FILE */
+
+#include "result.h" /* BitcoinResult */
+
+struct BitcoinBenchmarkOptions {
+	/* number of threads running each benchmark at once */
+	unsigned threads;
+
+	/* multiply the default number of operations of each benchmark by this */
+	unsigned scale;
+
+	/* only run benchmarks with names containing this string, or NULL for all */
+	const char *filter;
+};
+
+/** @brief Run the benchmarks and write a report with one line per benchmark.
+ *
+ *  @param[in] output File to write the report to.
+ *  @param[in] options Benchmark options.
+ *
+ *  @return BITCOIN_SUCCESS if every operation of every benchmark succeeded.
+ */
+BitcoinResult Bitcoin_RunBenchmark(FILE *output,
+	const struct BitcoinBenchmarkOptions *options
+);
+
+/** @brief List the names of all benchmarks. */
+void Bitcoin_ListBenchmarks(FILE *output);
+
+#endif
@@ -0,0 +1,600 @@
+#include "bip32.h"
+#include "applog.h"
+#include "ecbatch.h"
+#include "hash.h"
+#include "parallel.h"
+#include "prefix.h"
+#include "secure.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+/* children derived by each task, with their public keys made affine
+   together */
+#define BIP32_TASK_SIZE 256
+
+/* HMAC message: a public key or 0 and a private key, then the index */
+#define BIP32_DATA_SIZE (BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE + 4)
+
+/* Everything children of one parent share */
+struct BIP32Parent {
+	const struct BitcoinExtendedKey *key;
+	struct BitcoinHMACSHA512Key hmac;
+	unsigned char fingerprint[BIP32_FINGERPRINT_SIZE];
+
+	/* HMAC messages of hardened and normal children, less the index */
+	unsigned char hardened_data[BIP32_DATA_SIZE], normal_data[BIP32_DATA_SIZE];
+
+	/* the parent's public key as a point, for children of public keys */
+	EC_POINT *point;
+};
+
+/* A run of children derived together */
+struct BIP32Task {
+	const struct BIP32Parent *parent;
+	struct BitcoinExtendedKey *children;
+	uint32_t first;
+	size_t count;
+	BitcoinResult result;
+};
+
+static void BIP32_store32(unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = (unsigned char)(value >> 24);
+	bytes[1] = (unsigned char)(value >> 16);
+	bytes[2] = (unsigned char)(value >> 8);
+	bytes[3] = (unsigned char)value;
+}
+
+static uint32_t BIP32_load32(const unsigned char *bytes)
+{
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+		| ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static BitcoinResult BIP32_fail(const char *function_name)
+{
+	applog(APPLOG_ERROR, function_name, "OpenSSL failed: %s",
+		ERR_error_string(ERR_get_error(), NULL)
+	);
+	return BITCOIN_ERROR_LIBRARY_FAILURE;
+}
+
+/* Parse a decimal index with an optional hardened mark, returning the
+   character after it, or NULL if there isn't one. */
+static const char *BIP32_parseIndex(const char *text, uint32_t *index)
+{
+	unsigned long value = 0;
+	const char *p = text;
+
+	while (*p >= '0' && *p <= '9') {
+		value = value * 10 + (unsigned long)(*p - '0');
+		if (value >= BIP32_HARDENED) {
+			return NULL;
+		}
+		p++;
+	}
+	if (p == text) {
+		return NULL;
+	}
+	if (*p == '\'' || *p == 'h' || *p == 'H') {
+		value |= BIP32_HARDENED;
+		p++;
+	}
+	*index = (uint32_t)value;
+	return p;
+}
+
+BitcoinResult BIP32_parsePath(struct BitcoinDerivationPath *path,
+	const char *text)
+{
+	const char *p = text;
+
+	memset(path, 0, sizeof(*path));
+	if (*p++ != 'm') {
+		goto invalid;
+	}
+	while (*p == '/') {
+		uint32_t index;
+
+		p = BIP32_parseIndex(p + 1, &index);
+		if (!p) {
+			goto invalid;
+		}
+		if (path->levels > 0) {
+			if (path->levels == BIP32_MAX_PATH) {
+				applog(APPLOG_ERROR, __func__,
+					"Derivation path \"%s\" has more than %u levels",
+					text, (unsigned)BIP32_MAX_PATH
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			path->indexes[path->levels - 1] = path->last;
+		}
+		path->first = path->last = index;
+		path->levels++;
+
+		if (*p == '-') {
+			/* a range, only allowed at the last level */
+			p = BIP32_parseIndex(p + 1, &path->last);
+			if (!p || *p != '\0'
+				|| (path->first & BIP32_HARDENED) != (path->last & BIP32_HARDENED)
+				|| path->last < path->first)
+			{
+				goto invalid;
+			}
+		}
+	}
+	if (*p == '\0') {
+		return BITCOIN_SUCCESS;
+	}
+
+invalid:
+	applog(APPLOG_ERROR, __func__,
+		"Expected a derivation path such as \"m/44'/0'/0'/0/0-99\","
+		" not \"%s\"", text
+	);
+	return BITCOIN_ERROR_INVALID_FORMAT;
+}
+
+BitcoinResult BIP32_loadExtendedKey(struct BitcoinExtendedKey *key,
+	const uint8_t *data, size_t size,
+	const struct BitcoinNetworkType *network_type)
+{
+	const unsigned char *key_data = data + 45;
+	uint32_t version;
+	unsigned i;
+
+	if (size != BIP32_EXTENDED_KEY_SIZE) {
+		applog(APPLOG_ERROR, __func__,
+			"Invalid size input for extended key:"
+			" expected %u bytes but got %u bytes instead.",
+			(unsigned)BIP32_EXTENDED_KEY_SIZE, (unsigned)size
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	memset(key, 0, sizeof(*key));
+	version = BIP32_load32(data);
+	if (network_type) {
+		if (version != network_type->extended_public_key_prefix
+			&& version != network_type->extended_private_key_prefix)
+		{
+			network_type = NULL;
+		}
+	} else {
+		network_type = Bitcoin_GetNetworkTypeByExtendedKeyPrefix(version);
+	}
+	if (!network_type) {
+		applog(APPLOG_ERROR, __func__,
+			"Unknown version in extended key [0x%08lx]",
+			(unsigned long)version
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	key->network_type = network_type;
+	key->is_private = version == network_type->extended_private_key_prefix;
+	key->depth = data[4];
+	memcpy(key->parent_fingerprint, data + 5, BIP32_FINGERPRINT_SIZE);
+	key->child_number = BIP32_load32(data + 9);
+	memcpy(key->chain_code, data + 13, BIP32_CHAIN_CODE_SIZE);
+
+	if (key->depth == 0) {
+		/* a master key has no parent */
+		for (i = 0; i < BIP32_FINGERPRINT_SIZE; i++) {
+			if (key->parent_fingerprint[i]) {
+				break;
+			}
+		}
+		if (i < BIP32_FINGERPRINT_SIZE || key->child_number) {
+			applog(APPLOG_ERROR, __func__,
+				"Extended key at depth 0 has a parent or child number"
+			);
+			return BITCOIN_ERROR_INVALID_FORMAT;
+		}
+	}
+
+	if (key->is_private) {
+		const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+		BIGNUM *k = BN_bin2bn(key_data + 1, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+		BitcoinResult result;
+		int valid;
+
+		if (!group || !k) {
+			BN_free(k);
+			return BIP32_fail(__func__);
+		}
+		valid = key_data[0] == 0 && !BN_is_zero(k)
+			&& BN_cmp(k, EC_GROUP_get0_order(group)) < 0;
+		BN_clear_free(k);
+		if (!valid) {
+			applog(APPLOG_ERROR, __func__,
+				"Extended private key is not a valid private key"
+			);
+			return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+		}
+		memcpy(key->private_key.data, key_data + 1, BITCOIN_PRIVATE_KEY_SIZE);
+		key->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		key->private_key.network_type = network_type;
+
+		/* the private key is secret, so this takes constant time */
+		result = Bitcoin_MakePublicKeyFromPrivateKey(&key->public_key,
+			&key->private_key);
+		if (result != BITCOIN_SUCCESS) {
+			return result;
+		}
+	} else {
+		const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+		EC_POINT *point = group ? EC_POINT_new(group) : NULL;
+		int valid;
+
+		if (!point) {
+			return BIP32_fail(__func__);
+		}
+		valid = (key_data[0] == 0x02 || key_data[0] == 0x03)
+			&& EC_POINT_oct2point(group, point, key_data,
+				BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE, NULL);
+		EC_POINT_free(point);
+		if (!valid) {
+			ERR_clear_error();
+			applog(APPLOG_ERROR, __func__,
+				"Extended public key is not a point on the curve"
+			);
+			return BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+		}
+		memcpy(key->public_key.data, key_data,
+			BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE);
+		key->public_key.compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		key->public_key.network_type = network_type;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult BIP32_makeMasterKey(struct BitcoinExtendedKey *key,
+	const uint8_t *seed, size_t size,
+	const struct BitcoinNetworkType *network_type)
+{
+	static const char hmac_key[] = "Bitcoin seed";
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	struct BitcoinHMACSHA512Key hmac;
+	struct BitcoinSHA512 hash;
+	BIGNUM *k;
+	int valid;
+
+	memset(key, 0, sizeof(*key));
+	Bitcoin_HMACSHA512Init(&hmac, hmac_key, sizeof(hmac_key) - 1);
+	Bitcoin_HMACSHA512(&hash, &hmac, seed, size);
+	Secure_wipe(&hmac, sizeof(hmac));
+
+	k = group ? BN_bin2bn(hash.data, BITCOIN_PRIVATE_KEY_SIZE, NULL) : NULL;
+	if (!k) {
+		Secure_wipe(&hash, sizeof(hash));
+		return BIP32_fail(__func__);
+	}
+	valid = !BN_is_zero(k) && BN_cmp(k, EC_GROUP_get0_order(group)) < 0;
+	BN_clear_free(k);
+	if (!valid) {
+		Secure_wipe(&hash, sizeof(hash));
+		applog(APPLOG_ERROR, __func__,
+			"Seed makes an invalid master key, which BIP32 gives a chance"
+			" below 2^-127"
+		);
+		return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+	}
+
+	memcpy(key->private_key.data, hash.data, BITCOIN_PRIVATE_KEY_SIZE);
+	memcpy(key->chain_code, hash.data + BITCOIN_PRIVATE_KEY_SIZE,
+		BIP32_CHAIN_CODE_SIZE);
+	Secure_wipe(&hash, sizeof(hash));
+	key->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+	key->private_key.network_type = network_type;
+	key->is_private = 1;
+	key->network_type = network_type;
+
+	return Bitcoin_MakePublicKeyFromPrivateKey(&key->public_key,
+		&key->private_key);
+}
+
+/* Set up what every child of 'key' shares.  The key must have its public
+   key. */
+static BitcoinResult BIP32_initParent(struct BIP32Parent *parent,
+	const struct BitcoinExtendedKey *key)
+{
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+
+	memset(parent, 0, sizeof(*parent));
+	parent->key = key;
+	Bitcoin_HMACSHA512Init(&parent->hmac, key->chain_code,
+		BIP32_CHAIN_CODE_SIZE);
+
+	Bitcoin_MakeSHA256FromPublicKey(&sha256, &key->public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+	memcpy(parent->fingerprint, ripemd160.data, BIP32_FINGERPRINT_SIZE);
+
+	memcpy(parent->normal_data, key->public_key.data,
+		BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE);
+	if (key->is_private) {
+		memcpy(parent->hardened_data + 1, key->private_key.data,
+			BITCOIN_PRIVATE_KEY_SIZE);
+	} else {
+		const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+
+		parent->point = group ? EC_POINT_new(group) : NULL;
+		if (!parent->point
+			|| !EC_POINT_oct2point(group, parent->point, key->public_key.data,
+				BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE, NULL))
+		{
+			EC_POINT_free(parent->point);
+			parent->point = NULL;
+			return BIP32_fail(__func__);
+		}
+	}
+	return BITCOIN_SUCCESS;
+}
+
+static void BIP32_destroyParent(struct BIP32Parent *parent)
+{
+	EC_POINT_free(parent->point);
+	Secure_wipe(parent, sizeof(*parent));
+}
+
+/* Hash the parent's key and 'index' into IL and the child's chain code, and
+   fill in everything about the child but its keys. */
+static BitcoinResult BIP32_hashChild(const struct BIP32Parent *parent,
+	struct BitcoinExtendedKey *child, uint32_t index,
+	struct BitcoinSHA512 *hash)
+{
+	const struct BitcoinExtendedKey *key = parent->key;
+	unsigned char data[BIP32_DATA_SIZE];
+
+	if (index & BIP32_HARDENED) {
+		if (!key->is_private) {
+			applog(APPLOG_ERROR, __func__,
+				"Hardened child %lu' can't be derived from an extended"
+				" public key", (unsigned long)(index & ~BIP32_HARDENED)
+			);
+			return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+		}
+		memcpy(data, parent->hardened_data, sizeof(data));
+	} else {
+		memcpy(data, parent->normal_data, sizeof(data));
+	}
+	if (key->depth >= 255) {
+		applog(APPLOG_ERROR, __func__, "Extended key is too deep to derive");
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	BIP32_store32(data + BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE, index);
+	Bitcoin_HMACSHA512(hash, &parent->hmac, data, sizeof(data));
+	Secure_wipe(data, sizeof(data));
+
+	memset(child, 0, sizeof(*child));
+	memcpy(child->chain_code, hash->data + BITCOIN_PRIVATE_KEY_SIZE,
+		BIP32_CHAIN_CODE_SIZE);
+	memcpy(child->parent_fingerprint, parent->fingerprint,
+		BIP32_FINGERPRINT_SIZE);
+	child->depth = key->depth + 1;
+	child->child_number = index;
+	child->is_private = key->is_private;
+	child->network_type = key->network_type;
+	child->private_key.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+	child->private_key.network_type = key->network_type;
+	child->public_key.network_type = key->network_type;
+	return BITCOIN_SUCCESS;
+}
+
+static BitcoinResult BIP32_invalidChild(const char *function_name,
+	uint32_t index)
+{
+	applog(APPLOG_ERROR, function_name,
+		"Child %lu%s has no valid key, BIP32 says to use the next one",
+		(unsigned long)(index & ~BIP32_HARDENED),
+		(index & BIP32_HARDENED) ? "'" : ""
+	);
+	return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+}
+
+/* Derive a run of children of a private key, their private keys being IL
+   plus the parent's, mod n. */
+static BitcoinResult BIP32_derivePrivate(const struct BIP32Parent *parent,
+	struct BitcoinExtendedKey *children, uint32_t first, size_t count)
+{
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	const BIGNUM *order = group ? EC_GROUP_get0_order(group) : NULL;
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *k = BN_new(), *il = BN_new();
+	BitcoinResult result = BITCOIN_SUCCESS;
+	struct BitcoinSHA512 hash;
+	size_t i;
+
+	if (!order || !ctx || !k || !il
+		|| !BN_bin2bn(parent->key->private_key.data, BITCOIN_PRIVATE_KEY_SIZE, k))
+	{
+		result = BIP32_fail(__func__);
+	}
+	for (i = 0; result == BITCOIN_SUCCESS && i < count; i++) {
+		uint32_t index = first + (uint32_t)i;
+
+		result = BIP32_hashChild(parent, &children[i], index, &hash);
+		if (result != BITCOIN_SUCCESS) {
+			break;
+		}
+		if (!BN_bin2bn(hash.data, BITCOIN_PRIVATE_KEY_SIZE, il)) {
+			result = BIP32_fail(__func__);
+		} else if (BN_cmp(il, order) >= 0) {
+			result = BIP32_invalidChild(__func__, index);
+		} else if (!BN_mod_add(il, il, k, order, ctx)
+			|| BN_bn2binpad(il, children[i].private_key.data,
+				BITCOIN_PRIVATE_KEY_SIZE) < 0)
+		{
+			result = BIP32_fail(__func__);
+		} else if (BN_is_zero(il)) {
+			result = BIP32_invalidChild(__func__, index);
+		}
+	}
+
+	Secure_wipe(&hash, sizeof(hash));
+	BN_clear_free(il);
+	BN_clear_free(k);
+	BN_CTX_free(ctx);
+	return result;
+}
+
+/* Derive a run of children of a public key, their public keys being IL*G
+   plus the parent's, all made affine together. */
+static BitcoinResult BIP32_derivePublic(const struct BIP32Parent *parent,
+	struct BitcoinExtendedKey *children, uint32_t first, size_t count)
+{
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	unsigned char order[BITCOIN_PRIVATE_KEY_SIZE];
+	EC_POINT *points[BIP32_TASK_SIZE];
+	const EC_POINT *jumps[BIP32_TASK_SIZE];
+	BN_CTX *ctx = BN_CTX_new();
+	BitcoinResult result = BITCOIN_SUCCESS;
+	struct BitcoinSHA512 hash;
+	size_t i;
+
+	memset(points, 0, sizeof(points));
+	if (!ctx || count > BIP32_TASK_SIZE
+		|| BN_bn2binpad(EC_GROUP_get0_order(group), order, sizeof(order)) < 0)
+	{
+		result = BIP32_fail(__func__);
+	}
+	for (i = 0; result == BITCOIN_SUCCESS && i < count; i++) {
+		uint32_t index = first + (uint32_t)i;
+
+		result = BIP32_hashChild(parent, &children[i], index, &hash);
+		if (result != BITCOIN_SUCCESS) {
+			break;
+		}
+		if (memcmp(hash.data, order, sizeof(order)) >= 0) {
+			result = BIP32_invalidChild(__func__, index);
+			break;
+		}
+		points[i] = EC_POINT_new(group);
+		jumps[i] = parent->point;
+		if (!points[i] || !Bitcoin_MulGeneratorFast(points[i], hash.data, ctx)) {
+			result = BIP32_fail(__func__);
+		}
+	}
+	if (result == BITCOIN_SUCCESS
+		&& !ECBatch_jump(group, points, jumps, count, ctx))
+	{
+		result = BIP32_fail(__func__);
+	}
+	for (i = 0; result == BITCOIN_SUCCESS && i < count; i++) {
+		struct BitcoinPublicKey *public_key = &children[i].public_key;
+
+		if (EC_POINT_is_at_infinity(group, points[i])) {
+			result = BIP32_invalidChild(__func__, first + (uint32_t)i);
+		} else if (EC_POINT_point2oct(group, points[i],
+			POINT_CONVERSION_COMPRESSED, public_key->data,
+			BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE, ctx)
+			!= BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE)
+		{
+			result = BIP32_fail(__func__);
+		} else {
+			public_key->compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		}
+	}
+
+	for (i = 0; i < count && i < BIP32_TASK_SIZE; i++) {
+		EC_POINT_free(points[i]);
+	}
+	BN_CTX_free(ctx);
+	return result;
+}
+
+static void BIP32_task(void *arg, unsigned thread_index)
+{
+	struct BIP32Task *task = arg;
+
+	task->result = task->parent->key->is_private ?
+		BIP32_derivePrivate(task->parent, task->children, task->first,
+			task->count) :
+		BIP32_derivePublic(task->parent, task->children, task->first,
+			task->count);
+	applog_flush();
+}
+
+BitcoinResult BIP32_deriveChild(struct BitcoinExtendedKey *child,
+	const struct BitcoinExtendedKey *parent, uint32_t index)
+{
+	struct BitcoinExtendedKey derived;
+	BitcoinResult result;
+
+	result = BIP32_deriveChildren(&derived, parent, index, 1, NULL);
+	if (result == BITCOIN_SUCCESS && derived.is_private) {
+		/* the next level needs it, from the secret key so in constant
+		   time */
+		result = Bitcoin_MakePublicKeyFromPrivateKey(&derived.public_key,
+			&derived.private_key);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		*child = derived;
+	}
+	Secure_wipe(&derived, sizeof(derived));
+	return result;
+}
+
+BitcoinResult BIP32_deriveChildren(struct BitcoinExtendedKey *children,
+	const struct BitcoinExtendedKey *parent, uint32_t first, size_t count,
+	struct ParallelPool *pool)
+{
+	const size_t task_count = (count + BIP32_TASK_SIZE - 1) / BIP32_TASK_SIZE;
+	struct BIP32Parent shared;
+	struct BIP32Task *tasks;
+	struct ParallelGroup group;
+	BitcoinResult result;
+	size_t i;
+
+	if (count == 0) {
+		return BITCOIN_SUCCESS;
+	}
+	if ((uint32_t)(first + (count - 1)) < first) {
+		applog(APPLOG_ERROR, __func__, "Child index out of range");
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	tasks = calloc(task_count, sizeof(*tasks));
+	if (!tasks) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate derivation tasks");
+		return BITCOIN_ERROR;
+	}
+	result = BIP32_initParent(&shared, parent);
+	if (result != BITCOIN_SUCCESS) {
+		free(tasks);
+		return result;
+	}
+
+	group.pending = 0;
+	for (i = 0; i < task_count; i++) {
+		struct BIP32Task *task = &tasks[i];
+
+		task->parent = &shared;
+		task->children = children + i * BIP32_TASK_SIZE;
+		task->first = first + (uint32_t)(i * BIP32_TASK_SIZE);
+		task->count = count - i * BIP32_TASK_SIZE < BIP32_TASK_SIZE ?
+			count - i * BIP32_TASK_SIZE : BIP32_TASK_SIZE;
+		if (!pool || task_count == 1
+			|| ParallelPool_submit(pool, &group, BIP32_task, task)
+				!= BITCOIN_SUCCESS)
+		{
+			BIP32_task(task, 0);
+		}
+	}
+	if (pool) {
+		ParallelPool_wait(pool, &group);
+	}
+	for (i = 0; i < task_count && result == BITCOIN_SUCCESS; i++) {
+		result = tasks[i].result;
+	}
+
+	BIP32_destroyParent(&shared);
+	free(tasks);
+	return result;
+}
@@ -0,0 +1,144 @@
+#ifndef BITCOIN_INCLUDE_BIP32_H
+#define BITCOIN_INCLUDE_BIP32_H
+
+/** @file bip32.h
+ *  @brief BIP32 hierarchical deterministic keys: loading extended keys and
+ *         deriving their children.
+ *
+ *  Each child is HMAC-SHA512 of its parent's key and its index, keyed by
+ *  the parent's chain code.  The left half IL is added to the parent's
+ *  private key (or IL*G to its public key) and the right half is the
+ *  child's chain code.  Siblings share the HMAC key, so it's set up once
+ *  for the parent, and the public keys of a run of siblings are made
+ *  affine together.
+ *
+ *  https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t, uint32_t */
+
+#include "keys.h" /* struct BitcoinPrivateKey, struct BitcoinPublicKey */
+#include "result.h" /* BitcoinResult */
+
+struct ParallelPool;
+struct BitcoinNetworkType;
+
+/* size of a serialised extended key, not including base58check checksum */
+#define BIP32_EXTENDED_KEY_SIZE 78
+
+#define BIP32_CHAIN_CODE_SIZE 32
+#define BIP32_FINGERPRINT_SIZE 4
+
+/* indexes from this one up are hardened, derived from the private key */
+#define BIP32_HARDENED 0x80000000UL
+
+/* most levels in a --derive path */
+#define BIP32_MAX_PATH 32
+
+struct BitcoinExtendedKey {
+	/* set for extended private keys only */
+	struct BitcoinPrivateKey private_key;
+
+	/* always compressed, and may be empty for children of a private key
+	   derived in bulk */
+	struct BitcoinPublicKey public_key;
+
+	unsigned char chain_code[BIP32_CHAIN_CODE_SIZE];
+	unsigned char parent_fingerprint[BIP32_FINGERPRINT_SIZE];
+	unsigned depth;
+	uint32_t child_number;
+	int is_private;
+
+	const struct BitcoinNetworkType *network_type;
+};
+
+/** A derivation path relative to some extended key, with a range of
+ *  indexes at the last level */
+struct BitcoinDerivationPath {
+	/* every level but the last */
+	uint32_t indexes[BIP32_MAX_PATH];
+
+	/* number of levels including the last, 0 for the key itself */
+	size_t levels;
+
+	/* indexes of the last level, including both ends */
+	uint32_t first, last;
+};
+
+/** @brief Parse a path such as "m/44'/0'/0'/0/0-99", where "m" is the key
+ *         being derived from, ' or h marks hardened indexes, and the last
+ *         level may be a range "FIRST-LAST".
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if 'text' isn't a path.
+ */
+BitcoinResult BIP32_parsePath(struct BitcoinDerivationPath *path,
+	const char *text
+);
+
+/** @brief Load a serialised extended key, taking its network from its
+ *         version, which must belong to 'network_type' if not NULL.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if it's the wrong size or has an
+ *          unknown version.
+ *          BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT or
+ *          BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT if the key isn't valid.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult BIP32_loadExtendedKey(struct BitcoinExtendedKey *key,
+	const uint8_t *data, size_t size,
+	const struct BitcoinNetworkType *network_type
+);
+
+/** @brief Make the master extended private key of a seed, such as a BIP39
+ *         mnemonic's, for addresses on 'network_type'.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT if the seed makes an
+ *          invalid key.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult BIP32_makeMasterKey(struct BitcoinExtendedKey *key,
+	const uint8_t *seed, size_t size,
+	const struct BitcoinNetworkType *network_type
+);
+
+/** @brief Derive the child 'index' of 'parent', which may be the same
+ *         struct as 'child'.  The child has its public key set.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_IMPOSSIBLE_CONVERSION for a hardened child of a
+ *          public key.
+ *          BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT if the child key is
+ *          invalid, which BIP32 gives a chance below 2^-127.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult BIP32_deriveChild(struct BitcoinExtendedKey *child,
+	const struct BitcoinExtendedKey *parent, uint32_t index
+);
+
+/** @brief Derive 'count' children of 'parent' from index 'first', sharing
+ *         the work between 'pool' if not NULL.
+ *
+ *  Children of a private key only have their private keys set, leaving
+ *  the public keys to the caller if needed.  Children of a public key are
+ *  IL*G plus the parent's public key, where IL is no secret from anyone
+ *  with the parent, so the multiplication uses precomputed multiples of G
+ *  and the sums are made affine together.
+ *
+ *  @return BitcoinResult indicating error state, as BIP32_deriveChild().
+ */
+BitcoinResult BIP32_deriveChildren(struct BitcoinExtendedKey *children,
+	const struct BitcoinExtendedKey *parent, uint32_t first, size_t count,
+	struct ParallelPool *pool
+);
+
+#endif
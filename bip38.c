@@ -0,0 +1,547 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads, fileno */
+
+#include "bip38.h"
+#include "applog.h"
+#include "base58.h"
+#include "hash.h"
+#include "parallel.h"
+#include "progress.h"
+#include "scrypt.h"
+#include "secure.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+
+/* offsets of the fields after the prefix and flag, which are the same for
+   both methods up to the address hash */
+#define BIP38_FLAG_OFFSET 2
+#define BIP38_ADDRESS_HASH_OFFSET 3
+#define BIP38_ADDRESS_HASH_SIZE 4
+#define BIP38_ENCRYPTED_OFFSET 7
+
+/* EC multiply keys have the owner's salt, and lot and sequence numbers if
+   the flag says so, then only the second half of the first encrypted
+   block, the first being the seed's second half */
+#define BIP38_OWNER_ENTROPY_OFFSET 7
+#define BIP38_OWNER_ENTROPY_SIZE 8
+#define BIP38_OWNER_SALT_LOT_SEQUENCE_SIZE 4
+#define BIP38_ENCRYPTED_PART1_OFFSET 15
+#define BIP38_ENCRYPTED_PART2_OFFSET 23
+#define BIP38_SEED_B_SIZE 24
+
+/* scrypt parameters of the passpoint, which is only a public key */
+#define BIP38_PASSPOINT_SCRYPT_N 1024
+#define BIP38_PASSPOINT_SCRYPT_R 1
+#define BIP38_PASSPOINT_SCRYPT_P 1
+
+#define BIP38_AES_BLOCK_SIZE 16
+
+/* longest candidate passphrase read from a file, longer lines being split */
+#define BIP38_MAX_PASSPHRASE_SIZE 1024
+
+/* Passphrase candidates shared between threads */
+struct BIP38Recovery {
+	const uint8_t *data;
+	const struct BitcoinBIP38RecoveryOptions *options;
+
+	pthread_mutex_t mutex;
+
+	/* lines read so far, and the offset of the next one */
+	FILE *file;
+	uint64_t line, offset;
+
+	int done, found;
+	BitcoinResult result;
+	struct BitcoinPrivateKey private_key;
+	char passphrase[BIP38_MAX_PASSPHRASE_SIZE];
+	uint64_t found_line;
+
+	struct BitcoinProgress progress;
+};
+
+static BitcoinResult BIP38_fail(const char *function_name)
+{
+	applog(APPLOG_ERROR, function_name, "OpenSSL failed: %s",
+		ERR_error_string(ERR_get_error(), NULL)
+	);
+	return BITCOIN_ERROR_LIBRARY_FAILURE;
+}
+
+/* Encrypt or decrypt whole AES blocks, each on its own. */
+static BitcoinResult BIP38_aes(uint8_t *output, const uint8_t *input,
+	size_t size, const uint8_t *key, int encrypt)
+{
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	int length = 0;
+	int ok = ctx
+		&& EVP_CipherInit_ex(ctx, EVP_aes_256_ecb(), NULL, key, NULL, encrypt)
+		&& EVP_CIPHER_CTX_set_padding(ctx, 0)
+		&& EVP_CipherUpdate(ctx, output, &length, input, (int)size)
+		&& (size_t)length == size;
+
+	EVP_CIPHER_CTX_free(ctx);
+	return ok ? BITCOIN_SUCCESS : BIP38_fail(__func__);
+}
+
+static void BIP38_xor(uint8_t *output, const uint8_t *a, const uint8_t *b,
+	size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		output[i] = a[i] ^ b[i];
+	}
+}
+
+/* First four bytes of the double SHA256 of the key's Base58Check address,
+   which is what the passphrase is checked with. */
+static BitcoinResult BIP38_addressHash(uint8_t *hash,
+	const struct BitcoinPrivateKey *private_key)
+{
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	struct BitcoinAddress address;
+	char text[64];
+	size_t text_size = 0;
+	BitcoinResult result;
+
+	result = Bitcoin_MakePublicKeyFromPrivateKey(&public_key, private_key);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	Bitcoin_MakeSHA256FromPublicKey(&sha256, &public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+	Bitcoin_MakeAddressFromRIPEMD160(&address, &ripemd160,
+		private_key->network_type);
+	result = Bitcoin_EncodeBase58Check(text, sizeof(text), &text_size,
+		address.data, BITCOIN_ADDRESS_SIZE);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	Bitcoin_DoubleSHA256(&sha256, text, text_size);
+	memcpy(hash, sha256.data, BIP38_ADDRESS_HASH_SIZE);
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult BIP38_check(const uint8_t *data, size_t size)
+{
+	uint8_t flag;
+
+	if (size != BIP38_SIZE) {
+		applog(APPLOG_ERROR, __func__,
+			"Invalid size input for BIP38 private key:"
+			" expected %u bytes but got %u bytes instead.",
+			(unsigned)BIP38_SIZE, (unsigned)size
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	flag = data[BIP38_FLAG_OFFSET];
+	if (data[0] != BIP38_VERSION || (data[1] != BIP38_TYPE_NON_EC_MULTIPLY
+		&& data[1] != BIP38_TYPE_EC_MULTIPLY))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Unknown prefix bytes in BIP38 private key [%u %u]",
+			(unsigned)data[0], (unsigned)data[1]
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if ((data[1] == BIP38_TYPE_NON_EC_MULTIPLY
+			&& (flag & ~BIP38_FLAG_COMPRESSED) != BIP38_FLAG_NON_EC_MULTIPLY)
+		|| (data[1] == BIP38_TYPE_EC_MULTIPLY
+			&& (flag & ~(BIP38_FLAG_COMPRESSED | BIP38_FLAG_LOT_SEQUENCE))))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Unknown flags in BIP38 private key [0x%02x]", (unsigned)flag
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	return BITCOIN_SUCCESS;
+}
+
+/* Decrypt a key encrypted directly with the passphrase: each half of it is
+   XORed with half of the first 32 bytes of the scrypt output, and then
+   encrypted with the other 32 bytes as the key. */
+static BitcoinResult BIP38_decryptNonECMultiply(
+	struct BitcoinPrivateKey *private_key, const uint8_t *data,
+	const char *passphrase, size_t passphrase_size,
+	struct BitcoinScryptPool *scrypt_pool)
+{
+	uint8_t derived[64];
+	BitcoinResult result;
+
+	result = Scrypt_derive(derived, sizeof(derived),
+		passphrase, passphrase_size,
+		data + BIP38_ADDRESS_HASH_OFFSET, BIP38_ADDRESS_HASH_SIZE,
+		BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, scrypt_pool
+	);
+	if (result == BITCOIN_SUCCESS) {
+		result = BIP38_aes(private_key->data, data + BIP38_ENCRYPTED_OFFSET,
+			BITCOIN_PRIVATE_KEY_SIZE, derived + 32, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		BIP38_xor(private_key->data, private_key->data, derived,
+			BITCOIN_PRIVATE_KEY_SIZE);
+	}
+	Secure_wipe(derived, sizeof(derived));
+	return result;
+}
+
+/* Decrypt a key made from an intermediate code.  The passphrase makes the
+   "passfactor", and its public key the "passpoint", whose scrypt output
+   decrypts the random "seedb" which the key's maker chose.  The key is the
+   passfactor times the double SHA256 of seedb. */
+static BitcoinResult BIP38_decryptECMultiply(
+	struct BitcoinPrivateKey *private_key, const uint8_t *data,
+	const char *passphrase, size_t passphrase_size,
+	struct BitcoinScryptPool *scrypt_pool)
+{
+	const uint8_t *owner_entropy = data + BIP38_OWNER_ENTROPY_OFFSET;
+	const int lot_sequence =
+		(data[BIP38_FLAG_OFFSET] & BIP38_FLAG_LOT_SEQUENCE) != 0;
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	const BIGNUM *order = group ? EC_GROUP_get0_order(group) : NULL;
+	struct BitcoinPrivateKey passfactor;
+	struct BitcoinPublicKey passpoint;
+	struct BitcoinSHA256 hash;
+	uint8_t prefactor[BITCOIN_SHA256_SIZE + BIP38_OWNER_ENTROPY_SIZE];
+	uint8_t salt[BIP38_ADDRESS_HASH_SIZE + BIP38_OWNER_ENTROPY_SIZE];
+	uint8_t derived[64], encrypted[BIP38_AES_BLOCK_SIZE];
+	uint8_t decrypted[BIP38_AES_BLOCK_SIZE], seed_b[BIP38_SEED_B_SIZE];
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *a = BN_new(), *b = BN_new();
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	if (!order || !ctx || !a || !b) {
+		result = BIP38_fail(__func__);
+	}
+
+	/* with lot and sequence numbers, only the first four bytes of the
+	   owner's entropy are salt */
+	if (result == BITCOIN_SUCCESS) {
+		result = Scrypt_derive(prefactor, BITCOIN_SHA256_SIZE,
+			passphrase, passphrase_size, owner_entropy,
+			lot_sequence ? BIP38_OWNER_SALT_LOT_SEQUENCE_SIZE
+				: BIP38_OWNER_ENTROPY_SIZE,
+			BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, scrypt_pool
+		);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		if (lot_sequence) {
+			memcpy(prefactor + BITCOIN_SHA256_SIZE, owner_entropy,
+				BIP38_OWNER_ENTROPY_SIZE);
+			Bitcoin_DoubleSHA256(&hash, prefactor, sizeof(prefactor));
+			memcpy(passfactor.data, hash.data, BITCOIN_PRIVATE_KEY_SIZE);
+		} else {
+			memcpy(passfactor.data, prefactor, BITCOIN_PRIVATE_KEY_SIZE);
+		}
+		passfactor.public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		passfactor.network_type = private_key->network_type;
+		if (!BN_bin2bn(passfactor.data, BITCOIN_PRIVATE_KEY_SIZE, a)) {
+			result = BIP38_fail(__func__);
+		} else if (BN_is_zero(a) || BN_cmp(a, order) >= 0) {
+			/* as likely as a wrong passphrase matching the address hash */
+			result = BITCOIN_ERROR_CHECKSUM_FAILURE;
+		}
+	}
+	if (result == BITCOIN_SUCCESS) {
+		result = Bitcoin_MakePublicKeyFromPrivateKey(&passpoint, &passfactor);
+	}
+
+	if (result == BITCOIN_SUCCESS) {
+		memcpy(salt, data + BIP38_ADDRESS_HASH_OFFSET,
+			BIP38_ADDRESS_HASH_SIZE);
+		memcpy(salt + BIP38_ADDRESS_HASH_SIZE, owner_entropy,
+			BIP38_OWNER_ENTROPY_SIZE);
+		result = Scrypt_derive(derived, sizeof(derived),
+			passpoint.data, BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE,
+			salt, sizeof(salt),
+			BIP38_PASSPOINT_SCRYPT_N, BIP38_PASSPOINT_SCRYPT_R,
+			BIP38_PASSPOINT_SCRYPT_P, scrypt_pool
+		);
+	}
+
+	/* the second block holds the rest of the first block, and the last 8
+	   bytes of seedb */
+	if (result == BITCOIN_SUCCESS) {
+		result = BIP38_aes(decrypted, data + BIP38_ENCRYPTED_PART2_OFFSET,
+			BIP38_AES_BLOCK_SIZE, derived + 32, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		BIP38_xor(decrypted, decrypted, derived + 16, BIP38_AES_BLOCK_SIZE);
+		memcpy(seed_b + 16, decrypted + 8, 8);
+		memcpy(encrypted, data + BIP38_ENCRYPTED_PART1_OFFSET, 8);
+		memcpy(encrypted + 8, decrypted, 8);
+		result = BIP38_aes(decrypted, encrypted, BIP38_AES_BLOCK_SIZE,
+			derived + 32, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		BIP38_xor(seed_b, decrypted, derived, 16);
+		Bitcoin_DoubleSHA256(&hash, seed_b, sizeof(seed_b));
+		if (!BN_bin2bn(hash.data, BITCOIN_SHA256_SIZE, b)
+			|| !BN_mod_mul(a, a, b, order, ctx)
+			|| BN_bn2binpad(a, private_key->data, BITCOIN_PRIVATE_KEY_SIZE) < 0)
+		{
+			result = BIP38_fail(__func__);
+		}
+	}
+
+	BN_clear_free(a);
+	BN_clear_free(b);
+	BN_CTX_free(ctx);
+	Secure_wipe(&passfactor, sizeof(passfactor));
+	Secure_wipe(&hash, sizeof(hash));
+	Secure_wipe(prefactor, sizeof(prefactor));
+	Secure_wipe(derived, sizeof(derived));
+	Secure_wipe(decrypted, sizeof(decrypted));
+	Secure_wipe(seed_b, sizeof(seed_b));
+	return result;
+}
+
+BitcoinResult BIP38_decrypt(struct BitcoinPrivateKey *private_key,
+	const uint8_t *data, const char *passphrase, size_t passphrase_size,
+	const struct BitcoinNetworkType *network_type,
+	struct BitcoinScryptPool *scrypt_pool)
+{
+	uint8_t address_hash[BIP38_ADDRESS_HASH_SIZE];
+	BitcoinResult result;
+
+	private_key->network_type = network_type;
+	private_key->public_key_compression =
+		data[BIP38_FLAG_OFFSET] & BIP38_FLAG_COMPRESSED ?
+		BITCOIN_PUBLIC_KEY_COMPRESSED : BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+	if (data[1] == BIP38_TYPE_EC_MULTIPLY) {
+		result = BIP38_decryptECMultiply(private_key, data,
+			passphrase, passphrase_size, scrypt_pool);
+	} else {
+		result = BIP38_decryptNonECMultiply(private_key, data,
+			passphrase, passphrase_size, scrypt_pool);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		result = BIP38_addressHash(address_hash, private_key);
+	}
+	if (result == BITCOIN_SUCCESS && memcmp(address_hash,
+		data + BIP38_ADDRESS_HASH_OFFSET, BIP38_ADDRESS_HASH_SIZE) != 0)
+	{
+		result = BITCOIN_ERROR_CHECKSUM_FAILURE;
+	}
+	if (result != BITCOIN_SUCCESS) {
+		Secure_wipe(private_key->data, BITCOIN_PRIVATE_KEY_SIZE);
+	}
+	return result;
+}
+
+BitcoinResult BIP38_encrypt(uint8_t *data,
+	const struct BitcoinPrivateKey *private_key,
+	const char *passphrase, size_t passphrase_size,
+	struct BitcoinScryptPool *scrypt_pool)
+{
+	uint8_t derived[64];
+	uint8_t block[BITCOIN_PRIVATE_KEY_SIZE];
+	BitcoinResult result;
+
+	data[0] = BIP38_VERSION;
+	data[1] = BIP38_TYPE_NON_EC_MULTIPLY;
+	data[BIP38_FLAG_OFFSET] = BIP38_FLAG_NON_EC_MULTIPLY;
+	switch (private_key->public_key_compression) {
+		case BITCOIN_PUBLIC_KEY_COMPRESSED :
+			data[BIP38_FLAG_OFFSET] |= BIP38_FLAG_COMPRESSED;
+			break;
+		case BITCOIN_PUBLIC_KEY_UNCOMPRESSED :
+			break;
+		default :
+			applog(APPLOG_ERROR, __func__,
+				"Public key compression flag must be set using"
+				" --public-key-compression (compressed | uncompressed)"
+				" when importing raw private keys."
+			);
+			return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	result = BIP38_addressHash(data + BIP38_ADDRESS_HASH_OFFSET, private_key);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	result = Scrypt_derive(derived, sizeof(derived),
+		passphrase, passphrase_size,
+		data + BIP38_ADDRESS_HASH_OFFSET, BIP38_ADDRESS_HASH_SIZE,
+		BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, scrypt_pool
+	);
+	if (result == BITCOIN_SUCCESS) {
+		BIP38_xor(block, private_key->data, derived, sizeof(block));
+		result = BIP38_aes(data + BIP38_ENCRYPTED_OFFSET, block,
+			sizeof(block), derived + 32, 1);
+	}
+	Secure_wipe(derived, sizeof(derived));
+	Secure_wipe(block, sizeof(block));
+	return result;
+}
+
+/* Take the next line of the file, returning 0 if there are none left or
+   another thread has found the passphrase. */
+static int BIP38_take(struct BIP38Recovery *recovery, char *passphrase,
+	uint64_t *line)
+{
+	size_t size;
+	int taken = 0;
+
+	pthread_mutex_lock(&recovery->mutex);
+	if (!recovery->done && fgets(passphrase, BIP38_MAX_PASSPHRASE_SIZE,
+		recovery->file))
+	{
+		size = strlen(passphrase);
+		recovery->offset += size;
+		*line = ++recovery->line;
+		while (size > 0 && (passphrase[size - 1] == '\n'
+			|| passphrase[size - 1] == '\r'))
+		{
+			passphrase[--size] = '\0';
+		}
+		taken = 1;
+	}
+	pthread_mutex_unlock(&recovery->mutex);
+	return taken;
+}
+
+static void BIP38_thread(void *arg, unsigned thread_index)
+{
+	struct BIP38Recovery *recovery = arg;
+	const struct BitcoinBIP38RecoveryOptions *options = recovery->options;
+	struct BitcoinPrivateKey private_key;
+	char passphrase[BIP38_MAX_PASSPHRASE_SIZE];
+	BitcoinResult result = BITCOIN_SUCCESS;
+	uint64_t line;
+
+	(void)thread_index;
+	while (result == BITCOIN_SUCCESS
+		&& BIP38_take(recovery, passphrase, &line))
+	{
+		result = BIP38_decrypt(&private_key, recovery->data,
+			passphrase, strlen(passphrase), options->network_type,
+			options->scrypt_pool
+		);
+
+		pthread_mutex_lock(&recovery->mutex);
+		if (result == BITCOIN_SUCCESS && !recovery->found) {
+			recovery->found = 1;
+			recovery->private_key = private_key;
+			recovery->found_line = line;
+			memcpy(recovery->passphrase, passphrase, sizeof(passphrase));
+		}
+		if (result == BITCOIN_SUCCESS) {
+			recovery->done = 1;
+		}
+		Progress_update(&recovery->progress, ++recovery->progress.count,
+			recovery->offset);
+		pthread_mutex_unlock(&recovery->mutex);
+
+		if (result == BITCOIN_ERROR_CHECKSUM_FAILURE) {
+			result = BITCOIN_SUCCESS;
+		}
+	}
+
+	if (result != BITCOIN_SUCCESS) {
+		pthread_mutex_lock(&recovery->mutex);
+		recovery->result = result;
+		recovery->done = 1;
+		pthread_mutex_unlock(&recovery->mutex);
+	}
+	Secure_wipe(&private_key, sizeof(private_key));
+	Secure_wipe(passphrase, sizeof(passphrase));
+
+	/* messages from this thread come out before the summary */
+	applog_flush();
+}
+
+BitcoinResult BIP38_recover(struct BitcoinPrivateKey *private_key,
+	const uint8_t *data, const struct BitcoinBIP38RecoveryOptions *options)
+{
+	struct BIP38Recovery *recovery = calloc(1, sizeof(*recovery));
+	struct ParallelGroup group;
+	struct stat st;
+	BitcoinResult result;
+	unsigned i, tasks = options->pool && options->threads > 1 ?
+		options->threads : 1;
+
+	if (!recovery) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate recovery");
+		return BITCOIN_ERROR;
+	}
+	recovery->file = fopen(options->filename, "rb");
+	if (!recovery->file) {
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			options->filename, strerror(errno)
+		);
+		free(recovery);
+		return BITCOIN_ERROR_FILE;
+	}
+	recovery->data = data;
+	recovery->options = options;
+	recovery->result = BITCOIN_SUCCESS;
+	Progress_init(&recovery->progress, stderr, "passphrases",
+		options->progress_interval);
+	if (fstat(fileno(recovery->file), &st) == 0 && S_ISREG(st.st_mode)) {
+		recovery->progress.total = (uint64_t)st.st_size;
+	}
+
+	pthread_mutex_init(&recovery->mutex, NULL);
+	group.pending = 0;
+	for (i = 0; i < tasks; i++) {
+		if (i + 1 == tasks || ParallelPool_submit(options->pool, &group,
+			BIP38_thread, recovery) != BITCOIN_SUCCESS)
+		{
+			/* the calling thread takes its share too */
+			BIP38_thread(recovery, 0);
+			break;
+		}
+	}
+	if (options->pool) {
+		ParallelPool_wait(options->pool, &group);
+	}
+	pthread_mutex_destroy(&recovery->mutex);
+
+	if (recovery->progress.interval) {
+		Progress_report(&recovery->progress);
+	}
+	result = recovery->result;
+	if (result == BITCOIN_SUCCESS && !recovery->found
+		&& ferror(recovery->file))
+	{
+		applog(APPLOG_ERROR, __func__, "Failed to read file [%s]",
+			options->filename
+		);
+		result = BITCOIN_ERROR_FILE;
+	}
+
+	if (result == BITCOIN_SUCCESS && recovery->found) {
+		*private_key = recovery->private_key;
+		applog(APPLOG_NOTICE, __func__,
+			"Passphrase has been found on line %llu of %s, after trying %llu"
+			" passphrases.",
+			(unsigned long long)recovery->found_line, options->filename,
+			(unsigned long long)recovery->progress.count
+		);
+		applog(APPLOG_NOTICE, __func__, "passphrase: %s",
+			recovery->passphrase);
+	} else if (result == BITCOIN_SUCCESS) {
+		applog(APPLOG_ERROR, __func__,
+			"None of the %llu passphrases in %s decrypts the key.",
+			(unsigned long long)recovery->line, options->filename
+		);
+		result = BITCOIN_ERROR_NOT_FOUND;
+	}
+
+	fclose(recovery->file);
+	Secure_wipe(recovery, sizeof(*recovery));
+	free(recovery);
+	return result;
+}
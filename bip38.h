@@ -0,0 +1,132 @@
+#ifndef BITCOIN_INCLUDE_BIP38_H
+#define BITCOIN_INCLUDE_BIP38_H
+
+/** @file bip38.h
+ *  @brief BIP38 passphrase protected private keys, the 58 character
+ *         Base58Check strings starting "6P".
+ *
+ *  A key is encrypted with AES-256 under a key made from the passphrase by
+ *  scrypt(N=16384, r=8, p=8), which takes a large fraction of a second and
+ *  16MB of memory on purpose.  There is no checksum of the key itself, just
+ *  the first four bytes of the double SHA256 of its address, which a wrong
+ *  passphrase fails to match all but once in four billion times.  Keys made
+ *  with the "EC multiply" method from an intermediate code, such as those of
+ *  printed wallets whose printer never knew the key, can be decrypted too.
+ *
+ *  https://github.com/bitcoin/bips/blob/master/bip-0038.mediawiki
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "keys.h" /* struct BitcoinPrivateKey */
+#include "result.h" /* BitcoinResult */
+
+struct BitcoinScryptPool;
+struct ParallelPool;
+
+/* decoded size, less the Base58Check checksum */
+#define BIP38_SIZE 39
+
+/* the two prefix bytes which make every key start with "6P", the second
+   saying which method encrypted it */
+#define BIP38_VERSION 0x01
+#define BIP38_TYPE_NON_EC_MULTIPLY 0x42
+#define BIP38_TYPE_EC_MULTIPLY 0x43
+
+/* flag byte */
+#define BIP38_FLAG_NON_EC_MULTIPLY 0xc0
+#define BIP38_FLAG_COMPRESSED 0x20
+#define BIP38_FLAG_LOT_SEQUENCE 0x04
+
+/* scrypt parameters of the passphrase */
+#define BIP38_SCRYPT_N 16384
+#define BIP38_SCRYPT_R 8
+#define BIP38_SCRYPT_P 8
+
+/** Options for BIP38_recover(). */
+struct BitcoinBIP38RecoveryOptions {
+	/* file of candidate passphrases, one per line */
+	const char *filename;
+
+	/* network whose address the key's address hash is of */
+	const struct BitcoinNetworkType *network_type;
+
+	/* scratch memory for scrypt, or NULL to allocate it each time */
+	struct BitcoinScryptPool *scrypt_pool;
+
+	/* workers to share the candidates with, or NULL to try them on the
+	   calling thread, and how many of them to use */
+	struct ParallelPool *pool;
+	unsigned threads;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+};
+
+/** @brief Check that 'data' is a BIP38 key, of either method.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if it is.
+ *          BITCOIN_ERROR_INVALID_FORMAT if not, having logged why.
+ */
+BitcoinResult BIP38_check(const uint8_t *data, size_t size);
+
+/** @brief Decrypt a BIP38 key checked by BIP38_check(), and check it
+ *         against the hash of its address on 'network_type'.  The
+ *         passphrase is used as given, so should be NFC normalised if it's
+ *         not ASCII.
+ *
+ *  @param[out] private_key The key, with its network type and compression.
+ *  @param[in] scrypt_pool Scratch memory for scrypt, or NULL.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_CHECKSUM_FAILURE if the key doesn't match its
+ *          address hash, which is nearly always a wrong passphrase, or else
+ *          the wrong network.  Nothing is logged, so that candidates can be
+ *          tried quietly.
+ *          BITCOIN_ERROR or BITCOIN_ERROR_LIBRARY_FAILURE if out of memory
+ *          or OpenSSL failed.
+ */
+BitcoinResult BIP38_decrypt(struct BitcoinPrivateKey *private_key,
+	const uint8_t *data, const char *passphrase, size_t passphrase_size,
+	const struct BitcoinNetworkType *network_type,
+	struct BitcoinScryptPool *scrypt_pool
+);
+
+/** @brief Encrypt a private key by the non-EC-multiply method, with its
+ *         network type and compression, into BIP38_SIZE bytes of 'data'
+ *         to be Base58Check encoded.  Each key costs one scrypt, with its
+ *         scratch memory from 'scrypt_pool' if it's not NULL.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if the key's compression isn't
+ *          known.
+ *          BITCOIN_ERROR or BITCOIN_ERROR_LIBRARY_FAILURE if out of memory
+ *          or OpenSSL failed.
+ */
+BitcoinResult BIP38_encrypt(uint8_t *data,
+	const struct BitcoinPrivateKey *private_key,
+	const char *passphrase, size_t passphrase_size,
+	struct BitcoinScryptPool *scrypt_pool
+);
+
+/** @brief Try each passphrase in a file until one decrypts a BIP38 key
+ *         checked by BIP38_check(), sharing them between threads.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if one did.
+ *          BITCOIN_ERROR_NOT_FOUND if none did.
+ *          BITCOIN_ERROR_FILE if the file couldn't be read.
+ *          BITCOIN_ERROR or BITCOIN_ERROR_LIBRARY_FAILURE if out of memory
+ *          or OpenSSL failed.
+ */
+BitcoinResult BIP38_recover(struct BitcoinPrivateKey *private_key,
+	const uint8_t *data, const struct BitcoinBIP38RecoveryOptions *options
+);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BITCOIN_INCLUDE_BIP39_H
+#define BITCOIN_INCLUDE_BIP39_H
+
+/** @file bip39.h
+ *  @brief BIP39 mnemonic sentences: checking them against the English
+ *         wordlist and their checksum, and making their seeds.
+ *
+ *  A mnemonic of 12 to 24 words is 11 bits a word of entropy followed by
+ *  the first bits of its SHA256 hash.  Its seed is 2048 iterations of
+ *  PBKDF2-HMAC-SHA512 of the sentence, salted with "mnemonic" and an
+ *  optional passphrase, which is the slow part of turning a mnemonic into
+ *  keys, so seeds are made several at a time where the processor allows.
+ *
+ *  https://github.com/bitcoin/bips/blob/master/bip-0039.mediawiki
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "result.h" /* BitcoinResult */
+
+#define BIP39_SEED_SIZE 64
+#define BIP39_ITERATIONS 2048
+
+/* number of words in the wordlist, each standing for 11 bits */
+#define BIP39_WORDLIST_SIZE 2048
+#define BIP39_BITS_PER_WORD 11
+#define BIP39_MAX_WORD_SIZE 8
+
+#define BIP39_MIN_WORDS 12
+#define BIP39_MAX_WORDS 24
+
+/* longest sentence, words and the spaces after all but the last */
+#define BIP39_MAX_MNEMONIC_SIZE (BIP39_MAX_WORDS * (BIP39_MAX_WORD_SIZE + 1))
+
+struct BitcoinBIP39Mnemonic {
+	/* words separated by single spaces, as the seed is made from */
+	char text[BIP39_MAX_MNEMONIC_SIZE];
+	size_t size;
+
+	uint8_t seed[BIP39_SEED_SIZE];
+};
+
+/** @brief The word of the English wordlist standing for 'index'.
+ */
+const char *BIP39_word(unsigned index);
+
+/** @brief Index of a word in the English wordlist, or -1 if it isn't one.
+ */
+int BIP39_findWord(const char *word, size_t size);
+
+/** @brief Check that 'text' is a mnemonic of 12, 15, 18, 21 or 24 words
+ *         from the English wordlist with a valid checksum, and keep it with
+ *         single spaces between words.  Words may be separated by any
+ *         whitespace, and upper case letters are taken as lower case.
+ *
+ *  @param[in] report Log why 'text' isn't a mnemonic if not 0.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if it has the wrong number of words
+ *          or a word not on the list.
+ *          BITCOIN_ERROR_CHECKSUM_FAILURE if the checksum is wrong.
+ */
+BitcoinResult BIP39_parse(struct BitcoinBIP39Mnemonic *mnemonic,
+	const char *text, size_t size, int report
+);
+
+/** @brief Make the seeds of 'count' mnemonics with 'passphrase', which
+ *         is used as given, so should be NFKD normalised if it's not ASCII.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR if out of memory.
+ */
+BitcoinResult BIP39_makeSeeds(struct BitcoinBIP39Mnemonic *mnemonics,
+	size_t count, const char *passphrase
+);
+
+#endif
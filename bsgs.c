@@ -0,0 +1,657 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads, mmap, ftruncate */
+
+#include "bsgs.h"
+#include "applog.h"
+#include "ecbatch.h"
+#include "parallel.h"
+#include "progress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+/* points made affine together, sharing one field inversion */
+#define BSGS_BATCH_SIZE 1024
+
+/* steps taken from the job at a time */
+#define BSGS_CHUNK_SIZE (16 * BSGS_BATCH_SIZE)
+
+/* tasks submitted to the pool for each job, each taking chunks until there
+   are none left, enough to keep any likely number of workers busy */
+#define BSGS_TASKS 256
+
+/* smallest table made, in entries */
+#define BSGS_MIN_CAPACITY 1024
+
+static const char bsgs_magic[8] = { 'B', 'T', 'B', 'S', 'G', 'S', '0', '1' };
+
+/* start of a table file, followed by 'capacity' entries */
+struct BSGSHeader {
+	char magic[8];
+	uint64_t baby_steps;
+	uint64_t capacity;
+};
+
+struct BitcoinBSGSTable {
+	/* 32 bits of x above the index of j, 0 for an empty slot */
+	uint64_t *entries;
+	uint64_t capacity, baby_steps;
+
+	/* mapping of the table file, or NULL if 'entries' was allocated */
+	void *map;
+	size_t map_size;
+};
+
+enum BSGSJobType {
+	BSGS_JOB_BABY_STEPS,
+	BSGS_JOB_GIANT_STEPS
+};
+
+struct BSGSJob {
+	enum BSGSJobType type;
+	struct BitcoinBSGSTable *table;
+	const EC_GROUP *group;
+	const BIGNUM *order;
+
+	/* giant steps: find k with k*G = 'target', k = 'base' + i*'stride' +/- j,
+	   'first' being the point of i = 0 and 'step' adding one giant step */
+	const EC_POINT *target, *first, *step;
+	const BIGNUM *base, *stride;
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* next step to hand out, and the step after the last */
+	uint64_t next, end;
+
+	int done;
+	BitcoinResult result;
+	BIGNUM *found;
+
+	struct BitcoinProgress progress;
+};
+
+static uint64_t BSGS_fingerprint(const uint8_t *x)
+{
+	return ECBatch_load64(x + 20) >> 32;
+}
+
+static uint64_t BSGS_slot(const struct BitcoinBSGSTable *table, const uint8_t *x)
+{
+	return ECBatch_load64(x + 24) & (table->capacity - 1);
+}
+
+static void BSGS_insert(struct BitcoinBSGSTable *table, const uint8_t *x,
+	uint64_t j)
+{
+	uint64_t slot = BSGS_slot(table, x);
+
+	while (table->entries[slot]) {
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	table->entries[slot] = (BSGS_fingerprint(x) << 32) | j;
+}
+
+static void BSGS_fail(struct BSGSJob *job, const char *function_name)
+{
+	applog(APPLOG_ERROR, function_name, "OpenSSL failed: %s",
+		ERR_error_string(ERR_get_error(), NULL)
+	);
+	pthread_mutex_lock(&job->mutex);
+	job->result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	job->done = 1;
+	pthread_mutex_unlock(&job->mutex);
+}
+
+/* Take the next chunk of steps, returning how many, or 0 when done. */
+static unsigned BSGS_take(struct BSGSJob *job, uint64_t *first)
+{
+	unsigned count = 0;
+
+	pthread_mutex_lock(&job->mutex);
+	if (!job->done && job->next < job->end) {
+		*first = job->next;
+		count = job->end - job->next < BSGS_CHUNK_SIZE ?
+			(unsigned)(job->end - job->next) : BSGS_CHUNK_SIZE;
+		job->next += count;
+	}
+	pthread_mutex_unlock(&job->mutex);
+
+	return count;
+}
+
+static void BSGS_progress(struct BSGSJob *job, unsigned count)
+{
+	pthread_mutex_lock(&job->mutex);
+	job->progress.count += count;
+	Progress_update(&job->progress, job->progress.count, job->progress.count);
+	pthread_mutex_unlock(&job->mutex);
+}
+
+/* Check whether k = base + i*stride + sign*j is the key, and keep it if so. */
+static int BSGS_check(struct BSGSJob *job, BN_CTX *ctx, EC_POINT *point,
+	uint64_t i, uint64_t j, int sign)
+{
+	BIGNUM *k = BN_CTX_get(ctx), *v = BN_CTX_get(ctx);
+	int ok;
+
+	ok = k && v
+		&& ECBatch_setUint64(v, i)
+		&& BN_mul(k, v, job->stride, ctx)
+		&& BN_add(k, k, job->base)
+		&& ECBatch_setUint64(v, j)
+		&& (sign > 0 ? BN_add(k, k, v) : BN_sub(k, k, v))
+		&& BN_nnmod(k, k, job->order, ctx);
+	if (!ok) {
+		return 0;
+	}
+	if (BN_is_zero(k)
+		|| !EC_POINT_mul(job->group, point, k, NULL, NULL, ctx)
+		|| EC_POINT_cmp(job->group, point, job->target, ctx) != 0)
+	{
+		/* a false match on the truncated x coordinate */
+		return 1;
+	}
+
+	pthread_mutex_lock(&job->mutex);
+	if (!job->found) {
+		job->found = BN_dup(k);
+	}
+	job->done = 1;
+	pthread_mutex_unlock(&job->mutex);
+	return 1;
+}
+
+/* Look up the x coordinate of giant step i in the baby steps. */
+static int BSGS_lookup(struct BSGSJob *job, BN_CTX *ctx, EC_POINT *scratch,
+	const uint8_t *x, uint64_t i)
+{
+	const struct BitcoinBSGSTable *table = job->table;
+	const uint64_t fingerprint = BSGS_fingerprint(x);
+	uint64_t slot = BSGS_slot(table, x), entry;
+
+	while ((entry = table->entries[slot]) != 0) {
+		if (entry >> 32 == fingerprint) {
+			uint64_t j = entry & 0xffffffff;
+			int ok;
+
+			BN_CTX_start(ctx);
+			ok = BSGS_check(job, ctx, scratch, i, j, 1)
+				&& BSGS_check(job, ctx, scratch, i, j, -1);
+			BN_CTX_end(ctx);
+			if (!ok) {
+				return 0;
+			}
+		}
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	return 1;
+}
+
+static void BSGS_worker(void *arg, unsigned thread_index)
+{
+	struct BSGSJob *job = arg;
+	const EC_GROUP *group = job->group;
+	EC_POINT *points[BSGS_BATCH_SIZE], *scratch = EC_POINT_new(group);
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *scalar = BN_new(), *x = BN_new();
+	uint8_t x_bytes[BSGS_BATCH_SIZE][ECBATCH_FIELD_SIZE];
+	uint64_t first;
+	unsigned i, count, chunk, batch;
+	int ok = ctx && scalar && x && scratch;
+
+	for (i = 0; i < BSGS_BATCH_SIZE; i++) {
+		points[i] = EC_POINT_new(group);
+		ok = ok && points[i];
+	}
+
+	while (ok && (chunk = BSGS_take(job, &first)) > 0) {
+		/* the first point of the chunk, baby step j = first + 1, or giant
+		   step i = first */
+		if (job->type == BSGS_JOB_BABY_STEPS) {
+			ok = ECBatch_setUint64(scalar, first + 1)
+				&& EC_POINT_mul(group, points[0], scalar, NULL, NULL, ctx);
+		} else {
+			ok = ECBatch_setUint64(scalar, first)
+				&& EC_POINT_mul(group, points[0], NULL, job->step, scalar, ctx)
+				&& EC_POINT_add(group, points[0], points[0], job->first, ctx);
+		}
+
+		for (batch = 0; ok && batch < chunk; batch += count) {
+			const EC_POINT *step = job->type == BSGS_JOB_BABY_STEPS ?
+				EC_GROUP_get0_generator(group) : job->step;
+
+			count = chunk - batch < BSGS_BATCH_SIZE ?
+				chunk - batch : BSGS_BATCH_SIZE;
+			if (batch > 0) {
+				/* carry on from the last point of the previous batch */
+				ok = EC_POINT_add(group, points[0], points[BSGS_BATCH_SIZE - 1],
+					step, ctx);
+			}
+			ok = ok && ECBatch_walk(group, points, count, step, ctx)
+				&& ECBatch_getX(group, points, count, x_bytes, x, ctx);
+			for (i = 0; ok && i < count; i++) {
+				if (job->type == BSGS_JOB_GIANT_STEPS
+					&& EC_POINT_is_at_infinity(group, points[i]))
+				{
+					/* the key is exactly base + i*stride, with j = 0 */
+					BN_CTX_start(ctx);
+					ok = BSGS_check(job, ctx, scratch, first + batch + i, 0, 1);
+					BN_CTX_end(ctx);
+				}
+			}
+			if (!ok) {
+				break;
+			}
+
+			if (job->type == BSGS_JOB_BABY_STEPS) {
+				pthread_mutex_lock(&job->mutex);
+				for (i = 0; i < count; i++) {
+					BSGS_insert(job->table, x_bytes[i], first + batch + i + 1);
+				}
+				pthread_mutex_unlock(&job->mutex);
+			} else {
+				for (i = 0; ok && i < count; i++) {
+					if (!EC_POINT_is_at_infinity(group, points[i])) {
+						ok = BSGS_lookup(job, ctx, scratch, x_bytes[i],
+							first + batch + i);
+					}
+				}
+			}
+		}
+		if (ok) {
+			BSGS_progress(job, chunk);
+		}
+	}
+	if (!ok) {
+		BSGS_fail(job, __func__);
+	}
+
+	for (i = 0; i < BSGS_BATCH_SIZE; i++) {
+		EC_POINT_free(points[i]);
+	}
+	EC_POINT_free(scratch);
+	BN_free(scalar);
+	BN_free(x);
+	BN_CTX_free(ctx);
+	applog_flush();
+}
+
+/* Run every step of a job on the pool, or here if there isn't one. */
+static BitcoinResult BSGS_run(struct BSGSJob *job, uint64_t steps,
+	const char *unit, const struct BitcoinBSGSOptions *options)
+{
+	struct ParallelGroup group;
+	unsigned i, queued = 0;
+
+	job->next = 0;
+	job->end = steps;
+	job->done = 0;
+	job->result = BITCOIN_SUCCESS;
+	job->found = NULL;
+	Progress_init(&job->progress, stderr, unit, options->progress_interval);
+	job->progress.total = steps;
+	pthread_mutex_init(&job->mutex, NULL);
+
+	if (options->pool) {
+		group.pending = 0;
+		for (i = 0; i < BSGS_TASKS; i++) {
+			if (ParallelPool_submit(options->pool, &group, BSGS_worker, job)
+				!= BITCOIN_SUCCESS)
+			{
+				/* the tasks already queued will do the rest */
+				break;
+			}
+			queued++;
+		}
+		ParallelPool_wait(options->pool, &group);
+	}
+	if (!queued) {
+		BSGS_worker(job, 0);
+	}
+
+	pthread_mutex_destroy(&job->mutex);
+	if (job->progress.interval) {
+		Progress_report(&job->progress);
+	}
+	return job->result;
+}
+
+/* Number of baby steps which would make the baby and giant steps of
+   'range' about the same amount of work, sqrt(N/2). */
+static double BSGS_balancedSteps(const struct BitcoinKeyRange *range)
+{
+	double start = 0, end = 0;
+	unsigned i;
+
+	for (i = 0; i < BITCOIN_PRIVATE_KEY_SIZE; i++) {
+		start = start * 256 + range->start[i];
+		end = end * 256 + range->end[i];
+	}
+	return ceil(sqrt((end - start + 1) / 2));
+}
+
+static BitcoinResult BSGS_mapFile(struct BitcoinBSGSTable *table,
+	const char *filename, int fd)
+{
+	struct stat st;
+	const struct BSGSHeader *header;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+		applog(APPLOG_ERROR, __func__,
+			"Baby-step table file \"%s\" is too small", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+	table->map_size = st.st_size;
+	table->map = mmap(NULL, table->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (table->map == MAP_FAILED) {
+		table->map = NULL;
+		applog(APPLOG_ERROR, __func__, "Failed to map file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+
+	header = table->map;
+	if (memcmp(header->magic, bsgs_magic, sizeof(bsgs_magic)) != 0
+		|| header->capacity < BSGS_MIN_CAPACITY
+		|| (header->capacity & (header->capacity - 1)) != 0
+		|| header->baby_steps == 0
+		|| header->baby_steps >= header->capacity
+		|| header->capacity > (table->map_size - sizeof(*header)) / 8)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" isn't a baby-step table made by this version", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+	table->capacity = header->capacity;
+	table->baby_steps = header->baby_steps;
+	table->entries = (uint64_t *)(header + 1);
+
+	applog(APPLOG_NOTICE, __func__,
+		"Using %llu baby steps from \"%s\"",
+		(unsigned long long)table->baby_steps, filename
+	);
+	return BITCOIN_SUCCESS;
+}
+
+static BitcoinResult BSGS_build(struct BitcoinBSGSTable *table,
+	const struct BitcoinBSGSOptions *options)
+{
+	struct BSGSJob job;
+
+	memset(&job, 0, sizeof(job));
+	job.type = BSGS_JOB_BABY_STEPS;
+	job.table = table;
+	job.group = Bitcoin_GetSecp256k1Group();
+	if (!job.group) {
+		return BITCOIN_ERROR_LIBRARY_FAILURE;
+	}
+
+	/* steps are numbered from 0, baby steps from j = 1 */
+	return BSGS_run(&job, table->baby_steps, "baby steps", options);
+}
+
+BitcoinResult BSGS_createTable(struct BitcoinBSGSTable **table_out,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinBSGSOptions *options)
+{
+	struct BitcoinBSGSTable *table = calloc(1, sizeof(*table));
+	struct BSGSHeader *header = NULL;
+	double balanced = BSGS_balancedSteps(range);
+	uint64_t capacity = BSGS_MIN_CAPACITY;
+	BitcoinResult result;
+	int fd = -1;
+
+	*table_out = NULL;
+	if (!table) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate baby-step table");
+		return BITCOIN_ERROR;
+	}
+
+	if (options->filename) {
+		fd = open(options->filename, O_RDONLY);
+		if (fd >= 0) {
+			result = BSGS_mapFile(table, options->filename, fd);
+			close(fd);
+			if (result != BITCOIN_SUCCESS) {
+				BSGS_destroyTable(table);
+				return result;
+			}
+			*table_out = table;
+			return BITCOIN_SUCCESS;
+		}
+	}
+
+	/* at most half full, so lookups which miss stop soon */
+	while (capacity * 2 * sizeof(uint64_t) <= options->memory
+		&& capacity < ((uint64_t)1 << 33)
+		&& capacity < 2 * balanced)
+	{
+		capacity *= 2;
+	}
+	table->capacity = capacity;
+	table->baby_steps = capacity / 2;
+	if ((double)table->baby_steps > balanced) {
+		table->baby_steps = (uint64_t)balanced;
+	}
+	if (table->baby_steps >= ((uint64_t)1 << 32)) {
+		table->baby_steps = ((uint64_t)1 << 32) - 1;
+	}
+	if (table->baby_steps == 0) {
+		table->baby_steps = 1;
+	}
+
+	if (options->filename) {
+		table->map_size = sizeof(*header) + capacity * sizeof(uint64_t);
+		fd = open(options->filename, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd < 0 || ftruncate(fd, table->map_size) != 0) {
+			applog(APPLOG_ERROR, __func__, "Failed to create file [%s] (%s)",
+				options->filename, strerror(errno)
+			);
+			if (fd >= 0) {
+				close(fd);
+				unlink(options->filename);
+			}
+			BSGS_destroyTable(table);
+			return BITCOIN_ERROR_FILE;
+		}
+		table->map = mmap(NULL, table->map_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+		close(fd);
+		if (table->map == MAP_FAILED) {
+			table->map = NULL;
+			applog(APPLOG_ERROR, __func__, "Failed to map file [%s] (%s)",
+				options->filename, strerror(errno)
+			);
+			unlink(options->filename);
+			BSGS_destroyTable(table);
+			return BITCOIN_ERROR_FILE;
+		}
+		header = table->map;
+		table->entries = (uint64_t *)(header + 1);
+	} else {
+		table->entries = calloc(capacity, sizeof(uint64_t));
+		if (!table->entries) {
+			applog(APPLOG_ERROR, __func__,
+				"Failed to allocate %llu bytes of baby steps",
+				(unsigned long long)(capacity * sizeof(uint64_t))
+			);
+			BSGS_destroyTable(table);
+			return BITCOIN_ERROR;
+		}
+	}
+
+	applog(APPLOG_NOTICE, __func__,
+		"Making %llu baby steps (%llu MB)",
+		(unsigned long long)table->baby_steps,
+		(unsigned long long)(capacity * sizeof(uint64_t) >> 20)
+	);
+	result = BSGS_build(table, options);
+
+	if (header) {
+		if (result == BITCOIN_SUCCESS) {
+			/* written last, so a table which wasn't finished isn't used */
+			header->baby_steps = table->baby_steps;
+			header->capacity = table->capacity;
+			memcpy(header->magic, bsgs_magic, sizeof(bsgs_magic));
+			if (msync(table->map, table->map_size, MS_SYNC) != 0) {
+				applog(APPLOG_ERROR, __func__, "Failed to write file [%s] (%s)",
+					options->filename, strerror(errno)
+				);
+				result = BITCOIN_ERROR_FILE;
+			}
+		}
+		if (result != BITCOIN_SUCCESS) {
+			unlink(options->filename);
+		}
+	}
+
+	if (result != BITCOIN_SUCCESS) {
+		BSGS_destroyTable(table);
+		return result;
+	}
+	*table_out = table;
+	return BITCOIN_SUCCESS;
+}
+
+void BSGS_destroyTable(struct BitcoinBSGSTable *table)
+{
+	if (!table) {
+		return;
+	}
+	if (table->map) {
+		munmap(table->map, table->map_size);
+	} else {
+		free(table->entries);
+	}
+	free(table);
+}
+
+BitcoinResult BSGS_solve(const struct BitcoinBSGSTable *table,
+	struct BitcoinPrivateKey *private_key,
+	const struct BitcoinPublicKey *public_key,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinBSGSOptions *options)
+{
+	struct BSGSJob job;
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *order = BN_new(), *start = NULL, *end = NULL, *base = BN_new(),
+		*stride = BN_new(), *steps = BN_new(), *scalar = BN_new();
+	EC_POINT *target = NULL, *first = NULL, *step = NULL;
+	BitcoinResult result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	uint64_t giant_steps;
+
+	memset(&job, 0, sizeof(job));
+	if (!group || !ctx || !order || !base || !stride || !steps || !scalar) {
+		goto done;
+	}
+	target = EC_POINT_new(group);
+	first = EC_POINT_new(group);
+	step = EC_POINT_new(group);
+	start = BN_bin2bn(range->start, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	end = BN_bin2bn(range->end, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	if (!target || !first || !step || !start || !end
+		|| !EC_GROUP_get_order(group, order, ctx))
+	{
+		goto done;
+	}
+
+	if (!EC_POINT_oct2point(group, target, public_key->data,
+		BitcoinPublicKey_GetSize(public_key), ctx))
+	{
+		applog(APPLOG_ERROR, __func__, "Public key is not a point on the curve");
+		result = BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+		goto done;
+	}
+
+	/* key = start + m + i*(2m+1) +/- j, with j*G from the baby steps, and
+	   i*(2m+1) giant steps from target - (start + m)*G */
+	if (!ECBatch_setUint64(base, table->baby_steps)
+		|| !BN_add(base, base, start)
+		|| !ECBatch_setUint64(stride, table->baby_steps * 2 + 1)
+		|| !BN_sub(steps, end, start)
+		|| !BN_add_word(steps, 1)
+		|| !BN_add(steps, steps, stride)
+		|| !BN_sub_word(steps, 1)
+		|| !BN_div(steps, NULL, steps, stride, ctx))
+	{
+		goto done;
+	}
+	if (BN_num_bits(steps) > 62) {
+		applog(APPLOG_ERROR, __func__,
+			"The range is too large for %llu baby steps",
+			(unsigned long long)table->baby_steps
+		);
+		result = BITCOIN_ERROR_INVALID_FORMAT;
+		goto done;
+	}
+	giant_steps = ECBatch_getUint64(steps);
+
+	/* first = target - base*G, step = -stride*G */
+	if (!BN_sub(scalar, order, base)
+		|| !BN_nnmod(scalar, scalar, order, ctx)
+		|| !EC_POINT_mul(group, first, scalar, target, BN_value_one(), ctx)
+		|| !BN_sub(scalar, order, stride)
+		|| !EC_POINT_mul(group, step, scalar, NULL, NULL, ctx))
+	{
+		goto done;
+	}
+
+	job.type = BSGS_JOB_GIANT_STEPS;
+	job.table = (struct BitcoinBSGSTable *)table;
+	job.group = group;
+	job.order = order;
+	job.target = target;
+	job.first = first;
+	job.step = step;
+	job.base = base;
+	job.stride = stride;
+
+	result = BSGS_run(&job, giant_steps, "giant steps", options);
+	if (result == BITCOIN_SUCCESS) {
+		if (!job.found) {
+			result = BITCOIN_ERROR_NOT_FOUND;
+		} else if (BN_bn2binpad(job.found, private_key->data,
+			BITCOIN_PRIVATE_KEY_SIZE) < 0)
+		{
+			result = BITCOIN_ERROR_LIBRARY_FAILURE;
+		} else {
+			private_key->public_key_compression = public_key->compression;
+			private_key->network_type = NULL;
+		}
+	}
+	BN_clear_free(job.found);
+
+done:
+	if (result == BITCOIN_ERROR_LIBRARY_FAILURE) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+	EC_POINT_free(target);
+	EC_POINT_free(first);
+	EC_POINT_free(step);
+	BN_free(order);
+	BN_free(start);
+	BN_free(end);
+	BN_free(base);
+	BN_free(stride);
+	BN_free(steps);
+	BN_free(scalar);
+	BN_CTX_free(ctx);
+	return result;
+}
@@ -0,0 +1,86 @@
+#ifndef BITCOIN_INCLUDE_BSGS_H
+#define BITCOIN_INCLUDE_BSGS_H
+
+/** @file bsgs.h
+ *  @brief Baby-step giant-step discrete log, to find the private key of a
+ *         public key when the key is known to be in a small range.
+ *
+ *  The baby steps are a table of x coordinates of j*G for j from 1 to m.
+ *  Since j*G and -j*G share x, each lookup matches 2m+1 keys, so giant
+ *  steps of 2m+1 cover a range of N keys in N/(2m+1) steps.
+ *
+ *  The table holds only 32 bits of each x coordinate, with the slot chosen
+ *  by 64 more bits, so each entry is 8 bytes.  A match is checked with a
+ *  full point multiplication before it is believed.  The table doesn't
+ *  depend on the public key or the range, so it can be kept in a file and
+ *  memory-mapped by later runs.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stdint.h> /* uint64_t */
+
+#include "keys.h" /* struct BitcoinPrivateKey, struct BitcoinPublicKey */
+#include "result.h" /* BitcoinResult */
+#include "search.h" /* struct BitcoinKeyRange */
+
+struct ParallelPool;
+
+/** Baby steps, opaque */
+struct BitcoinBSGSTable;
+
+struct BitcoinBSGSOptions {
+	/* most bytes the table may use */
+	uint64_t memory;
+
+	/* file to map the table from, or to save it to if the file doesn't
+	   exist yet, NULL to keep it in memory */
+	const char *filename;
+
+	/* workers to share the steps between, NULL to run them all here */
+	struct ParallelPool *pool;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+};
+
+/** @brief Make a table of baby steps suited to searching 'range', as large
+ *         as 'options->memory' allows, or map an existing one from
+ *         'options->filename'.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_FILE if the table file can't be read or written,
+ *          or wasn't made by this version.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult BSGS_createTable(struct BitcoinBSGSTable **table,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinBSGSOptions *options
+);
+
+/** @brief Free or unmap the table. */
+void BSGS_destroyTable(struct BitcoinBSGSTable *table);
+
+/** @brief Find the private key of 'public_key' in 'range'.
+ *
+ *  The private key found has the compression of the public key, and no
+ *  network type.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if the key was found.
+ *          BITCOIN_ERROR_NOT_FOUND if it isn't in the range.
+ *          BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT if the public key isn't
+ *          a point on the curve.
+ *          BITCOIN_ERROR_INVALID_FORMAT if the range needs more than 2^62
+ *          giant steps with this table.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult BSGS_solve(const struct BitcoinBSGSTable *table,
+	struct BitcoinPrivateKey *private_key,
+	const struct BitcoinPublicKey *public_key,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinBSGSOptions *options
+);
+
+#endif
@@ -30,3 +30,24 @@ int Combination_next(struct Combination *c)
 
 	return 1;
 }
+
+uint64_t Combination_count(int n, int r)
+{
+	uint64_t count = 1;
+	int i;
+
+	if (r < 0 || r > n) {
+		return 0;
+	}
+	if (r > n - r) {
+		r = n - r;
+	}
+	/* count * (n - i) / (i + 1) is always exact at each step */
+	for (i = 0; i < r; i++) {
+		if (count > UINT64_MAX / (uint64_t)(n - i)) {
+			return UINT64_MAX;
+		}
+		count = count * (n - i) / (i + 1);
+	}
+	return count;
+}
@@ -1,6 +1,8 @@
 #ifndef BITCOIN_INCLUDE_COMBINATION_H
 #define BITCOIN_INCLUDE_COMBINATION_H
 
+#include <stdint.h> /* uint64_t */
+
 struct Combination {
 	int n; /* total number of elements */
 	int r; /* number of elements to select from total */
@@ -11,4 +13,7 @@ void Combination_create(struct Combination *c, int n, int r);
 void Combination_destroy(struct Combination *c);
 int Combination_next(struct Combination *c);
 
+/* number of combinations of r elements from n, UINT64_MAX if too many */
+uint64_t Combination_count(int n, int r);
+
 #endif
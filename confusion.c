@@ -0,0 +1,190 @@
+#include "confusion.h"
+#include "applog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+/* characters in each group look alike in at least some common fonts, or
+   handwriting */
+static const char *lookalike_groups[] = {
+	"1lIi|!",
+	"0Oo",
+	"5Ss",
+	"2Zz",
+	"8B",
+	"6Gb",
+	"9gq",
+	"uv",
+	"UV",
+	"nh",
+	"ce",
+	"ao",
+	"7T",
+	"4A",
+	"3E",
+	"mn",
+	"Yy",
+	"Xx",
+	"Kk",
+	NULL
+};
+
+/* keys of a QWERTY keyboard, each row offset half a key to the right of
+   the row above */
+static const char *keyboard_rows[] = {
+	"1234567890",
+	"qwertyuiop",
+	"asdfghjkl",
+	"zxcvbnm"
+};
+
+static void Confusion_setMax(struct BitcoinConfusion *confusion,
+	int seen, int meant, double weight)
+{
+	if (seen == meant) {
+		return;
+	}
+	if (confusion->weight[seen][meant] < weight) {
+		confusion->weight[seen][meant] = weight;
+	}
+}
+
+/* mark keys adjacent on the keyboard, both ways round, and with shift held */
+static void Confusion_setKeys(struct BitcoinConfusion *confusion,
+	char a, char b)
+{
+	const double w = BITCOIN_CONFUSION_WEIGHT_KEYBOARD;
+
+	Confusion_setMax(confusion, a, b, w);
+	Confusion_setMax(confusion, b, a, w);
+	if (isalpha((unsigned char)a) && isalpha((unsigned char)b)) {
+		Confusion_setMax(confusion, toupper(a), toupper(b), w);
+		Confusion_setMax(confusion, toupper(b), toupper(a), w);
+	}
+}
+
+void Confusion_init(struct BitcoinConfusion *confusion)
+{
+	const unsigned rows = sizeof(keyboard_rows) / sizeof(keyboard_rows[0]);
+	unsigned i, j, k, row;
+
+	for (i = 0; i < BITCOIN_CONFUSION_CHARS; i++) {
+		for (j = 0; j < BITCOIN_CONFUSION_CHARS; j++) {
+			confusion->weight[i][j] = BITCOIN_CONFUSION_WEIGHT_DEFAULT;
+		}
+	}
+
+	for (i = 0; i < BITCOIN_CONFUSION_CHARS; i++) {
+		if (isalpha(i)) {
+			Confusion_setMax(confusion, i,
+				isupper(i) ? tolower(i) : toupper(i),
+				BITCOIN_CONFUSION_WEIGHT_CASE
+			);
+		}
+	}
+
+	for (i = 0; lookalike_groups[i]; i++) {
+		const char *group = lookalike_groups[i];
+		for (j = 0; group[j]; j++) {
+			for (k = 0; group[k]; k++) {
+				Confusion_setMax(confusion, group[j], group[k],
+					BITCOIN_CONFUSION_WEIGHT_LOOKALIKE
+				);
+			}
+		}
+	}
+
+	for (row = 0; row < rows; row++) {
+		const char *keys = keyboard_rows[row];
+		const size_t length = strlen(keys);
+		for (i = 0; i < length; i++) {
+			if (i + 1 < length) {
+				Confusion_setKeys(confusion, keys[i], keys[i + 1]);
+			}
+			/* the row below is offset to the right, so key i sits above
+			   keys i-1 and i of the next row */
+			if (row + 1 < rows) {
+				const char *below = keyboard_rows[row + 1];
+				const size_t below_length = strlen(below);
+				if (i < below_length) {
+					Confusion_setKeys(confusion, keys[i], below[i]);
+				}
+				if (i > 0 && i - 1 < below_length) {
+					Confusion_setKeys(confusion, keys[i], below[i - 1]);
+				}
+			}
+		}
+	}
+}
+
+BitcoinResult Confusion_load(struct BitcoinConfusion *confusion,
+	const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	char line[256];
+	unsigned line_number = 0;
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	if (!file) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to open confusion file \"%s\"", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char seen, meant, rest;
+		double weight;
+		int fields;
+
+		line_number++;
+		fields = sscanf(line, " %c %c %lf %c", &seen, &meant, &weight, &rest);
+		if (fields <= 0 || seen == '#') {
+			continue;
+		}
+		if (fields != 3
+			|| (unsigned char)seen >= BITCOIN_CONFUSION_CHARS
+			|| (unsigned char)meant >= BITCOIN_CONFUSION_CHARS
+			|| !(weight > 0))
+		{
+			applog(APPLOG_ERROR, __func__,
+				"%s:%u: expected \"SEEN MEANT WEIGHT\" with a positive weight",
+				filename, line_number
+			);
+			result = BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+		}
+		confusion->weight[(int)seen][(int)meant] = weight;
+	}
+
+	if (result == BITCOIN_SUCCESS && ferror(file)) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to read confusion file \"%s\"", filename
+		);
+		result = BITCOIN_ERROR_FILE;
+	}
+
+	fclose(file);
+	return result;
+}
+
+double Confusion_cost(const struct BitcoinConfusion *confusion,
+	const char *alphabet, char seen, char meant)
+{
+	const int s = (unsigned char)seen % BITCOIN_CONFUSION_CHARS;
+	double total = 0;
+	const char *p;
+
+	for (p = alphabet; *p; p++) {
+		if (*p != seen) {
+			total += confusion->weight[s][(int)*p];
+		}
+	}
+
+	return -log(BITCOIN_CONFUSION_ERROR_PROBABILITY
+		* confusion->weight[s][(unsigned char)meant % BITCOIN_CONFUSION_CHARS]
+		/ total
+	);
+}
@@ -0,0 +1,66 @@
+#ifndef BITCOIN_INCLUDE_CONFUSION_H
+#define BITCOIN_INCLUDE_CONFUSION_H
+
+/** @file confusion.h
+ *  @brief Model of which characters are likely to be mistaken for which,
+ *         when a string is typed, copied by hand or read off a printout.
+ *
+ *  Each pair of characters has a relative weight, the default being 1 for
+ *  any unrelated substitution.  The built-in model gives extra weight to
+ *  letters with their case changed, characters which look alike in common
+ *  fonts (1/l/I, 0/O/o, 5/S, ...) and keys next to each other on a QWERTY
+ *  keyboard.
+ *
+ *  @author Matthew Anger
+ */
+
+#include "result.h" /* BitcoinResult / BITCOIN_SUCCESS / BITCOIN_ERROR_* */
+
+/** Only 7-bit ASCII characters are modelled */
+#define BITCOIN_CONFUSION_CHARS 128
+
+/** Weight of a substitution not otherwise listed */
+#define BITCOIN_CONFUSION_WEIGHT_DEFAULT 1.0
+
+/** Weights of the built-in kinds of mistake */
+#define BITCOIN_CONFUSION_WEIGHT_CASE 40.0
+#define BITCOIN_CONFUSION_WEIGHT_LOOKALIKE 40.0
+#define BITCOIN_CONFUSION_WEIGHT_KEYBOARD 10.0
+
+/** Probability that any single character is wrong, which makes one change
+    more likely than two regardless of the weights */
+#define BITCOIN_CONFUSION_ERROR_PROBABILITY 0.01
+
+struct BitcoinConfusion {
+	/* relative likelihood of seeing [seen] when [meant] was intended */
+	double weight[BITCOIN_CONFUSION_CHARS][BITCOIN_CONFUSION_CHARS];
+};
+
+/** @brief Initialise the built-in model. */
+void Confusion_init(struct BitcoinConfusion *confusion);
+
+/** @brief Override weights of the model from a text file.
+ *
+ *  Each line is "SEEN MEANT WEIGHT", for example "0 o 40" to say an 'o'
+ *  is 40 times more likely than an unrelated character to have been
+ *  written as '0'.  Blank lines and lines starting with '#' are ignored.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_FILE if the file can't be read.
+ *          BITCOIN_ERROR_INVALID_FORMAT if a line can't be understood.
+ */
+BitcoinResult Confusion_load(struct BitcoinConfusion *confusion,
+	const char *filename
+);
+
+/** @brief Cost of 'meant' having been written as 'seen', as the negative
+ *         natural log of its probability, given 'seen' is wrong and one of
+ *         the characters in 'alphabet' was meant.  Adding costs of
+ *         independent changes gives the cost of making them all.
+ */
+double Confusion_cost(const struct BitcoinConfusion *confusion,
+	const char *alphabet, char seen, char meant
+);
+
+#endif
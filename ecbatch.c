@@ -0,0 +1,465 @@
+#include "ecbatch.h"
+
+#include <string.h>
+
+/* Lanes of Jacobi symbols need AVX2, checked for at run time. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ >= 5)
+#define BITCOIN_ECBATCH_AVX2
+#include <immintrin.h>
+#endif
+
+/* Numbers for Jacobi symbols are kept in 30 bit limbs, least significant
+   first, so that a limb times an entry of a transition matrix, which is at
+   most 2^30, fits in 64 bits with room to add two of them up.  Nine hold
+   a little more than 256 bits, as the numbers can grow slightly before
+   they shrink. */
+#define ECBATCH_LIMBS 9
+#define ECBATCH_LIMB_BITS 30
+#define ECBATCH_LIMB_MASK 0x3fffffffUL
+
+/* steps done on the bottom bits of the numbers before being applied to the
+   whole of them, and the most batches of steps before a symbol is left to
+   OpenSSL, about twice as many as 256 bit numbers ever seem to need */
+#define ECBATCH_JACOBI_STEPS 30
+#define ECBATCH_JACOBI_MAX_BATCHES 60
+
+/* Jacobi symbols (g/f) being made side by side, starting from (a/p), with
+   each limb and number of every lane together so that registers can be
+   loaded with them. */
+struct ECBatchJacobi {
+	uint32_t f[ECBATCH_LIMBS][ECBATCH_MAX_LANES];
+	uint32_t g[ECBATCH_LIMBS][ECBATCH_MAX_LANES];
+
+	/* minus how many more steps g has had than f, carried between
+	   batches */
+	uint32_t eta[ECBATCH_MAX_LANES];
+
+	/* bottom bit set if the sign has flipped */
+	uint32_t sign[ECBATCH_MAX_LANES];
+
+	/* what the latest batch of steps does: f becomes (u f + v g) / 2^30,
+	   and g (q f + r g) / 2^30 */
+	uint32_t u[ECBATCH_MAX_LANES], v[ECBATCH_MAX_LANES];
+	uint32_t q[ECBATCH_MAX_LANES], r[ECBATCH_MAX_LANES];
+
+	/* lanes, and limbs still in use by any of them as the numbers shrink */
+	unsigned count, size;
+
+	/* the symbol, set once f is 1 */
+	int symbols[ECBATCH_MAX_LANES];
+};
+
+int ECBatch_walk(const EC_GROUP *group, EC_POINT **points, size_t count,
+	const EC_POINT *step, BN_CTX *ctx)
+{
+	size_t i;
+
+	for (i = 1; i < count; i++) {
+		if (!EC_POINT_add(group, points[i], points[i - 1], step, ctx)) {
+			return 0;
+		}
+	}
+	return EC_POINTs_make_affine(group, count, points, ctx);
+}
+
+int ECBatch_jump(const EC_GROUP *group, EC_POINT **points,
+	const EC_POINT *const *jumps, size_t count, BN_CTX *ctx)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (!EC_POINT_add(group, points[i], points[i], jumps[i], ctx)) {
+			return 0;
+		}
+	}
+	return EC_POINTs_make_affine(group, count, points, ctx);
+}
+
+int ECBatch_getX(const EC_GROUP *group, EC_POINT *const *points,
+	size_t count, uint8_t (*x)[ECBATCH_FIELD_SIZE], BIGNUM *scratch,
+	BN_CTX *ctx)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (EC_POINT_is_at_infinity(group, points[i])) {
+			memset(x[i], 0, ECBATCH_FIELD_SIZE);
+		} else if (!EC_POINT_get_affine_coordinates(group, points[i], scratch,
+				NULL, ctx)
+			|| BN_bn2binpad(scratch, x[i], ECBATCH_FIELD_SIZE) < 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void ECBatch_loadLimbs(uint32_t (*limbs)[ECBATCH_MAX_LANES],
+	unsigned lane, const uint8_t *bytes)
+{
+	uint64_t bits = 0;
+	unsigned i, count = 0;
+	int byte = ECBATCH_FIELD_SIZE - 1;
+
+	for (i = 0; i < ECBATCH_LIMBS; i++) {
+		while (count < ECBATCH_LIMB_BITS && byte >= 0) {
+			bits |= (uint64_t)bytes[byte--] << count;
+			count += 8;
+		}
+		limbs[i][lane] = (uint32_t)(bits & ECBATCH_LIMB_MASK);
+		bits >>= ECBATCH_LIMB_BITS;
+		count = count > ECBATCH_LIMB_BITS ? count - ECBATCH_LIMB_BITS : 0;
+	}
+}
+
+/* Make Jacobi symbols by the binary GCD, in the form Bernstein and Yang
+   call divsteps, in the variant which keeps both numbers positive that
+   libsecp256k1 uses.  Each step, if g is odd and has had more steps than f,
+   they swap, which flips the sign when both are 3 mod 4 by quadratic
+   reciprocity.  Then an odd g has f added to it, and is halved, which flips
+   the sign when f is 3 or 5 mod 8.  f comes down to the GCD, 1, at which
+   point the sign is the symbol.  Which way each of a batch of steps goes
+   depends only on the bottom 32 bits of f and g, so the batch is done on
+   those alone, without branches, keeping track of what it does to the
+   whole numbers in each lane's matrix.
+
+   Rather than flipping the sign each step, the values of f at each halving
+   are XORed together, as are those of f AND g at each swap, the number of
+   flips being the bits they were flipped by XORed together too. */
+#define ECBATCH_JACOBI_FLIPS(halved, swapped) \
+	((((halved) >> 1) ^ ((halved) >> 2) ^ ((swapped) >> 1)) & 1)
+
+static void ECBatch_jacobiSteps(struct ECBatchJacobi *jacobi)
+{
+	unsigned lane, i;
+
+	for (lane = 0; lane < jacobi->count; lane++) {
+		uint32_t f = jacobi->f[0][lane] | jacobi->f[1][lane] << ECBATCH_LIMB_BITS;
+		uint32_t g = jacobi->g[0][lane] | jacobi->g[1][lane] << ECBATCH_LIMB_BITS;
+		uint32_t eta = jacobi->eta[lane], halved = 0, swapped = 0;
+		uint32_t u = 1, v = 0, q = 0, r = 1, odd, swap, d;
+
+		for (i = 0; i < ECBATCH_JACOBI_STEPS; i++) {
+			odd = 0 - (g & 1);
+			swap = odd & (0 - (eta >> 31));
+			d = (f ^ g) & swap; f ^= d; g ^= d;
+			d = (u ^ q) & swap; u ^= d; q ^= d;
+			d = (v ^ r) & swap; v ^= d; r ^= d;
+			eta = (eta ^ swap) - swap;
+			swapped ^= f & g & swap;
+
+			g += f & odd;
+			q += u & odd;
+			r += v & odd;
+			g >>= 1;
+			u <<= 1;
+			v <<= 1;
+			eta--;
+			halved ^= f;
+		}
+
+		jacobi->eta[lane] = eta;
+		jacobi->sign[lane] ^= ECBATCH_JACOBI_FLIPS(halved, swapped);
+		jacobi->u[lane] = u;
+		jacobi->v[lane] = v;
+		jacobi->q[lane] = q;
+		jacobi->r[lane] = r;
+	}
+}
+
+/* Apply each lane's matrix to the whole of its f and g, the bottom limbs
+   coming to 0 and being shifted out. */
+static void ECBatch_jacobiUpdate(struct ECBatchJacobi *jacobi)
+{
+	const unsigned size = jacobi->size;
+	unsigned lane, i;
+
+	for (lane = 0; lane < jacobi->count; lane++) {
+		const uint64_t u = jacobi->u[lane], v = jacobi->v[lane];
+		const uint64_t q = jacobi->q[lane], r = jacobi->r[lane];
+		uint64_t cf, cg;
+
+		cf = (u * jacobi->f[0][lane] + v * jacobi->g[0][lane])
+			>> ECBATCH_LIMB_BITS;
+		cg = (q * jacobi->f[0][lane] + r * jacobi->g[0][lane])
+			>> ECBATCH_LIMB_BITS;
+		for (i = 1; i < size; i++) {
+			cf += u * jacobi->f[i][lane] + v * jacobi->g[i][lane];
+			cg += q * jacobi->f[i][lane] + r * jacobi->g[i][lane];
+			jacobi->f[i - 1][lane] = (uint32_t)(cf & ECBATCH_LIMB_MASK);
+			jacobi->g[i - 1][lane] = (uint32_t)(cg & ECBATCH_LIMB_MASK);
+			cf >>= ECBATCH_LIMB_BITS;
+			cg >>= ECBATCH_LIMB_BITS;
+		}
+		jacobi->f[size - 1][lane] = (uint32_t)cf;
+		jacobi->g[size - 1][lane] = (uint32_t)cg;
+	}
+}
+
+#if defined(BITCOIN_ECBATCH_AVX2)
+
+/* The same steps for sixteen lanes, eight in each of two sets of registers
+   whose steps are interleaved, as each step has to wait for the last. */
+__attribute__((target("avx2")))
+static void ECBatch_jacobiSteps16(struct ECBatchJacobi *jacobi)
+{
+	const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+	__m256i f[2], g[2], eta[2], halved[2], swapped[2];
+	__m256i u[2], v[2], q[2], r[2], odd, swap, d;
+	uint32_t words[2][ECBATCH_MAX_LANES];
+	unsigned i, k;
+
+	for (k = 0; k < 2; k++) {
+		const __m256i f1 = _mm256_loadu_si256((const __m256i *)&jacobi->f[1][8 * k]);
+		const __m256i g1 = _mm256_loadu_si256((const __m256i *)&jacobi->g[1][8 * k]);
+
+		f[k] = _mm256_or_si256(
+			_mm256_loadu_si256((const __m256i *)&jacobi->f[0][8 * k]),
+			_mm256_slli_epi32(f1, ECBATCH_LIMB_BITS));
+		g[k] = _mm256_or_si256(
+			_mm256_loadu_si256((const __m256i *)&jacobi->g[0][8 * k]),
+			_mm256_slli_epi32(g1, ECBATCH_LIMB_BITS));
+		eta[k] = _mm256_loadu_si256((const __m256i *)&jacobi->eta[8 * k]);
+		halved[k] = swapped[k] = v[k] = q[k] = zero;
+		u[k] = r[k] = one;
+	}
+
+	for (i = 0; i < ECBATCH_JACOBI_STEPS; i++) {
+		for (k = 0; k < 2; k++) {
+			odd = _mm256_sub_epi32(zero, _mm256_and_si256(g[k], one));
+			swap = _mm256_and_si256(odd, _mm256_srai_epi32(eta[k], 31));
+			d = _mm256_and_si256(_mm256_xor_si256(f[k], g[k]), swap);
+			f[k] = _mm256_xor_si256(f[k], d);
+			g[k] = _mm256_xor_si256(g[k], d);
+			d = _mm256_and_si256(_mm256_xor_si256(u[k], q[k]), swap);
+			u[k] = _mm256_xor_si256(u[k], d);
+			q[k] = _mm256_xor_si256(q[k], d);
+			d = _mm256_and_si256(_mm256_xor_si256(v[k], r[k]), swap);
+			v[k] = _mm256_xor_si256(v[k], d);
+			r[k] = _mm256_xor_si256(r[k], d);
+			eta[k] = _mm256_sub_epi32(_mm256_xor_si256(eta[k], swap), swap);
+			swapped[k] = _mm256_xor_si256(swapped[k],
+				_mm256_and_si256(_mm256_and_si256(f[k], g[k]), swap));
+
+			g[k] = _mm256_add_epi32(g[k], _mm256_and_si256(f[k], odd));
+			q[k] = _mm256_add_epi32(q[k], _mm256_and_si256(u[k], odd));
+			r[k] = _mm256_add_epi32(r[k], _mm256_and_si256(v[k], odd));
+			g[k] = _mm256_srli_epi32(g[k], 1);
+			u[k] = _mm256_slli_epi32(u[k], 1);
+			v[k] = _mm256_slli_epi32(v[k], 1);
+			eta[k] = _mm256_sub_epi32(eta[k], one);
+			halved[k] = _mm256_xor_si256(halved[k], f[k]);
+		}
+	}
+
+	for (k = 0; k < 2; k++) {
+		_mm256_storeu_si256((__m256i *)&jacobi->eta[8 * k], eta[k]);
+		_mm256_storeu_si256((__m256i *)&words[0][8 * k], halved[k]);
+		_mm256_storeu_si256((__m256i *)&words[1][8 * k], swapped[k]);
+		_mm256_storeu_si256((__m256i *)&jacobi->u[8 * k], u[k]);
+		_mm256_storeu_si256((__m256i *)&jacobi->v[8 * k], v[k]);
+		_mm256_storeu_si256((__m256i *)&jacobi->q[8 * k], q[k]);
+		_mm256_storeu_si256((__m256i *)&jacobi->r[8 * k], r[k]);
+	}
+	for (i = 0; i < ECBATCH_MAX_LANES; i++) {
+		jacobi->sign[i] ^= ECBATCH_JACOBI_FLIPS(words[0][i], words[1][i]);
+	}
+}
+
+/* The same update for sixteen lanes, four at a time in 64 bit lanes. */
+__attribute__((target("avx2")))
+static void ECBatch_jacobiUpdate16(struct ECBatchJacobi *jacobi)
+{
+	const __m256i mask = _mm256_set1_epi64x(ECBATCH_LIMB_MASK);
+	/* the bottom 32 bits of each 64 bit lane, into the bottom half */
+	const __m256i low = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	const unsigned size = jacobi->size;
+	__m256i u, v, q, r, f, g, cf, cg;
+	unsigned lane, i;
+
+#define ECBATCH_LOAD4(array) \
+	_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)&(array)[lane]))
+#define ECBATCH_STORE4(array, x) \
+	_mm_storeu_si128((__m128i *)&(array)[lane], _mm256_castsi256_si128( \
+		_mm256_permutevar8x32_epi32((x), low)))
+
+	for (lane = 0; lane < ECBATCH_MAX_LANES; lane += 4) {
+		u = ECBATCH_LOAD4(jacobi->u);
+		v = ECBATCH_LOAD4(jacobi->v);
+		q = ECBATCH_LOAD4(jacobi->q);
+		r = ECBATCH_LOAD4(jacobi->r);
+
+		f = ECBATCH_LOAD4(jacobi->f[0]);
+		g = ECBATCH_LOAD4(jacobi->g[0]);
+		cf = _mm256_srli_epi64(_mm256_add_epi64(_mm256_mul_epu32(u, f),
+			_mm256_mul_epu32(v, g)), ECBATCH_LIMB_BITS);
+		cg = _mm256_srli_epi64(_mm256_add_epi64(_mm256_mul_epu32(q, f),
+			_mm256_mul_epu32(r, g)), ECBATCH_LIMB_BITS);
+		for (i = 1; i < size; i++) {
+			f = ECBATCH_LOAD4(jacobi->f[i]);
+			g = ECBATCH_LOAD4(jacobi->g[i]);
+			cf = _mm256_add_epi64(cf, _mm256_add_epi64(
+				_mm256_mul_epu32(u, f), _mm256_mul_epu32(v, g)));
+			cg = _mm256_add_epi64(cg, _mm256_add_epi64(
+				_mm256_mul_epu32(q, f), _mm256_mul_epu32(r, g)));
+			ECBATCH_STORE4(jacobi->f[i - 1], _mm256_and_si256(cf, mask));
+			ECBATCH_STORE4(jacobi->g[i - 1], _mm256_and_si256(cg, mask));
+			cf = _mm256_srli_epi64(cf, ECBATCH_LIMB_BITS);
+			cg = _mm256_srli_epi64(cg, ECBATCH_LIMB_BITS);
+		}
+		ECBATCH_STORE4(jacobi->f[size - 1], cf);
+		ECBATCH_STORE4(jacobi->g[size - 1], cg);
+	}
+
+#undef ECBATCH_LOAD4
+#undef ECBATCH_STORE4
+}
+
+#endif
+
+unsigned ECBatch_jacobiLanes(void)
+{
+#if defined(BITCOIN_ECBATCH_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		return 16;
+	}
+#endif
+	return 1;
+}
+
+/* Make the symbols of up to ECBATCH_MAX_LANES numbers, leaving any not
+   done after ECBATCH_JACOBI_MAX_BATCHES as 2. */
+static void ECBatch_jacobiRun(struct ECBatchJacobi *jacobi,
+	const uint8_t p[ECBATCH_FIELD_SIZE],
+	const uint8_t (*a)[ECBATCH_FIELD_SIZE], unsigned count)
+{
+	unsigned batch, done = 0, lane, i;
+	uint32_t rest;
+
+	/* lanes past 'count' are filled in too, with 1, when they're run */
+	memset(jacobi, 0, sizeof(*jacobi));
+	jacobi->count = count;
+	jacobi->size = ECBATCH_LIMBS;
+	ECBatch_loadLimbs(jacobi->f, 0, p);
+	for (lane = 0; lane < ECBATCH_MAX_LANES; lane++) {
+		for (i = 0; i < ECBATCH_LIMBS; i++) {
+			jacobi->f[i][lane] = jacobi->f[i][0];
+		}
+		if (lane < count) {
+			ECBatch_loadLimbs(jacobi->g, lane, a[lane]);
+		} else {
+			jacobi->g[0][lane] = 1;
+		}
+		jacobi->eta[lane] = (uint32_t)-1;
+		jacobi->symbols[lane] = 2;
+	}
+
+	for (batch = 0; batch < ECBATCH_JACOBI_MAX_BATCHES && done < count;
+		batch++)
+	{
+#if defined(BITCOIN_ECBATCH_AVX2)
+		if (count > 1) {
+			ECBatch_jacobiSteps16(jacobi);
+			ECBatch_jacobiUpdate16(jacobi);
+		} else
+#endif
+		{
+			ECBatch_jacobiSteps(jacobi);
+			ECBatch_jacobiUpdate(jacobi);
+		}
+
+		for (lane = 0; lane < count; lane++) {
+			if (jacobi->symbols[lane] != 2 || jacobi->f[0][lane] != 1) {
+				continue;
+			}
+			for (rest = 0, i = 1; i < jacobi->size; i++) {
+				rest |= jacobi->f[i][lane];
+			}
+			if (rest == 0) {
+				jacobi->symbols[lane] = 1 - 2 * (int)(jacobi->sign[lane] & 1);
+				done++;
+			}
+		}
+
+		/* the steps read the bottom two limbs, so keep those.  Lanes past
+		   'count' may lose their top limbs, but aren't looked at. */
+		while (jacobi->size > 2) {
+			for (rest = 0, lane = 0; lane < count; lane++) {
+				rest |= jacobi->f[jacobi->size - 1][lane]
+					| jacobi->g[jacobi->size - 1][lane];
+			}
+			if (rest) {
+				break;
+			}
+			jacobi->size--;
+		}
+	}
+}
+
+int ECBatch_jacobi(const BIGNUM *p, const uint8_t (*a)[ECBATCH_FIELD_SIZE],
+	size_t count, int *symbols, BN_CTX *ctx)
+{
+	struct ECBatchJacobi jacobi;
+	uint8_t p_bytes[ECBATCH_FIELD_SIZE];
+	const unsigned width = ECBatch_jacobiLanes();
+	unsigned lane, n;
+	size_t first;
+	BIGNUM *scratch;
+	int ok = 1;
+
+	if (BN_bn2binpad(p, p_bytes, sizeof(p_bytes)) < 0) {
+		return 0;
+	}
+
+	for (first = 0; ok && first < count; first += n) {
+		n = count - first < width ? (unsigned)(count - first) : width;
+		ECBatch_jacobiRun(&jacobi, p_bytes, a + first, n);
+
+		/* anything not done by now, such as 0, is left to OpenSSL */
+		for (lane = 0; ok && lane < n; lane++) {
+			symbols[first + lane] = jacobi.symbols[lane];
+			if (jacobi.symbols[lane] != 2) {
+				continue;
+			}
+			BN_CTX_start(ctx);
+			scratch = BN_CTX_get(ctx);
+			ok = scratch && BN_bin2bn(a[first + lane], ECBATCH_FIELD_SIZE,
+				scratch);
+			if (ok) {
+				symbols[first + lane] = BN_kronecker(scratch, p, ctx);
+				ok = symbols[first + lane] != -2;
+			}
+			BN_CTX_end(ctx);
+		}
+	}
+	return ok;
+}
+
+uint64_t ECBatch_load64(const uint8_t *bytes)
+{
+	uint64_t value = 0;
+	unsigned i;
+
+	for (i = 0; i < 8; i++) {
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+int ECBatch_setUint64(BIGNUM *bn, uint64_t value)
+{
+	return BN_set_word(bn, (BN_ULONG)(value >> 32))
+		&& BN_lshift(bn, bn, 32)
+		&& BN_add_word(bn, (BN_ULONG)(value & 0xffffffff));
+}
+
+uint64_t ECBatch_getUint64(const BIGNUM *bn)
+{
+	uint8_t bytes[8];
+
+	if (BN_bn2binpad(bn, bytes, sizeof(bytes)) < 0) {
+		return UINT64_MAX;
+	}
+	return ECBatch_load64(bytes);
+}
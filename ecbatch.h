@@ -0,0 +1,89 @@
+#ifndef BITCOIN_INCLUDE_ECBATCH_H
+#define BITCOIN_INCLUDE_ECBATCH_H
+
+/** @file ecbatch.h
+ *  @brief Move a batch of EC points one step each, for range searches and
+ *         discrete log solvers.
+ *
+ *  Adding points is cheap in the projective coordinates OpenSSL keeps them
+ *  in, but the affine x coordinate needs a field inversion costing as much
+ *  as dozens of additions.  These step every point of a batch and then make
+ *  them all affine together, sharing one inversion.
+ *
+ *  Jacobi symbols, which say whether a number has a square root without
+ *  taking it, are made for several numbers side by side, each in one lane
+ *  of an AVX2 register where the processor has it.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t, uint64_t */
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+
+/** bytes of a big-endian field element */
+#define ECBATCH_FIELD_SIZE 32
+
+/** @brief Set points[i] = points[i - 1] + 'step' for i from 1 to count - 1,
+ *         then make all of them affine.
+ *
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int ECBatch_walk(const EC_GROUP *group, EC_POINT **points, size_t count,
+	const EC_POINT *step, BN_CTX *ctx
+);
+
+/** @brief Add jumps[i] to points[i] for each i, then make all of them
+ *         affine.
+ *
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int ECBatch_jump(const EC_GROUP *group, EC_POINT **points,
+	const EC_POINT *const *jumps, size_t count, BN_CTX *ctx
+);
+
+/** @brief Get the x coordinates of affine points, all zero for the point
+ *         at infinity.
+ *
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int ECBatch_getX(const EC_GROUP *group, EC_POINT *const *points,
+	size_t count, uint8_t (*x)[ECBATCH_FIELD_SIZE], BIGNUM *scratch,
+	BN_CTX *ctx
+);
+
+/** most Jacobi symbols made side by side */
+#define ECBATCH_MAX_LANES 16
+
+/** @brief Number of Jacobi symbols ECBatch_jacobi() makes side by side on
+ *         this processor, so callers can hand it that many at once.
+ */
+unsigned ECBatch_jacobiLanes(void);
+
+/** @brief Set symbols[i] to the Jacobi symbol (a[i] / p) for each i, which
+ *         for a prime p is 1 if a[i] has a square root mod p, -1 if not,
+ *         and 0 if a[i] is 0.  p is odd and no more than 256 bits, and the
+ *         numbers are big-endian and below it.
+ *
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int ECBatch_jacobi(const BIGNUM *p, const uint8_t (*a)[ECBATCH_FIELD_SIZE],
+	size_t count, int *symbols, BN_CTX *ctx
+);
+
+/** @brief Read 8 bytes as a big-endian number. */
+uint64_t ECBatch_load64(const uint8_t *bytes);
+
+/** @brief Set 'bn' to 'value', which BN_set_word() can't do where BN_ULONG
+ *         is 32 bits.
+ *
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int ECBatch_setUint64(BIGNUM *bn, uint64_t value);
+
+/** @brief Get 'bn' as a number, or UINT64_MAX if it's too large. */
+uint64_t ECBatch_getUint64(const BIGNUM *bn);
+
+#endif
@@ -1,4 +1,7 @@
 #include "hash.h"
+#include "secure.h"
+
+#include <string.h>
 
 void Bitcoin_SHA256(struct BitcoinSHA256 *output, const void *input, size_t size)
 {
@@ -28,3 +31,49 @@ void Bitcoin_RIPEMD160(struct BitcoinRIPEMD160 *output, const void *input, size_
 	RIPEMD160_Final(output->data, &ctx);
 }
 
+void Bitcoin_HMACSHA512Init(struct BitcoinHMACSHA512Key *key,
+	const void *secret, size_t size)
+{
+	unsigned char pad[SHA512_CBLOCK];
+	struct BitcoinSHA512 hashed;
+	size_t i;
+
+	/* keys longer than a block are hashed first */
+	if (size > SHA512_CBLOCK) {
+		SHA512_CTX ctx;
+		SHA512_Init(&ctx);
+		SHA512_Update(&ctx, secret, size);
+		SHA512_Final(hashed.data, &ctx);
+		secret = hashed.data;
+		size = BITCOIN_SHA512_SIZE;
+	}
+
+	memset(pad, 0x36, sizeof(pad));
+	for (i = 0; i < size; i++) {
+		pad[i] ^= ((const unsigned char *)secret)[i];
+	}
+	SHA512_Init(&key->inner);
+	SHA512_Update(&key->inner, pad, sizeof(pad));
+
+	/* 0x36 ^ 0x5c turns the inner pad into the outer one */
+	for (i = 0; i < sizeof(pad); i++) {
+		pad[i] ^= 0x36 ^ 0x5c;
+	}
+	SHA512_Init(&key->outer);
+	SHA512_Update(&key->outer, pad, sizeof(pad));
+
+	Secure_wipe(pad, sizeof(pad));
+	Secure_wipe(&hashed, sizeof(hashed));
+}
+
+void Bitcoin_HMACSHA512(struct BitcoinSHA512 *output,
+	const struct BitcoinHMACSHA512Key *key, const void *input, size_t size)
+{
+	SHA512_CTX ctx = key->inner;
+
+	SHA512_Update(&ctx, input, size);
+	SHA512_Final(output->data, &ctx);
+	ctx = key->outer;
+	SHA512_Update(&ctx, output->data, BITCOIN_SHA512_SIZE);
+	SHA512_Final(output->data, &ctx);
+}
@@ -8,7 +8,9 @@
  *  @author Matthew Anger
  */
 
-#include <openssl/sha.h> /* SHA256_DIGEST_LENGTH */
+#include <stddef.h> /* size_t */
+
+#include <openssl/sha.h> /* SHA256_DIGEST_LENGTH, SHA512_DIGEST_LENGTH */
 #include <openssl/ripemd.h> /* RIPEMD160_DIGEST_LENGTH */
 
 /* Wrap various data types in structs for type-safety */
@@ -19,6 +21,20 @@ struct BitcoinSHA256
 	unsigned char data[BITCOIN_SHA256_SIZE];
 };
 
+#define BITCOIN_SHA512_SIZE (SHA512_DIGEST_LENGTH)
+struct BitcoinSHA512
+{
+	unsigned char data[BITCOIN_SHA512_SIZE];
+};
+
+/* HMAC-SHA512 key, kept as the SHA512 states after hashing the inner and
+   outer padded keys, so each message hashed with the same key skips those
+   two compressions */
+struct BitcoinHMACSHA512Key
+{
+	SHA512_CTX inner, outer;
+};
+
 #define BITCOIN_RIPEMD160_SIZE (RIPEMD160_DIGEST_LENGTH)
 struct BitcoinRIPEMD160
 {
@@ -56,5 +72,27 @@ void Bitcoin_RIPEMD160(struct BitcoinRIPEMD160 *output,
 	const void *input, size_t size
 );
 
+/** @brief Set up an HMAC-SHA512 key, for any number of messages.
+ *
+ *  @param[out] key Pointer to key to write.
+ *  @param[in] secret Pointer to key bytes.
+ *  @param[in] size Number of bytes at 'secret'.
+ */
+void Bitcoin_HMACSHA512Init(struct BitcoinHMACSHA512Key *key,
+	const void *secret, size_t size
+);
+
+/** @brief Calculate HMAC-SHA512 of a message with a key set up by
+ *         Bitcoin_HMACSHA512Init(), and write to output buffer.
+ *
+ *  @param[out] output Pointer to hash output buffer.
+ *  @param[in] key Pointer to key to use.
+ *  @param[in] input Pointer to data to hash.
+ *  @param[in] size Number of bytes of data at 'input' to hash.
+ */
+void Bitcoin_HMACSHA512(struct BitcoinSHA512 *output,
+	const struct BitcoinHMACSHA512Key *key, const void *input, size_t size
+);
+
 #endif
 
@@ -0,0 +1,699 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "kangaroo.h"
+#include "applog.h"
+#include "ecbatch.h"
+#include "parallel.h"
+#include "progress.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+/* most kangaroos in each thread's herd, which jump together sharing one
+   field inversion */
+#define KANGAROO_HERD_SIZE 1024
+
+/* most different jumps, 2^0*G to 2^(n-1)*G */
+#define KANGAROO_MAX_JUMPS 255
+
+/* give up after this many times the number of jumps expected */
+#define KANGAROO_GIVE_UP 16
+
+/* bytes of x kept for each distinguished point, the last of the 32 */
+#define KANGAROO_X_SIZE 16
+
+/* smallest table of distinguished points, in entries */
+#define KANGAROO_MIN_CAPACITY 1024
+
+enum KangarooType {
+	KANGAROO_EMPTY,
+	KANGAROO_TAME,
+	KANGAROO_WILD
+};
+
+static const char kangaroo_magic[8] = { 'B', 'T', 'K', 'A', 'N', 'G', '0', '1' };
+
+/* a distinguished point, as kept in memory and in the checkpoint file */
+struct KangarooPoint {
+	uint8_t x[KANGAROO_X_SIZE];
+
+	/* distance travelled to reach it, big-endian */
+	uint8_t distance[ECBATCH_FIELD_SIZE];
+
+	/* enum KangarooType of the kangaroo which reached it */
+	uint8_t type;
+
+	uint8_t reserved[15];
+};
+
+/* start of a checkpoint file, followed by 'count' points */
+struct KangarooHeader {
+	char magic[8];
+
+	/* what is being solved */
+	uint8_t target[BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE];
+	uint8_t start[BITCOIN_PRIVATE_KEY_SIZE];
+	uint8_t end[BITCOIN_PRIVATE_KEY_SIZE];
+
+	/* how, since points from other jumps or criteria would be no use */
+	uint8_t distinguished_bits;
+	uint8_t jump_count;
+
+	/* big-endian */
+	uint8_t count[8];
+};
+
+struct Kangaroo {
+	const struct BitcoinKangarooOptions *options;
+	const EC_GROUP *group;
+	BIGNUM *order, *start, *width, *half_width;
+
+	/* the public key less start*G, whose key is from 0 to width - 1 */
+	EC_POINT *target;
+
+	/* jump i is 2^i*G */
+	unsigned jump_count;
+	EC_POINT *jump_points[KANGAROO_MAX_JUMPS];
+	BIGNUM *jump_distances[KANGAROO_MAX_JUMPS];
+
+	unsigned distinguished_bits, herd_size;
+
+	/* square root of the number of keys in the range */
+	double root;
+	uint64_t give_up;
+
+	struct KangarooHeader header;
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* distinguished points, open addressing on x, at most half full */
+	struct KangarooPoint *points;
+	size_t capacity, count;
+
+	int done;
+	BitcoinResult result;
+	BIGNUM *found;
+
+	uint64_t checkpoint_nanoseconds;
+	struct BitcoinProgress progress;
+};
+
+static void Kangaroo_fail(struct Kangaroo *kangaroo, const char *function_name)
+{
+	applog(APPLOG_ERROR, function_name, "OpenSSL failed: %s",
+		ERR_error_string(ERR_get_error(), NULL)
+	);
+	pthread_mutex_lock(&kangaroo->mutex);
+	kangaroo->result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	kangaroo->done = 1;
+	pthread_mutex_unlock(&kangaroo->mutex);
+}
+
+/* Find the point with this x, or the empty slot it would go in. */
+static struct KangarooPoint *Kangaroo_find(struct Kangaroo *kangaroo,
+	const uint8_t *x)
+{
+	size_t slot = (size_t)ECBatch_load64(x) & (kangaroo->capacity - 1);
+
+	while (kangaroo->points[slot].type != KANGAROO_EMPTY
+		&& memcmp(kangaroo->points[slot].x, x, KANGAROO_X_SIZE) != 0)
+	{
+		slot = (slot + 1) & (kangaroo->capacity - 1);
+	}
+	return &kangaroo->points[slot];
+}
+
+/* Add a point which isn't in the table yet. */
+static int Kangaroo_add(struct Kangaroo *kangaroo,
+	const struct KangarooPoint *point)
+{
+	if ((kangaroo->count + 1) * 2 > kangaroo->capacity) {
+		struct KangarooPoint *old = kangaroo->points;
+		size_t old_capacity = kangaroo->capacity, i;
+
+		kangaroo->capacity = old_capacity * 2;
+		kangaroo->points = calloc(kangaroo->capacity, sizeof(*old));
+		if (!kangaroo->points) {
+			applog(APPLOG_ERROR, __func__,
+				"Failed to allocate %lu distinguished points",
+				(unsigned long)kangaroo->capacity
+			);
+			kangaroo->points = old;
+			kangaroo->capacity = old_capacity;
+			return 0;
+		}
+		for (i = 0; i < old_capacity; i++) {
+			if (old[i].type != KANGAROO_EMPTY) {
+				*Kangaroo_find(kangaroo, old[i].x) = old[i];
+			}
+		}
+		free(old);
+	}
+	*Kangaroo_find(kangaroo, point->x) = *point;
+	kangaroo->count++;
+	return 1;
+}
+
+/* Write every distinguished point to the checkpoint file, through a
+   temporary file so a crash while writing leaves the last one intact. */
+static BitcoinResult Kangaroo_save(struct Kangaroo *kangaroo)
+{
+	const char *filename = kangaroo->options->checkpoint_filename;
+	char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+	FILE *file = NULL;
+	uint64_t count = kangaroo->count;
+	size_t i;
+	int ok;
+
+	if (!temporary) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate file name");
+		return BITCOIN_ERROR;
+	}
+	strcpy(temporary, filename);
+	strcat(temporary, ".tmp");
+
+	for (i = 0; i < 8; i++) {
+		kangaroo->header.count[7 - i] = (uint8_t)(count >> (i * 8));
+	}
+	file = fopen(temporary, "wb");
+	ok = file && fwrite(&kangaroo->header, sizeof(kangaroo->header), 1, file);
+	for (i = 0; ok && i < kangaroo->capacity; i++) {
+		if (kangaroo->points[i].type != KANGAROO_EMPTY) {
+			ok = fwrite(&kangaroo->points[i], sizeof(kangaroo->points[i]), 1,
+				file);
+		}
+	}
+	if (file && fclose(file) != 0) {
+		ok = 0;
+	}
+	ok = ok && rename(temporary, filename) == 0;
+	if (!ok) {
+		applog(APPLOG_ERROR, __func__, "Failed to write file [%s] (%s)",
+			temporary, strerror(errno)
+		);
+		remove(temporary);
+	}
+	free(temporary);
+
+	return ok ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+/* Read the distinguished points of an earlier run, and the jumps and
+   criteria it used, if the checkpoint file exists. */
+static BitcoinResult Kangaroo_load(struct Kangaroo *kangaroo)
+{
+	const char *filename = kangaroo->options->checkpoint_filename;
+	FILE *file = fopen(filename, "rb");
+	struct KangarooHeader header;
+	struct KangarooPoint point;
+	uint64_t count, i;
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	if (!file) {
+		if (errno == ENOENT) {
+			return BITCOIN_SUCCESS;
+		}
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1
+		|| memcmp(header.magic, kangaroo_magic, sizeof(kangaroo_magic)) != 0
+		|| header.jump_count == 0
+		|| header.distinguished_bits > 60)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" isn't a kangaroo checkpoint made by this version", filename
+		);
+		fclose(file);
+		return BITCOIN_ERROR_FILE;
+	}
+	if (memcmp(header.target, kangaroo->header.target, sizeof(header.target))
+		|| memcmp(header.start, kangaroo->header.start, sizeof(header.start))
+		|| memcmp(header.end, kangaroo->header.end, sizeof(header.end)))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" is a checkpoint for another public key or range", filename
+		);
+		fclose(file);
+		return BITCOIN_ERROR_FILE;
+	}
+	kangaroo->distinguished_bits = header.distinguished_bits;
+	kangaroo->jump_count = header.jump_count;
+	kangaroo->header.distinguished_bits = header.distinguished_bits;
+	kangaroo->header.jump_count = header.jump_count;
+
+	count = ECBatch_load64(header.count);
+	for (i = 0; result == BITCOIN_SUCCESS && i < count; i++) {
+		if (fread(&point, sizeof(point), 1, file) != 1
+			|| (point.type != KANGAROO_TAME && point.type != KANGAROO_WILD))
+		{
+			applog(APPLOG_ERROR, __func__,
+				"Failed to read distinguished point %llu of \"%s\"",
+				(unsigned long long)i, filename
+			);
+			result = BITCOIN_ERROR_FILE;
+		} else if (Kangaroo_find(kangaroo, point.x)->type == KANGAROO_EMPTY
+			&& !Kangaroo_add(kangaroo, &point))
+		{
+			result = BITCOIN_ERROR;
+		}
+	}
+	fclose(file);
+
+	if (result == BITCOIN_SUCCESS) {
+		applog(APPLOG_NOTICE, __func__,
+			"Carrying on from %lu distinguished points in \"%s\"",
+			(unsigned long)kangaroo->count, filename
+		);
+	}
+	return result;
+}
+
+/* Put a kangaroo at a new random place, tame ones from width/2 to
+   3*width/2 and wild ones from the target to the target + width. */
+static int Kangaroo_start(const struct Kangaroo *kangaroo, BN_CTX *ctx,
+	EC_POINT *point, BIGNUM *distance, int wild)
+{
+	if (!BN_rand_range(distance, kangaroo->width)) {
+		return 0;
+	}
+	if (wild) {
+		return EC_POINT_mul(kangaroo->group, point, distance, kangaroo->target,
+			BN_value_one(), ctx);
+	}
+	return BN_add(distance, distance, kangaroo->half_width)
+		&& EC_POINT_mul(kangaroo->group, point, distance, NULL, NULL, ctx);
+}
+
+/* A tame and a wild kangaroo reached points with the same x, so the key is
+   tame - wild, or -tame - wild if the points were negations of each other.
+   Keep the key if it is one of those. */
+static int Kangaroo_collide(struct Kangaroo *kangaroo, BN_CTX *ctx,
+	const struct KangarooPoint *a, const struct KangarooPoint *b)
+{
+	const struct KangarooPoint *tame = a->type == KANGAROO_TAME ? a : b;
+	const struct KangarooPoint *wild = a->type == KANGAROO_TAME ? b : a;
+	EC_POINT *point = EC_POINT_new(kangaroo->group);
+	BIGNUM *key, *tame_distance, *wild_distance;
+	unsigned negated;
+	int ok;
+
+	BN_CTX_start(ctx);
+	key = BN_CTX_get(ctx);
+	tame_distance = BN_CTX_get(ctx);
+	wild_distance = BN_CTX_get(ctx);
+	ok = point && wild_distance
+		&& BN_bin2bn(tame->distance, ECBATCH_FIELD_SIZE, tame_distance)
+		&& BN_bin2bn(wild->distance, ECBATCH_FIELD_SIZE, wild_distance);
+
+	for (negated = 0; ok && negated < 2 && !kangaroo->found; negated++) {
+		if (negated) {
+			BN_set_negative(tame_distance, 1);
+		}
+		ok = BN_mod_sub(key, tame_distance, wild_distance, kangaroo->order,
+				ctx)
+			&& EC_POINT_mul(kangaroo->group, point, key, NULL, NULL, ctx);
+		if (ok && EC_POINT_cmp(kangaroo->group, point, kangaroo->target, ctx)
+			== 0)
+		{
+			kangaroo->found = BN_new();
+			ok = kangaroo->found
+				&& BN_mod_add(kangaroo->found, key, kangaroo->start,
+					kangaroo->order, ctx);
+			kangaroo->done = 1;
+		}
+	}
+
+	BN_CTX_end(ctx);
+	EC_POINT_free(point);
+	return ok;
+}
+
+/* Keep the distinguished points a herd reached, and mark the kangaroos
+   which are following a kangaroo of their own kind to start again, since
+   they'd keep to its path and never find anything new. */
+static int Kangaroo_store(struct Kangaroo *kangaroo, BN_CTX *ctx,
+	struct KangarooPoint *points, const unsigned *herd_index, unsigned count,
+	char *restart)
+{
+	unsigned i;
+	int ok = 1;
+
+	pthread_mutex_lock(&kangaroo->mutex);
+	for (i = 0; ok && i < count; i++) {
+		struct KangarooPoint *existing = Kangaroo_find(kangaroo, points[i].x);
+
+		if (existing->type == KANGAROO_EMPTY) {
+			if (!Kangaroo_add(kangaroo, &points[i])) {
+				kangaroo->result = BITCOIN_ERROR;
+				kangaroo->done = 1;
+			}
+		} else if (existing->type == points[i].type) {
+			restart[herd_index[i]] = 1;
+		} else {
+			ok = Kangaroo_collide(kangaroo, ctx, existing, &points[i]);
+			restart[herd_index[i]] = 1;
+		}
+	}
+	pthread_mutex_unlock(&kangaroo->mutex);
+
+	return ok;
+}
+
+/* Count a round of jumps, saving the checkpoint if it's due. */
+static void Kangaroo_progress(struct Kangaroo *kangaroo, unsigned count)
+{
+	const struct BitcoinKangarooOptions *options = kangaroo->options;
+
+	pthread_mutex_lock(&kangaroo->mutex);
+	kangaroo->progress.count += count;
+	Progress_update(&kangaroo->progress, kangaroo->progress.count,
+		kangaroo->progress.count);
+	if (kangaroo->progress.count >= kangaroo->give_up) {
+		kangaroo->done = 1;
+	}
+	if (options->checkpoint_filename && !kangaroo->done) {
+		uint64_t now = Timer_nanoseconds();
+
+		if (now - kangaroo->checkpoint_nanoseconds
+			>= (uint64_t)options->checkpoint_interval * 1000000000)
+		{
+			kangaroo->checkpoint_nanoseconds = now;
+			if (Kangaroo_save(kangaroo) != BITCOIN_SUCCESS) {
+				kangaroo->result = BITCOIN_ERROR_FILE;
+				kangaroo->done = 1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&kangaroo->mutex);
+}
+
+static int Kangaroo_isDone(struct Kangaroo *kangaroo)
+{
+	int done;
+
+	pthread_mutex_lock(&kangaroo->mutex);
+	done = kangaroo->done;
+	pthread_mutex_unlock(&kangaroo->mutex);
+
+	return done;
+}
+
+static void Kangaroo_thread(void *arg, unsigned thread_index)
+{
+	struct Kangaroo *kangaroo = arg;
+	const EC_GROUP *group = kangaroo->group;
+	const unsigned herd_size = kangaroo->herd_size,
+		distinguished_shift = 64 - kangaroo->distinguished_bits;
+	EC_POINT *points[KANGAROO_HERD_SIZE];
+	const EC_POINT *jumps[KANGAROO_HERD_SIZE];
+	BIGNUM *distances[KANGAROO_HERD_SIZE];
+	uint8_t x[KANGAROO_HERD_SIZE][ECBATCH_FIELD_SIZE];
+	struct KangarooPoint found[KANGAROO_HERD_SIZE];
+	unsigned found_index[KANGAROO_HERD_SIZE];
+	char restart[KANGAROO_HERD_SIZE];
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *scratch = BN_new();
+	unsigned i, found_count;
+	int ok = ctx && scratch;
+
+	memset(found, 0, sizeof(found));
+	for (i = 0; i < herd_size; i++) {
+		points[i] = EC_POINT_new(group);
+		distances[i] = BN_new();
+		ok = ok && points[i] && distances[i]
+			&& Kangaroo_start(kangaroo, ctx, points[i], distances[i], i & 1);
+	}
+
+	while (ok && !Kangaroo_isDone(kangaroo)) {
+		ok = ECBatch_getX(group, points, herd_size, x, scratch, ctx);
+
+		/* distinguished points start with enough zero bits */
+		found_count = 0;
+		for (i = 0; ok && i < herd_size; i++) {
+			restart[i] = 0;
+			if (kangaroo->distinguished_bits == 0
+				|| ECBatch_load64(x[i]) >> distinguished_shift == 0)
+			{
+				struct KangarooPoint *point = &found[found_count];
+
+				memcpy(point->x, x[i] + ECBATCH_FIELD_SIZE - KANGAROO_X_SIZE,
+					KANGAROO_X_SIZE);
+				point->type = i & 1 ? KANGAROO_WILD : KANGAROO_TAME;
+				ok = BN_bn2binpad(distances[i], point->distance,
+					ECBATCH_FIELD_SIZE) >= 0;
+				found_index[found_count++] = i;
+			}
+		}
+		if (ok && found_count > 0) {
+			ok = Kangaroo_store(kangaroo, ctx, found, found_index, found_count,
+				restart);
+		}
+
+		for (i = 0; ok && i < herd_size; i++) {
+			unsigned jump = (unsigned)(ECBatch_load64(x[i] + 24)
+				% kangaroo->jump_count);
+
+			if (restart[i]) {
+				ok = Kangaroo_start(kangaroo, ctx, points[i], distances[i],
+					i & 1);
+			}
+			jumps[i] = kangaroo->jump_points[jump];
+			ok = ok && BN_add(distances[i], distances[i],
+				kangaroo->jump_distances[jump]);
+		}
+		ok = ok && ECBatch_jump(group, points, jumps, herd_size, ctx);
+		if (ok) {
+			Kangaroo_progress(kangaroo, herd_size);
+		}
+	}
+	if (!ok) {
+		Kangaroo_fail(kangaroo, __func__);
+	}
+
+	for (i = 0; i < herd_size; i++) {
+		EC_POINT_free(points[i]);
+		BN_free(distances[i]);
+	}
+	BN_free(scratch);
+	BN_CTX_free(ctx);
+	applog_flush();
+}
+
+/* Pick herd sizes, jumps and the distinguished point criterion for the
+   range and number of threads. */
+static void Kangaroo_plan(struct Kangaroo *kangaroo,
+	const struct BitcoinKeyRange *range)
+{
+	const unsigned threads = kangaroo->options->threads ?
+		kangaroo->options->threads : 1;
+	double width = 0, root, kangaroos, mean;
+	unsigned i;
+
+	for (i = 0; i < BITCOIN_PRIVATE_KEY_SIZE; i++) {
+		width = width * 256 + (range->end[i] - (double)range->start[i]);
+	}
+	root = sqrt(width + 1);
+	kangaroo->root = root;
+
+	/* enough kangaroos to share the inversions, but not so many that
+	   starting them is most of the work */
+	kangaroo->herd_size = KANGAROO_HERD_SIZE;
+	while (kangaroo->herd_size > 2
+		&& kangaroo->herd_size * 16.0 * threads > root)
+	{
+		kangaroo->herd_size /= 2;
+	}
+
+	/* the mean jump which makes the tame and wild herds meet soonest */
+	kangaroos = (double)kangaroo->herd_size * threads;
+	mean = kangaroos * root / 4;
+	kangaroo->jump_count = 1;
+	while (kangaroo->jump_count < KANGAROO_MAX_JUMPS
+		&& (ldexp(1, kangaroo->jump_count) - 1) / kangaroo->jump_count < mean)
+	{
+		kangaroo->jump_count++;
+	}
+
+	/* rare enough that there are only a few times as many as kangaroos,
+	   common enough that a kangaroo soon reaches one after a meeting */
+	kangaroo->distinguished_bits = 0;
+	while (kangaroo->distinguished_bits < 60
+		&& ldexp(kangaroos, kangaroo->distinguished_bits + 3) <= root)
+	{
+		kangaroo->distinguished_bits++;
+	}
+}
+
+BitcoinResult Kangaroo_solve(struct BitcoinPrivateKey *private_key,
+	const struct BitcoinPublicKey *public_key,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinKangarooOptions *options)
+{
+	struct Kangaroo kangaroo;
+	BN_CTX *ctx = BN_CTX_new();
+	EC_POINT *public_point = NULL;
+	BIGNUM *end = NULL, *scalar = BN_new();
+	BitcoinResult result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	double expected;
+	unsigned i;
+
+	memset(&kangaroo, 0, sizeof(kangaroo));
+	kangaroo.options = options;
+	kangaroo.group = Bitcoin_GetSecp256k1Group();
+	pthread_mutex_init(&kangaroo.mutex, NULL);
+	kangaroo.capacity = KANGAROO_MIN_CAPACITY;
+	kangaroo.points = calloc(kangaroo.capacity, sizeof(*kangaroo.points));
+	if (!kangaroo.points) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to allocate distinguished points"
+		);
+		result = BITCOIN_ERROR;
+		goto done;
+	}
+	if (!kangaroo.group || !ctx || !scalar) {
+		goto done;
+	}
+	kangaroo.order = BN_new();
+	kangaroo.width = BN_new();
+	kangaroo.half_width = BN_new();
+	kangaroo.target = EC_POINT_new(kangaroo.group);
+	public_point = EC_POINT_new(kangaroo.group);
+	kangaroo.start = BN_bin2bn(range->start, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	end = BN_bin2bn(range->end, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	if (!kangaroo.order || !kangaroo.width || !kangaroo.half_width
+		|| !kangaroo.target || !public_point || !kangaroo.start || !end
+		|| !EC_GROUP_get_order(kangaroo.group, kangaroo.order, ctx))
+	{
+		goto done;
+	}
+
+	if (!EC_POINT_oct2point(kangaroo.group, public_point, public_key->data,
+		BitcoinPublicKey_GetSize(public_key), ctx))
+	{
+		applog(APPLOG_ERROR, __func__, "Public key is not a point on the curve");
+		result = BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+		goto done;
+	}
+
+	/* target = public key - start*G */
+	if (!BN_sub(kangaroo.width, end, kangaroo.start)
+		|| !BN_add_word(kangaroo.width, 1)
+		|| !BN_rshift1(kangaroo.half_width, kangaroo.width)
+		|| !BN_sub(scalar, kangaroo.order, kangaroo.start)
+		|| !BN_nnmod(scalar, scalar, kangaroo.order, ctx)
+		|| !EC_POINT_mul(kangaroo.group, kangaroo.target, scalar, public_point,
+			BN_value_one(), ctx)
+		|| !EC_POINT_point2oct(kangaroo.group, public_point,
+			POINT_CONVERSION_COMPRESSED, kangaroo.header.target,
+			sizeof(kangaroo.header.target), ctx))
+	{
+		goto done;
+	}
+
+	Kangaroo_plan(&kangaroo, range);
+	memcpy(kangaroo.header.magic, kangaroo_magic, sizeof(kangaroo_magic));
+	memcpy(kangaroo.header.start, range->start, BITCOIN_PRIVATE_KEY_SIZE);
+	memcpy(kangaroo.header.end, range->end, BITCOIN_PRIVATE_KEY_SIZE);
+	kangaroo.header.distinguished_bits = kangaroo.distinguished_bits;
+	kangaroo.header.jump_count = kangaroo.jump_count;
+	if (options->checkpoint_filename) {
+		result = Kangaroo_load(&kangaroo);
+		if (result != BITCOIN_SUCCESS) {
+			goto done;
+		}
+		result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	}
+
+	for (i = 0; i < kangaroo.jump_count; i++) {
+		kangaroo.jump_points[i] = EC_POINT_new(kangaroo.group);
+		kangaroo.jump_distances[i] = BN_new();
+		if (!kangaroo.jump_points[i] || !kangaroo.jump_distances[i]
+			|| !BN_set_bit(kangaroo.jump_distances[i], i)
+			|| !EC_POINT_mul(kangaroo.group, kangaroo.jump_points[i],
+				kangaroo.jump_distances[i], NULL, NULL, ctx))
+		{
+			goto done;
+		}
+	}
+
+	/* 2*sqrt(N) jumps to meet, and a few more to reach a distinguished
+	   point after */
+	expected = 2 * kangaroo.root + ldexp((double)kangaroo.herd_size
+		* (options->threads ? options->threads : 1),
+		kangaroo.distinguished_bits);
+	kangaroo.give_up = expected * KANGAROO_GIVE_UP >= 1.8e19 ?
+		UINT64_MAX : (uint64_t)(expected * KANGAROO_GIVE_UP);
+
+	applog(APPLOG_NOTICE, __func__,
+		"Expecting about %.0f jumps, %u kangaroos per thread, points with"
+		" %u leading zero bits distinguished",
+		expected, kangaroo.herd_size, kangaroo.distinguished_bits
+	);
+
+	kangaroo.result = BITCOIN_SUCCESS;
+	kangaroo.checkpoint_nanoseconds = Timer_nanoseconds();
+	Progress_init(&kangaroo.progress, stderr, "jumps",
+		options->progress_interval);
+	result = Parallel_run(options->threads ? options->threads : 1,
+		Kangaroo_thread, &kangaroo);
+	if (result == BITCOIN_SUCCESS) {
+		result = kangaroo.result;
+	}
+	if (kangaroo.progress.interval) {
+		Progress_report(&kangaroo.progress);
+	}
+	if (result == BITCOIN_SUCCESS && options->checkpoint_filename) {
+		result = Kangaroo_save(&kangaroo);
+	}
+
+	if (result == BITCOIN_SUCCESS) {
+		if (!kangaroo.found) {
+			result = BITCOIN_ERROR_NOT_FOUND;
+		} else if (BN_bn2binpad(kangaroo.found, private_key->data,
+			BITCOIN_PRIVATE_KEY_SIZE) < 0)
+		{
+			result = BITCOIN_ERROR_LIBRARY_FAILURE;
+		} else {
+			private_key->public_key_compression = public_key->compression;
+			private_key->network_type = NULL;
+		}
+	}
+
+done:
+	if (result == BITCOIN_ERROR_LIBRARY_FAILURE) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+	pthread_mutex_destroy(&kangaroo.mutex);
+	for (i = 0; i < KANGAROO_MAX_JUMPS; i++) {
+		EC_POINT_free(kangaroo.jump_points[i]);
+		BN_free(kangaroo.jump_distances[i]);
+	}
+	free(kangaroo.points);
+	BN_clear_free(kangaroo.found);
+	BN_free(kangaroo.order);
+	BN_free(kangaroo.start);
+	BN_free(kangaroo.width);
+	BN_free(kangaroo.half_width);
+	EC_POINT_free(kangaroo.target);
+	EC_POINT_free(public_point);
+	BN_free(end);
+	BN_free(scalar);
+	BN_CTX_free(ctx);
+	return result;
+}
@@ -0,0 +1,67 @@
+#ifndef BITCOIN_INCLUDE_KANGAROO_H
+#define BITCOIN_INCLUDE_KANGAROO_H
+
+/** @file kangaroo.h
+ *  @brief Pollard's kangaroo method, to find the private key of a public
+ *         key in a range too large for baby-step giant-step tables.
+ *
+ *  Each thread has a herd of kangaroos, half tame (starting from known
+ *  keys) and half wild (starting from the public key plus a known
+ *  distance).  Every kangaroo jumps by a power of two multiple of G chosen
+ *  by its x coordinate, so two kangaroos which land on the same point
+ *  follow the same path from then on.  Points whose x starts with a number
+ *  of zero bits are distinguished, and kept with the distance travelled to
+ *  reach them; when a tame and a wild kangaroo reach the same one, the
+ *  difference of their distances is the key.  It takes about 2*sqrt(N)
+ *  jumps for a range of N keys, with memory for only the distinguished
+ *  points.
+ *
+ *  The distinguished points can be saved to a checkpoint file as the
+ *  search goes, and a later run for the same public key and range carries
+ *  on from them instead of starting again.
+ *
+ *  @author Matthew Anger
+ */
+
+#include "keys.h" /* struct BitcoinPrivateKey, struct BitcoinPublicKey */
+#include "result.h" /* BitcoinResult */
+#include "search.h" /* struct BitcoinKeyRange */
+
+struct BitcoinKangarooOptions {
+	/* threads, each with its own herd */
+	unsigned threads;
+
+	/* file to keep the distinguished points in, read at the start if it
+	   exists, NULL for none */
+	const char *checkpoint_filename;
+
+	/* seconds between saves of the checkpoint file */
+	unsigned checkpoint_interval;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+};
+
+/** @brief Find the private key of 'public_key' in 'range'.
+ *
+ *  The private key found has the compression of the public key, and no
+ *  network type.  The method can't tell that the key isn't in the range,
+ *  so it gives up after many times the number of jumps it expects to
+ *  need.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if the key was found.
+ *          BITCOIN_ERROR_NOT_FOUND if it gave up.
+ *          BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT if the public key isn't
+ *          a point on the curve.
+ *          BITCOIN_ERROR_FILE if the checkpoint file can't be read or
+ *          written, or is for another public key or range.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Kangaroo_solve(struct BitcoinPrivateKey *private_key,
+	const struct BitcoinPublicKey *public_key,
+	const struct BitcoinKeyRange *range,
+	const struct BitcoinKangarooOptions *options
+);
+
+#endif
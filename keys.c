@@ -4,16 +4,21 @@ Elliptic curve secp256k1 related functions.
 reference : https://en.bitcoin.it/wiki/Secp256k1
 */
 
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
 #include <string.h>
+#include <pthread.h>
 
 #include <openssl/ecdsa.h>
 #include <openssl/obj_mac.h>
 #include <openssl/err.h>
 
 #include "keys.h"
+#include "ecbatch.h"
 #include "base58.h"
 #include "applog.h"
 #include "hash.h"
+#include "prefix.h"
 
 int BitcoinPublicKey_Empty(const struct BitcoinPublicKey *public_key)
 {
@@ -195,20 +200,80 @@ err:
 	return group;
 }
 
-EC_KEY *EC_KEY_new_by_curve_name_NID_secp256k1(void)
-{
-	static EC_GROUP *group = NULL;
-	EC_KEY *ret = NULL;
+/* the group is shared by every key, and made only once even when keys are
+   made on several threads at the same time */
+static EC_GROUP *secp256k1_group = NULL;
+static pthread_once_t secp256k1_group_once = PTHREAD_ONCE_INIT;
 
-	if (group == NULL) {
+static void secp256k1_group_init(void)
+{
 #ifdef HAVE_NID_secp256k1
-		group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+	secp256k1_group = EC_GROUP_new_by_curve_name(NID_secp256k1);
 #else
-		group = ec_group_new_from_data(&EC_SECG_PRIME_256K1.h);
+	secp256k1_group = ec_group_new_from_data(&EC_SECG_PRIME_256K1.h);
 #endif
-		if (group == NULL) {
-			return NULL;
-		}
+}
+
+const EC_GROUP *Bitcoin_GetSecp256k1Group(void)
+{
+	pthread_once(&secp256k1_group_once, secp256k1_group_init);
+	return secp256k1_group;
+}
+
+static const char *secp256k1_beta_hex =
+	"7ae96a2b657c07106e64479eac3434e99cf0497512f58995c1396c28719501ee";
+static const char *secp256k1_lambda_hex =
+	"5363ad4cc05c30e0a5261c028812645a122e22ea20816678df02967c1b23bd72";
+static const char *secp256k1_a1_hex = "3086d221a7d46bcde86c90e49284eb15";
+static const char *secp256k1_b1_hex = "-e4437ed6010e88286f547fa90abfe4c3";
+static const char *secp256k1_a2_hex = "114ca50f7a8e2f3f657c1108d9d44cfd8";
+
+static struct BitcoinSecp256k1Endomorphism secp256k1_endomorphism;
+static int secp256k1_endomorphism_ok = 0;
+static pthread_once_t secp256k1_endomorphism_once = PTHREAD_ONCE_INIT;
+
+static void secp256k1_endomorphism_init(void)
+{
+	struct BitcoinSecp256k1Endomorphism *e = &secp256k1_endomorphism;
+	BIGNUM *beta = NULL, *lambda = NULL, *a1 = NULL, *b1 = NULL, *a2 = NULL;
+
+	secp256k1_endomorphism_ok = BN_hex2bn(&beta, secp256k1_beta_hex)
+		&& BN_hex2bn(&lambda, secp256k1_lambda_hex)
+		&& BN_hex2bn(&a1, secp256k1_a1_hex)
+		&& BN_hex2bn(&b1, secp256k1_b1_hex)
+		&& BN_hex2bn(&a2, secp256k1_a2_hex);
+	if (!secp256k1_endomorphism_ok) {
+		BN_free(beta);
+		BN_free(lambda);
+		BN_free(a1);
+		BN_free(b1);
+		BN_free(a2);
+		return;
+	}
+	e->beta = beta;
+	e->lambda = lambda;
+	e->a1 = a1;
+	e->b1 = b1;
+	e->a2 = a2;
+
+	/* b2 is the same as a1 */
+	e->b2 = a1;
+}
+
+const struct BitcoinSecp256k1Endomorphism *
+	Bitcoin_GetSecp256k1Endomorphism(void)
+{
+	pthread_once(&secp256k1_endomorphism_once, secp256k1_endomorphism_init);
+	return secp256k1_endomorphism_ok ? &secp256k1_endomorphism : NULL;
+}
+
+EC_KEY *EC_KEY_new_by_curve_name_NID_secp256k1(void)
+{
+	EC_KEY *ret = NULL;
+
+	pthread_once(&secp256k1_group_once, secp256k1_group_init);
+	if (secp256k1_group == NULL) {
+		return NULL;
 	}
 
 	ret = EC_KEY_new();
@@ -216,7 +281,7 @@ EC_KEY *EC_KEY_new_by_curve_name_NID_secp256k1(void)
 		return NULL;
 	}
 
-	EC_KEY_set_group(ret, group);
+	EC_KEY_set_group(ret, secp256k1_group);
 
 	return ret;
 }
@@ -343,3 +408,296 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 
 	return BITCOIN_SUCCESS;
 }
+
+/* Multiples of G for Bitcoin_MakePublicKeyFromPrivateKeyFast(), entry
+   [i][j] being (j+1)*256^i*G, affine so each addition is cheaper, so that a
+   key takes one addition for each of its non-zero bytes. */
+#define SECP256K1_COMB_WINDOWS BITCOIN_PRIVATE_KEY_SIZE
+#define SECP256K1_COMB_POINTS 255
+
+static EC_POINT *secp256k1_comb[SECP256K1_COMB_WINDOWS][SECP256K1_COMB_POINTS];
+static int secp256k1_comb_ok = 0;
+static pthread_once_t secp256k1_comb_once = PTHREAD_ONCE_INIT;
+
+static void secp256k1_comb_init(void)
+{
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	BN_CTX *ctx = BN_CTX_new();
+	EC_POINT *base = NULL;
+	unsigned i, j;
+	int ok = group && ctx;
+
+	if (ok) {
+		base = EC_POINT_dup(EC_GROUP_get0_generator(group), group);
+		ok = base != NULL;
+	}
+	for (i = 0; ok && i < SECP256K1_COMB_WINDOWS; i++) {
+		for (j = 0; ok && j < SECP256K1_COMB_POINTS; j++) {
+			secp256k1_comb[i][j] = EC_POINT_new(group);
+			ok = secp256k1_comb[i][j]
+				&& (j == 0 ?
+					EC_POINT_copy(secp256k1_comb[i][j], base) :
+					EC_POINT_add(group, secp256k1_comb[i][j],
+						secp256k1_comb[i][j - 1], base, ctx));
+		}
+		/* the next window starts from 256 times this one */
+		ok = ok
+			&& EC_POINT_add(group, base,
+				secp256k1_comb[i][SECP256K1_COMB_POINTS - 1], base, ctx)
+			&& EC_POINTs_make_affine(group, SECP256K1_COMB_POINTS,
+				secp256k1_comb[i], ctx);
+	}
+	if (!ok) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+	secp256k1_comb_ok = ok;
+
+	EC_POINT_free(base);
+	BN_CTX_free(ctx);
+}
+
+int Bitcoin_MulGeneratorFast(EC_POINT *point, const unsigned char *scalar,
+	BN_CTX *ctx)
+{
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	unsigned i;
+	int ok;
+
+	pthread_once(&secp256k1_comb_once, secp256k1_comb_init);
+	ok = secp256k1_comb_ok && EC_POINT_set_to_infinity(group, point);
+	for (i = 0; ok && i < SECP256K1_COMB_WINDOWS; i++) {
+		unsigned byte = scalar[BITCOIN_PRIVATE_KEY_SIZE - 1 - i];
+
+		if (byte) {
+			ok = EC_POINT_add(group, point, point,
+				secp256k1_comb[i][byte - 1], ctx);
+		}
+	}
+	return ok;
+}
+
+BitcoinResult Bitcoin_MakePublicKeyFromPrivateKeyFast(
+	struct BitcoinPublicKey *public_key,
+	const struct BitcoinPrivateKey *private_key
+)
+{
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	const int compressed =
+		private_key->public_key_compression == BITCOIN_PUBLIC_KEY_COMPRESSED;
+	BN_CTX *ctx = BN_CTX_new();
+	EC_POINT *point = group ? EC_POINT_new(group) : NULL;
+	BitcoinResult result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	int ok;
+
+	ok = ctx && point
+		&& Bitcoin_MulGeneratorFast(point, private_key->data, ctx);
+
+	if (ok && EC_POINT_is_at_infinity(group, point)) {
+		/* the key was 0 or the order of the group */
+		result = BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+	} else if (ok && EC_POINT_point2oct(group, point,
+		compressed ?
+			POINT_CONVERSION_COMPRESSED : POINT_CONVERSION_UNCOMPRESSED,
+		public_key->data, sizeof(public_key->data), ctx))
+	{
+		public_key->compression = compressed ?
+			BITCOIN_PUBLIC_KEY_COMPRESSED : BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+		public_key->network_type = private_key->network_type;
+		result = BITCOIN_SUCCESS;
+	} else {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+
+	EC_POINT_free(point);
+	BN_CTX_free(ctx);
+	return result;
+}
+
+/* the field prime p of secp256k1, big-endian */
+static const unsigned char secp256k1_p[32] = {
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFE,0xFF,0xFF,0xFC,0x2F
+};
+
+/* public keys checked together, their Jacobi symbols side by side */
+#define KEYS_CHECK_BATCH ECBATCH_MAX_LANES
+
+/* Montgomery multiplication mod p, which takes a fraction of the time of
+   BN_mod_mul() as there's no division, shared by every key checked.  It
+   leaves an extra factor of 1/R in each product, which is kept track of
+   rather than taken out: both sides of y^2 = x^3 + 7 are compared over
+   R^2, and x^3 + 7 over R^2 has a square root just when x^3 + 7 does. */
+static BIGNUM *secp256k1_check_p = NULL;
+static BIGNUM *secp256k1_check_one = NULL;
+static BIGNUM *secp256k1_check_seven = NULL; /* 7 / R^2 */
+static BN_MONT_CTX *secp256k1_check_mont = NULL;
+static int secp256k1_check_ok = 0;
+static pthread_once_t secp256k1_check_once = PTHREAD_ONCE_INIT;
+
+static void secp256k1_check_init(void)
+{
+	BN_CTX *ctx = BN_CTX_new();
+
+	secp256k1_check_p = BN_bin2bn(secp256k1_p, sizeof(secp256k1_p), NULL);
+	secp256k1_check_one = BN_new();
+	secp256k1_check_seven = BN_new();
+	secp256k1_check_mont = BN_MONT_CTX_new();
+
+	secp256k1_check_ok = ctx && secp256k1_check_p && secp256k1_check_one
+		&& secp256k1_check_seven && secp256k1_check_mont
+		&& BN_MONT_CTX_set(secp256k1_check_mont, secp256k1_check_p, ctx)
+		&& BN_one(secp256k1_check_one)
+		&& BN_set_word(secp256k1_check_seven, 7)
+		&& BN_mod_mul_montgomery(secp256k1_check_seven, secp256k1_check_seven,
+			secp256k1_check_one, secp256k1_check_mont, ctx)
+		&& BN_mod_mul_montgomery(secp256k1_check_seven, secp256k1_check_seven,
+			secp256k1_check_one, secp256k1_check_mont, ctx);
+
+	BN_CTX_free(ctx);
+}
+
+/* Check the prefix and coordinates of a key, and set 'rhs' to
+   (x^3 + 7) / R^2, returning the reason it's invalid, or NULL if it may be
+   valid.  Sets '*ok' to 0 if OpenSSL failed. */
+static const char *Bitcoin_checkPublicKeyPoint(
+	const struct BitcoinPublicKey *public_key, BIGNUM *x, BIGNUM *y,
+	BIGNUM *rhs, BN_CTX *ctx, int *ok)
+{
+	const unsigned char *data = public_key->data;
+	const int compressed =
+		public_key->compression == BITCOIN_PUBLIC_KEY_COMPRESSED;
+	BN_MONT_CTX *mont = secp256k1_check_mont;
+
+	if (compressed ? (data[0] != 0x02 && data[0] != 0x03) : data[0] != 0x04) {
+		return compressed ? "compressed key doesn't start with 02 or 03"
+			: "uncompressed key doesn't start with 04";
+	}
+	if (memcmp(data + 1, secp256k1_p, sizeof(secp256k1_p)) >= 0) {
+		return "x coordinate isn't below the field prime";
+	}
+	if (!compressed && memcmp(data + 33, secp256k1_p, sizeof(secp256k1_p)) >= 0) {
+		return "y coordinate isn't below the field prime";
+	}
+
+	*ok = BN_bin2bn(data + 1, 32, x)
+		&& BN_mod_mul_montgomery(rhs, x, x, mont, ctx)
+		&& BN_mod_mul_montgomery(rhs, rhs, x, mont, ctx)
+		&& BN_mod_add_quick(rhs, rhs, secp256k1_check_seven,
+			secp256k1_check_p);
+	if (*ok && !compressed) {
+		*ok = BN_bin2bn(data + 33, 32, y)
+			&& BN_mod_mul_montgomery(y, y, y, mont, ctx)
+			&& BN_mod_mul_montgomery(y, y, secp256k1_check_one, mont, ctx);
+		if (*ok && BN_cmp(y, rhs) != 0) {
+			return "point isn't on the curve";
+		}
+	}
+	return NULL;
+}
+
+BitcoinResult Bitcoin_CheckPublicKeys(
+	const struct BitcoinPublicKey *const *public_keys, size_t count,
+	BitcoinResult *results
+)
+{
+	uint8_t rhs_bytes[KEYS_CHECK_BATCH][ECBATCH_FIELD_SIZE];
+	int symbols[KEYS_CHECK_BATCH];
+	size_t compressed[KEYS_CHECK_BATCH];
+	BN_CTX *ctx;
+	BIGNUM *x, *y, *rhs;
+	size_t i, j, n = 0;
+	int ok;
+
+	pthread_once(&secp256k1_check_once, secp256k1_check_init);
+	ctx = secp256k1_check_ok ? BN_CTX_new() : NULL;
+	if (!ctx) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+		return BITCOIN_ERROR_LIBRARY_FAILURE;
+	}
+	BN_CTX_start(ctx);
+	x = BN_CTX_get(ctx);
+	y = BN_CTX_get(ctx);
+	rhs = BN_CTX_get(ctx);
+	ok = rhs != NULL;
+
+	/* uncompressed keys are done as they come, and compressed ones once
+	   there are enough of them to make their Jacobi symbols together */
+	for (i = 0; ok && i < count; i++) {
+		const char *reason = Bitcoin_checkPublicKeyPoint(public_keys[i],
+			x, y, rhs, ctx, &ok);
+
+		results[i] = BITCOIN_SUCCESS;
+		if (reason) {
+			applog(APPLOG_ERROR, __func__, "Invalid public key: %s.", reason);
+			results[i] = BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+		} else if (ok && public_keys[i]->compression
+			== BITCOIN_PUBLIC_KEY_COMPRESSED)
+		{
+			compressed[n] = i;
+			ok = BN_bn2binpad(rhs, rhs_bytes[n++], ECBATCH_FIELD_SIZE) >= 0;
+		}
+		if (ok && n > 0 && (n == KEYS_CHECK_BATCH || i + 1 == count)) {
+			ok = ECBatch_jacobi(secp256k1_check_p,
+				(const uint8_t (*)[ECBATCH_FIELD_SIZE])rhs_bytes, n, symbols,
+				ctx);
+			for (j = 0; ok && j < n; j++) {
+				if (symbols[j] != 1) {
+					applog(APPLOG_ERROR, __func__, "Invalid public key:"
+						" x coordinate isn't on the curve.");
+					results[compressed[j]] =
+						BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+				}
+			}
+			n = 0;
+		}
+	}
+	if (!ok) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return ok ? BITCOIN_SUCCESS : BITCOIN_ERROR_LIBRARY_FAILURE;
+}
+
+void Bitcoin_MakeAddressFromRIPEMD160(
+	struct BitcoinAddress *address,
+	const struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinNetworkType *network_type
+)
+{
+	memcpy(address->data+1, hash->data, BITCOIN_RIPEMD160_SIZE);
+	address->data[0] = BitcoinNetworkType_GetPublicKeyPrefix(network_type);
+}
+
+void Bitcoin_MakeRIPEMD160FromAddress(
+	struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinAddress *address
+)
+{
+	memcpy(&hash->data, address->data+BITCOIN_ADDRESS_VERSION_SIZE, BITCOIN_RIPEMD160_SIZE);
+}
+
+void Bitcoin_MakeRIPEMD160FromSHA256(
+	struct BitcoinRIPEMD160 *output_hash,
+	const struct BitcoinSHA256 *input_hash
+)
+{
+	Bitcoin_RIPEMD160(output_hash, &input_hash->data, BITCOIN_SHA256_SIZE);
+}
+
+void Bitcoin_MakeSHA256FromPublicKey(
+	struct BitcoinSHA256 *output_hash,
+	const struct BitcoinPublicKey *public_key
+)
+{
+	Bitcoin_SHA256(output_hash, &public_key->data, BitcoinPublicKey_GetSize(public_key));
+}
@@ -11,6 +11,11 @@
 #include "result.h" /* BitcoinResult */
 #include "utility.h" /* uint_max2 */
 
+/* OpenSSL types, without needing its headers */
+struct ec_point_st;
+struct bignum_st;
+struct bignum_ctx;
+
 /* declare Bitcoin address format */
 
 #define BITCOIN_ADDRESS_VERSION_SIZE 1
@@ -144,6 +149,63 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	const struct BitcoinPrivateKey *private_key
 );
 
+/** @brief Convert a private key to a public key, about ten times faster
+ *         than Bitcoin_MakePublicKeyFromPrivateKey(), by adding up
+ *         precomputed multiples of G.  The time taken depends on the
+ *         private key, so only use it for keys which are no secret to
+ *         anyone able to time it, such as leaked passphrases being audited.
+ *         Uncompressed unless the private key says compressed.
+ *
+ *  @param public_key[output] Pointer to public key to write.
+ *  @param private_key Pointer to private key to read.
+
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult Bitcoin_MakePublicKeyFromPrivateKeyFast(
+	struct BitcoinPublicKey *public_key,
+	const struct BitcoinPrivateKey *private_key
+);
+
+/** @brief Check that public keys are points on the secp256k1 curve, so
+ *         that their addresses can be spent from: the first byte is 02 or
+ *         03 for compressed keys and 04 for uncompressed ones, the
+ *         coordinates are below the field prime p, and y^2 = x^3 + 7, or for
+ *         compressed keys x^3 + 7 has a square root.
+ *
+ *         The square root is never taken, only the Jacobi symbol of x^3 + 7,
+ *         made by subtracting and shifting instead of raising it to the
+ *         power (p - 1) / 2, for several keys side by side, and the
+ *         multiplications are Montgomery ones.  Why each invalid key is
+ *         invalid is logged.
+ *
+ *  @param public_keys[input] The keys to check.
+ *  @param count Number of keys.
+ *  @param results[output] For each key, BITCOIN_SUCCESS if it's valid, or
+ *         BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT if not.
+
+ *  @return BITCOIN_SUCCESS if the keys were checked, whether or not they
+ *          are valid, or BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Bitcoin_CheckPublicKeys(
+	const struct BitcoinPublicKey *const *public_keys, size_t count,
+	BitcoinResult *results
+);
+
+/** @brief Set 'point' to 'scalar' times G, the same way as
+ *         Bitcoin_MakePublicKeyFromPrivateKeyFast() and with the same
+ *         caveat, but leaving it in projective coordinates so that a batch
+ *         of points can be made affine together.
+ *
+ *  @param point[output] Point on the secp256k1 curve to write.
+ *  @param scalar[input] 32 byte big-endian number to multiply G by.
+ *  @param ctx OpenSSL scratch space.
+
+ *  @return 1 if success, 0 if OpenSSL failed.
+ */
+int Bitcoin_MulGeneratorFast(struct ec_point_st *point,
+	const unsigned char *scalar, struct bignum_ctx *ctx
+);
+
 /** @brief Convert a public key to a Bitcoin address structure.
  *
  *  @param address[output] Pointer to address to write.
@@ -156,6 +218,72 @@ BitcoinResult Bitcoin_MakeAddressFromPublicKey(
 	const struct BitcoinPublicKey *public_key
 );
 
+/** @brief Make an address from a RIPEMD160(SHA256(public key)) hash, using
+ *         the public key prefix of the network type.
+ *
+ *  @param address[output] Pointer to address to write.
+ *  @param hash[input] Pointer to hash of public key to read.
+ *  @param network_type[input] Network type to take the prefix byte from.
+ */
+void Bitcoin_MakeAddressFromRIPEMD160(
+	struct BitcoinAddress *address,
+	const struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinNetworkType *network_type
+);
+
+/** @brief Extract the RIPEMD160(SHA256(public key)) hash from an address.
+ *
+ *  @param hash[output] Pointer to hash to write.
+ *  @param address[input] Pointer to address to read.
+ */
+void Bitcoin_MakeRIPEMD160FromAddress(
+	struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinAddress *address
+);
+
+/** @brief Calculate RIPEMD160 of a SHA256 hash of a public key.
+ *
+ *  @param output_hash[output] Pointer to hash to write.
+ *  @param input_hash[input] Pointer to SHA256 hash to read.
+ */
+void Bitcoin_MakeRIPEMD160FromSHA256(
+	struct BitcoinRIPEMD160 *output_hash,
+	const struct BitcoinSHA256 *input_hash
+);
+
+/** @brief Calculate SHA256 of a public key, compressed or uncompressed
+ *         depending on the compression type of the key.
+ *
+ *  @param output_hash[output] Pointer to hash to write.
+ *  @param public_key[input] Pointer to public key to read.
+ */
+void Bitcoin_MakeSHA256FromPublicKey(
+	struct BitcoinSHA256 *output_hash,
+	const struct BitcoinPublicKey *public_key
+);
+
+/** @brief The secp256k1 group, shared by every caller and never freed.
+ *
+ *  @return The group, or NULL if it couldn't be made.
+ */
+const struct ec_group_st *Bitcoin_GetSecp256k1Group(void);
+
+/* secp256k1's endomorphism lambda * (x, y) = (beta * x, y), beta and lambda
+   being cube roots of unity mod p and mod n, and the basis (a1, b1),
+   (a2, b2) of scalars k1 + k2 * lambda = 0 mod n, which splits a scalar into
+   two of half its length (from the GLV paper, as used by libsecp256k1) */
+struct BitcoinSecp256k1Endomorphism {
+	const struct bignum_st *beta, *lambda, *a1, *b1, *a2, *b2;
+};
+
+/** @brief The constants of secp256k1's endomorphism, shared by every caller
+ *         and never freed.
+ *
+ *  @return The constants, or NULL if they couldn't be made.
+ */
+const struct BitcoinSecp256k1Endomorphism *
+	Bitcoin_GetSecp256k1Endomorphism(void);
+
 /** @brief Convert a base58 representation of a private key to a raw
  *         private key.
  *
@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
@@ -19,10 +20,54 @@
 #include "applog.h"
 #include "result.h"
 #include "prefix.h"
+#include "benchmark.h"
+#include "parallel.h"
+#include "stats.h"
+#include "progress.h"
+#include "timer.h"
+#include "confusion.h"
+#include "match.h"
+#include "minikey.h"
+#include "search.h"
+#include "bsgs.h"
+#include "kangaroo.h"
+#include "bip32.h"
+#include "bip39.h"
+#include "recovery.h"
+#include "pbkdf2.h"
+#include "bip38.h"
+#include "scrypt.h"
+#include "secure.h"
+#include "ecbatch.h"
+#include "message.h"
 
 #define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS 3
 #define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_INSERT_CHARS 3
 #define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_REMOVE_CHARS 3
+#define BITCOINTOOL_OPTION_DEFAULT_PROGRESS_INTERVAL 5
+#define BITCOINTOOL_OPTION_DEFAULT_SOLVE_MEMORY 1024
+#define BITCOINTOOL_OPTION_DEFAULT_SOLVE_CHECKPOINT_INTERVAL 300
+
+/* number of batch records which may be in progress at once when using
+   more than one thread, which bounds the memory used while an expensive
+   record holds up the output of those after it */
+#define BITCOINTOOL_PARALLEL_WINDOW 1024
+
+/* most --threads, far more than any machine has processors, but few enough
+   that a mistyped number fails here rather than while starting them */
+#define BITCOINTOOL_MAX_THREADS 1024
+
+/* children of an extended key derived at a time, before they're written */
+#define BITCOINTOOL_DERIVE_CHUNK 4096
+
+/* locked output buffer of each batch record, and of each batch of generated
+   keys, before either spills over onto the heap */
+#define BITCOINTOOL_RECORD_OUTPUT_SIZE 512
+#define BITCOINTOOL_GENERATE_OUTPUT_SIZE 65536
+
+/* most batch records converted side by side by one task, the larger of
+   PBKDF2_MAX_LANES and ECBATCH_MAX_LANES */
+#define BITCOINTOOL_MAX_LANES 16
 
 typedef struct BitcoinTool BitcoinTool;
 typedef struct BitcoinToolOptions BitcoinToolOptions;
@@ -39,7 +84,12 @@ struct BitcoinToolOptions {
 		INPUT_TYPE_PUBLIC_KEY,
 		INPUT_TYPE_PRIVATE_KEY_WIF,
 		INPUT_TYPE_PRIVATE_KEY,
-		INPUT_TYPE_MINI_PRIVATE_KEY
+		INPUT_TYPE_MINI_PRIVATE_KEY,
+		INPUT_TYPE_PASSPHRASE,
+		INPUT_TYPE_EXTENDED_PRIVATE_KEY,
+		INPUT_TYPE_EXTENDED_PUBLIC_KEY,
+		INPUT_TYPE_MNEMONIC,
+		INPUT_TYPE_PRIVATE_KEY_BIP38
 	} input_type;
 
 	enum InputFormat {
@@ -60,7 +110,9 @@ struct BitcoinToolOptions {
 		OUTPUT_TYPE_PUBLIC_KEY_SHA256,
 		OUTPUT_TYPE_PUBLIC_KEY,
 		OUTPUT_TYPE_PRIVATE_KEY_WIF,
-		OUTPUT_TYPE_PRIVATE_KEY
+		OUTPUT_TYPE_PRIVATE_KEY,
+		OUTPUT_TYPE_PRIVATE_KEY_BIP38,
+		OUTPUT_TYPE_MINI_PRIVATE_KEY
 	} output_type;
 
 	enum OutputFormat {
@@ -90,6 +142,12 @@ struct BitcoinToolOptions {
 	/* maximum number of characters to remove */
 	unsigned fix_base58_remove_chars;
 
+	/* file of likely mistakes to override the built-in confusion model */
+	const char *fix_base58_confusion_file;
+
+	/* attempt to fix invalid bech32 encoded inputs? */
+	int fix_bech32;
+
 	/* set the network type prefix of addresses, public keys and private keys */
 	const struct BitcoinNetworkType *network_type;
 
@@ -99,6 +157,103 @@ struct BitcoinToolOptions {
 	/* in batch mode we can set a flag to ignore invalid inputs and continue
 	   with the next line */
 	int ignore_input_errors;
+
+	/* number of threads to use, where the work can be split up */
+	unsigned threads;
+
+	/* search a range of private keys for addresses in --match-file instead
+	   of converting input */
+	int search;
+	struct BitcoinKeyRange search_range;
+
+	/* addresses to search for, or to only write out input matching */
+	const char *match_file;
+
+	/* generate this many random mini private keys instead of converting
+	   input */
+	int generate;
+	uint64_t generate_count;
+
+	/* check six keys for each point in the search, using the endomorphism
+	   and negation */
+	int search_endomorphism;
+
+	/* find the private key of public key input in this range */
+	int solve;
+	struct BitcoinKeyRange solve_range;
+
+	enum SolveMethod {
+		SOLVE_METHOD_BSGS,
+		SOLVE_METHOD_KANGAROO
+	} solve_method;
+
+	/* megabytes of baby steps, and a file to keep them in */
+	unsigned solve_memory;
+	const char *solve_table_file;
+
+	/* file to keep kangaroo distinguished points in, and seconds between
+	   saves */
+	const char *solve_checkpoint_file;
+	unsigned solve_checkpoint_interval;
+
+	/* write out keys derived from extended key input at this path, rather
+	   than the extended key itself */
+	int derive;
+	struct BitcoinDerivationPath derive_path;
+
+	/* BIP39 passphrase salting the seeds of mnemonic input */
+	const char *mnemonic_passphrase;
+
+	/* search for missing or mistyped words of mnemonic input, and how many
+	   words on the wordlist may be wrong too */
+	int fix_mnemonic;
+	unsigned fix_mnemonic_change_words;
+
+	/* search for the unreadable or misread characters of mini private key
+	   input, how many readable characters may be wrong too, and the file
+	   recording how far the search has got */
+	int fix_mini_private_key;
+	unsigned fix_mini_private_key_change_chars;
+	const char *fix_mini_private_key_checkpoint_file;
+
+	/* passphrase of BIP38 private key input or output, or a file of
+	   candidates to try until one decrypts the input */
+	const char *bip38_passphrase;
+	const char *bip38_passphrase_file;
+
+	/* megabytes of scrypt memory for BIP38 keys, 0 for one table a thread */
+	unsigned bip38_memory;
+
+	/* check the signed message on each line of input instead of converting
+	   it, writing out the public key which signed it as the output type */
+	int verify_message;
+
+	/* run the built-in benchmarks instead of converting input */
+	int benchmark;
+	unsigned benchmark_scale;
+	const char *benchmark_filter;
+
+	/* report counters and timings of each stage on stderr */
+	int stats;
+
+	/* seconds between reports while running, 0 to only report at the end */
+	unsigned stats_interval;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+
+	/* write a record of each rejected input line to this file */
+	const char *error_file;
+};
+
+/* output of a record held back until the records before it are written */
+struct BitcoinToolBuffer {
+	char *data;
+	size_t size, capacity;
+
+	/* set once 'data' has outgrown the locked memory it started in, and
+	   been moved to the heap */
+	int allocated;
 };
 
 struct BitcoinTool {
@@ -110,6 +265,12 @@ struct BitcoinTool {
 	struct BitcoinSHA256 public_key_sha256;
 	struct BitcoinRIPEMD160 public_key_ripemd160;
 	struct BitcoinAddress address;
+	struct BitcoinExtendedKey extended_key;
+	struct BitcoinBIP39Mnemonic mnemonic;
+
+	/* set if the mnemonic's seed has been made along with others, before
+	   its record was converted */
+	int mnemonic_seed_set;
 
 	/* flag the input types as being set if we load or convert into them */
 	int mini_private_key_set,
@@ -131,31 +292,79 @@ struct BitcoinTool {
 
 	FILE *input_file_handle;
 
+	/* line number (from 1) and byte offset in the input of the current
+	   input, and the byte offset of the next line in batch mode */
+	uint64_t input_line, input_offset, input_next_offset;
+
+	FILE *error_file_handle;
+
+	/* NULL unless --fix-base58check-confusion is used */
+	struct BitcoinConfusion *confusion;
+
+	/* workers when --threads is more than 1 */
+	struct ParallelPool *pool;
+
+	/* baby steps for --solve-range, shared by every record */
+	struct BitcoinBSGSTable *bsgs_table;
+
+	/* scrypt scratch memory for BIP38 keys, shared by every record */
+	struct BitcoinScryptPool *scrypt_pool;
+
+	/* only input whose address is in here is written, if not NULL */
+	struct BitcoinMatchSet *match_set;
+
+	/* output is appended here instead of written to stdout, if not NULL */
+	struct BitcoinToolBuffer *output_buffer;
+
+	/* NULL unless --stats is used */
+	struct BitcoinStats *stats;
+
+	/* locked memory this tool is in, and the batch records or generated
+	   keys being converted, one for each thread */
+	struct BitcoinSecureArena *arena;
+	struct BitcoinSecureArena **thread_arenas;
+	unsigned thread_arena_count;
+
 	int (*parseOptions)(struct BitcoinTool *self, int argc, char *argv[]);
 	void (*help)(struct BitcoinTool *self);
 	int (*run)(struct BitcoinTool *self);
 	void (*destroy)(struct BitcoinTool *self);
 };
 
-static void BitcoinTool_ListInputTypes(FILE *output)
+/* types which can be both input and output */
+static void BitcoinTool_ListKeyTypes(FILE *output)
 {
 	static const char indent[] = "      ";
 	fprintf(output, "%smini-private-key : 30 character Casascius mini private key\n", indent);
 	fprintf(output, "%sprivate-key      : 32 byte ECDSA private key\n", indent);
 	fprintf(output, "%sprivate-key-wif  : 33/34 byte ECDSA WIF private key\n", indent);
+	fprintf(output, "%sprivate-key-bip38: 39 byte BIP38 passphrase protected private\n", indent);
+	fprintf(output, "%s                   key\n", indent);
 	fprintf(output, "%spublic-key       : 33/65 byte ECDSA public key\n", indent);
 	fprintf(output, "%spublic-key-sha   : 32 byte SHA256(public key) hash\n", indent);
 	fprintf(output, "%spublic-key-rmd   : 20 byte RIPEMD160(SHA256(public key)) hash\n", indent);
 	fprintf(output, "%saddress          : 21 byte Bitcoin address (prefix + hash)\n", indent);
 }
 
+static void BitcoinTool_ListInputTypes(FILE *output)
+{
+	static const char indent[] = "      ";
+	fprintf(output, "%spassphrase       : brainwallet passphrase, SHA256 hashed into a\n", indent);
+	fprintf(output, "%s                   private key\n", indent);
+	fprintf(output, "%sxprv             : 78 byte BIP32 extended private key\n", indent);
+	fprintf(output, "%sxpub             : 78 byte BIP32 extended public key\n", indent);
+	fprintf(output, "%smnemonic         : BIP39 mnemonic sentence, made into a BIP32\n", indent);
+	fprintf(output, "%s                   master private key\n", indent);
+	BitcoinTool_ListKeyTypes(output);
+}
+
 static void BitcoinTool_ListOutputTypes(FILE *output)
 {
 	static const char indent[] = "      ";
 	fprintf(output, "%sall              : All output types, as type:value pairs, most of which\n", indent);
 	fprintf(output, "%s                   are never commonly used, probably for good reason.\n", indent);
 	fprintf(output, "%saddress-checksum : 25 byte Bitcoin address (prefix + hash + checksum)\n", indent);
-	BitcoinTool_ListInputTypes(output);
+	BitcoinTool_ListKeyTypes(output);
 }
 
 static void BitcoinTool_ListInputFormats(FILE *output)
@@ -206,6 +415,14 @@ static void BitcoinTool_help(BitcoinTool *self)
 		"  --input-file          : Specify file name to read for input ('-' for stdin)\n"
 		"  --batch               : Read multiple lines of input from --input-file\n"
 		"  --ignore-input-errors : Continue processing batch input if errors are found.\n"
+		"  --error-file          : Write the line number, byte offset and error of each\n"
+		"                          rejected input line to this file.\n"
+		"  --log-level LEVEL     : Only show messages at least as important as LEVEL,\n"
+		"                          one of debug, info, notice, warning, error, fatal\n"
+		"                          (default=notice)\n"
+		"  --log-repeat-limit N  : Show each message at most N times, then count the\n"
+		"                          rest (default=%u, 0 means no limit)\n",
+		APPLOG_DEFAULT_REPEAT_LIMIT
 	);
 	fprintf(file,
 		"  --public-key-compression : Can be one of :\n"
@@ -228,6 +445,128 @@ static void BitcoinTool_help(BitcoinTool *self)
 		"                                   (default=%u)\n",
 		BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS
 	);
+	fprintf(file,
+		"  --fix-base58check-confusion FILE : Override the likelihood of each\n"
+		"                                     mistake, one \"SEEN MEANT WEIGHT\"\n"
+		"                                     per line, e.g. \"0 o 40\"\n"
+	);
+	fprintf(file,
+		"  --fix-bech32 : Attempt to fix a bech32 address with up to two mistyped\n"
+		"                 characters, using its checksum to find them.\n"
+	);
+	fprintf(file,
+		"  --fix-mnemonic : Search for the missing (written as ?) or mistyped\n"
+		"                   words of a mnemonic, until one derives an\n"
+		"                   address in --match-file at the --derive path.\n"
+		"  --fix-mnemonic-change-words N : Also try changing up to N words\n"
+		"                                  which are on the wordlist\n"
+		"                                  (default=0)\n"
+	);
+	fprintf(file,
+		"  --fix-mini-private-key : Search for the unreadable (written as ?)\n"
+		"                           or misread characters of a mini private\n"
+		"                           key, until one has an address in\n"
+		"                           --match-file.\n"
+		"  --fix-mini-private-key-change-chars N : Also try changing up to N\n"
+		"                                          characters which were read,\n"
+		"                                          likeliest misreadings first\n"
+		"                                          (default=0)\n"
+		"  --fix-mini-private-key-checkpoint FILE : Save how far the search\n"
+		"                                           has got to FILE, and carry\n"
+		"                                           on from there if FILE\n"
+		"                                           exists.\n"
+	);
+	fprintf(file,
+		"  --threads N : Number of threads to use where work can be split up,\n"
+		"                including --batch lines, which are still output in\n"
+		"                order (default=1, 0 means one per processor)\n"
+	);
+	fprintf(file,
+		"  --search-range START:END : Search private keys from START to END (hex)\n"
+		"                             for addresses in --match-file, instead of\n"
+		"                             converting input.  Keys found are written\n"
+		"                             as --output-type and --output-format.\n"
+		"  --match-file FILE : Addresses or hex public key hashes to search for,\n"
+		"                      one per line.  Without --search-range, only\n"
+		"                      private key input matching one is written out.\n"
+		"  --search-endomorphism : Also check lambda*k, lambda^2*k and the\n"
+		"                          negations of all three for each key k, six keys\n"
+		"                          for each EC point computed.\n"
+	);
+	fprintf(file,
+		"  --generate mini-private-key : Generate random mini private keys\n"
+		"                                instead of converting input, each\n"
+		"                                written with its --output-type.\n"
+		"  --count N : Number of keys to generate (default=1)\n"
+	);
+	fprintf(file,
+		"  --solve-range START:END : Find the private key of public key input,\n"
+		"                            known to be from START to END (hex), with a\n"
+		"                            baby-step giant-step search.\n"
+		"  --solve-method bsgs|kangaroo : Baby-step giant-step (default), or\n"
+		"                                 Pollard's kangaroo for ranges too\n"
+		"                                 large for baby-step tables.\n"
+		"  --solve-memory MB : Most memory to use for baby steps (default=%u)\n"
+		"  --solve-table FILE : Keep the baby steps in FILE, made on the first\n"
+		"                       run and reused by later runs.\n"
+		"  --solve-checkpoint FILE : Save kangaroo distinguished points to\n"
+		"                            FILE as the search goes, and carry on\n"
+		"                            from them if FILE exists.\n"
+		"  --solve-checkpoint-interval SECONDS : Time between saves of the\n"
+		"                                        checkpoint, of --solve-checkpoint\n"
+		"                                        or --fix-mini-private-key-checkpoint\n"
+		"                                        (default=%u)\n",
+		BITCOINTOOL_OPTION_DEFAULT_SOLVE_MEMORY,
+		BITCOINTOOL_OPTION_DEFAULT_SOLVE_CHECKPOINT_INTERVAL
+	);
+	fprintf(file,
+		"  --derive PATH : Write out the keys derived from xprv, xpub or mnemonic\n"
+		"                  at PATH, e.g. m/44'/0'/0'/0/0-99, where m is the\n"
+		"                  input key, ' marks hardened levels and the last\n"
+		"                  level may be a range of children.\n"
+		"  --mnemonic-passphrase TEXT : BIP39 passphrase of mnemonic input\n"
+		"                               (default none)\n"
+	);
+	fprintf(file,
+		"  --bip38-passphrase TEXT : Passphrase of BIP38 private key input\n"
+		"                            or output\n"
+		"  --bip38-passphrase-file FILE : Try each line of FILE as the\n"
+		"                                 passphrase until one decrypts the\n"
+		"                                 key, on --threads at once.\n"
+		"  --bip38-memory MB : Most memory for the scrypt of BIP38 keys made\n"
+		"                      at once, each taking just over 16MB\n"
+		"                      (default enough for every thread)\n"
+	);
+	fprintf(file,
+		"  --verify-message : Check that each line of input, an address, a\n"
+		"                     message and a Base64 signature separated by\n"
+		"                     spaces, was signed by the address as Bitcoin\n"
+		"                     Core's signmessage does, writing out the\n"
+		"                     public key which signed it as --output-type\n"
+		"                     (default address) instead of converting it.\n"
+	);
+	fprintf(file,
+		"  --benchmark : Run built-in benchmarks of each conversion step and of\n"
+		"                common conversions, instead of converting any input.\n"
+		"  --benchmark-scale N : Multiply the number of operations of each\n"
+		"                        benchmark by N (default=1)\n"
+		"  --benchmark-filter NAME : Only run benchmarks with names containing\n"
+		"                            NAME, one of :\n"
+	);
+	Bitcoin_ListBenchmarks(file);
+	fprintf(file,
+		"  --stats : Write counters and timings of each conversion stage, error\n"
+		"            counts and record latency percentiles to stderr on exit.\n"
+		"  --stats-interval SECONDS : Also write them every SECONDS while running\n"
+		"                             (default=0, only on exit)\n"
+	);
+	fprintf(file,
+		"  --progress : Report progress of --batch input and --fix-base58check\n"
+		"               searches on stderr, with rate, percentage done and ETA.\n"
+		"  --progress-interval SECONDS : Seconds between progress reports\n"
+		"                                (default=%u)\n",
+		BITCOINTOOL_OPTION_DEFAULT_PROGRESS_INTERVAL
+	);
 	fprintf(file,
 		"\n"
 	);
@@ -270,6 +609,10 @@ static int BitcoinTool_parseOptions(BitcoinTool *self
 	/* fail-safe network type - don't assume Bitcoin for raw keys */
 	o->network_type = NULL;
 
+	o->solve_memory = BITCOINTOOL_OPTION_DEFAULT_SOLVE_MEMORY;
+	o->solve_checkpoint_interval =
+		BITCOINTOOL_OPTION_DEFAULT_SOLVE_CHECKPOINT_INTERVAL;
+
 	for (i=1; i<argc; i++) {
 		const char *a = argv[i];
 		const char *v = NULL;
@@ -296,6 +639,16 @@ static int BitcoinTool_parseOptions(BitcoinTool *self
 				o->input_type = INPUT_TYPE_PRIVATE_KEY;
 			} else if (!strcmp(v, "mini-private-key")) {
 				o->input_type = INPUT_TYPE_MINI_PRIVATE_KEY;
+			} else if (!strcmp(v, "passphrase")) {
+				o->input_type = INPUT_TYPE_PASSPHRASE;
+			} else if (!strcmp(v, "xprv")) {
+				o->input_type = INPUT_TYPE_EXTENDED_PRIVATE_KEY;
+			} else if (!strcmp(v, "xpub")) {
+				o->input_type = INPUT_TYPE_EXTENDED_PUBLIC_KEY;
+			} else if (!strcmp(v, "mnemonic")) {
+				o->input_type = INPUT_TYPE_MNEMONIC;
+			} else if (!strcmp(v, "private-key-bip38")) {
+				o->input_type = INPUT_TYPE_PRIVATE_KEY_BIP38;
 			} else {
 				applog(APPLOG_ERROR, __func__,
 					"Unknown value \"%s\" for --input-type, must be one of:", v
@@ -326,6 +679,10 @@ static int BitcoinTool_parseOptions(BitcoinTool *self
 				o->output_type = OUTPUT_TYPE_PRIVATE_KEY_WIF;
 			} else if (!strcmp(v, "private-key")) {
 				o->output_type = OUTPUT_TYPE_PRIVATE_KEY;
+			} else if (!strcmp(v, "private-key-bip38")) {
+				o->output_type = OUTPUT_TYPE_PRIVATE_KEY_BIP38;
+			} else if (!strcmp(v, "mini-private-key")) {
+				o->output_type = OUTPUT_TYPE_MINI_PRIVATE_KEY;
 			} else if (!strcmp(v, "all")) {
 				o->output_type = OUTPUT_TYPE_ALL;
 			} else {
@@ -450,6 +807,54 @@ static int BitcoinTool_parseOptions(BitcoinTool *self
 			o->fix_base58_change_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS;
 			o->fix_base58_insert_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_INSERT_CHARS;
 			o->fix_base58_remove_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_REMOVE_CHARS;
+		} else if (!strcmp(a, "--fix-base58check-confusion")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->fix_base58_confusion_file = argv[i];
+		} else if (!strcmp(a, "--fix-bech32")) {
+			o->fix_bech32 = 1;
+		} else if (!strcmp(a, "--fix-mnemonic")) {
+			o->fix_mnemonic = 1;
+		} else if (!strcmp(a, "--fix-mnemonic-change-words")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				o->fix_mnemonic_change_words = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--fix-mini-private-key")) {
+			o->fix_mini_private_key = 1;
+		} else if (!strcmp(a, "--fix-mini-private-key-change-chars")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				o->fix_mini_private_key_change_chars = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--fix-mini-private-key-checkpoint")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->fix_mini_private_key_checkpoint_file = argv[i];
 		} else if (!strcmp(a, "--fix-base58check-change-chars")) {
 			unsigned parsed_value = 0;
 			if (++i >= argc) {
@@ -465,171 +870,668 @@ static int BitcoinTool_parseOptions(BitcoinTool *self
 				);
 				return 0;
 			}
-		} else if (!strcmp(a, "--batch")) {
-			o->batch = 1;
-		} else if (!strcmp(a, "--ignore-input-errors")) {
-			o->ignore_input_errors = 1;
-		} else if (!strcmp(a, "--help")) {
-			BitcoinTool_help(self);
-			return 0;
-		} else {
-			applog(APPLOG_ERROR, __func__, "unknown option \"%s\"", a);
-			return 0;
-		}
-	}
-
-	if (o->batch) {
-		if (o->input) {
-			applog(APPLOG_ERROR, __func__,
-				"--batch and --input should not be specified at the same time."
-				" In batch mode, use --input-file to specify the name of the"
-				" file (or '-' or stdin) to read lines of input from."
-			);
-			errors++;
-		}
-		if (!o->input_file) {
-			applog(APPLOG_ERROR, __func__,
-				"If --batch is specified then --input-file must be used to"
-				" specify the name of the file (or '-' or stdin) to read lines"
-				" of input from."
-			);
-			errors++;
-		}
-	} else {
-		if (!o->input && !o->input_file) {
-			applog(APPLOG_ERROR, __func__,
-				"Either --input <text> or --input-file <filename>"
-				" must be specified.");
-			errors++;
-		}
-	}
-
-	if (!o->input_type) {
-		applog(APPLOG_ERROR, __func__, "--input-type must be specified.");
-		errors++;
-	}
-
-	if (!o->input_format) {
-		applog(APPLOG_ERROR, __func__, "--input-format must be specified.");
-		errors++;
-	}
-
-	if (!o->output_type) {
-		applog(APPLOG_ERROR, __func__, "--output-type must be specified.");
-		errors++;
-	}
-
-	if (
-		INPUT_FORMAT_BASE58CHECK == o->input_format
-		&& (
-			PUBLIC_KEY_COMPRESSION_COMPRESSED == o->public_key_compression
-			|| PUBLIC_KEY_COMPRESSION_UNCOMPRESSED == o->public_key_compression
-		)
-	) {
-		applog(APPLOG_WARNING, __func__,
-			"using --input-format base58check with --public-key-compression"
-			" other than auto to override the WIF compression type is very"
-			" unusual, please be sure what you are doing!");
-	}
-
-	if (
-		OUTPUT_FORMAT_BECH32 == o->output_format
-		&& PUBLIC_KEY_COMPRESSION_UNCOMPRESSED == o->public_key_compression
-	) {
-		errors++;
-		applog(APPLOG_ERROR, __func__,
-			"Using --output-format bech32 with --public-key-compression"
-			" uncompressed is not permitted.  For more details see "
-			"https://github.com/bitcoin/bips/blob/master/bip-0143.mediawiki#Restrictions_on_public_key_type"
-		);
-	}
-
-	if (errors) {
-		applog(APPLOG_ERROR, __func__, "Use --help for more information.");
-		return 0;
-	}
-
-	return argc > 1;
-}
-
-void Bitcoin_MakeAddressFromRIPEMD160(
-	struct BitcoinAddress *address,
-	const struct BitcoinRIPEMD160 *hash,
-	const struct BitcoinNetworkType *network_type
-)
-{
-	memcpy(address->data+1, hash->data, BITCOIN_RIPEMD160_SIZE);
-	address->data[0] = BitcoinNetworkType_GetPublicKeyPrefix(network_type);;
-}
-
-void Bitcoin_MakeRIPEMD160FromAddress(
-	struct BitcoinRIPEMD160 *hash,
-	const struct BitcoinAddress *address
-)
-{
-	memcpy(&hash->data, address->data+BITCOIN_ADDRESS_VERSION_SIZE, BITCOIN_RIPEMD160_SIZE);
-}
-
-void Bitcoin_MakeRIPEMD160FromSHA256(
-	struct BitcoinRIPEMD160 *output_hash,
-	const struct BitcoinSHA256 *input_hash
-)
-{
-	Bitcoin_RIPEMD160(output_hash, &input_hash->data, BITCOIN_SHA256_SIZE);
-}
-
-void Bitcoin_MakeSHA256FromPublicKey(
-	struct BitcoinSHA256 *output_hash,
-	const struct BitcoinPublicKey *public_key
-)
-{
-	Bitcoin_SHA256(output_hash, &public_key->data, BitcoinPublicKey_GetSize(public_key));
-}
-
-BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
-{
-	/* Convert from the input type to the output type.
-	   Depending on the options selected, this may need multiple conversions
-	   for example :
-
-	    private key -> public key -> sha256 -> ripemd160 -> address -> base58
-
-	   The conversion may be impossible, for example asking to output the
-	   private key, using the public key as input.  We can detect this and
-	   return an error.
-	*/
-	BitcoinResult result;
-
-	switch (self->options.input_type) {
-		case INPUT_TYPE_MINI_PRIVATE_KEY :
-			switch (self->options.output_type) {
-				case OUTPUT_TYPE_ALL :
-				case OUTPUT_TYPE_ADDRESS :
-				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
-				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
-				case OUTPUT_TYPE_PUBLIC_KEY :
-				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
-					self->mini_private_key_set = 1;
-					break;
-				default :
-					break;
+		} else if (!strcmp(a, "--threads")) {
+			unsigned long parsed_value = 0;
+			char *end = NULL;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
 			}
-		case INPUT_TYPE_PRIVATE_KEY :
-			switch (self->options.output_type) {
-				case OUTPUT_TYPE_ALL :
-				case OUTPUT_TYPE_ADDRESS :
-				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
-				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
-				case OUTPUT_TYPE_PUBLIC_KEY :
-				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
-					self->private_key_wif_set = 1;
-					break;
-				case OUTPUT_TYPE_PRIVATE_KEY :
-					return BITCOIN_SUCCESS;
-					break;
+			v = argv[i];
+			/* sscanf() and strtoul() would take "-1" as the largest value */
+			errno = 0;
+			if (*v >= '0' && *v <= '9') {
+				parsed_value = strtoul(v, &end, 10);
+			}
+			if (end && *end == '\0' && errno == 0
+				&& parsed_value <= BITCOINTOOL_MAX_THREADS)
+			{
+				o->threads = parsed_value ?
+					(unsigned)parsed_value : Parallel_processors();
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an integer from 0 to %u", a,
+					BITCOINTOOL_MAX_THREADS
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--search-range")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			if (Search_parseRange(&o->search_range, argv[i]) != BITCOIN_SUCCESS) {
+				return 0;
+			}
+			o->search = 1;
+		} else if (!strcmp(a, "--generate")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			if (strcmp(argv[i], "mini-private-key")) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --generate, only"
+					" mini-private-key can be generated", argv[i]
+				);
+				return 0;
+			}
+			o->generate = 1;
+		} else if (!strcmp(a, "--count")) {
+			unsigned long parsed_value = 0;
+			char *end = NULL;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			/* strtoul() would take "-1" as the largest value */
+			errno = 0;
+			if (*v >= '0' && *v <= '9') {
+				parsed_value = strtoul(v, &end, 10);
+			}
+			if (end && *end == '\0' && errno == 0 && parsed_value > 0) {
+				o->generate_count = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--match-file")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->match_file = argv[i];
+		} else if (!strcmp(a, "--search-endomorphism")) {
+			o->search_endomorphism = 1;
+		} else if (!strcmp(a, "--solve-range")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			if (Search_parseRange(&o->solve_range, argv[i]) != BITCOIN_SUCCESS) {
+				return 0;
+			}
+			o->solve = 1;
+		} else if (!strcmp(a, "--solve-memory")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->solve_memory = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--solve-table")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->solve_table_file = argv[i];
+		} else if (!strcmp(a, "--solve-method")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!strcmp(v, "bsgs")) {
+				o->solve_method = SOLVE_METHOD_BSGS;
+			} else if (!strcmp(v, "kangaroo")) {
+				o->solve_method = SOLVE_METHOD_KANGAROO;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"unknown value \"%s\" for --solve-method", v
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--solve-checkpoint")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->solve_checkpoint_file = argv[i];
+		} else if (!strcmp(a, "--solve-checkpoint-interval")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				o->solve_checkpoint_interval = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a number of seconds", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--derive")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			if (BIP32_parsePath(&o->derive_path, argv[i]) != BITCOIN_SUCCESS) {
+				return 0;
+			}
+			o->derive = 1;
+		} else if (!strcmp(a, "--mnemonic-passphrase")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->mnemonic_passphrase = argv[i];
+		} else if (!strcmp(a, "--bip38-passphrase")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->bip38_passphrase = argv[i];
+		} else if (!strcmp(a, "--bip38-passphrase-file")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->bip38_passphrase_file = argv[i];
+		} else if (!strcmp(a, "--bip38-memory")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->bip38_memory = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--verify-message")) {
+			o->verify_message = 1;
+		} else if (!strcmp(a, "--benchmark")) {
+			o->benchmark = 1;
+		} else if (!strcmp(a, "--benchmark-scale")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->benchmark_scale = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--benchmark-filter")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s, must be one of:", a);
+				Bitcoin_ListBenchmarks(stderr);
+				return 0;
+			}
+			o->benchmark_filter = argv[i];
+		} else if (!strcmp(a, "--stats")) {
+			o->stats = 1;
+		} else if (!strcmp(a, "--stats-interval")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				o->stats = 1;
+				o->stats_interval = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--progress")) {
+			o->progress_interval = BITCOINTOOL_OPTION_DEFAULT_PROGRESS_INTERVAL;
+		} else if (!strcmp(a, "--progress-interval")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->progress_interval = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--error-file")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->error_file = argv[i];
+		} else if (!strcmp(a, "--log-level")) {
+			enum ApplogLevel level;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!applog_parse_level(v, &level)) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --log-level, must be one of:"
+					" debug, info, notice, warning, error, fatal", v
+				);
+				return 0;
+			}
+			applog_set_level(level);
+		} else if (!strcmp(a, "--log-repeat-limit")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				applog_set_repeat_limit(parsed_value);
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--batch")) {
+			o->batch = 1;
+		} else if (!strcmp(a, "--ignore-input-errors")) {
+			o->ignore_input_errors = 1;
+		} else if (!strcmp(a, "--help")) {
+			BitcoinTool_help(self);
+			return 0;
+		} else {
+			applog(APPLOG_ERROR, __func__, "unknown option \"%s\"", a);
+			return 0;
+		}
+	}
+
+	if (o->benchmark) {
+		/* benchmarks make up their own input, nothing else to check */
+		return 1;
+	}
+
+	if (o->search) {
+		/* searches make up their own private keys, they only need to know
+		   what to look for and how to write out what they find */
+		if (!o->match_file) {
+			applog(APPLOG_ERROR, __func__,
+				"--match-file must be specified with --search-range.");
+			errors++;
+		}
+		if (!o->output_type) {
+			applog(APPLOG_ERROR, __func__, "--output-type must be specified.");
+			errors++;
+		}
+		if (!o->network_type && o->output_type != OUTPUT_TYPE_PRIVATE_KEY) {
+			applog(APPLOG_ERROR, __func__,
+				"--network must be specified to write out keys found.");
+			errors++;
+		}
+		if (errors) {
+			applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+			return 0;
+		}
+		o->input_type = INPUT_TYPE_PRIVATE_KEY;
+		return 1;
+	}
+
+	if (o->generate) {
+		/* generated keys go down the same path as mini private key input */
+		if (!o->output_type) {
+			applog(APPLOG_ERROR, __func__, "--output-type must be specified.");
+			errors++;
+		}
+		if (o->input || o->input_file || o->batch) {
+			applog(APPLOG_ERROR, __func__,
+				"--generate makes its own input, so --input, --input-file and"
+				" --batch can't be used with it.");
+			errors++;
+		}
+		if (o->output_type == OUTPUT_TYPE_PRIVATE_KEY_BIP38
+			&& !o->bip38_passphrase)
+		{
+			applog(APPLOG_ERROR, __func__,
+				"BIP38 private key output needs --bip38-passphrase.");
+			errors++;
+		}
+		if (errors) {
+			applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+			return 0;
+		}
+		o->input_type = INPUT_TYPE_MINI_PRIVATE_KEY;
+		o->input_format = INPUT_FORMAT_RAW;
+		if (!o->generate_count) {
+			o->generate_count = 1;
+		}
+		return 1;
+	}
+
+	if (o->verify_message) {
+		/* the public key which signed each line is recovered from it, and
+		   then converted like public key input */
+		if (o->input_type || o->input_format) {
+			applog(APPLOG_ERROR, __func__,
+				"--verify-message reads an address, a message and a signature"
+				" from each line, so --input-type and --input-format can't be"
+				" used with it.");
+			errors++;
+		}
+		if (o->match_file || o->solve || o->fix_base58 || o->fix_bech32) {
+			applog(APPLOG_ERROR, __func__,
+				"--verify-message can't be used with --match-file,"
+				" --solve-range, --fix-base58check or --fix-bech32.");
+			errors++;
+		}
+		o->input_type = INPUT_TYPE_PUBLIC_KEY;
+		o->input_format = INPUT_FORMAT_RAW;
+		if (!o->output_type) {
+			o->output_type = OUTPUT_TYPE_ADDRESS;
+		}
+		if (!o->output_format) {
+			o->output_format = OUTPUT_FORMAT_BASE58CHECK;
+		}
+	}
+
+	if (o->batch) {
+		if (o->input) {
+			applog(APPLOG_ERROR, __func__,
+				"--batch and --input should not be specified at the same time."
+				" In batch mode, use --input-file to specify the name of the"
+				" file (or '-' or stdin) to read lines of input from."
+			);
+			errors++;
+		}
+		if (!o->input_file) {
+			applog(APPLOG_ERROR, __func__,
+				"If --batch is specified then --input-file must be used to"
+				" specify the name of the file (or '-' or stdin) to read lines"
+				" of input from."
+			);
+			errors++;
+		}
+	} else {
+		if (!o->input && !o->input_file) {
+			applog(APPLOG_ERROR, __func__,
+				"Either --input <text> or --input-file <filename>"
+				" must be specified.");
+			errors++;
+		}
+	}
+
+	if (!o->input_type) {
+		applog(APPLOG_ERROR, __func__, "--input-type must be specified.");
+		errors++;
+	}
+
+	if (!o->input_format) {
+		applog(APPLOG_ERROR, __func__, "--input-format must be specified.");
+		errors++;
+	}
+
+	if (!o->output_type) {
+		applog(APPLOG_ERROR, __func__, "--output-type must be specified.");
+		errors++;
+	}
+
+	if (
+		INPUT_FORMAT_BASE58CHECK == o->input_format
+		&& (
+			PUBLIC_KEY_COMPRESSION_COMPRESSED == o->public_key_compression
+			|| PUBLIC_KEY_COMPRESSION_UNCOMPRESSED == o->public_key_compression
+		)
+	) {
+		applog(APPLOG_WARNING, __func__,
+			"using --input-format base58check with --public-key-compression"
+			" other than auto to override the WIF compression type is very"
+			" unusual, please be sure what you are doing!");
+	}
+
+	if (o->match_file
+		&& !(o->fix_mnemonic && o->input_type == INPUT_TYPE_MNEMONIC)
+		&& o->input_type != INPUT_TYPE_PASSPHRASE
+		&& o->input_type != INPUT_TYPE_MINI_PRIVATE_KEY
+		&& o->input_type != INPUT_TYPE_PRIVATE_KEY
+		&& o->input_type != INPUT_TYPE_PRIVATE_KEY_WIF)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--match-file without --search-range needs private key or"
+			" passphrase input.");
+		errors++;
+	}
+
+	if (o->derive
+		&& o->input_type != INPUT_TYPE_EXTENDED_PRIVATE_KEY
+		&& o->input_type != INPUT_TYPE_EXTENDED_PUBLIC_KEY
+		&& o->input_type != INPUT_TYPE_MNEMONIC)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--derive needs --input-type xprv, xpub or mnemonic.");
+		errors++;
+	}
+
+	if (o->mnemonic_passphrase && o->input_type != INPUT_TYPE_MNEMONIC) {
+		applog(APPLOG_ERROR, __func__,
+			"--mnemonic-passphrase needs --input-type mnemonic.");
+		errors++;
+	}
+
+	if (o->fix_mnemonic
+		&& (o->input_type != INPUT_TYPE_MNEMONIC || !o->match_file))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--fix-mnemonic needs --input-type mnemonic and a --match-file"
+			" of addresses to recognise the mnemonic by.");
+		errors++;
+	}
+
+	if (o->fix_mini_private_key
+		&& (o->input_type != INPUT_TYPE_MINI_PRIVATE_KEY || !o->match_file))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--fix-mini-private-key needs --input-type mini-private-key and"
+			" a --match-file with the address of the key.");
+		errors++;
+	}
+
+	if (!o->fix_mini_private_key
+		&& (o->fix_mini_private_key_change_chars
+			|| o->fix_mini_private_key_checkpoint_file))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--fix-mini-private-key-change-chars and"
+			" --fix-mini-private-key-checkpoint need --fix-mini-private-key.");
+		errors++;
+	}
+
+	if (o->input_type == INPUT_TYPE_PRIVATE_KEY_BIP38
+		&& !o->bip38_passphrase == !o->bip38_passphrase_file)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"BIP38 private key input needs either --bip38-passphrase or"
+			" --bip38-passphrase-file.");
+		errors++;
+	}
+
+	if (o->output_type == OUTPUT_TYPE_PRIVATE_KEY_BIP38
+		&& !o->bip38_passphrase)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"BIP38 private key output needs --bip38-passphrase.");
+		errors++;
+	}
+
+	if (o->generate_count) {
+		applog(APPLOG_ERROR, __func__, "--count needs --generate.");
+		errors++;
+	}
+
+	if (o->bip38_passphrase_file
+		&& o->input_type != INPUT_TYPE_PRIVATE_KEY_BIP38)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--bip38-passphrase-file needs --input-type private-key-bip38.");
+		errors++;
+	}
+
+	if (o->bip38_passphrase && o->input_type != INPUT_TYPE_PRIVATE_KEY_BIP38
+		&& o->output_type != OUTPUT_TYPE_PRIVATE_KEY_BIP38)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"--bip38-passphrase needs --input-type or --output-type"
+			" private-key-bip38.");
+		errors++;
+	}
+
+	if (o->solve && o->input_type != INPUT_TYPE_PUBLIC_KEY) {
+		applog(APPLOG_ERROR, __func__,
+			"--solve-range needs --input-type public-key.");
+		errors++;
+	}
+
+	if (
+		OUTPUT_FORMAT_BECH32 == o->output_format
+		&& PUBLIC_KEY_COMPRESSION_UNCOMPRESSED == o->public_key_compression
+	) {
+		errors++;
+		applog(APPLOG_ERROR, __func__,
+			"Using --output-format bech32 with --public-key-compression"
+			" uncompressed is not permitted.  For more details see "
+			"https://github.com/bitcoin/bips/blob/master/bip-0143.mediawiki#Restrictions_on_public_key_type"
+		);
+	}
+
+	if (errors) {
+		applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+		return 0;
+	}
+
+	return argc > 1;
+}
+
+static void BitcoinTool_solveOptions(const BitcoinTool *self,
+	struct BitcoinBSGSOptions *solve_options)
+{
+	solve_options->memory = (uint64_t)self->options.solve_memory << 20;
+	solve_options->filename = self->options.solve_table_file;
+	solve_options->pool = self->pool;
+	solve_options->progress_interval = self->options.progress_interval;
+}
+
+BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
+{
+	/* Convert from the input type to the output type.
+	   Depending on the options selected, this may need multiple conversions
+	   for example :
+
+	    private key -> public key -> sha256 -> ripemd160 -> address -> base58
+
+	   The conversion may be impossible, for example asking to output the
+	   private key, using the public key as input.  We can detect this and
+	   return an error.
+	*/
+	BitcoinResult result;
+	uint64_t begin;
+
+	/* a public key with its private key in a known range can be solved, and
+	   then converted like private key input */
+	if (self->options.solve
+		&& self->options.input_type == INPUT_TYPE_PUBLIC_KEY)
+	{
+		begin = Stats_begin(self->stats);
+		if (self->options.solve_method == SOLVE_METHOD_KANGAROO) {
+			struct BitcoinKangarooOptions kangaroo_options;
+
+			/* batch lines running in parallel already use the threads */
+			kangaroo_options.threads = self->pool && self->options.batch ?
+				1 : self->options.threads;
+			kangaroo_options.checkpoint_filename =
+				self->options.solve_checkpoint_file;
+			kangaroo_options.checkpoint_interval =
+				self->options.solve_checkpoint_interval;
+			kangaroo_options.progress_interval =
+				self->options.progress_interval;
+			result = Kangaroo_solve(&self->private_key, &self->public_key,
+				&self->options.solve_range, &kangaroo_options);
+		} else {
+			struct BitcoinBSGSOptions solve_options;
+
+			BitcoinTool_solveOptions(self, &solve_options);
+			result = BSGS_solve(self->bsgs_table, &self->private_key,
+				&self->public_key, &self->options.solve_range, &solve_options);
+		}
+		Stats_end(self->stats, BITCOIN_STATS_EC, begin);
+		if (result != BITCOIN_SUCCESS) {
+			if (result == BITCOIN_ERROR_NOT_FOUND) {
+				applog(APPLOG_ERROR, __func__,
+					"Private key of the public key was not found in the range"
+				);
+			}
+			return result;
+		}
+		self->private_key.network_type = self->options.network_type;
+		self->private_key_set = 1;
+
+		self->options.input_type = INPUT_TYPE_PRIVATE_KEY;
+		result = Bitcoin_ConvertInputToOutput(self);
+		self->options.input_type = INPUT_TYPE_PUBLIC_KEY;
+		return result;
+	}
+
+	switch (self->options.input_type) {
+		case INPUT_TYPE_MINI_PRIVATE_KEY :
+			switch (self->options.output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+					self->mini_private_key_set = 1;
+					break;
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
+					return BITCOIN_SUCCESS;
+					break;
 				default :
 					break;
 			}
+		case INPUT_TYPE_PASSPHRASE :
+		case INPUT_TYPE_PRIVATE_KEY :
+			switch (self->options.output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+					self->private_key_wif_set = 1;
+					break;
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					return BITCOIN_SUCCESS;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PRIVATE_KEY_BIP38 :
 		case INPUT_TYPE_PRIVATE_KEY_WIF :
 			switch (self->options.output_type) {
 				case OUTPUT_TYPE_ALL :
@@ -641,8 +1543,15 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 					self->private_key_set = 1;
 					break;
 				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
 					return BITCOIN_SUCCESS;
 					break;
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
+					/* mini keys are hashed into private keys, which can't
+					   be undone */
+					applog(APPLOG_ERROR, __func__, "impossible conversion");
+					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					break;
 				default :
 					break;
 			}
@@ -660,9 +1569,11 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 						return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
 					}
 
+					begin = Stats_begin(self->stats);
 					result = Bitcoin_MakePublicKeyFromPrivateKey(
 						&self->public_key, &self->private_key
 					);
+					Stats_end(self->stats, BITCOIN_STATS_EC, begin);
 					if (result != BITCOIN_SUCCESS) {
 						return result;
 					}
@@ -682,7 +1593,9 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 				case OUTPUT_TYPE_ADDRESS :
 				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
 				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+					begin = Stats_begin(self->stats);
 					Bitcoin_MakeSHA256FromPublicKey(&self->public_key_sha256, &self->public_key);
+					Stats_end(self->stats, BITCOIN_STATS_HASH, begin);
 					self->public_key_sha256_set = 1;
 					break;
 				case OUTPUT_TYPE_PUBLIC_KEY :
@@ -690,6 +1603,8 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 					break;
 				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
 				case OUTPUT_TYPE_PRIVATE_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
 					applog(APPLOG_ERROR, __func__, "impossible conversion");
 					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
 					break;
@@ -701,7 +1616,9 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 				case OUTPUT_TYPE_ALL :
 				case OUTPUT_TYPE_ADDRESS :
 				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+					begin = Stats_begin(self->stats);
 					Bitcoin_MakeRIPEMD160FromSHA256(&self->public_key_ripemd160, &self->public_key_sha256);
+					Stats_end(self->stats, BITCOIN_STATS_HASH, begin);
 					self->public_key_ripemd160_set = 1;
 					break;
 				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
@@ -710,6 +1627,8 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 				case OUTPUT_TYPE_PUBLIC_KEY :
 				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
 				case OUTPUT_TYPE_PRIVATE_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
 					applog(APPLOG_ERROR, __func__, "impossible conversion");
 					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
 					break;
@@ -750,6 +1669,8 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 				case OUTPUT_TYPE_PUBLIC_KEY :
 				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
 				case OUTPUT_TYPE_PRIVATE_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
 					applog(APPLOG_ERROR, __func__, "impossible conversion");
 					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
 					break;
@@ -771,6 +1692,8 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 				case OUTPUT_TYPE_PUBLIC_KEY :
 				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
 				case OUTPUT_TYPE_PRIVATE_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
+				case OUTPUT_TYPE_MINI_PRIVATE_KEY :
 					applog(APPLOG_ERROR, __func__, "impossible conversion");
 					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
 					break;
@@ -784,7 +1707,113 @@ BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self)
 	return BITCOIN_SUCCESS;
 }
 
-BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
+/* Tell the Base58Check fixer what the input type must decode to : the
+   version byte of the network (or of any network if none was given), and
+   the size, and compression flag of private keys. */
+static void Bitcoin_FixBase58CheckShapes(const struct BitcoinTool *self,
+	struct BitcoinFixBase58CheckOptions *fix_options,
+	struct BitcoinBase58CheckShape *shapes, uint8_t *versions)
+{
+	const struct BitcoinNetworkType *network;
+	size_t i;
+
+	memset(versions, 0, 256);
+	switch (self->options.input_type) {
+		case INPUT_TYPE_PRIVATE_KEY_WIF :
+			shapes[0].size = BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE
+				+ BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
+			shapes[0].flag_offset = 0;
+			shapes[0].flag = 0;
+			/* the compression flag comes directly after the key */
+			shapes[1].size = BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE
+				+ BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
+			shapes[1].flag_offset = BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE;
+			shapes[1].flag = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+			fix_options->shape_count = 2;
+			break;
+		case INPUT_TYPE_ADDRESS :
+			shapes[0].size = BITCOIN_ADDRESS_SIZE
+				+ BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
+			shapes[0].flag_offset = 0;
+			shapes[0].flag = 0;
+			fix_options->shape_count = 1;
+			break;
+		case INPUT_TYPE_PRIVATE_KEY_BIP38 :
+			/* the same for every network, the byte after the version
+			   saying which method encrypted the key */
+			shapes[0].size = BIP38_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
+			shapes[0].flag_offset = 1;
+			shapes[0].flag = BIP38_TYPE_NON_EC_MULTIPLY;
+			shapes[1] = shapes[0];
+			shapes[1].flag = BIP38_TYPE_EC_MULTIPLY;
+			fix_options->shape_count = 2;
+			versions[BIP38_VERSION] = 1;
+			fix_options->shapes = shapes;
+			fix_options->versions = versions;
+			return;
+		default :
+			return;
+	}
+
+	for (i = 0; (network = Bitcoin_GetNetworkTypeByIndex(i)) != NULL; i++) {
+		if (self->options.network_type) {
+			network = self->options.network_type;
+		}
+		if (self->options.input_type == INPUT_TYPE_PRIVATE_KEY_WIF) {
+			versions[network->private_key_prefix & 0xff] = 1;
+		} else {
+			versions[network->public_key_prefix & 0xff] = 1;
+			versions[network->script_prefix & 0xff] = 1;
+		}
+		if (self->options.network_type) {
+			break;
+		}
+	}
+
+	fix_options->shapes = shapes;
+	fix_options->versions = versions;
+}
+
+/* Correct up to two characters of bech32 input, reporting the changes as
+   the Base58Check fixer does, and decode the result. */
+static BitcoinResult Bitcoin_FixBech32(struct BitcoinTool *self, char *hrp,
+	int *witver)
+{
+	char fixed[sizeof(self->input)];
+	char markers[sizeof(self->input)];
+	size_t positions[2], count = 0, i;
+
+	if (!bech32_correct(fixed, positions, &count, self->input)
+		|| !segwit_addr_decode_any(hrp, witver,
+			self->input_raw+1, &self->input_raw_size, fixed))
+	{
+		applog(APPLOG_WARNING, __func__,
+			"Failed to find a correction of up to two characters that"
+			" results in a valid bech32 address."
+		);
+		return BITCOIN_ERROR_CHECKSUM_FAILURE;
+	}
+
+	memset(markers, ' ', self->input_size);
+	markers[self->input_size] = '\0';
+	for (i = 0; i < count; i++) {
+		markers[positions[i]] = '^';
+	}
+	applog(APPLOG_WARNING, __func__, "from: %s", self->input);
+	applog(APPLOG_WARNING, __func__, "  to: %s", fixed);
+	applog(APPLOG_WARNING, __func__, "      %s", markers);
+	applog(APPLOG_WARNING, __func__,
+		"bech32 input has been corrected by changing %u character%s.",
+		(unsigned)count,
+		count == 1 ? "" : "s"
+	);
+
+	return BITCOIN_SUCCESS;
+}
+
+/* Read the next input, from the next line of --input-file in batch mode, or
+   from --input-file or --input once otherwise. */
+BitcoinResult Bitcoin_ReadInput(struct BitcoinTool *self)
 {
 	if (self->options.batch) {
 		/* in batch mode we open the file only once and read as much as
@@ -820,15 +1849,46 @@ BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
 			self->input_file_handle);
 		if (fgets_result == NULL) {
 			/* error or EOF */
+			if (feof(self->input_file_handle)) {
+				return BITCOIN_ERROR_END_OF_FILE;
+			}
 			return BITCOIN_ERROR_FILE;
 		}
 
 		self->input_size = strlen(self->input);
+		self->input_line++;
+		self->input_offset = self->input_next_offset;
+		self->input_next_offset += self->input_size;
 		if (self->input_size > 0) {
 			/* remove newline character */
 			if (self->input[self->input_size - 1] == '\n') {
 				self->input[self->input_size - 1] = '\0';
 				self->input_size--;
+			} else {
+				/* unless the newline or the end of the file is next, the
+				   line didn't fit, so rather than taking the rest of it as
+				   the next line, skip over it */
+				int c = fgetc(self->input_file_handle);
+
+				if (c == EOF) {
+					return BITCOIN_SUCCESS;
+				}
+				self->input_next_offset++;
+				if (c == '\n') {
+					return BITCOIN_SUCCESS;
+				}
+				while ((c = fgetc(self->input_file_handle)) != EOF) {
+					self->input_next_offset++;
+					if (c == '\n') {
+						break;
+					}
+				}
+				applog(APPLOG_ERROR, __func__,
+					"Input line %llu is longer than %u characters",
+					(unsigned long long)self->input_line,
+					(unsigned)(sizeof(self->input) - 2)
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
 			}
 		}
 
@@ -877,6 +1937,12 @@ BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
 		}
 	}
 
+	return BITCOIN_SUCCESS;
+}
+
+/* Convert the input format to raw data. */
+BitcoinResult Bitcoin_DecodeInput(struct BitcoinTool *self)
+{
 	/* check if we have any input we can work with */
 	if (self->input_size == 0) {
 		applog(APPLOG_ERROR, __func__,
@@ -937,15 +2003,29 @@ BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
 					size_t output_base58_buffer_size = self->input_size + 1;
 					char *output_base58 = calloc(1, output_base58_buffer_size);
 					size_t output_base58_size = 0;
+					struct BitcoinFixBase58CheckOptions fix_options;
+					struct BitcoinBase58CheckShape shapes[2];
+					uint8_t versions[256];
 					int result;
 
+					fix_options.change_chars = self->options.fix_base58_change_chars;
+					fix_options.insert_chars = self->options.fix_base58_insert_chars;
+					fix_options.remove_chars = self->options.fix_base58_remove_chars;
+					fix_options.progress_interval = self->options.progress_interval;
+					fix_options.confusion = self->confusion;
+					fix_options.shapes = NULL;
+					fix_options.shape_count = 0;
+					fix_options.versions = NULL;
+					fix_options.pool = self->pool;
+					Bitcoin_FixBase58CheckShapes(self, &fix_options,
+						shapes, versions
+					);
+
 					result = Bitcoin_FixBase58Check(
 						output_base58, output_base58_buffer_size, &output_base58_size,
 						self->input_raw, sizeof(self->input_raw), &self->input_raw_size,
 						self->input, self->input_size,
-						self->options.fix_base58_change_chars,
-						self->options.fix_base58_insert_chars,
-						self->options.fix_base58_remove_chars
+						&fix_options
 					);
 
 					free(output_base58);
@@ -964,16 +2044,27 @@ BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
 			break;
 		}
 		case INPUT_FORMAT_BECH32 : {
-			char hrp[32] = {0};
-			if (!bech32_decode(
-				&hrp[0], self->input_raw+1, &self->input_raw_size,
+			char hrp[84] = {0};
+			int witver = 0;
+			/* one pass checks the checksum, witness version and program */
+			if (!segwit_addr_decode_any(
+				hrp, &witver, self->input_raw+1, &self->input_raw_size,
 				self->input))
 			{
 				applog(APPLOG_ERROR, __func__,
 					"Failed to decode bech32 input (%s).",
 					Bitcoin_ResultString(BITCOIN_ERROR)
 				);
-				return BITCOIN_ERROR_INVALID_FORMAT;
+				if (!self->options.fix_bech32) {
+					applog(APPLOG_ERROR, __func__,
+						"You can use the --fix-bech32 option to correct up"
+						" to two mistyped characters using the checksum."
+					);
+					return BITCOIN_ERROR_INVALID_FORMAT;
+				}
+				if (Bitcoin_FixBech32(self, hrp, &witver) != BITCOIN_SUCCESS) {
+					return BITCOIN_ERROR_CHECKSUM_FAILURE;
+				}
 			}
 			/* obtain network type from the HRP part of the address */
 			if (!self->options.network_type)
@@ -985,17 +2076,6 @@ BitcoinResult Bitcoin_ParseInput(struct BitcoinTool *self)
 				);
 				return BITCOIN_ERROR_INVALID_FORMAT;
 			}
-			int witver = 0;
-			if (!segwit_addr_decode(
-				&witver, self->input_raw+1, &self->input_raw_size, hrp,
-				self->input))
-			{
-				applog(APPLOG_ERROR, __func__,
-					"Failed to validate bech32 input (%s).",
-					Bitcoin_ResultString(BITCOIN_ERROR)
-				);
-				return BITCOIN_ERROR_INVALID_FORMAT;
-			}
 			self->input_raw[0] = self->options.network_type->public_key_prefix;
 			self->input_raw_size += 1;
 			break;
@@ -1020,23 +2100,51 @@ BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self)
 		case INPUT_TYPE_MINI_PRIVATE_KEY : {
 			size_t expected_size = BITCOIN_MINI_PRIVATE_KEY_SIZE;
 			char test_buffer[BITCOIN_MINI_PRIVATE_KEY_SIZE + 1];
+			char fixed[BITCOIN_MINI_PRIVATE_KEY_SIZE];
 			struct BitcoinSHA256 hash;
+			const uint8_t *key = input_raw;
+			size_t key_size = input_raw_size;
+
+			if (self->options.fix_mini_private_key) {
+				struct BitcoinMiniKeyRecoveryOptions recovery_options;
+				BitcoinResult result;
+
+				memset(&recovery_options, 0, sizeof(recovery_options));
+				recovery_options.change_chars =
+					self->options.fix_mini_private_key_change_chars;
+				recovery_options.confusion = self->confusion;
+				recovery_options.targets = self->match_set;
+				recovery_options.threads = self->options.threads;
+				recovery_options.progress_interval =
+					self->options.progress_interval;
+				recovery_options.checkpoint_filename =
+					self->options.fix_mini_private_key_checkpoint_file;
+				recovery_options.checkpoint_interval =
+					self->options.solve_checkpoint_interval;
+				result = MiniKey_recover(fixed, (const char *)input_raw,
+					input_raw_size, &recovery_options);
+				if (result != BITCOIN_SUCCESS) {
+					return result;
+				}
+				key = (const uint8_t *)fixed;
+				key_size = BITCOIN_MINI_PRIVATE_KEY_SIZE;
+			}
 
-			if (input_raw_size != expected_size) {
+			if (key_size != expected_size) {
 				const char *extra_message = "";
 				applog(APPLOG_ERROR, __func__,
 					"Invalid size input for mini private key:"
 					" expected %u bytes but got %u bytes instead.",
 					(unsigned)expected_size,
-					(unsigned)input_raw_size,
+					(unsigned)key_size,
 					extra_message
 				);
 				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
 			}
 
 			/* prepare a test buffer, to check that the key is valid */
-			memcpy(test_buffer, input_raw, input_raw_size);
-			test_buffer[input_raw_size] = '?';
+			memcpy(test_buffer, key, key_size);
+			test_buffer[key_size] = '?';
 			Bitcoin_SHA256(&hash, test_buffer, BITCOIN_MINI_PRIVATE_KEY_SIZE + 1);
 			if (hash.data[0] != 0) {
 				applog(APPLOG_ERROR, __func__,
@@ -1050,7 +2158,7 @@ BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self)
 
 			/* 1/256 chance the key is valid, hash the string into the real
 			   private key. */
-			Bitcoin_SHA256(&hash, input_raw, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+			Bitcoin_SHA256(&hash, key, BITCOIN_MINI_PRIVATE_KEY_SIZE);
 			memcpy(self->private_key.data, hash.data, BITCOIN_SHA256_SIZE);
 
 			/* since the compression type is always uncompressed, we can set
@@ -1072,6 +2180,13 @@ BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self)
 				);
 			}
 
+			memcpy(self->mini_private_key, key,
+				BITCOIN_MINI_PRIVATE_KEY_SIZE);
+			self->mini_private_key_set = 1;
+			Secure_wipe(fixed, sizeof(fixed));
+			Secure_wipe(test_buffer, sizeof(test_buffer));
+			Secure_wipe(&hash, sizeof(hash));
+
 			/* we have a valid private key */
 			self->private_key_set = 1;
 
@@ -1080,6 +2195,148 @@ BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self)
 
 			break;
 		}
+		case INPUT_TYPE_PASSPHRASE : {
+			struct BitcoinSHA256 hash;
+
+			Bitcoin_SHA256(&hash, input_raw, input_raw_size);
+			memcpy(self->private_key.data, hash.data, BITCOIN_SHA256_SIZE);
+			Secure_wipe(&hash, sizeof(hash));
+
+			if (!self->options.network_type) {
+				applog(APPLOG_ERROR, __func__,
+					"Passphrase has no network prefix and it is unsafe"
+					" to assume one.  Please explicitally specify prefix using"
+					" --network option."
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			self->private_key.network_type = self->options.network_type;
+			self->private_key_set = 1;
+			break;
+		}
+		case INPUT_TYPE_EXTENDED_PRIVATE_KEY :
+		case INPUT_TYPE_EXTENDED_PUBLIC_KEY : {
+			const int want_private =
+				self->options.input_type == INPUT_TYPE_EXTENDED_PRIVATE_KEY;
+			BitcoinResult result = BIP32_loadExtendedKey(&self->extended_key,
+				input_raw, input_raw_size, self->options.network_type
+			);
+
+			if (result != BITCOIN_SUCCESS) {
+				return result;
+			}
+			if (self->extended_key.is_private != want_private) {
+				applog(APPLOG_ERROR, __func__,
+					"Input is an extended %s key, not an extended %s key.",
+					want_private ? "public" : "private",
+					want_private ? "private" : "public"
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			break;
+		}
+		case INPUT_TYPE_MNEMONIC : {
+			BitcoinResult result;
+
+			if (!self->options.network_type) {
+				applog(APPLOG_ERROR, __func__,
+					"Mnemonic has no network prefix and it is unsafe"
+					" to assume one.  Please explicitally specify prefix using"
+					" --network option."
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			if (self->options.fix_mnemonic) {
+				struct BitcoinRecoveryOptions recovery_options;
+
+				memset(&recovery_options, 0, sizeof(recovery_options));
+				recovery_options.change_words =
+					self->options.fix_mnemonic_change_words;
+				recovery_options.passphrase =
+					self->options.mnemonic_passphrase;
+				recovery_options.path = &self->options.derive_path;
+				recovery_options.targets = self->match_set;
+				recovery_options.pool = self->pool;
+				recovery_options.threads = self->options.threads;
+				recovery_options.progress_interval =
+					self->options.progress_interval;
+				result = Recovery_mnemonic(&self->mnemonic,
+					(const char *)input_raw, input_raw_size,
+					&recovery_options
+				);
+				if (result != BITCOIN_SUCCESS) {
+					Secure_wipe(&self->mnemonic, sizeof(self->mnemonic));
+					return result;
+				}
+			} else if (!self->mnemonic_seed_set) {
+				result = BIP39_parse(&self->mnemonic,
+					(const char *)input_raw, input_raw_size, 1);
+				if (result == BITCOIN_SUCCESS) {
+					result = BIP39_makeSeeds(&self->mnemonic, 1,
+						self->options.mnemonic_passphrase);
+				}
+				if (result != BITCOIN_SUCCESS) {
+					Secure_wipe(&self->mnemonic, sizeof(self->mnemonic));
+					return result;
+				}
+			}
+			self->mnemonic_seed_set = 0;
+			result = BIP32_makeMasterKey(&self->extended_key,
+				self->mnemonic.seed, BIP39_SEED_SIZE,
+				self->options.network_type
+			);
+			Secure_wipe(&self->mnemonic, sizeof(self->mnemonic));
+			if (result != BITCOIN_SUCCESS) {
+				return result;
+			}
+			break;
+		}
+		case INPUT_TYPE_PRIVATE_KEY_BIP38 : {
+			/* the address hash is of a Bitcoin address unless the key is
+			   for another network */
+			const struct BitcoinNetworkType *network_type =
+				self->options.network_type ? self->options.network_type
+				: Bitcoin_GetNetworkTypeByName("bitcoin");
+			BitcoinResult result = BIP38_check(input_raw, input_raw_size);
+
+			if (result != BITCOIN_SUCCESS) {
+				return result;
+			}
+			if (self->options.bip38_passphrase_file) {
+				struct BitcoinBIP38RecoveryOptions recovery_options;
+
+				recovery_options.filename =
+					self->options.bip38_passphrase_file;
+				recovery_options.network_type = network_type;
+				recovery_options.scrypt_pool = self->scrypt_pool;
+				recovery_options.pool = self->pool;
+				recovery_options.threads = self->options.threads;
+				recovery_options.progress_interval =
+					self->options.progress_interval;
+				result = BIP38_recover(&self->private_key, input_raw,
+					&recovery_options);
+			} else {
+				result = BIP38_decrypt(&self->private_key, input_raw,
+					self->options.bip38_passphrase,
+					strlen(self->options.bip38_passphrase),
+					network_type, self->scrypt_pool
+				);
+				if (result == BITCOIN_ERROR_CHECKSUM_FAILURE) {
+					applog(APPLOG_ERROR, __func__,
+						"BIP38 private key doesn't match its address hash, the"
+						" passphrase is wrong%s.",
+						self->options.network_type ? ""
+						: " or the key is for a network other than bitcoin"
+						" (use --network)"
+					);
+				}
+			}
+			if (result != BITCOIN_SUCCESS) {
+				return result;
+			}
+			self->private_key_wif_set = 1;
+			break;
+		}
 		case INPUT_TYPE_PRIVATE_KEY : {
 			size_t expected_size = BITCOIN_PRIVATE_KEY_SIZE;
 			if (input_raw_size != expected_size) {
@@ -1175,349 +2432,1449 @@ BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self)
 					self->public_key.compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
 					break;
 			}
-			assert(sizeof(self->public_key.data) >= input_raw_size);
-			memcpy(self->public_key.data, input_raw, input_raw_size);
-			self->public_key_set = 1;
+			assert(sizeof(self->public_key.data) >= input_raw_size);
+			memcpy(self->public_key.data, input_raw, input_raw_size);
+			self->public_key_set = 1;
+			break;
+		}
+		case INPUT_TYPE_PUBLIC_KEY_SHA256 : {
+			size_t expected_size = BITCOIN_SHA256_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for SHA256(public_key):"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+                        assert(sizeof(self->public_key_sha256.data) >= BITCOIN_SHA256_SIZE);
+                        assert(input_raw_size >= BITCOIN_SHA256_SIZE);
+                        memcpy(self->public_key_sha256.data, input_raw, BITCOIN_SHA256_SIZE);
+			self->public_key_sha256_set = 1;
+			break;
+		}
+		case INPUT_TYPE_PUBLIC_KEY_RIPEMD160 : {
+			size_t expected_size = BITCOIN_RIPEMD160_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for RIPEMD160(SHA256(public_key)):"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			assert(sizeof(self->public_key_ripemd160.data) >= BITCOIN_RIPEMD160_SIZE);
+			assert(input_raw_size >= BITCOIN_RIPEMD160_SIZE);
+			memcpy(self->public_key_ripemd160.data, input_raw, BITCOIN_RIPEMD160_SIZE);
+			self->public_key_ripemd160_set = 1;
+			break;
+		}
+		case INPUT_TYPE_ADDRESS : {
+			size_t expected_size = BITCOIN_ADDRESS_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for address:"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			memcpy(self->address.data, input_raw, BITCOIN_ADDRESS_SIZE);
+			self->address_set = 1;
+			break;
+		}
+		default :
+			applog(APPLOG_ERROR, __func__, "Unknown input.");
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_FormatOutput(struct BitcoinTool *self,
+	enum OutputType output_type, enum OutputFormat output_format,
+	char *output_buffer, size_t *output_buffer_size
+) {
+	struct BitcoinSHA256 checksum;
+	BitcoinResult result = BITCOIN_ERROR;
+	size_t output_raw_size = 0;
+
+	memset(&checksum, 0, sizeof(checksum));
+	memset(output_buffer, 0, *output_buffer_size);
+
+	switch (output_type) {
+		case OUTPUT_TYPE_ADDRESS :
+			output_raw_size = BITCOIN_ADDRESS_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->address.data, output_raw_size);
+			break;
+		case OUTPUT_TYPE_ADDRESS_CHECKSUM :
+			output_raw_size = BITCOIN_ADDRESS_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			Bitcoin_DoubleSHA256(&checksum, self->address.data, BITCOIN_ADDRESS_SIZE);
+			memcpy(self->output_raw, self->address.data, BITCOIN_ADDRESS_SIZE);
+			memcpy(self->output_raw + BITCOIN_ADDRESS_SIZE, &checksum.data,
+				BITCOIN_BASE58CHECK_CHECKSUM_SIZE);
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+			output_raw_size = BITCOIN_RIPEMD160_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->public_key_ripemd160.data, output_raw_size);
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+			output_raw_size = BITCOIN_SHA256_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->public_key_sha256.data, output_raw_size);
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY :
+			output_raw_size = BitcoinPublicKey_GetSize(&self->public_key);
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->public_key.data, output_raw_size);
+			break;
+		case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+			self->output_raw[0] = BitcoinNetworkType_GetPrivateKeyPrefix(self->private_key.network_type);
+			memcpy(self->output_raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+				self->private_key.data, BITCOIN_PRIVATE_KEY_SIZE
+			);
+			switch (self->private_key.public_key_compression) {
+				case BITCOIN_PUBLIC_KEY_COMPRESSED :
+					/* set compression flag */
+					self->output_raw[
+						BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE
+					] = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE +
+						BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_SIZE;
+					break;
+				case BITCOIN_PUBLIC_KEY_UNCOMPRESSED :
+					/* no compression flag to set, size determines that the
+					corresponding public key should be uncompressed. */
+					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE;
+					break;
+				default :
+					applog(APPLOG_ERROR, __func__,
+						"Public key compression flag must be set using"
+						" --public-key-compression (compressed | uncompressed)"
+						" when importing raw private keys."
+					);
+					return BITCOIN_ERROR_INVALID_FORMAT;
+					break;
+			}
+			assert(sizeof(self->output_raw) >= output_raw_size);
 			break;
-		}
-		case INPUT_TYPE_PUBLIC_KEY_SHA256 : {
-			size_t expected_size = BITCOIN_SHA256_SIZE;
-			if (input_raw_size != expected_size) {
+		case OUTPUT_TYPE_PRIVATE_KEY :
+			output_raw_size = BitcoinPrivateKey_GetSize(&self->private_key);
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->private_key.data, output_raw_size);
+			break;
+		case OUTPUT_TYPE_MINI_PRIVATE_KEY :
+			output_raw_size = BITCOIN_MINI_PRIVATE_KEY_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			memcpy(self->output_raw, self->mini_private_key, output_raw_size);
+			break;
+		case OUTPUT_TYPE_PRIVATE_KEY_BIP38 :
+			if (!self->private_key.network_type) {
 				applog(APPLOG_ERROR, __func__,
-					"Invalid size input for SHA256(public_key):"
-					" expected %u bytes but got %u bytes instead.",
-					(unsigned)expected_size,
-					(unsigned)input_raw_size
+					"Network type is not specified, please set using"
+					" --network option"
 				);
-				return BITCOIN_ERROR_INVALID_FORMAT;
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			output_raw_size = BIP38_SIZE;
+			assert(sizeof(self->output_raw) >= output_raw_size);
+			result = BIP38_encrypt(self->output_raw, &self->private_key,
+				self->options.bip38_passphrase,
+				strlen(self->options.bip38_passphrase), self->scrypt_pool
+			);
+			if (result != BITCOIN_SUCCESS) {
+				return result;
 			}
-                        assert(sizeof(self->public_key_sha256.data) >= BITCOIN_SHA256_SIZE);
-                        assert(input_raw_size >= BITCOIN_SHA256_SIZE);
-                        memcpy(self->public_key_sha256.data, input_raw, BITCOIN_SHA256_SIZE);
-			self->public_key_sha256_set = 1;
 			break;
-		}
-		case INPUT_TYPE_PUBLIC_KEY_RIPEMD160 : {
-			size_t expected_size = BITCOIN_RIPEMD160_SIZE;
-			if (input_raw_size != expected_size) {
-				applog(APPLOG_ERROR, __func__,
-					"Invalid size input for RIPEMD160(SHA256(public_key)):"
-					" expected %u bytes but got %u bytes instead.",
-					(unsigned)expected_size,
-					(unsigned)input_raw_size
+		default :
+			applog(APPLOG_ERROR, __func__, "Unknown output type.");
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	self->output_raw_size = output_raw_size;
+
+	switch (output_format) {
+		case OUTPUT_FORMAT_RAW : {
+			if (output_raw_size > *output_buffer_size) {
+				applog(APPLOG_BUG, __func__,
+					"output_raw buffer (%u) larger than output_text buffer (%u),"
+					"unable to write output",
+					(unsigned)output_raw_size,
+					(unsigned)*output_buffer_size
 				);
-				return BITCOIN_ERROR_INVALID_FORMAT;
+				result = BITCOIN_ERROR_INVALID_FORMAT;
+			} else {
+				memcpy(output_buffer, self->output_raw, output_raw_size);
+				*output_buffer_size = output_raw_size;
+				result = BITCOIN_SUCCESS;
 			}
-			assert(sizeof(self->public_key_ripemd160.data) >= BITCOIN_RIPEMD160_SIZE);
-			assert(input_raw_size >= BITCOIN_RIPEMD160_SIZE);
-			memcpy(self->public_key_ripemd160.data, input_raw, BITCOIN_RIPEMD160_SIZE);
-			self->public_key_ripemd160_set = 1;
 			break;
 		}
-		case INPUT_TYPE_ADDRESS : {
-			size_t expected_size = BITCOIN_ADDRESS_SIZE;
-			if (input_raw_size != expected_size) {
-				applog(APPLOG_ERROR, __func__,
-					"Invalid size input for address:"
-					" expected %u bytes but got %u bytes instead.",
-					(unsigned)expected_size,
-					(unsigned)input_raw_size
-				);
-				return BITCOIN_ERROR_INVALID_FORMAT;
+		case OUTPUT_FORMAT_HEX : {
+			int lower_case = 1;
+			result = Bitcoin_EncodeHex(
+				output_buffer, *output_buffer_size,
+				output_buffer_size,
+				self->output_raw, output_raw_size,
+				lower_case
+			);
+			break;
+		}
+		case OUTPUT_FORMAT_BASE58 : {
+			result = Bitcoin_EncodeBase58(
+				output_buffer, *output_buffer_size,
+				output_buffer_size,
+				self->output_raw, output_raw_size
+			);
+			break;
+		}
+		case OUTPUT_FORMAT_BASE58CHECK : {
+			result = Bitcoin_EncodeBase58Check(
+				output_buffer, *output_buffer_size,
+				output_buffer_size,
+				self->output_raw, output_raw_size
+			);
+			break;
+		}
+		case OUTPUT_FORMAT_BECH32 : {
+			/* keys which say what network they're for, such as WIF, don't
+			   need --network */
+			const struct BitcoinNetworkType *network_type =
+				self->options.network_type ? self->options.network_type
+				: self->public_key.network_type;
+
+			if (!network_type || !network_type->hrp) {
+				result = BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+			} else if (segwit_addr_encode(
+				output_buffer,
+				network_type->hrp, 0,
+				self->output_raw+1, output_raw_size-1
+			) == 1) {
+				result = BITCOIN_SUCCESS;
+			} else {
+				result = BITCOIN_ERROR;
 			}
-			memcpy(self->address.data, input_raw, BITCOIN_ADDRESS_SIZE);
-			self->address_set = 1;
+			*output_buffer_size = strlen(output_buffer);
 			break;
 		}
-		default :
-			applog(APPLOG_ERROR, __func__, "Unknown input.");
+		default:
+			applog(APPLOG_ERROR, __func__,
+				"Unspecified output format."
+				" Please use --output-format with one of:"
+			);
+			BitcoinTool_ListOutputFormats(stderr);
 			return BITCOIN_ERROR_INVALID_FORMAT;
 			break;
 	}
 
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	/* raw output may start with a zero byte */
+	if (output_format != OUTPUT_FORMAT_RAW && strlen(output_buffer) == 0) {
+		applog(APPLOG_BUG, __func__,
+			"No text to output - something went wrong"
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+/* Wipe an output buffer, and free it if it's on the heap. */
+static void BitcoinTool_freeBuffer(struct BitcoinToolBuffer *buffer)
+{
+	Secure_wipe(buffer->data, buffer->capacity);
+	if (buffer->allocated) {
+		free(buffer->data);
+	}
+	buffer->data = NULL;
+	buffer->size = buffer->capacity = 0;
+	buffer->allocated = 0;
+}
+
+/* Wipe the key material of the record just converted, leaving the options
+   and anything shared between records. */
+static void BitcoinTool_wipeRecord(BitcoinTool *self)
+{
+	Secure_wipe(self->input, sizeof(self->input));
+	Secure_wipe(self->input_raw, sizeof(self->input_raw));
+	Secure_wipe(self->output_raw, sizeof(self->output_raw));
+	Secure_wipe(self->mini_private_key, sizeof(self->mini_private_key));
+	Secure_wipe(self->private_key.data, sizeof(self->private_key.data));
+	Secure_wipe(&self->extended_key, sizeof(self->extended_key));
+	Secure_wipe(&self->mnemonic, sizeof(self->mnemonic));
+}
+
+/* Write output to stdout, or to the record's output buffer if it has one. */
+static BitcoinResult BitcoinTool_write(struct BitcoinTool *self,
+	const char *data, size_t size)
+{
+	struct BitcoinToolBuffer *buffer = self->output_buffer;
+
+	if (!buffer) {
+		return Bitcoin_fwrite_safe(data, 1, size, stdout);
+	}
+	if (buffer->size + size > buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity : 256;
+		const size_t used = buffer->size;
+		char *data_new;
+
+		while (capacity < buffer->size + size) {
+			capacity *= 2;
+		}
+		/* not realloc(), which could leave a copy of the output behind */
+		data_new = malloc(capacity);
+		if (!data_new) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate output buffer");
+			return BITCOIN_ERROR;
+		}
+		if (used) {
+			memcpy(data_new, buffer->data, used);
+		}
+		BitcoinTool_freeBuffer(buffer);
+		buffer->data = data_new;
+		buffer->size = used;
+		buffer->capacity = capacity;
+		buffer->allocated = 1;
+	}
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self);
+
+BitcoinResult Bitcoin_WriteAllOutput(struct BitcoinTool *self)
+{
+	struct OutputFormatString {
+		enum OutputFormat output_format;
+		char *name;
+	} output_formats[] = {
+		{ OUTPUT_FORMAT_HEX,         "hex" },
+		{ OUTPUT_FORMAT_BASE58,      "base58" },
+		{ OUTPUT_FORMAT_BASE58CHECK, "base58check" },
+		{ OUTPUT_FORMAT_BECH32,      "bech32" }
+	}, *output_format = NULL;
+
+	struct OutputTypeString {
+		enum OutputType output_type;
+		char *name;
+		int is_set;
+	} output_types[] = {
+		{ OUTPUT_TYPE_ADDRESS,              "address" },
+		{ OUTPUT_TYPE_ADDRESS_CHECKSUM,     "address-checksum" },
+		{ OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160, "public-key-ripemd160" },
+		{ OUTPUT_TYPE_PUBLIC_KEY_SHA256,    "public-key-sha256" },
+		{ OUTPUT_TYPE_PUBLIC_KEY,           "public-key" },
+		{ OUTPUT_TYPE_PRIVATE_KEY_WIF,      "private-key-wif" },
+		{ OUTPUT_TYPE_PRIVATE_KEY,          "private-key" }
+	}, *output_type = NULL;
+
+	/* mini keys are text, which only makes sense written as it is */
+	if (self->mini_private_key_set) {
+		static const char name[] = "mini-private-key.raw:";
+
+		BitcoinTool_write(self, name, sizeof(name) - 1);
+		BitcoinTool_write(self, self->mini_private_key,
+			BITCOIN_MINI_PRIVATE_KEY_SIZE);
+		BitcoinTool_write(self, "\n", 1);
+	}
+
+	for (output_type = output_types;
+		output_type != output_types +
+		(sizeof(output_types) / sizeof(output_types[0]));
+		output_type++
+	) {
+		for (output_format = output_formats;
+			output_format != output_formats +
+			(sizeof(output_formats) / sizeof(output_formats[0]));
+			output_format++
+		) {
+			if (
+				output_type->output_type == OUTPUT_TYPE_ADDRESS_CHECKSUM
+				&& output_format->output_format == OUTPUT_FORMAT_BASE58CHECK
+			) {
+				/* This combination shouldn't be output, as I believe there
+				   is no valid use for it and there is potential for confusion
+				   for it to represent a usable address.
+				*/
+				continue;
+			}
+
+			if (
+				(output_type->output_type == OUTPUT_TYPE_ADDRESS && self->address_set) ||
+				(output_type->output_type == OUTPUT_TYPE_ADDRESS_CHECKSUM && self->address_set) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 && self->public_key_ripemd160_set) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_SHA256 && self->public_key_sha256_set) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY && self->public_key_set) ||
+				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY_WIF && self->private_key_wif_set) ||
+				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY && self->private_key_set)
+			) {
+				char output_buffer[256];
+				size_t output_buffer_size = sizeof(output_buffer);
+				BitcoinResult format_result = BITCOIN_ERROR;
+				uint64_t begin;
+
+				memset(&output_buffer, 0, sizeof(output_buffer));
+				begin = Stats_begin(self->stats);
+				format_result = Bitcoin_FormatOutput(self,
+					output_type->output_type, output_format->output_format,
+					output_buffer, &output_buffer_size);
+				Stats_end(self->stats, BITCOIN_STATS_FORMAT_OUTPUT, begin);
+
+				if (format_result == BITCOIN_SUCCESS) {
+					begin = Stats_begin(self->stats);
+					BitcoinTool_write(self, output_type->name,
+						strlen(output_type->name));
+					BitcoinTool_write(self, ".", 1);
+					BitcoinTool_write(self, output_format->name,
+						strlen(output_format->name));
+					BitcoinTool_write(self, ":", 1);
+					BitcoinTool_write(self, output_buffer, output_buffer_size);
+					BitcoinTool_write(self, "\n", 1);
+					Stats_end(self->stats, BITCOIN_STATS_WRITE_OUTPUT, begin);
+				}
+			}
+		}
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self) {
+	char output_buffer[256];
+	size_t output_buffer_size = sizeof(output_buffer);
+	BitcoinResult format_result = BITCOIN_ERROR;
+	uint64_t begin;
+
+	if (self->options.output_type == OUTPUT_TYPE_ALL) {
+		return Bitcoin_WriteAllOutput(self);
+	}
+
+	memset(&output_buffer, 0, sizeof(output_buffer));
+
+	begin = Stats_begin(self->stats);
+	format_result = Bitcoin_FormatOutput(self, self->options.output_type,
+		self->options.output_format, output_buffer, &output_buffer_size);
+	Stats_end(self->stats, BITCOIN_STATS_FORMAT_OUTPUT, begin);
+	if (format_result == BITCOIN_SUCCESS) {
+		begin = Stats_begin(self->stats);
+		BitcoinTool_write(self, output_buffer, output_buffer_size);
+
+		/* output a newline for clarity if we're on a TTY */
+		if (self->options.batch || isatty(fileno(stdin))) {
+			BitcoinTool_write(self, "\n", 1);
+		}
+		Stats_end(self->stats, BITCOIN_STATS_WRITE_OUTPUT, begin);
+	} else {
+		applog(APPLOG_ERROR, __func__, "Error formatting output");
+		return BITCOIN_ERROR;
+	}
+
 	return BITCOIN_SUCCESS;
 }
 
-BitcoinResult Bitcoin_FormatOutput(struct BitcoinTool *self,
-	enum OutputType output_type, enum OutputFormat output_format,
-	char *output_buffer, size_t *output_buffer_size
-) {
-	struct BitcoinSHA256 checksum;
-	BitcoinResult result = BITCOIN_ERROR;
-	size_t output_raw_size = 0;
+static int Bitcoin_HasMoreInput(BitcoinTool *self)
+{
+	return self->options.batch;
+}
 
-	memset(&checksum, 0, sizeof(checksum));
-	memset(output_buffer, 0, *output_buffer_size);
+/* Write out a private key found by a search, as if it was input. */
+static void BitcoinTool_searchFound(void *arg,
+	const struct BitcoinPrivateKey *private_key)
+{
+	BitcoinTool tool;
+
+	memcpy(&tool, arg, sizeof(tool));
+	tool.private_key = *private_key;
+	tool.private_key_set = 1;
+	/* one line for each key found, as in batch mode */
+	tool.options.batch = 1;
+	if (Bitcoin_ConvertInputToOutput(&tool) == BITCOIN_SUCCESS) {
+		Bitcoin_WriteOutput(&tool);
+		fflush(stdout);
+	}
+	Secure_wipe(&tool, sizeof(tool));
+}
 
-	switch (output_type) {
-		case OUTPUT_TYPE_ADDRESS :
-			output_raw_size = BITCOIN_ADDRESS_SIZE;
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			memcpy(self->output_raw, self->address.data, output_raw_size);
-			break;
-		case OUTPUT_TYPE_ADDRESS_CHECKSUM :
-			output_raw_size = BITCOIN_ADDRESS_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE;
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			Bitcoin_DoubleSHA256(&checksum, self->address.data, BITCOIN_ADDRESS_SIZE);
-			memcpy(self->output_raw, self->address.data, BITCOIN_ADDRESS_SIZE);
-			memcpy(self->output_raw + BITCOIN_ADDRESS_SIZE, &checksum.data,
-				BITCOIN_BASE58CHECK_CHECKSUM_SIZE);
-			break;
-		case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
-			output_raw_size = BITCOIN_RIPEMD160_SIZE;
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			memcpy(self->output_raw, self->public_key_ripemd160.data, output_raw_size);
+static int BitcoinTool_runSearch(BitcoinTool *self)
+{
+	struct BitcoinMatchSet targets;
+	struct BitcoinSearchOptions options;
+	size_t found = 0;
+	BitcoinResult result;
+
+	if (Match_load(&targets, self->options.match_file) != BITCOIN_SUCCESS) {
+		return 0;
+	}
+
+	options.range = self->options.search_range;
+	options.targets = &targets;
+	options.endomorphism = self->options.search_endomorphism;
+	switch (self->options.public_key_compression) {
+		case PUBLIC_KEY_COMPRESSION_COMPRESSED :
+			options.compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
 			break;
-		case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
-			output_raw_size = BITCOIN_SHA256_SIZE;
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			memcpy(self->output_raw, self->public_key_sha256.data, output_raw_size);
+		case PUBLIC_KEY_COMPRESSION_UNCOMPRESSED :
+			options.compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
 			break;
-		case OUTPUT_TYPE_PUBLIC_KEY :
-			output_raw_size = BitcoinPublicKey_GetSize(&self->public_key);
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			memcpy(self->output_raw, self->public_key.data, output_raw_size);
+		case PUBLIC_KEY_COMPRESSION_AUTO :
+		default :
+			/* check both */
+			options.compression = BITCOIN_PUBLIC_KEY_EMPTY;
 			break;
-		case OUTPUT_TYPE_PRIVATE_KEY_WIF :
-			self->output_raw[0] = BitcoinNetworkType_GetPrivateKeyPrefix(self->private_key.network_type);
-			memcpy(self->output_raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
-				self->private_key.data, BITCOIN_PRIVATE_KEY_SIZE
-			);
-			switch (self->private_key.public_key_compression) {
-				case BITCOIN_PUBLIC_KEY_COMPRESSED :
-					/* set compression flag */
-					self->output_raw[
-						BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
-						BITCOIN_PRIVATE_KEY_SIZE
-					] = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
-					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
-						BITCOIN_PRIVATE_KEY_SIZE +
-						BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_SIZE;
-					break;
-				case BITCOIN_PUBLIC_KEY_UNCOMPRESSED :
-					/* no compression flag to set, size determines that the
-					corresponding public key should be uncompressed. */
-					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
-						BITCOIN_PRIVATE_KEY_SIZE;
-					break;
-				default :
-					applog(APPLOG_ERROR, __func__,
-						"Public key compression flag must be set using"
-						" --public-key-compression (compressed | uncompressed)"
-						" when importing raw private keys."
-					);
-					return BITCOIN_ERROR_INVALID_FORMAT;
-					break;
+	}
+	options.network_type = self->options.network_type;
+	options.threads = self->options.threads;
+	options.progress_interval = self->options.progress_interval;
+	options.found = BitcoinTool_searchFound;
+	options.found_arg = self;
+
+	result = Search_range(&options, &found);
+	if (result == BITCOIN_SUCCESS) {
+		applog(APPLOG_NOTICE, __func__, "Found %lu of %lu addresses.",
+			(unsigned long)found, (unsigned long)targets.count
+		);
+	}
+	Match_destroy(&targets);
+
+	return result == BITCOIN_SUCCESS && found > 0;
+}
+
+/* Write out a batch of generated mini keys, each as if it was input.  The
+   batch's lines are collected and written at once, so those of batches
+   generated on other threads at the same time don't get mixed in. */
+static BitcoinResult BitcoinTool_generated(void *arg, unsigned thread_index,
+	const char *keys, size_t count)
+{
+	const BitcoinTool *self = arg;
+	struct BitcoinSecureArena *arena = self->thread_arenas[thread_index];
+	struct BitcoinToolBuffer buffer;
+	BitcoinTool *tool;
+	BitcoinResult result = BITCOIN_SUCCESS;
+	size_t i;
+
+	/* the thread's arena holds the key being converted and the batch's
+	   output, and is reset for the next batch */
+	tool = SecureArena_alloc(arena, sizeof(*tool));
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.data = SecureArena_alloc(arena, BITCOINTOOL_GENERATE_OUTPUT_SIZE);
+	buffer.capacity = BITCOINTOOL_GENERATE_OUTPUT_SIZE;
+	if (!tool || !buffer.data) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate key");
+		SecureArena_reset(arena);
+		return BITCOIN_ERROR;
+	}
+	for (i = 0; i < count && result == BITCOIN_SUCCESS; i++) {
+		memcpy(tool, self, sizeof(*tool));
+		tool->output_buffer = &buffer;
+		memcpy(tool->input_raw, keys + i * BITCOIN_MINI_PRIVATE_KEY_SIZE,
+			BITCOIN_MINI_PRIVATE_KEY_SIZE);
+		tool->input_raw_size = BITCOIN_MINI_PRIVATE_KEY_SIZE;
+
+		result = Bitcoin_CheckInputSize(tool);
+		if (result == BITCOIN_SUCCESS) {
+			result = Bitcoin_ConvertInputToOutput(tool);
+		}
+		/* the key goes in front of anything else written out for it */
+		if (result == BITCOIN_SUCCESS
+			&& tool->options.output_type != OUTPUT_TYPE_MINI_PRIVATE_KEY
+			&& tool->options.output_type != OUTPUT_TYPE_ALL)
+		{
+			result = BitcoinTool_write(tool, tool->mini_private_key,
+				BITCOIN_MINI_PRIVATE_KEY_SIZE);
+			if (result == BITCOIN_SUCCESS) {
+				result = BitcoinTool_write(tool, " ", 1);
 			}
-			assert(sizeof(self->output_raw) >= output_raw_size);
+		}
+		if (result == BITCOIN_SUCCESS) {
+			result = Bitcoin_WriteOutput(tool);
+		}
+	}
+	if (result == BITCOIN_SUCCESS && buffer.size) {
+		result = Bitcoin_fwrite_safe(buffer.data, 1, buffer.size, stdout);
+	}
+
+	BitcoinTool_freeBuffer(&buffer);
+	SecureArena_reset(arena);
+	return result;
+}
+
+/* Make a locked arena of 'size' bytes for each thread. */
+static int BitcoinTool_createThreadArenas(BitcoinTool *self, unsigned count,
+	size_t size)
+{
+	unsigned i;
+
+	self->thread_arenas = calloc(count, sizeof(*self->thread_arenas));
+	if (!self->thread_arenas) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate arenas");
+		return 0;
+	}
+	self->thread_arena_count = count;
+	for (i = 0; i < count; i++) {
+		self->thread_arenas[i] = SecureArena_create(size);
+		if (!self->thread_arenas[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int BitcoinTool_runGenerate(BitcoinTool *self)
+{
+	struct BitcoinMiniKeyOptions options;
+
+	/* one line for each key, as in batch mode */
+	self->options.batch = 1;
+
+	if (!BitcoinTool_createThreadArenas(self,
+		self->options.threads ? self->options.threads : 1,
+		sizeof(BitcoinTool) + BITCOINTOOL_GENERATE_OUTPUT_SIZE + 32))
+	{
+		return 0;
+	}
+
+	options.count = self->options.generate_count;
+	options.threads = self->options.threads;
+	options.progress_interval = self->options.progress_interval;
+	options.found = BitcoinTool_generated;
+	options.found_arg = self;
+
+	return MiniKey_generate(&options) == BITCOIN_SUCCESS;
+}
+
+static int BitcoinTool_runBenchmark(BitcoinTool *self)
+{
+	struct BitcoinBenchmarkOptions options;
+
+	options.threads = self->options.threads;
+	options.scale = self->options.benchmark_scale;
+	options.filter = self->options.benchmark_filter;
+
+	return Bitcoin_RunBenchmark(stdout, &options) == BITCOIN_SUCCESS;
+}
+
+/* Check whether the address of the private key input is in --match-file,
+   for each public key compression allowed, and use the one which matched.
+   Both public keys come from one EC multiplication, since the compressed
+   key is the x coordinate of the uncompressed one and the parity of y. */
+static BitcoinResult BitcoinTool_matchRecord(BitcoinTool *self, int *matched)
+{
+	struct BitcoinPrivateKey private_key = self->private_key;
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	enum BitcoinPublicKeyCompression compressions[2];
+	unsigned i, count = 0;
+	BitcoinResult result;
+	uint64_t begin;
+
+	*matched = 0;
+	switch (self->options.public_key_compression) {
+		case PUBLIC_KEY_COMPRESSION_COMPRESSED :
+			compressions[count++] = BITCOIN_PUBLIC_KEY_COMPRESSED;
 			break;
-		case OUTPUT_TYPE_PRIVATE_KEY :
-			output_raw_size = BitcoinPrivateKey_GetSize(&self->private_key);
-			assert(sizeof(self->output_raw) >= output_raw_size);
-			memcpy(self->output_raw, self->private_key.data, output_raw_size);
+		case PUBLIC_KEY_COMPRESSION_UNCOMPRESSED :
+			compressions[count++] = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
 			break;
+		case PUBLIC_KEY_COMPRESSION_AUTO :
 		default :
-			applog(APPLOG_ERROR, __func__, "Unknown output type.");
-			return BITCOIN_ERROR_INVALID_FORMAT;
+			if (self->options.input_type == INPUT_TYPE_PRIVATE_KEY_WIF
+				|| self->options.input_type == INPUT_TYPE_PRIVATE_KEY_BIP38
+				|| self->options.input_type == INPUT_TYPE_MINI_PRIVATE_KEY)
+			{
+				/* the key says which */
+				compressions[count++] = private_key.public_key_compression;
+			} else {
+				compressions[count++] = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+				compressions[count++] = BITCOIN_PUBLIC_KEY_COMPRESSED;
+			}
 			break;
 	}
 
-	self->output_raw_size = output_raw_size;
+	/* passphrases being audited against known addresses are no secret, so
+	   don't need the constant time multiplication, but other private keys
+	   may well be */
+	private_key.public_key_compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+	begin = Stats_begin(self->stats);
+	if (self->options.input_type == INPUT_TYPE_PASSPHRASE) {
+		result = Bitcoin_MakePublicKeyFromPrivateKeyFast(&public_key,
+			&private_key);
+	} else {
+		result = Bitcoin_MakePublicKeyFromPrivateKey(&public_key,
+			&private_key);
+	}
+	Stats_end(self->stats, BITCOIN_STATS_EC, begin);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
 
-	switch (output_format) {
-		case OUTPUT_FORMAT_RAW : {
-			if (output_raw_size > *output_buffer_size) {
-				applog(APPLOG_BUG, __func__,
-					"output_raw buffer (%u) larger than output_text buffer (%u),"
-					"unable to write output",
-					(unsigned)output_raw_size,
-					(unsigned)*output_buffer_size
+	for (i = 0; i < count && !*matched; i++) {
+		if (compressions[i] == BITCOIN_PUBLIC_KEY_COMPRESSED) {
+			public_key.data[0] = 0x02
+				| (public_key.data[BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE - 1] & 1);
+			public_key.compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		}
+		begin = Stats_begin(self->stats);
+		Bitcoin_MakeSHA256FromPublicKey(&sha256, &public_key);
+		Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+		Stats_end(self->stats, BITCOIN_STATS_HASH, begin);
+
+		if (Match_find(self->match_set, &ripemd160, NULL)) {
+			self->private_key.public_key_compression = compressions[i];
+			*matched = 1;
+			if (self->options.batch) {
+				applog(APPLOG_NOTICE, __func__, "Input line %llu matched",
+					(unsigned long long)self->input_line
 				);
-				result = BITCOIN_ERROR_INVALID_FORMAT;
 			}
-			break;
 		}
-		case OUTPUT_FORMAT_HEX : {
-			int lower_case = 1;
-			result = Bitcoin_EncodeHex(
-				output_buffer, *output_buffer_size,
-				output_buffer_size,
-				self->output_raw, output_raw_size,
-				lower_case
-			);
-			break;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+/* Convert and write out one extended key, as private key input if it has
+   one, or public key input otherwise. */
+static BitcoinResult BitcoinTool_writeExtendedKey(BitcoinTool *self,
+	const struct BitcoinExtendedKey *key)
+{
+	const enum InputType input_type = self->options.input_type;
+	BitcoinResult result;
+	uint64_t begin;
+
+	if (key->is_private) {
+		self->private_key = key->private_key;
+		self->private_key_set = 1;
+		self->options.input_type = INPUT_TYPE_PRIVATE_KEY;
+	} else {
+		self->public_key = key->public_key;
+		self->public_key_set = 1;
+		self->options.input_type = INPUT_TYPE_PUBLIC_KEY;
+	}
+	begin = Stats_begin(self->stats);
+	result = Bitcoin_ConvertInputToOutput(self);
+	Stats_end(self->stats, BITCOIN_STATS_CONVERT, begin);
+	self->options.input_type = input_type;
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	return Bitcoin_WriteOutput(self);
+}
+
+/* Write out the keys at the --derive path from the extended key or
+   mnemonic input, or
+   the key itself without --derive.  The parent of the last level is
+   derived once, and its children a chunk at a time, which shares the
+   parent's HMAC key between them and makes their public keys affine
+   together.  The children are kept in a locked arena of their own, as
+   records may be derived on several threads at once. */
+static BitcoinResult BitcoinTool_deriveRecord(BitcoinTool *self)
+{
+	const struct BitcoinDerivationPath *path = &self->options.derive_path;
+	const int batch = self->options.batch;
+	struct BitcoinExtendedKey parent = self->extended_key;
+	struct BitcoinExtendedKey *children = NULL;
+	struct BitcoinSecureArena *arena = NULL;
+	BitcoinResult result = BITCOIN_SUCCESS;
+	uint64_t index, begin;
+	size_t i;
+
+	if (!self->options.derive || path->levels == 0) {
+		result = BitcoinTool_writeExtendedKey(self, &parent);
+		Secure_wipe(&parent, sizeof(parent));
+		return result;
+	}
+
+	begin = Stats_begin(self->stats);
+	for (i = 0; i + 1 < path->levels && result == BITCOIN_SUCCESS; i++) {
+		result = BIP32_deriveChild(&parent, &parent, path->indexes[i]);
+	}
+	Stats_end(self->stats, BITCOIN_STATS_EC, begin);
+	if (result == BITCOIN_SUCCESS) {
+		arena = SecureArena_create(BITCOINTOOL_DERIVE_CHUNK * sizeof(*children));
+		children = arena ? SecureArena_alloc(arena,
+			BITCOINTOOL_DERIVE_CHUNK * sizeof(*children)) : NULL;
+		if (!children) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate derived keys");
+			result = BITCOIN_ERROR;
 		}
-		case OUTPUT_FORMAT_BASE58 : {
-			result = Bitcoin_EncodeBase58(
-				output_buffer, *output_buffer_size,
-				output_buffer_size,
-				self->output_raw, output_raw_size
-			);
-			break;
+	}
+
+	/* one line for each key derived, as in batch mode */
+	self->options.batch = 1;
+	for (index = path->first;
+		index <= path->last && result == BITCOIN_SUCCESS;
+		index += BITCOINTOOL_DERIVE_CHUNK)
+	{
+		size_t count = path->last - index + 1 < BITCOINTOOL_DERIVE_CHUNK ?
+			(size_t)(path->last - index + 1) : BITCOINTOOL_DERIVE_CHUNK;
+
+		begin = Stats_begin(self->stats);
+		result = BIP32_deriveChildren(children, &parent, (uint32_t)index,
+			count, self->pool);
+		Stats_end(self->stats, BITCOIN_STATS_EC, begin);
+		for (i = 0; i < count && result == BITCOIN_SUCCESS; i++) {
+			result = BitcoinTool_writeExtendedKey(self, &children[i]);
 		}
-		case OUTPUT_FORMAT_BASE58CHECK : {
-			result = Bitcoin_EncodeBase58Check(
-				output_buffer, *output_buffer_size,
-				output_buffer_size,
-				self->output_raw, output_raw_size
-			);
-			break;
+		if (children) {
+			Secure_wipe(children, count * sizeof(*children));
 		}
-		case OUTPUT_FORMAT_BECH32 : {
-			if (segwit_addr_encode(
-				output_buffer,
-				self->options.network_type->hrp, 0,
-				self->output_raw+1, output_raw_size-1
-			) == 1) {
-				result = BITCOIN_SUCCESS;
-			} else {
-				result = BITCOIN_ERROR;
-			}
-			*output_buffer_size = strlen(output_buffer);
-			break;
+	}
+	self->options.batch = batch;
+
+	SecureArena_destroy(arena);
+	Secure_wipe(&parent, sizeof(parent));
+	return result;
+}
+
+/* Split a --verify-message line into its address, message and signature,
+   separated by one space or tab each, and recover the public key which
+   signed it.  The message is everything between the first separator and
+   the last, so it can have spaces of its own, or be empty.  A signature
+   which doesn't match is an input error, like any other wrong input. */
+static BitcoinResult BitcoinTool_verifyRecord(BitcoinTool *self,
+	int *input_error, uint64_t begin)
+{
+	struct BitcoinStats *stats = self->stats;
+	const struct BitcoinNetworkType *network_type = self->options.network_type;
+	uint8_t signature[MESSAGE_SIGNATURE_SIZE];
+	size_t size = self->input_size, first, last, decoded_size = 0;
+	BitcoinResult result = BITCOIN_ERROR_INVALID_FORMAT;
+
+	while (size > 0
+		&& (self->input[size - 1] == '\n' || self->input[size - 1] == '\r'))
+	{
+		size--;
+	}
+	first = 0;
+	while (first < size
+		&& self->input[first] != ' ' && self->input[first] != '\t')
+	{
+		first++;
+	}
+	last = size;
+	while (last > first
+		&& self->input[last - 1] != ' ' && self->input[last - 1] != '\t')
+	{
+		last--;
+	}
+	if (first == size) {
+		applog(APPLOG_ERROR, __func__,
+			"Expected an address, a message and a signature.");
+	} else if (Bitcoin_DecodeBase58Check(self->input_raw,
+			sizeof(self->input_raw), &decoded_size, self->input, first)
+			!= BITCOIN_SUCCESS
+		|| decoded_size != BITCOIN_ADDRESS_SIZE)
+	{
+		applog(APPLOG_ERROR, __func__, "Address isn't valid Base58Check.");
+	} else if (network_type
+		&& self->input_raw[0] != network_type->public_key_prefix)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Address isn't a %s public key address.", network_type->name);
+	} else if (!network_type && !(network_type =
+		Bitcoin_GetNetworkTypeByPublicKeyPrefix(self->input_raw[0])))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Address prefix %u isn't one of any network known.",
+			(unsigned)self->input_raw[0]);
+	} else {
+		result = Message_decodeSignature(signature, self->input + last,
+			size - last);
+	}
+	Stats_end(stats, BITCOIN_STATS_PARSE_INPUT, begin);
+	if (result != BITCOIN_SUCCESS) {
+		*input_error = 1;
+		return result;
+	}
+	memcpy(self->address.data, self->input_raw, BITCOIN_ADDRESS_SIZE);
+
+	begin = Stats_begin(stats);
+	result = Message_verify(&self->public_key, &self->address,
+		self->input + first + 1, last > first + 1 ? last - first - 2 : 0,
+		signature);
+	Stats_end(stats, BITCOIN_STATS_CHECK_INPUT, begin);
+	if (result == BITCOIN_ERROR_INVALID_SIGNATURE) {
+		applog(APPLOG_ERROR, __func__,
+			"Message wasn't signed by the key of %.*s.",
+			(int)first, self->input);
+		*input_error = 1;
+	}
+	if (result == BITCOIN_SUCCESS) {
+		self->public_key.network_type = network_type;
+		self->public_key_set = 1;
+	}
+	return result;
+}
+
+/* Decode a record which has been read and check its size, the first
+   stages of converting it.  'begin' is when parsing the input started. */
+static BitcoinResult BitcoinTool_checkRecord(BitcoinTool *self,
+	int *input_error, uint64_t begin)
+{
+	struct BitcoinStats *stats = self->stats;
+	BitcoinResult result;
+
+	if (self->options.verify_message) {
+		return BitcoinTool_verifyRecord(self, input_error, begin);
+	}
+
+	result = Bitcoin_DecodeInput(self);
+
+	Stats_end(stats, BITCOIN_STATS_PARSE_INPUT, begin);
+	if (result != BITCOIN_SUCCESS) {
+		*input_error = 1;
+		return result;
+	}
+
+	begin = Stats_begin(stats);
+	result = Bitcoin_CheckInputSize(self);
+	Stats_end(stats, BITCOIN_STATS_CHECK_INPUT, begin);
+	return result;
+}
+
+/* Check that the public keys input by records which passed
+   BitcoinTool_checkRecord() are on the curve, all together, as part of
+   the check stage.  A key which isn't fails its record as an input error,
+   which --ignore-input-errors can skip over, as it's the input which is
+   wrong. */
+static void BitcoinTool_checkPublicKeys(BitcoinTool *const *tools,
+	BitcoinResult *results, int *const *input_errors, unsigned count)
+{
+	const struct BitcoinPublicKey *public_keys[BITCOINTOOL_MAX_LANES];
+	BitcoinResult checked[BITCOINTOOL_MAX_LANES];
+	unsigned index[BITCOINTOOL_MAX_LANES];
+	uint64_t begin;
+	unsigned i, n = 0;
+	BitcoinResult result;
+
+	assert(count <= BITCOINTOOL_MAX_LANES);
+	if (count == 0 || tools[0]->options.input_type != INPUT_TYPE_PUBLIC_KEY
+		|| tools[0]->options.verify_message)
+	{
+		/* keys recovered from signatures are on the curve already */
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		if (results[i] == BITCOIN_SUCCESS && tools[i]->public_key_set) {
+			public_keys[n] = &tools[i]->public_key;
+			index[n++] = i;
+		}
+	}
+	if (n == 0) {
+		return;
+	}
+
+	begin = Stats_begin(tools[0]->stats);
+	result = Bitcoin_CheckPublicKeys(public_keys, n, checked);
+	for (i = 0; i < n; i++) {
+		if (result != BITCOIN_SUCCESS) {
+			results[index[i]] = result;
+		} else if (checked[i] != BITCOIN_SUCCESS) {
+			results[index[i]] = checked[i];
+			*input_errors[index[i]] = 1;
+		}
+	}
+	Stats_end(tools[0]->stats, BITCOIN_STATS_CHECK_INPUT, begin);
+}
+
+/* Run a record which has been checked through the rest of the stages. */
+static BitcoinResult BitcoinTool_finishRecord(BitcoinTool *self)
+{
+	struct BitcoinStats *stats = self->stats;
+	BitcoinResult result;
+	uint64_t begin;
+
+	if (self->options.input_type == INPUT_TYPE_EXTENDED_PRIVATE_KEY
+		|| self->options.input_type == INPUT_TYPE_EXTENDED_PUBLIC_KEY
+		|| self->options.input_type == INPUT_TYPE_MNEMONIC)
+	{
+		result = BitcoinTool_deriveRecord(self);
+		if (result == BITCOIN_SUCCESS && stats) {
+			stats->records_converted++;
+			stats->records_written++;
+		}
+		return result;
+	}
+
+	if (self->match_set) {
+		int matched = 0;
+
+		result = BitcoinTool_matchRecord(self, &matched);
+		if (result != BITCOIN_SUCCESS || !matched) {
+			return result;
 		}
-		default:
-			applog(APPLOG_ERROR, __func__,
-				"Unspecified output format."
-				" Please use --output-format with one of:"
-			);
-			BitcoinTool_ListOutputFormats(stderr);
-			return BITCOIN_ERROR_INVALID_FORMAT;
-			break;
 	}
 
+	begin = Stats_begin(stats);
+	result = Bitcoin_ConvertInputToOutput(self);
+	Stats_end(stats, BITCOIN_STATS_CONVERT, begin);
 	if (result != BITCOIN_SUCCESS) {
 		return result;
 	}
+	if (stats) {
+		stats->records_converted++;
+	}
 
-	if (strlen(output_buffer) == 0) {
-		applog(APPLOG_BUG, __func__,
-			"No text to output - something went wrong"
-		);
-		return BITCOIN_ERROR_INVALID_FORMAT;
+	result = Bitcoin_WriteOutput(self);
+	if (result == BITCOIN_SUCCESS && stats) {
+		stats->records_written++;
 	}
 
-	return BITCOIN_SUCCESS;
+	return result;
 }
 
-BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self);
-
-BitcoinResult Bitcoin_WriteAllOutput(struct BitcoinTool *self)
+/* Run a record which has been read through the rest of the stages.
+   'begin' is when parsing the input started. */
+static BitcoinResult BitcoinTool_convertRecord(BitcoinTool *self,
+	int *input_error, uint64_t begin)
 {
-	FILE *file = stdout;
+	BitcoinResult result = BitcoinTool_checkRecord(self, input_error, begin);
 
-	struct OutputFormatString {
-		enum OutputFormat output_format;
-		char *name;
-	} output_formats[] = {
-		{ OUTPUT_FORMAT_HEX,         "hex" },
-		{ OUTPUT_FORMAT_BASE58,      "base58" },
-		{ OUTPUT_FORMAT_BASE58CHECK, "base58check" },
-		{ OUTPUT_FORMAT_BECH32,      "bech32" }
-	}, *output_format = NULL;
+	BitcoinTool_checkPublicKeys(&self, &result, &input_error, 1);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	return BitcoinTool_finishRecord(self);
+}
 
-	struct OutputTypeString {
-		enum OutputType output_type;
-		char *name;
-		int is_set;
-	} output_types[] = {
-		{ OUTPUT_TYPE_ADDRESS,              "address" },
-		{ OUTPUT_TYPE_ADDRESS_CHECKSUM,     "address-checksum" },
-		{ OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160, "public-key-ripemd160" },
-		{ OUTPUT_TYPE_PUBLIC_KEY_SHA256,    "public-key-sha256" },
-		{ OUTPUT_TYPE_PUBLIC_KEY,           "public-key" },
-		{ OUTPUT_TYPE_PRIVATE_KEY_WIF,      "private-key-wif" },
-		{ OUTPUT_TYPE_PRIVATE_KEY,          "private-key" }
-	}, *output_type = NULL;
+/* Run one record through every stage, counting and timing them if --stats
+   is used.  'input_error' is set if the record failed while parsing input,
+   which --ignore-input-errors can skip over. */
+static BitcoinResult BitcoinTool_runRecord(BitcoinTool *self, int *input_error)
+{
+	struct BitcoinStats *stats = self->stats;
+	uint64_t begin = Stats_begin(stats);
+	BitcoinResult result = Bitcoin_ReadInput(self);
 
-	for (output_type = output_types;
-		output_type != output_types +
-		(sizeof(output_types) / sizeof(output_types[0]));
-		output_type++
-	) {
-		for (output_format = output_formats;
-			output_format != output_formats +
-			(sizeof(output_formats) / sizeof(output_formats[0]));
-			output_format++
-		) {
-			if (
-				output_type->output_type == OUTPUT_TYPE_ADDRESS_CHECKSUM
-				&& output_format->output_format == OUTPUT_FORMAT_BASE58CHECK
-			) {
-				/* This combination shouldn't be output, as I believe there
-				   is no valid use for it and there is potential for confusion
-				   for it to represent a usable address.
-				*/
-				continue;
-			}
+	if (result == BITCOIN_ERROR_END_OF_FILE) {
+		Stats_end(stats, BITCOIN_STATS_PARSE_INPUT, begin);
+		return result;
+	}
+	if (stats) {
+		stats->records_read++;
+	}
+	if (result != BITCOIN_SUCCESS) {
+		Stats_end(stats, BITCOIN_STATS_PARSE_INPUT, begin);
+		*input_error = 1;
+		return result;
+	}
 
-			if (
-				(output_type->output_type == OUTPUT_TYPE_ADDRESS && self->address_set) ||
-				(output_type->output_type == OUTPUT_TYPE_ADDRESS_CHECKSUM && self->address_set) ||
-				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 && self->public_key_ripemd160_set) ||
-				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_SHA256 && self->public_key_sha256_set) ||
-				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY && self->public_key_set) ||
-				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY_WIF && self->private_key_wif_set) ||
-				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY && self->private_key_set)
-			) {
-				char output_buffer[256];
-				size_t output_buffer_size = sizeof(output_buffer);
-				BitcoinResult format_result = BITCOIN_ERROR;
+	return BitcoinTool_convertRecord(self, input_error, begin);
+}
 
-				memset(&output_buffer, 0, sizeof(output_buffer));
-				format_result = Bitcoin_FormatOutput(self,
-					output_type->output_type, output_format->output_format,
-					output_buffer, &output_buffer_size);
+/* Size in bytes of the --input-file, or 0 if it's not a regular file, so
+   progress through batch input can be measured in bytes read. */
+static uint64_t BitcoinTool_inputFileSize(const BitcoinTool *self)
+{
+	struct stat st;
+	int result;
 
-				if (format_result == BITCOIN_SUCCESS) {
-					fprintf(file, "%s.%s:",
-						output_type->name, output_format->name
-					);
-					Bitcoin_fwrite_safe(output_buffer, 1, output_buffer_size, stdout);
-					putchar('\n');
-				}
-			}
-		}
+	if (strcmp(self->options.input_file, "-") == 0) {
+		result = fstat(fileno(stdin), &st);
+	} else {
+		result = stat(self->options.input_file, &st);
 	}
+	if (result != 0 || !S_ISREG(st.st_mode)) {
+		return 0;
+	}
+	return (uint64_t)st.st_size;
+}
 
-	return BITCOIN_SUCCESS;
+/* Write a tab separated record of an input line which failed: line number,
+   byte offset, result code and its description. */
+static void BitcoinTool_writeErrorRecord(BitcoinTool *self, BitcoinResult result)
+{
+	if (!self->error_file_handle) {
+		return;
+	}
+	fprintf(self->error_file_handle, "%llu\t%llu\t%d\t%s\n",
+		(unsigned long long)(self->options.batch ? self->input_line : 1),
+		(unsigned long long)self->input_offset,
+		(int)result,
+		Bitcoin_ResultString(result)
+	);
 }
 
-BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self) {
-	char output_buffer[256];
-	size_t output_buffer_size = sizeof(output_buffer);
-	BitcoinResult format_result = BITCOIN_ERROR;
+/* A batch record being converted by the pool, and its output waiting to be
+   written in input order. */
+struct BitcoinToolRecord {
+	BitcoinTool tool;
+	struct BitcoinToolBuffer output;
+	struct ParallelGroup group;
+	BitcoinResult result;
+	int input_error;
+	uint64_t start_nanoseconds;
 
-	if (self->options.output_type == OUTPUT_TYPE_ALL) {
-		return Bitcoin_WriteAllOutput(self);
+	/* statistics of each thread, indexed by the thread running the task */
+	struct BitcoinStats *thread_stats;
+
+	/* the record whose task converts this one, itself unless its mnemonic
+	   is seeded along with those of the records before it */
+	struct BitcoinToolRecord *leader;
+
+	/* records converted by this one's task in input order, if it leads */
+	struct BitcoinToolRecord *lane_records[BITCOINTOOL_MAX_LANES];
+	unsigned lane_count;
+};
+
+/* Number of batch records converted together by one task: raw mnemonics
+   seeded together, filling the SIMD lanes of PBKDF2, or public keys checked
+   together, filling those of the Jacobi symbol, or else 1. */
+static unsigned BitcoinTool_recordLanes(const BitcoinTool *self)
+{
+	unsigned lanes = 1;
+
+	if (self->options.input_type == INPUT_TYPE_MNEMONIC
+		&& self->options.input_format == INPUT_FORMAT_RAW
+		&& !self->options.fix_mnemonic)
+	{
+		lanes = PBKDF2_lanes();
+	} else if (self->options.input_type == INPUT_TYPE_PUBLIC_KEY
+		&& !self->options.verify_message)
+	{
+		lanes = ECBatch_jacobiLanes();
 	}
+	assert(lanes <= BITCOINTOOL_MAX_LANES);
+	return lanes;
+}
 
-	memset(&output_buffer, 0, sizeof(output_buffer));
+/* Make the seeds of the records' mnemonics together, ready for
+   Bitcoin_CheckInputSize().  Input which isn't a mnemonic is left for it
+   to report. */
+static void BitcoinTool_seedRecords(struct BitcoinToolRecord **records,
+	unsigned count)
+{
+	struct BitcoinBIP39Mnemonic mnemonics[PBKDF2_MAX_LANES];
+	BitcoinTool *tools[PBKDF2_MAX_LANES];
+	unsigned i, n = 0;
 
-	format_result = Bitcoin_FormatOutput(self, self->options.output_type,
-		self->options.output_format, output_buffer, &output_buffer_size);
-	if (format_result == BITCOIN_SUCCESS) {
-		Bitcoin_fwrite_safe(output_buffer, 1, output_buffer_size, stdout);
+	for (i = 0; i < count; i++) {
+		BitcoinTool *tool = &records[i]->tool;
 
-		/* output a newline for clarity if we're on a TTY */
-		if (self->options.batch || isatty(fileno(stdin))) {
-			putchar('\n');
+		if (BIP39_parse(&mnemonics[n], tool->input, tool->input_size, 0)
+			== BITCOIN_SUCCESS)
+		{
+			tools[n++] = tool;
+		}
+	}
+	if (n && BIP39_makeSeeds(mnemonics, n,
+		tools[0]->options.mnemonic_passphrase) == BITCOIN_SUCCESS)
+	{
+		for (i = 0; i < n; i++) {
+			tools[i]->mnemonic = mnemonics[i];
+			tools[i]->mnemonic_seed_set = 1;
 		}
-	} else {
-		applog(APPLOG_ERROR, __func__, "Error formatting output");
-		return BITCOIN_ERROR;
 	}
+	Secure_wipe(mnemonics, sizeof(mnemonics));
+}
 
-	return BITCOIN_SUCCESS;
+static void BitcoinTool_recordTask(void *arg, unsigned thread_index)
+{
+	struct BitcoinToolRecord *leader = arg;
+	struct BitcoinStats *stats = leader->thread_stats ?
+		&leader->thread_stats[thread_index] : NULL;
+	BitcoinTool *tools[BITCOINTOOL_MAX_LANES];
+	BitcoinResult results[BITCOINTOOL_MAX_LANES];
+	int *input_errors[BITCOINTOOL_MAX_LANES];
+	unsigned i;
+
+	if (leader->lane_count > 1
+		&& leader->tool.options.input_type == INPUT_TYPE_MNEMONIC)
+	{
+		uint64_t begin = Stats_begin(stats);
+
+		BitcoinTool_seedRecords(leader->lane_records, leader->lane_count);
+		Stats_end(stats, BITCOIN_STATS_CHECK_INPUT, begin);
+	}
+	for (i = 0; i < leader->lane_count; i++) {
+		struct BitcoinToolRecord *record = leader->lane_records[i];
+
+		record->tool.stats = stats;
+
+		/* reading was timed by the reader, decoding is timed here, the
+		   cycle counters of different processors not being comparable */
+		record->result = BitcoinTool_checkRecord(&record->tool,
+			&record->input_error, Stats_begin(stats));
+		tools[i] = &record->tool;
+		results[i] = record->result;
+		input_errors[i] = &record->input_error;
+	}
+	BitcoinTool_checkPublicKeys(tools, results, input_errors,
+		leader->lane_count);
+	for (i = 0; i < leader->lane_count; i++) {
+		struct BitcoinToolRecord *record = leader->lane_records[i];
+
+		record->result = results[i];
+		if (record->result == BITCOIN_SUCCESS) {
+			record->result = BitcoinTool_finishRecord(&record->tool);
+		}
+		record->tool.stats = NULL;
+	}
 }
 
-static int Bitcoin_HasMoreInput(BitcoinTool *self)
+/* Start converting the records led by 'leader', on the pool if there is
+   one, or now if not. */
+static void BitcoinTool_submitRecords(BitcoinTool *self,
+	struct BitcoinToolRecord *leader)
 {
-	return self->options.batch;
+	unsigned i;
+
+	if (!self->pool) {
+		BitcoinTool_recordTask(leader, 0);
+	} else if (ParallelPool_submit(self->pool, &leader->group,
+		BitcoinTool_recordTask, leader) != BITCOIN_SUCCESS)
+	{
+		for (i = 0; i < leader->lane_count; i++) {
+			leader->lane_records[i]->result = BITCOIN_ERROR;
+		}
+	}
+}
+
+/* Convert batch records on the pool, reading ahead up to
+   BITCOINTOOL_PARALLEL_WINDOW records, and write each one's output once all
+   the records before it have been written, so output stays in input order
+   however long each record takes.  Runs of mnemonic or public key records
+   are converted by one task, which makes their seeds or checks their keys
+   side by side, and without a pool the tasks run as they're submitted,
+   reading ahead only as far as one run so that the records stay in
+   cache. */
+static int BitcoinTool_runParallel(BitcoinTool *self,
+	struct BitcoinProgress *progress)
+{
+	const unsigned threads = self->options.threads;
+	const unsigned lanes = BitcoinTool_recordLanes(self);
+	const unsigned window = self->pool ? BITCOINTOOL_PARALLEL_WINDOW : lanes;
+	struct BitcoinToolRecord *records = NULL, *leader = NULL;
+	struct BitcoinSecureArena *arena;
+	struct BitcoinStats *thread_stats = NULL;
+	uint64_t read = 0, written = 0, begin;
+	int success = 1, end = 0;
+	unsigned i;
+
+	/* the window of records, and the start of each one's output, are in
+	   locked memory, each record being wiped once it's written */
+	arena = SecureArena_create(window
+		* (sizeof(*records) + BITCOINTOOL_RECORD_OUTPUT_SIZE + 16));
+	if (arena) {
+		records = SecureArena_alloc(arena,
+			window * sizeof(*records));
+	}
+	for (i = 0; records && i < window; i++) {
+		records[i].output.data = SecureArena_alloc(arena,
+			BITCOINTOOL_RECORD_OUTPUT_SIZE);
+		records[i].output.capacity = BITCOINTOOL_RECORD_OUTPUT_SIZE;
+	}
+	if (self->stats) {
+		/* one more for the main thread helping while it waits */
+		thread_stats = calloc(threads + 1, sizeof(*thread_stats));
+	}
+	if (!records || (self->stats && !thread_stats)) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate batch records");
+		SecureArena_destroy(arena);
+		free(thread_stats);
+		return 0;
+	}
+
+	while (success && (!end || written < read)) {
+		struct BitcoinToolRecord *record;
+
+		/* write out the oldest record once the window is full, or there is
+		   nothing left to read */
+		if (end || read - written == window) {
+			record = &records[written % window];
+			if (leader && (end || record->leader == leader)) {
+				/* the run being gathered includes this record, or is the
+				   last one */
+				BitcoinTool_submitRecords(self, leader);
+				leader = NULL;
+			}
+			if (self->pool) {
+				ParallelPool_wait(self->pool, &record->leader->group);
+			}
+			written++;
+
+			Bitcoin_fwrite_safe(record->output.data, 1, record->output.size,
+				stdout);
+			Secure_wipe(record->output.data, record->output.size);
+			record->output.size = 0;
+			if (progress->interval) {
+				Progress_update(progress, written,
+					record->tool.input_next_offset);
+			}
+			if (record->result != BITCOIN_SUCCESS) {
+				BitcoinTool_writeErrorRecord(&record->tool, record->result);
+			}
+			BitcoinTool_wipeRecord(&record->tool);
+			if (self->stats) {
+				if (record->result != BITCOIN_SUCCESS) {
+					Stats_recordError(self->stats, record->result);
+				}
+				Stats_recordLatency(self->stats,
+					Timer_nanoseconds() - record->start_nanoseconds);
+				if (Stats_reportDue(self->stats, self->options.stats_interval)) {
+					/* the stages are counted by the threads running them,
+					   which carry on while they're added up, so the report
+					   is as close as it can be without stopping them */
+					struct BitcoinStats snapshot = *self->stats;
+
+					for (i = 0; i <= threads; i++) {
+						Stats_merge(&snapshot, &thread_stats[i]);
+					}
+					Stats_report(stderr, &snapshot);
+				}
+			}
+			if (record->result != BITCOIN_SUCCESS
+				&& !(record->input_error && self->options.ignore_input_errors)
+			) {
+				success = 0;
+			}
+			continue;
+		}
+
+		record = &records[read % window];
+		record->start_nanoseconds = self->stats ? Timer_nanoseconds() : 0;
+		begin = Stats_begin(self->stats);
+		record->result = Bitcoin_ReadInput(self);
+		if (record->result == BITCOIN_ERROR_END_OF_FILE) {
+			Stats_end(self->stats, BITCOIN_STATS_PARSE_INPUT, begin);
+			end = 1;
+			continue;
+		}
+		if (record->result == BITCOIN_SUCCESS) {
+			/* the worker decoding the record counts the call */
+			Stats_add(self->stats, BITCOIN_STATS_PARSE_INPUT, begin);
+		}
+		if (self->stats) {
+			self->stats->records_read++;
+		}
+
+		/* the record gets its own copy of the input and everything converted
+		   from it, sharing only what is read-only while running */
+		memcpy(&record->tool, self, sizeof(record->tool));
+		record->tool.stats = NULL;
+		record->tool.input_file_handle = NULL;
+		record->tool.output_buffer = &record->output;
+		record->tool.options.progress_interval = 0;
+		record->thread_stats = thread_stats;
+		record->input_error = 0;
+		record->group.pending = 0;
+		record->leader = record;
+		record->lane_count = 0;
+		read++;
+
+		if (record->result != BITCOIN_SUCCESS) {
+			Stats_end(self->stats, BITCOIN_STATS_PARSE_INPUT, begin);
+			record->input_error = 1;
+			if (record->result == BITCOIN_ERROR_FILE) {
+				/* nothing more can be read */
+				end = 1;
+			}
+			continue;
+		}
+		if (!leader) {
+			leader = record;
+		}
+		record->leader = leader;
+		leader->lane_records[leader->lane_count++] = record;
+		if (leader->lane_count == lanes) {
+			BitcoinTool_submitRecords(self, leader);
+			leader = NULL;
+		}
+	}
+
+	/* let anything already queued finish before its record goes away */
+	for (; self->pool && written < read; written++) {
+		ParallelPool_wait(self->pool,
+			&records[written % window].group);
+	}
+
+	/* messages suppressed while this thread helped convert records are
+	   counted now, the workers' when the pool's threads exit */
+	applog_flush();
+	for (i = 0; i < window; i++) {
+		BitcoinTool_freeBuffer(&records[i].output);
+	}
+	SecureArena_destroy(arena);
+
+	if (thread_stats) {
+		for (i = 0; i <= threads; i++) {
+			Stats_merge(self->stats, &thread_stats[i]);
+		}
+		free(thread_stats);
+	}
+
+	return success;
 }
 
 static int BitcoinTool_run(BitcoinTool *self)
 {
+	int success = 1;
+	uint64_t records = 0;
+	struct BitcoinProgress progress;
+
+	if (self->options.benchmark) {
+		return BitcoinTool_runBenchmark(self);
+	}
+
+	if (self->options.search) {
+		return BitcoinTool_runSearch(self);
+	}
+
+	if (self->options.generate) {
+		return BitcoinTool_runGenerate(self);
+	}
+
+	if (self->options.stats) {
+		self->stats = malloc(sizeof(*self->stats));
+		if (!self->stats) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate statistics");
+			return 0;
+		}
+		Stats_init(self->stats);
+	}
+
+	if (self->options.error_file) {
+		self->error_file_handle = fopen(self->options.error_file, "w");
+		if (!self->error_file_handle) {
+			applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+				self->options.error_file,
+				strerror(errno)
+			);
+			return 0;
+		}
+		fprintf(self->error_file_handle, "# line\toffset\tresult\tdescription\n");
+	}
+
+	if (self->options.fix_base58_confusion_file) {
+		self->confusion = malloc(sizeof(*self->confusion));
+		if (!self->confusion) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate confusion model");
+			return 0;
+		}
+		Confusion_init(self->confusion);
+		if (Confusion_load(self->confusion,
+			self->options.fix_base58_confusion_file) != BITCOIN_SUCCESS)
+		{
+			return 0;
+		}
+	}
+
 	/* has user asked to override public key compression? */
 	switch (self->options.public_key_compression) {
 		/* user wants compressed public key */
@@ -1536,43 +3893,156 @@ static int BitcoinTool_run(BitcoinTool *self)
 			break;
 	}
 
-	do {
-		int result = Bitcoin_ParseInput(self);
+	Progress_init(&progress, stderr, "records",
+		self->options.batch ? self->options.progress_interval : 0
+	);
+	if (progress.interval) {
+		progress.total = BitcoinTool_inputFileSize(self);
+	}
 
-		if (result == BITCOIN_ERROR_END_OF_FILE) {
-			break;
-		} else if (result != BITCOIN_SUCCESS) {
-			if (self->options.ignore_input_errors == 0) {
-				return 0;
-			} else {
-				continue;
-			}
+	if (self->options.threads > 1) {
+		self->pool = ParallelPool_create(self->options.threads);
+		if (!self->pool) {
+			applog(APPLOG_ERROR, __func__, "Failed to start %u threads",
+				self->options.threads
+			);
+			return 0;
 		}
+	}
 
-		if (Bitcoin_CheckInputSize(self) != BITCOIN_SUCCESS) {
+	if (self->options.solve
+		&& self->options.solve_method == SOLVE_METHOD_BSGS)
+	{
+		struct BitcoinBSGSOptions solve_options;
+
+		BitcoinTool_solveOptions(self, &solve_options);
+		if (BSGS_createTable(&self->bsgs_table, &self->options.solve_range,
+			&solve_options) != BITCOIN_SUCCESS)
+		{
 			return 0;
 		}
+	}
 
-		if (Bitcoin_ConvertInputToOutput(self) != BITCOIN_SUCCESS) {
+	if (self->options.input_type == INPUT_TYPE_PRIVATE_KEY_BIP38
+		|| self->options.output_type == OUTPUT_TYPE_PRIVATE_KEY_BIP38)
+	{
+		/* one table for each thread making a key at once, workers and the
+		   main thread helping them, unless --bip38-memory allows fewer, in
+		   which case threads wait their turn */
+		size_t size = Scrypt_scratchSize(BIP38_SCRYPT_N, BIP38_SCRYPT_R,
+			BIP38_SCRYPT_P);
+		unsigned limit = self->pool ? self->options.threads + 1 : 1;
+
+		if (self->options.bip38_memory) {
+			uint64_t tables = (uint64_t)self->options.bip38_memory
+				* 1024 * 1024 / size;
+
+			if (tables < limit) {
+				limit = tables ? (unsigned)tables : 1;
+			}
+		}
+		self->scrypt_pool = ScryptPool_create(size, limit);
+		if (!self->scrypt_pool) {
 			return 0;
 		}
+	}
 
-		if (Bitcoin_WriteOutput(self) != BITCOIN_SUCCESS) {
+	if (self->options.match_file) {
+		self->match_set = calloc(1, sizeof(*self->match_set));
+		if (!self->match_set) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate match set");
+			return 0;
+		}
+		if (Match_load(self->match_set, self->options.match_file)
+			!= BITCOIN_SUCCESS)
+		{
 			return 0;
 		}
+	}
+
+	if (self->options.batch
+		&& (self->pool || BitcoinTool_recordLanes(self) > 1))
+	{
+		success = BitcoinTool_runParallel(self, &progress);
+	} else do {
+		uint64_t record_start = self->stats ? Timer_nanoseconds() : 0;
+		int input_error = 0;
+		BitcoinResult result = BitcoinTool_runRecord(self, &input_error);
+
+		BitcoinTool_wipeRecord(self);
+		if (result == BITCOIN_ERROR_END_OF_FILE) {
+			break;
+		}
+		records++;
+		if (progress.interval) {
+			Progress_update(&progress, records, self->input_next_offset);
+		}
+		if (result != BITCOIN_SUCCESS) {
+			BitcoinTool_writeErrorRecord(self, result);
+		}
+		if (self->stats) {
+			if (result != BITCOIN_SUCCESS) {
+				Stats_recordError(self->stats, result);
+			}
+			Stats_recordLatency(self->stats, Timer_nanoseconds() - record_start);
+			Stats_reportPeriodically(stderr, self->stats,
+				self->options.stats_interval);
+		}
+		if (result != BITCOIN_SUCCESS
+			&& !(input_error && self->options.ignore_input_errors)
+		) {
+			success = 0;
+			break;
+		}
 	} while (Bitcoin_HasMoreInput(self));
 
-	return 1;
+	if (progress.interval) {
+		Progress_report(&progress);
+	}
+	if (self->stats) {
+		Stats_report(stderr, self->stats);
+	}
+
+	return success;
 }
 
 static void BitcoinTool_destroy(BitcoinTool *self)
 {
-	free(self);
+	unsigned i;
+
+	if (self->error_file_handle) {
+		fclose(self->error_file_handle);
+	}
+	BSGS_destroyTable(self->bsgs_table);
+	if (self->match_set) {
+		Match_destroy(self->match_set);
+		free(self->match_set);
+	}
+	if (self->pool) {
+		ParallelPool_destroy(self->pool);
+	}
+	ScryptPool_destroy(self->scrypt_pool);
+	free(self->confusion);
+	free(self->stats);
+	for (i = 0; i < self->thread_arena_count; i++) {
+		SecureArena_destroy(self->thread_arenas[i]);
+	}
+	free(self->thread_arenas);
+
+	/* the tool itself is wiped along with its arena */
+	SecureArena_destroy(self->arena);
 }
 
 BitcoinTool *BitcoinTool_create(void)
 {
-	BitcoinTool *self = (BitcoinTool *)calloc(1, sizeof(*self));
+	struct BitcoinSecureArena *arena = SecureArena_create(sizeof(BitcoinTool));
+	BitcoinTool *self = arena ? SecureArena_alloc(arena, sizeof(*self)) : NULL;
+
+	if (!self) {
+		SecureArena_destroy(arena);
+		return NULL;
+	}
+	self->arena = arena;
 
 	/* load openssl error strings for error reporting */
 	ERR_load_crypto_strings();
@@ -1594,12 +4064,19 @@ int main(int argc, char *argv[])
 	BitcoinTool *bat = BitcoinTool_create();
 	int result = 0;
 
+	if (!bat) {
+		applog_flush();
+		return EXIT_FAILURE;
+	}
+
 	if (!bat->parseOptions(bat, argc, argv)) {
 		bat->destroy(bat);
+		applog_flush();
 		return EXIT_FAILURE;
 	}
 	result = bat->run(bat);
 	bat->destroy(bat);
+	applog_flush();
 
 	return result ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,180 @@
+#include "match.h"
+#include "applog.h"
+#include "base58.h"
+#include "keys.h"
+#include "segwit_addr.h"
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static int Match_compare(const void *a, const void *b)
+{
+	return memcmp(a, b, BITCOIN_RIPEMD160_SIZE);
+}
+
+static unsigned Match_filterIndex(const struct BitcoinRIPEMD160 *hash)
+{
+	return ((unsigned)hash->data[0] << 8) | hash->data[1];
+}
+
+/* Decode one target, as hex, a bech32 address or a Base58Check address.
+   bech32 is tried first since it fails quietly on other formats. */
+static int Match_decode(struct BitcoinRIPEMD160 *hash, const char *text,
+	size_t size)
+{
+	uint8_t decoded[64];
+	size_t decoded_size = 0;
+	char hrp[84];
+	int witver;
+
+	if (size == BITCOIN_RIPEMD160_SIZE * 2
+		&& Bitcoin_DecodeHex(hash->data, sizeof(hash->data), &decoded_size,
+			text, size) == BITCOIN_SUCCESS
+		&& decoded_size == BITCOIN_RIPEMD160_SIZE)
+	{
+		return 1;
+	}
+
+	if (segwit_addr_decode_any(hrp, &witver, decoded, &decoded_size, text)
+		&& witver == 0 && decoded_size == BITCOIN_RIPEMD160_SIZE)
+	{
+		memcpy(hash->data, decoded, BITCOIN_RIPEMD160_SIZE);
+		return 1;
+	}
+
+	if (Bitcoin_DecodeBase58Check(decoded, sizeof(decoded), &decoded_size,
+			text, size) == BITCOIN_SUCCESS
+		&& decoded_size == BITCOIN_ADDRESS_SIZE)
+	{
+		memcpy(hash->data, decoded + BITCOIN_ADDRESS_VERSION_SIZE,
+			BITCOIN_RIPEMD160_SIZE);
+		return 1;
+	}
+
+	return 0;
+}
+
+BitcoinResult Match_load(struct BitcoinMatchSet *set, const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	char line[256];
+	unsigned line_number = 0;
+	size_t capacity = 0, i, unique = 0;
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	memset(set, 0, sizeof(*set));
+
+	if (!file) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to open match file \"%s\"", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char *text = line;
+		size_t size;
+
+		line_number++;
+		while (isspace((unsigned char)*text)) {
+			text++;
+		}
+		size = strlen(text);
+		while (size > 0 && isspace((unsigned char)text[size - 1])) {
+			text[--size] = '\0';
+		}
+		if (size == 0 || text[0] == '#') {
+			continue;
+		}
+
+		if (set->count == capacity) {
+			size_t capacity_new = capacity ? capacity * 2 : 64;
+			struct BitcoinRIPEMD160 *hashes = realloc(set->hashes,
+				capacity_new * sizeof(*hashes));
+			if (!hashes) {
+				applog(APPLOG_ERROR, __func__, "Failed to allocate match set");
+				result = BITCOIN_ERROR;
+				break;
+			}
+			set->hashes = hashes;
+			capacity = capacity_new;
+		}
+
+		if (!Match_decode(&set->hashes[set->count], text, size)) {
+			applog(APPLOG_ERROR, __func__,
+				"%s:%u: expected an address or 40 hex digits of a public key"
+				" hash", filename, line_number
+			);
+			result = BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+		}
+		set->count++;
+	}
+
+	if (result == BITCOIN_SUCCESS && ferror(file)) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to read match file \"%s\"", filename
+		);
+		result = BITCOIN_ERROR_FILE;
+	}
+	fclose(file);
+
+	if (result != BITCOIN_SUCCESS) {
+		Match_destroy(set);
+		return result;
+	}
+
+	qsort(set->hashes, set->count, sizeof(*set->hashes), Match_compare);
+	for (i = 0; i < set->count; i++) {
+		const struct BitcoinRIPEMD160 *hash = &set->hashes[i];
+		unsigned bit = Match_filterIndex(hash);
+
+		if (unique > 0 && Match_compare(&set->hashes[unique - 1], hash) == 0) {
+			continue;
+		}
+		set->hashes[unique++] = *hash;
+		set->filter[bit >> 3] |= 1 << (bit & 7);
+	}
+	set->count = unique;
+
+	return BITCOIN_SUCCESS;
+}
+
+void Match_destroy(struct BitcoinMatchSet *set)
+{
+	free(set->hashes);
+	set->hashes = NULL;
+	set->count = 0;
+}
+
+int Match_find(const struct BitcoinMatchSet *set,
+	const struct BitcoinRIPEMD160 *hash, size_t *index)
+{
+	unsigned bit = Match_filterIndex(hash);
+	size_t low = 0, high = set->count;
+
+	if (!(set->filter[bit >> 3] & (1 << (bit & 7)))) {
+		return 0;
+	}
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		int compare = Match_compare(hash, &set->hashes[middle]);
+
+		if (compare == 0) {
+			if (index) {
+				*index = middle;
+			}
+			return 1;
+		}
+		if (compare < 0) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef BITCOIN_INCLUDE_MATCH_H
+#define BITCOIN_INCLUDE_MATCH_H
+
+/** @file match.h
+ *  @brief Set of public key hashes to look for while searching, loaded from
+ *         a file of addresses.
+ *
+ *  Hashes are kept sorted for binary search, behind a bitmap of their first
+ *  16 bits, so almost every hash which isn't in the set is rejected with a
+ *  single memory read.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "hash.h" /* struct BitcoinRIPEMD160 */
+#include "result.h" /* BitcoinResult */
+
+#define BITCOIN_MATCH_FILTER_BITS 65536
+
+struct BitcoinMatchSet {
+	/* sorted, without duplicates */
+	struct BitcoinRIPEMD160 *hashes;
+	size_t count;
+
+	/* bit set for the first two bytes of every hash in the set */
+	uint8_t filter[BITCOIN_MATCH_FILTER_BITS / 8];
+};
+
+/** @brief Load the set from a file with one target per line: a Base58Check
+ *         P2PKH address, a bech32 P2WPKH address, or 40 hex digits of a
+ *         public key RIPEMD160 hash.  Blank lines and lines starting with
+ *         '#' are ignored.  Addresses of any network may be mixed.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_FILE if the file can't be read.
+ *          BITCOIN_ERROR_INVALID_FORMAT if a line isn't a target.
+ */
+BitcoinResult Match_load(struct BitcoinMatchSet *set, const char *filename);
+
+/** @brief Free the hashes of the set. */
+void Match_destroy(struct BitcoinMatchSet *set);
+
+/** @brief Look for a hash in the set.
+ *
+ *  @param[out] index Set to the index of the hash in set->hashes if found,
+ *              may be NULL.
+ *
+ *  @return 1 if the hash is in the set, otherwise 0.
+ */
+int Match_find(const struct BitcoinMatchSet *set,
+	const struct BitcoinRIPEMD160 *hash, size_t *index
+);
+
+#endif
@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "message.h"
+#include "applog.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+static const char message_magic[] = "Bitcoin Signed Message:\n";
+
+/* a group of its own, whose multiples of G are made once and kept, and the
+   constants, shared by every thread */
+static struct MessageCurve {
+	EC_GROUP *group;
+	BIGNUM *p, *n, *half_n;
+	const struct BitcoinSecp256k1Endomorphism *e;
+	int ok;
+} message_curve;
+static pthread_once_t message_curve_once = PTHREAD_ONCE_INIT;
+
+static void Message_initCurve(void)
+{
+	struct MessageCurve *c = &message_curve;
+	const EC_GROUP *group = Bitcoin_GetSecp256k1Group();
+	BN_CTX *ctx = BN_CTX_new();
+
+	c->p = BN_new();
+	c->n = BN_new();
+	c->half_n = BN_new();
+	c->ok = ctx && group && c->p && c->n && c->half_n
+		&& (c->group = EC_GROUP_dup(group)) != NULL
+		&& EC_GROUP_precompute_mult(c->group, ctx)
+		&& EC_GROUP_get_curve(c->group, c->p, NULL, NULL, ctx)
+		&& EC_GROUP_get_order(c->group, c->n, ctx)
+		&& BN_rshift1(c->half_n, c->n)
+		&& (c->e = Bitcoin_GetSecp256k1Endomorphism()) != NULL;
+	if (!c->ok) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+	BN_CTX_free(ctx);
+}
+
+/* Length of a string before it, as a Bitcoin variable length integer. */
+static size_t Message_encodeSize(uint8_t *output, size_t size)
+{
+	unsigned bytes, i;
+
+	if (size < 0xfd) {
+		output[0] = (uint8_t)size;
+		return 1;
+	}
+	output[0] = size <= 0xffff ? 0xfd : 0xfe;
+	bytes = size <= 0xffff ? 2 : 4;
+	for (i = 0; i < bytes; i++) {
+		output[1 + i] = (uint8_t)(size >> (8 * i));
+	}
+	return 1 + bytes;
+}
+
+void Message_hash(struct BitcoinSHA256 *hash, const char *message,
+	size_t size)
+{
+	struct BitcoinSHA256 first;
+	uint8_t length[5];
+	SHA256_CTX ctx;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, length,
+		Message_encodeSize(length, sizeof(message_magic) - 1));
+	SHA256_Update(&ctx, message_magic, sizeof(message_magic) - 1);
+	SHA256_Update(&ctx, length, Message_encodeSize(length, size));
+	SHA256_Update(&ctx, message, size);
+	SHA256_Final(first.data, &ctx);
+	Bitcoin_SHA256(hash, first.data, BITCOIN_SHA256_SIZE);
+}
+
+BitcoinResult Message_decodeSignature(uint8_t *signature, const char *text,
+	size_t size)
+{
+	/* 65 bytes are 88 characters, the last being padding */
+	uint8_t decoded[MESSAGE_SIGNATURE_SIZE + 1];
+
+	if (size != MESSAGE_SIGNATURE_BASE64_SIZE || text[size - 1] != '='
+		|| text[size - 2] == '=')
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Signature should be %u characters of Base64, ending in one '='.",
+			(unsigned)MESSAGE_SIGNATURE_BASE64_SIZE
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (EVP_DecodeBlock(decoded, (const unsigned char *)text, (int)size)
+		!= (int)sizeof(decoded))
+	{
+		applog(APPLOG_ERROR, __func__, "Signature isn't valid Base64.");
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (decoded[0] < MESSAGE_HEADER_MIN || decoded[0] > MESSAGE_HEADER_MAX) {
+		applog(APPLOG_ERROR, __func__,
+			"Signature header byte %u isn't one of a P2PKH address (%u to %u).",
+			(unsigned)decoded[0], MESSAGE_HEADER_MIN, MESSAGE_HEADER_MAX
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	memcpy(signature, decoded, MESSAGE_SIGNATURE_SIZE);
+	return BITCOIN_SUCCESS;
+}
+
+/* Split 'k' into k1 + k2 * lambda mod n, both about half its length and
+   either of them maybe negative. */
+static int Message_splitScalar(BIGNUM *k1, BIGNUM *k2, const BIGNUM *k,
+	BN_CTX *ctx)
+{
+	const struct MessageCurve *c = &message_curve;
+	BIGNUM *c1, *c2, *t;
+	int ok;
+
+	BN_CTX_start(ctx);
+	c1 = BN_CTX_get(ctx);
+	c2 = BN_CTX_get(ctx);
+	t = BN_CTX_get(ctx);
+
+	/* c1 = round(b2 * k / n), c2 = round(-b1 * k / n) */
+	ok = t
+		&& BN_mul(t, c->e->b2, k, ctx)
+		&& BN_add(t, t, c->half_n)
+		&& BN_div(c1, NULL, t, c->n, ctx)
+		&& BN_mul(t, c->e->b1, k, ctx);
+	if (ok) {
+		BN_set_negative(t, !BN_is_negative(t));
+		ok = BN_add(t, t, c->half_n)
+			&& BN_div(c2, NULL, t, c->n, ctx)
+
+			/* k1 = k - c1 * a1 - c2 * a2 */
+			&& BN_mul(t, c1, c->e->a1, ctx)
+			&& BN_sub(k1, k, t)
+			&& BN_mul(t, c2, c->e->a2, ctx)
+			&& BN_sub(k1, k1, t)
+
+			/* k2 = -c1 * b1 - c2 * b2 */
+			&& BN_mul(t, c1, c->e->b1, ctx)
+			&& BN_mul(k2, c2, c->e->b2, ctx)
+			&& BN_add(k2, k2, t);
+		BN_set_negative(k2, !BN_is_negative(k2));
+	}
+
+	BN_CTX_end(ctx);
+	return ok;
+}
+
+BitcoinResult Message_recoverPublicKey(struct BitcoinPublicKey *public_key,
+	const uint8_t *signature, const struct BitcoinSHA256 *hash)
+{
+	const struct MessageCurve *c = &message_curve;
+	const unsigned header = signature[0] - MESSAGE_HEADER_MIN;
+	const int compressed = (header & MESSAGE_HEADER_COMPRESSED) != 0;
+	BitcoinResult result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	BN_CTX *ctx;
+	BIGNUM *r, *s, *e, *x, *y, *k1, *k2;
+	EC_POINT *points[2] = { NULL, NULL }, *q = NULL;
+	const BIGNUM *scalars[2];
+	int ok;
+
+	pthread_once(&message_curve_once, Message_initCurve);
+	ctx = c->ok ? BN_CTX_new() : NULL;
+	if (!ctx) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+		return result;
+	}
+	BN_CTX_start(ctx);
+	r = BN_CTX_get(ctx);
+	s = BN_CTX_get(ctx);
+	e = BN_CTX_get(ctx);
+	x = BN_CTX_get(ctx);
+	y = BN_CTX_get(ctx);
+	k1 = BN_CTX_get(ctx);
+	k2 = BN_CTX_get(ctx);
+	points[0] = EC_POINT_new(c->group);
+	points[1] = EC_POINT_new(c->group);
+	q = EC_POINT_new(c->group);
+
+	ok = k2 && points[0] && points[1] && q
+		&& BN_bin2bn(signature + 1, 32, r)
+		&& BN_bin2bn(signature + 33, 32, s)
+		&& BN_bin2bn(hash->data, BITCOIN_SHA256_SIZE, e);
+	if (!ok) {
+		goto done;
+	}
+
+	/* r is the x coordinate of R mod n, which was one of two numbers
+	   below p, and its y coordinate one of two */
+	if (BN_is_zero(r) || BN_cmp(r, c->n) >= 0
+		|| BN_is_zero(s) || BN_cmp(s, c->n) >= 0
+		|| !BN_copy(x, r)
+		|| ((header & 2) && !BN_add(x, x, c->n))
+		|| BN_cmp(x, c->p) >= 0
+		|| !EC_POINT_set_compressed_coordinates(c->group, points[0], x,
+			header & 1, ctx))
+	{
+		/* not on the curve, which isn't OpenSSL failing */
+		ERR_clear_error();
+		result = BITCOIN_ERROR_INVALID_SIGNATURE;
+		goto done;
+	}
+
+	/* Q = -e/r G + s/r R, with s/r split in two for R and lambda R */
+	ok = BN_mod_inverse(r, r, c->n, ctx) != NULL
+		&& BN_mod_mul(e, e, r, c->n, ctx)
+		&& (BN_is_zero(e) || BN_sub(e, c->n, e))
+		&& BN_mod_mul(s, s, r, c->n, ctx)
+		&& Message_splitScalar(k1, k2, s, ctx)
+		&& EC_POINT_get_affine_coordinates(c->group, points[0], x, y, ctx)
+		&& BN_mod_mul(x, x, c->e->beta, c->p, ctx)
+		&& EC_POINT_set_affine_coordinates(c->group, points[1], x, y, ctx);
+	scalars[0] = k1;
+	scalars[1] = k2;
+	ok = ok && EC_POINTs_mul(c->group, q, e, 2,
+		(const EC_POINT **)points, scalars, ctx);
+	if (!ok) {
+		goto done;
+	}
+	if (EC_POINT_is_at_infinity(c->group, q)) {
+		result = BITCOIN_ERROR_INVALID_SIGNATURE;
+		goto done;
+	}
+	ok = EC_POINT_point2oct(c->group, q,
+		compressed ?
+			POINT_CONVERSION_COMPRESSED : POINT_CONVERSION_UNCOMPRESSED,
+		public_key->data, sizeof(public_key->data), ctx) != 0;
+	if (ok) {
+		public_key->compression = compressed ?
+			BITCOIN_PUBLIC_KEY_COMPRESSED : BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+		result = BITCOIN_SUCCESS;
+	}
+
+done:
+	if (!ok) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+	EC_POINT_free(points[0]);
+	EC_POINT_free(points[1]);
+	EC_POINT_free(q);
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return result;
+}
+
+BitcoinResult Message_verify(struct BitcoinPublicKey *public_key,
+	const struct BitcoinAddress *address, const char *message, size_t size,
+	const uint8_t *signature)
+{
+	struct BitcoinSHA256 hash;
+	struct BitcoinRIPEMD160 ripemd160, expected;
+	BitcoinResult result;
+
+	Message_hash(&hash, message, size);
+	result = Message_recoverPublicKey(public_key, signature, &hash);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	Bitcoin_MakeSHA256FromPublicKey(&hash, public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &hash);
+	Bitcoin_MakeRIPEMD160FromAddress(&expected, address);
+	if (memcmp(ripemd160.data, expected.data, BITCOIN_RIPEMD160_SIZE) != 0) {
+		return BITCOIN_ERROR_INVALID_SIGNATURE;
+	}
+	return BITCOIN_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#ifndef BITCOIN_INCLUDE_MESSAGE_H
+#define BITCOIN_INCLUDE_MESSAGE_H
+
+/** @file message.h
+ *  @brief Messages signed with the private key of an address, as Bitcoin
+ *         Core's signmessage and verifymessage make and check them.
+ *
+ *  The message is hashed with double SHA256 after the text "Bitcoin Signed
+ *  Message:\n", each preceded by its length.  The signature is 65 bytes in
+ *  Base64: a header byte, then r and s.  The header says which of the
+ *  points with x coordinate r was used to sign, and whether the address is
+ *  of the compressed public key.  So the public key can be recovered from
+ *  the signature, and the message is genuine if the key's address is the
+ *  one it claims to be signed by.
+ *
+ *  The key is Q = r^-1 (s R - e G), with both multiplications made in one
+ *  pass of doublings (Shamir's trick).  s/r is split into two numbers of
+ *  half the length using the endomorphism of secp256k1, so that R and
+ *  lambda R need only half as many doublings, and the multiples of G come
+ *  from a table made the first time.
+ *
+ *  https://github.com/bitcoin/bips/blob/master/bip-0137.mediawiki
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "hash.h" /* struct BitcoinSHA256 */
+#include "keys.h" /* struct BitcoinPublicKey, struct BitcoinAddress */
+#include "result.h" /* BitcoinResult */
+
+/* decoded size of a signature, and the size of its Base64 */
+#define MESSAGE_SIGNATURE_SIZE 65
+#define MESSAGE_SIGNATURE_BASE64_SIZE 88
+
+/* header bytes of signatures by P2PKH addresses, the first four being of
+   uncompressed public keys and the next four of compressed ones */
+#define MESSAGE_HEADER_MIN 27
+#define MESSAGE_HEADER_MAX 34
+#define MESSAGE_HEADER_COMPRESSED 4
+
+/** @brief Hash a message of 'size' bytes the way signmessage does. */
+void Message_hash(struct BitcoinSHA256 *hash, const char *message,
+	size_t size
+);
+
+/** @brief Decode the Base64 text of a signature into
+ *         MESSAGE_SIGNATURE_SIZE bytes of 'signature'.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if it isn't the Base64 of a
+ *          signature by a P2PKH address, having logged why.
+ */
+BitcoinResult Message_decodeSignature(uint8_t *signature, const char *text,
+	size_t size
+);
+
+/** @brief Recover the public key which made a signature decoded by
+ *         Message_decodeSignature() of a message hashed by Message_hash().
+ *         The key is compressed if the header says so, and its network
+ *         type is left as it was.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_SIGNATURE if no key could have made it,
+ *          without logging anything.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Message_recoverPublicKey(struct BitcoinPublicKey *public_key,
+	const uint8_t *signature, const struct BitcoinSHA256 *hash
+);
+
+/** @brief Check that a message was signed by the private key of an
+ *         address, recovering the public key and comparing its RIPEMD160
+ *         hash with the address's.  The address's version byte isn't
+ *         checked.
+ *
+ *  @param[out] public_key The key which signed the message.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if it was.
+ *          BITCOIN_ERROR_INVALID_SIGNATURE if not, without logging anything.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Message_verify(struct BitcoinPublicKey *public_key,
+	const struct BitcoinAddress *address, const char *message, size_t size,
+	const uint8_t *signature
+);
+
+#endif
@@ -0,0 +1,1135 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "minikey.h"
+#include "applog.h"
+#include "combination.h"
+#include "confusion.h"
+#include "hash.h"
+#include "parallel.h"
+#include "progress.h"
+#include "secure.h"
+#include "timer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/err.h>
+#include <openssl/rand.h>
+
+/* Eight lanes of SHA256 need AVX2, checked for at run time. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ >= 5)
+#define BITCOIN_MINIKEY_AVX2
+#include <immintrin.h>
+#endif
+
+/* the key and "?" are hashed as one block: the 31 characters, the 0x80
+   which ends them, zeros, and their length in bits in the last word */
+#define MINIKEY_BLOCK_WORDS 16
+#define MINIKEY_MESSAGE_SIZE (BITCOIN_MINI_PRIVATE_KEY_SIZE + 1)
+#define MINIKEY_BIT_LENGTH (MINIKEY_MESSAGE_SIZE * 8)
+
+/* keys each thread takes from the count at a time, and hands to 'found' */
+#define MINIKEY_BATCH_SIZE 256
+
+/* random bytes fetched at once.  Bytes of 232 (4 * 58) or more are thrown
+   away, so that the rest map evenly onto the 58 characters. */
+#define MINIKEY_RANDOM_SIZE 4096
+#define MINIKEY_RANDOM_LIMIT (4 * 58)
+
+/* candidates each thread takes at a time when recovering a key */
+#define MINIKEY_CHUNK_SIZE 65536
+
+/* characters a key can have after its 'S' */
+#define MINIKEY_RADIX 58
+
+static const char minikey_checkpoint_magic[8] =
+	{ 'B', 'T', 'M', 'I', 'N', 'I', '0', '1' };
+
+static const char minikey_digits[] =
+	"123456789"
+	"ABCDEFGHJKLMNPQRSTUVWXYZ"
+	"abcdefghijkmnopqrstuvwxyz";
+
+/* Keys to generate, shared between threads */
+struct MiniKeyGenerator {
+	const struct BitcoinMiniKeyOptions *options;
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* keys handed out to threads so far, and generated so far */
+	uint64_t taken, generated;
+
+	/* set if generating has stopped early, on error */
+	int done;
+	BitcoinResult result;
+
+	struct BitcoinProgress progress;
+};
+
+/* Characters tried at a changed position, most likely first, how many,
+   and how many of those the confusion model gives more than the default
+   weight, such as lookalikes */
+struct MiniKeyPosition {
+	char candidates[MINIKEY_RADIX];
+	unsigned count, likely;
+};
+
+/* The candidates of a position tried in one step */
+struct MiniKeyRange {
+	unsigned position, first, count;
+};
+
+/* The positions changing in one step of the search, and the number of
+   candidates it has.  Each combination of readable characters being
+   changed makes a step for each way of splitting them between those
+   changed to a likely character and the rest. */
+struct MiniKeyStep {
+	struct MiniKeyRange ranges[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	unsigned count;
+	uint64_t size;
+};
+
+/* Key to recover, shared between threads */
+struct MiniKeyRecovery {
+	const struct BitcoinMiniKeyRecoveryOptions *options;
+
+	/* the key as given, with 'S' first */
+	char key[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+
+	/* the characters which could be anything else */
+	struct MiniKeyPosition positions[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+
+	/* characters which are wrong, and those which might be */
+	unsigned unknown[BITCOIN_MINI_PRIVATE_KEY_SIZE], unknown_count;
+	unsigned known[BITCOIN_MINI_PRIVATE_KEY_SIZE], known_count;
+
+	/* hash of everything deciding the order of candidates, which a
+	   checkpoint must have been made with */
+	struct BitcoinSHA256 search;
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* which readable characters are changed in this step, how many, how
+	   many of them to unlikely characters and which, the number of
+	   candidates in steps before it, and the next candidate of the step to
+	   hand out */
+	struct Combination combination;
+	unsigned changed, unlikely, unlikely_mask;
+	struct MiniKeyStep step;
+	uint64_t step_first, next;
+
+	/* first candidate of the run each thread is trying, UINT64_MAX for
+	   none, so the checkpoint can say every candidate before the lowest
+	   has been tried */
+	uint64_t *trying;
+	uint64_t checkpoint_nanoseconds;
+
+	/* set once every candidate is taken, one is found, or on error */
+	int done, found;
+	BitcoinResult result;
+	char found_key[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	uint64_t checked;
+
+	struct BitcoinProgress progress;
+};
+
+/* A run of candidates from one step, the first being 'number' in the
+   whole search */
+struct MiniKeyChunk {
+	struct MiniKeyStep step;
+	uint64_t first, count, number;
+};
+
+/* checkpoint file */
+struct MiniKeyCheckpoint {
+	char magic[8];
+
+	/* MiniKeyRecovery.search, rather than the characters which could be
+	   read, which are most of the key */
+	uint8_t search[BITCOIN_SHA256_SIZE];
+
+	/* candidates tried, big-endian */
+	uint8_t tried[8];
+};
+
+/* A character not yet tried at a position and its cost */
+struct MiniKeyCost {
+	double cost;
+	char c;
+};
+
+/* Random bytes not yet used */
+struct MiniKeyRandom {
+	uint8_t bytes[MINIKEY_RANDOM_SIZE];
+	size_t used;
+};
+
+/* One candidate on its own. */
+static void MiniKey_check1(const char *key, uint8_t *valid)
+{
+	char message[MINIKEY_MESSAGE_SIZE];
+	struct BitcoinSHA256 hash;
+
+	memcpy(message, key, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+	message[BITCOIN_MINI_PRIVATE_KEY_SIZE] = '?';
+	Bitcoin_SHA256(&hash, message, sizeof(message));
+	*valid = hash.data[0] == 0;
+}
+
+#if defined(BITCOIN_MINIKEY_AVX2)
+
+static const uint32_t minikey_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t minikey_sha256_h[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define MINIKEY_ROTR8(x, n) \
+	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define MINIKEY_XOR3(a, b, c) \
+	_mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+static uint32_t MiniKey_load32(const uint8_t *bytes)
+{
+	return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16
+		| (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+}
+
+/* Eight candidates side by side.  Only the first word of the hash is
+   needed, so the rest of the state isn't added back. */
+__attribute__((target("avx2")))
+static void MiniKey_check8(const char *keys, uint8_t *valid)
+{
+	uint8_t blocks[8][MINIKEY_BLOCK_WORDS * 4];
+	uint32_t first[8];
+	__m256i w[64];
+	__m256i a, b, c, d, e, f, g, h;
+	unsigned t, i;
+
+	memset(blocks, 0, sizeof(blocks));
+	for (i = 0; i < 8; i++) {
+		memcpy(blocks[i], keys + i * BITCOIN_MINI_PRIVATE_KEY_SIZE,
+			BITCOIN_MINI_PRIVATE_KEY_SIZE);
+		blocks[i][BITCOIN_MINI_PRIVATE_KEY_SIZE] = '?';
+		blocks[i][MINIKEY_MESSAGE_SIZE] = 0x80;
+	}
+	for (t = 0; t < 8; t++) {
+		w[t] = _mm256_set_epi32(
+			(int)MiniKey_load32(blocks[7] + t * 4),
+			(int)MiniKey_load32(blocks[6] + t * 4),
+			(int)MiniKey_load32(blocks[5] + t * 4),
+			(int)MiniKey_load32(blocks[4] + t * 4),
+			(int)MiniKey_load32(blocks[3] + t * 4),
+			(int)MiniKey_load32(blocks[2] + t * 4),
+			(int)MiniKey_load32(blocks[1] + t * 4),
+			(int)MiniKey_load32(blocks[0] + t * 4));
+	}
+	for (t = 8; t < 15; t++) {
+		w[t] = _mm256_setzero_si256();
+	}
+	w[15] = _mm256_set1_epi32(MINIKEY_BIT_LENGTH);
+	for (t = 16; t < 64; t++) {
+		const __m256i s0 = MINIKEY_XOR3(MINIKEY_ROTR8(w[t - 15], 7),
+			MINIKEY_ROTR8(w[t - 15], 18), _mm256_srli_epi32(w[t - 15], 3));
+		const __m256i s1 = MINIKEY_XOR3(MINIKEY_ROTR8(w[t - 2], 17),
+			MINIKEY_ROTR8(w[t - 2], 19), _mm256_srli_epi32(w[t - 2], 10));
+
+		w[t] = _mm256_add_epi32(_mm256_add_epi32(s0, s1),
+			_mm256_add_epi32(w[t - 16], w[t - 7]));
+	}
+
+	a = _mm256_set1_epi32((int)minikey_sha256_h[0]);
+	b = _mm256_set1_epi32((int)minikey_sha256_h[1]);
+	c = _mm256_set1_epi32((int)minikey_sha256_h[2]);
+	d = _mm256_set1_epi32((int)minikey_sha256_h[3]);
+	e = _mm256_set1_epi32((int)minikey_sha256_h[4]);
+	f = _mm256_set1_epi32((int)minikey_sha256_h[5]);
+	g = _mm256_set1_epi32((int)minikey_sha256_h[6]);
+	h = _mm256_set1_epi32((int)minikey_sha256_h[7]);
+	for (t = 0; t < 64; t++) {
+		const __m256i s1 = MINIKEY_XOR3(MINIKEY_ROTR8(e, 6),
+			MINIKEY_ROTR8(e, 11), MINIKEY_ROTR8(e, 25));
+		const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+			_mm256_andnot_si256(e, g));
+		const __m256i t1 = _mm256_add_epi32(
+			_mm256_add_epi32(_mm256_add_epi32(h, s1), ch),
+			_mm256_add_epi32(
+				_mm256_set1_epi32((int)minikey_sha256_k[t]), w[t]));
+		const __m256i s0 = MINIKEY_XOR3(MINIKEY_ROTR8(a, 2),
+			MINIKEY_ROTR8(a, 13), MINIKEY_ROTR8(a, 22));
+		const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b),
+			_mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+		h = g; g = f; f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c; c = b; b = a;
+		a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+	}
+
+	a = _mm256_add_epi32(a, _mm256_set1_epi32((int)minikey_sha256_h[0]));
+	_mm256_storeu_si256((__m256i *)first, a);
+	for (i = 0; i < 8; i++) {
+		valid[i] = (first[i] >> 24) == 0;
+	}
+}
+
+#endif
+
+unsigned MiniKey_lanes(void)
+{
+#if defined(BITCOIN_MINIKEY_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		return 8;
+	}
+#endif
+	return 1;
+}
+
+void MiniKey_check(const char *keys, size_t count, uint8_t *valid)
+{
+	size_t i = 0;
+
+#if defined(BITCOIN_MINIKEY_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		for (; i + 8 <= count; i += 8) {
+			MiniKey_check8(keys + i * BITCOIN_MINI_PRIVATE_KEY_SIZE,
+				valid + i);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		MiniKey_check1(keys + i * BITCOIN_MINI_PRIVATE_KEY_SIZE, valid + i);
+	}
+}
+
+/* Fill a candidate with 'S' and random characters, returning 0 if OpenSSL
+   failed.  Every byte is written out, but only kept by moving on to the
+   next character if it's below the limit, which saves a branch that would
+   be mispredicted for about one byte in ten. */
+static int MiniKey_candidate(struct MiniKeyRandom *random, char *candidate)
+{
+	size_t i = 1;
+
+	candidate[0] = 'S';
+	while (i < BITCOIN_MINI_PRIVATE_KEY_SIZE) {
+		const uint8_t *bytes, *end;
+
+		if (random->used == sizeof(random->bytes)) {
+			if (RAND_bytes(random->bytes, sizeof(random->bytes)) != 1) {
+				return 0;
+			}
+			random->used = 0;
+		}
+		bytes = random->bytes + random->used;
+		end = random->bytes + sizeof(random->bytes);
+		while (i < BITCOIN_MINI_PRIVATE_KEY_SIZE && bytes != end) {
+			const uint8_t byte = *bytes++;
+
+			candidate[i] = minikey_digits[byte % 58];
+			i += byte < MINIKEY_RANDOM_LIMIT;
+		}
+		random->used = bytes - random->bytes;
+	}
+	return 1;
+}
+
+/* Take up to a batch of keys to generate, returning how many, or 0 if
+   there are none left or generating has stopped. */
+static size_t MiniKey_take(struct MiniKeyGenerator *generator)
+{
+	const uint64_t count = generator->options->count;
+	size_t size = 0;
+
+	pthread_mutex_lock(&generator->mutex);
+	if (!generator->done && generator->taken < count) {
+		size = count - generator->taken < MINIKEY_BATCH_SIZE ?
+			(size_t)(count - generator->taken) : MINIKEY_BATCH_SIZE;
+		generator->taken += size;
+	}
+	pthread_mutex_unlock(&generator->mutex);
+	return size;
+}
+
+static void MiniKey_thread(void *arg, unsigned thread_index)
+{
+	struct MiniKeyGenerator *generator = arg;
+	const struct BitcoinMiniKeyOptions *options = generator->options;
+	const unsigned lanes = MiniKey_lanes();
+	struct MiniKeyRandom random;
+	char keys[MINIKEY_BATCH_SIZE * BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	char candidates[MINIKEY_MAX_LANES * BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	uint8_t valid[MINIKEY_MAX_LANES];
+	BitcoinResult result = BITCOIN_SUCCESS;
+	size_t size;
+	unsigned i;
+
+	random.used = sizeof(random.bytes);
+	while (result == BITCOIN_SUCCESS
+		&& (size = MiniKey_take(generator)) > 0)
+	{
+		size_t found = 0;
+
+		while (found < size && result == BITCOIN_SUCCESS) {
+			for (i = 0; i < lanes; i++) {
+				if (!MiniKey_candidate(&random,
+					candidates + i * BITCOIN_MINI_PRIVATE_KEY_SIZE))
+				{
+					applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+						ERR_error_string(ERR_get_error(), NULL)
+					);
+					result = BITCOIN_ERROR_LIBRARY_FAILURE;
+					break;
+				}
+			}
+			if (result != BITCOIN_SUCCESS) {
+				break;
+			}
+			MiniKey_check(candidates, lanes, valid);
+			for (i = 0; i < lanes && found < size; i++) {
+				if (valid[i]) {
+					memcpy(keys + found * BITCOIN_MINI_PRIVATE_KEY_SIZE,
+						candidates + i * BITCOIN_MINI_PRIVATE_KEY_SIZE,
+						BITCOIN_MINI_PRIVATE_KEY_SIZE);
+					found++;
+				}
+			}
+		}
+		if (result == BITCOIN_SUCCESS && options->found) {
+			result = options->found(options->found_arg, thread_index, keys,
+				size);
+		}
+
+		pthread_mutex_lock(&generator->mutex);
+		if (result == BITCOIN_SUCCESS) {
+			generator->generated += size;
+			Progress_update(&generator->progress, generator->generated,
+				generator->generated);
+		} else if (!generator->done) {
+			generator->done = 1;
+			generator->result = result;
+		}
+		pthread_mutex_unlock(&generator->mutex);
+	}
+
+	Secure_wipe(&random, sizeof(random));
+	Secure_wipe(keys, sizeof(keys));
+	Secure_wipe(candidates, sizeof(candidates));
+	applog_flush();
+}
+
+BitcoinResult MiniKey_generate(const struct BitcoinMiniKeyOptions *options)
+{
+	struct MiniKeyGenerator generator;
+	BitcoinResult result;
+
+	memset(&generator, 0, sizeof(generator));
+	generator.options = options;
+	generator.result = BITCOIN_SUCCESS;
+	Progress_init(&generator.progress, stderr, "keys",
+		options->progress_interval);
+	generator.progress.total = options->count;
+
+	pthread_mutex_init(&generator.mutex, NULL);
+	result = Parallel_run(options->threads ? options->threads : 1,
+		MiniKey_thread, &generator);
+	pthread_mutex_destroy(&generator.mutex);
+	if (result == BITCOIN_SUCCESS) {
+		result = generator.result;
+	}
+	if (generator.progress.interval) {
+		Progress_report(&generator.progress);
+	}
+	return result;
+}
+
+static int MiniKey_compareCost(const void *a, const void *b)
+{
+	const struct MiniKeyCost *x = a, *y = b;
+
+	if (x->cost != y->cost) {
+		return x->cost < y->cost ? -1 : 1;
+	}
+	return x->c < y->c ? -1 : x->c > y->c;
+}
+
+/* Fill in the characters to try at a position, every character for an
+   unknown one, or the likeliest to have been misread as what was written
+   first, leaving out what was written. */
+static void MiniKey_initPosition(struct MiniKeyPosition *position,
+	const struct BitcoinConfusion *confusion, char written)
+{
+	struct MiniKeyCost costs[MINIKEY_RADIX];
+	unsigned i, n = 0;
+
+	for (i = 0; i < MINIKEY_RADIX; i++) {
+		if (minikey_digits[i] == written) {
+			continue;
+		}
+		costs[n].c = minikey_digits[i];
+		costs[n].cost = written == MINIKEY_UNKNOWN_CHAR ? 0 :
+			Confusion_cost(confusion, minikey_digits, written,
+				minikey_digits[i]);
+		n++;
+	}
+	qsort(costs, n, sizeof(costs[0]), MiniKey_compareCost);
+	position->likely = 0;
+	for (i = 0; i < n; i++) {
+		position->candidates[i] = costs[i].c;
+		if (written != MINIKEY_UNKNOWN_CHAR
+			&& confusion->weight[(unsigned char)written
+				% BITCOIN_CONFUSION_CHARS][(int)costs[i].c]
+				> BITCOIN_CONFUSION_WEIGHT_DEFAULT)
+		{
+			position->likely++;
+		}
+	}
+	position->count = n;
+}
+
+/* Check the key is the right length, and set up the characters to try
+   where they're unknown or might be wrong. */
+static BitcoinResult MiniKey_parse(struct MiniKeyRecovery *recovery,
+	const char *text, size_t size)
+{
+	const struct BitcoinMiniKeyRecoveryOptions *options = recovery->options;
+	struct BitcoinConfusion *builtin_confusion = NULL;
+	const struct BitcoinConfusion *confusion = options->confusion;
+	uint8_t search[BITCOIN_MINI_PRIVATE_KEY_SIZE + 4
+		+ BITCOIN_MINI_PRIVATE_KEY_SIZE * (MINIKEY_RADIX + 1)];
+	unsigned i;
+
+	while (size > 0 && (text[size - 1] == '\r' || text[size - 1] == '\n'
+		|| text[size - 1] == ' '))
+	{
+		size--;
+	}
+	if (size != BITCOIN_MINI_PRIVATE_KEY_SIZE) {
+		applog(APPLOG_ERROR, __func__,
+			"Mini private key to fix has %u characters, but should have %u,"
+			" with %c for those which can't be read",
+			(unsigned)size, (unsigned)BITCOIN_MINI_PRIVATE_KEY_SIZE,
+			MINIKEY_UNKNOWN_CHAR
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (text[0] != 'S' && text[0] != MINIKEY_UNKNOWN_CHAR) {
+		applog(APPLOG_WARNING, __func__,
+			"Mini private keys start with 'S', not '%c', which has been"
+			" changed", text[0]
+		);
+	}
+
+	if (!confusion) {
+		builtin_confusion = malloc(sizeof(*builtin_confusion));
+		if (!builtin_confusion) {
+			applog(APPLOG_ERROR, __func__,
+				"Failed to allocate confusion model");
+			return BITCOIN_ERROR;
+		}
+		Confusion_init(builtin_confusion);
+		confusion = builtin_confusion;
+	}
+
+	memset(search, 0, sizeof(search));
+	recovery->key[0] = 'S';
+	for (i = 1; i < BITCOIN_MINI_PRIVATE_KEY_SIZE; i++) {
+		const char c = text[i];
+
+		recovery->key[i] = c;
+		if (c != MINIKEY_UNKNOWN_CHAR && strchr(minikey_digits, c)) {
+			recovery->known[recovery->known_count++] = i;
+			if (!options->change_chars) {
+				continue;
+			}
+		} else {
+			recovery->unknown[recovery->unknown_count++] = i;
+		}
+		MiniKey_initPosition(&recovery->positions[i], confusion, c);
+		memcpy(search + BITCOIN_MINI_PRIVATE_KEY_SIZE + 4
+			+ i * (MINIKEY_RADIX + 1), recovery->positions[i].candidates,
+			recovery->positions[i].count);
+		search[BITCOIN_MINI_PRIVATE_KEY_SIZE + 4 + i * (MINIKEY_RADIX + 1)
+			+ MINIKEY_RADIX] = (uint8_t)recovery->positions[i].likely;
+	}
+	free(builtin_confusion);
+
+	memcpy(search, recovery->key, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+	for (i = 0; i < 4; i++) {
+		search[BITCOIN_MINI_PRIVATE_KEY_SIZE + i] =
+			(uint8_t)(options->change_chars >> (24 - i * 8));
+	}
+	Bitcoin_SHA256(&recovery->search, search, sizeof(search));
+	Secure_wipe(search, sizeof(search));
+	return BITCOIN_SUCCESS;
+}
+
+static int MiniKey_compareRange(const void *a, const void *b)
+{
+	const struct MiniKeyRange *x = a, *y = b;
+
+	return x->position < y->position ? -1 : x->position > y->position;
+}
+
+/* Set up the step for the unknown characters and the readable characters
+   chosen by the current combination, those in the unlikely mask changed to
+   characters which aren't likely and the rest to those which are.
+   Returns 0 if it has too many candidates. */
+static int MiniKey_makeStep(struct MiniKeyRecovery *recovery,
+	struct MiniKeyStep *step)
+{
+	unsigned i;
+
+	step->count = 0;
+	for (i = 0; i < recovery->unknown_count; i++) {
+		struct MiniKeyRange *range = &step->ranges[step->count++];
+
+		range->position = recovery->unknown[i];
+		range->first = 0;
+		range->count = recovery->positions[range->position].count;
+	}
+	for (i = 0; i < recovery->changed; i++) {
+		struct MiniKeyRange *range = &step->ranges[step->count++];
+		const struct MiniKeyPosition *position;
+
+		range->position = recovery->known[recovery->combination.k[i]];
+		position = &recovery->positions[range->position];
+		if (recovery->unlikely_mask & (1u << i)) {
+			range->first = position->likely;
+			range->count = position->count - position->likely;
+		} else {
+			range->first = 0;
+			range->count = position->likely;
+		}
+	}
+	qsort(step->ranges, step->count, sizeof(step->ranges[0]),
+		MiniKey_compareRange);
+
+	step->size = 1;
+	for (i = 0; i < step->count; i++) {
+		const unsigned count = step->ranges[i].count;
+
+		if (count == 0) {
+			/* nothing likely, or nothing else, at this position */
+			step->size = 0;
+			break;
+		}
+		if (step->size > UINT64_MAX / count) {
+			return 0;
+		}
+		step->size *= count;
+	}
+	return 1;
+}
+
+/* Next mask with as many bits set, or 0 if it was the last of 'bits'. */
+static unsigned MiniKey_nextMask(unsigned mask, unsigned bits)
+{
+	unsigned lowest, ripple;
+
+	if (mask == 0) {
+		return 0;
+	}
+	lowest = mask & (~mask + 1);
+	ripple = mask + lowest;
+	mask = (((ripple ^ mask) >> 2) / lowest) | ripple;
+	return mask < (1u << bits) ? mask : 0;
+}
+
+/* Move on to the next step.  Fewer changed readable characters come
+   first, then fewer of them changed to unlikely characters, every
+   combination of positions being tried for each.  Returns 0 at the end. */
+static int MiniKey_nextStep(struct MiniKeyRecovery *recovery)
+{
+	unsigned mask;
+
+	recovery->step_first += recovery->step.size;
+	recovery->next = 0;
+	if (recovery->changed
+		&& (mask = MiniKey_nextMask(recovery->unlikely_mask,
+			recovery->changed)) != 0)
+	{
+		recovery->unlikely_mask = mask;
+	} else if (recovery->changed
+		&& Combination_next(&recovery->combination))
+	{
+		recovery->unlikely_mask = (1u << recovery->unlikely) - 1;
+	} else {
+		if (recovery->changed) {
+			Combination_destroy(&recovery->combination);
+		}
+		if (recovery->changed && recovery->unlikely < recovery->changed) {
+			recovery->unlikely++;
+		} else if (recovery->changed == recovery->options->change_chars
+			|| recovery->changed == recovery->known_count)
+		{
+			recovery->changed = 0;
+			return 0;
+		} else {
+			recovery->changed++;
+			recovery->unlikely = 0;
+		}
+		recovery->unlikely_mask = (1u << recovery->unlikely) - 1;
+		Combination_create(&recovery->combination,
+			(int)recovery->known_count, (int)recovery->changed);
+		if (!recovery->combination.k) {
+			recovery->changed = 0;
+			return 0;
+		}
+	}
+	return MiniKey_makeStep(recovery, &recovery->step);
+}
+
+/* Number of candidates in every step, or UINT64_MAX if too many. */
+static uint64_t MiniKey_countCandidates(struct MiniKeyRecovery *recovery)
+{
+	uint64_t total = recovery->step.size, count;
+	unsigned changed, i;
+
+	/* every changed readable character has one fewer candidate than the
+	   alphabet, so every combination of as many has the same number, however
+	   they're split between likely characters and the rest */
+	for (changed = 1; changed <= recovery->options->change_chars
+		&& changed <= recovery->known_count; changed++)
+	{
+		count = Combination_count((int)recovery->known_count, (int)changed);
+		for (i = 0; i < changed && count != UINT64_MAX; i++) {
+			count = count > UINT64_MAX / (MINIKEY_RADIX - 1) ?
+				UINT64_MAX : count * (MINIKEY_RADIX - 1);
+		}
+		if (count == UINT64_MAX || count > UINT64_MAX / recovery->step.size) {
+			return UINT64_MAX;
+		}
+		count *= recovery->step.size;
+		if (total > UINT64_MAX - count) {
+			return UINT64_MAX;
+		}
+		total += count;
+	}
+	return total;
+}
+
+/* Write how many candidates have been tried to the checkpoint file,
+   through a temporary file so a crash while writing leaves the last one
+   intact.  Called under the mutex. */
+static BitcoinResult MiniKey_save(struct MiniKeyRecovery *recovery)
+{
+	const struct BitcoinMiniKeyRecoveryOptions *options = recovery->options;
+	const char *filename = options->checkpoint_filename;
+	char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+	struct MiniKeyCheckpoint checkpoint;
+	uint64_t tried = recovery->step_first + recovery->next;
+	FILE *file;
+	unsigned i;
+	int ok;
+
+	if (!temporary) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate file name");
+		return BITCOIN_ERROR;
+	}
+	strcpy(temporary, filename);
+	strcat(temporary, ".tmp");
+
+	for (i = 0; i < (options->threads ? options->threads : 1); i++) {
+		if (recovery->trying[i] < tried) {
+			tried = recovery->trying[i];
+		}
+	}
+	memcpy(checkpoint.magic, minikey_checkpoint_magic,
+		sizeof(checkpoint.magic));
+	memcpy(checkpoint.search, recovery->search.data,
+		sizeof(checkpoint.search));
+	for (i = 0; i < 8; i++) {
+		checkpoint.tried[7 - i] = (uint8_t)(tried >> (i * 8));
+	}
+
+	file = fopen(temporary, "wb");
+	ok = file && fwrite(&checkpoint, sizeof(checkpoint), 1, file);
+	if (file && fclose(file) != 0) {
+		ok = 0;
+	}
+	ok = ok && rename(temporary, filename) == 0;
+	if (!ok) {
+		applog(APPLOG_ERROR, __func__, "Failed to write file [%s] (%s)",
+			temporary, strerror(errno)
+		);
+		remove(temporary);
+	}
+	free(temporary);
+
+	return ok ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+/* Skip the candidates an earlier run tried, if the checkpoint file
+   exists. */
+static BitcoinResult MiniKey_load(struct MiniKeyRecovery *recovery)
+{
+	const char *filename = recovery->options->checkpoint_filename;
+	FILE *file = fopen(filename, "rb");
+	struct MiniKeyCheckpoint checkpoint;
+	uint64_t tried = 0;
+	unsigned i;
+
+	if (!file) {
+		if (errno == ENOENT) {
+			return BITCOIN_SUCCESS;
+		}
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+	if (fread(&checkpoint, sizeof(checkpoint), 1, file) != 1
+		|| memcmp(checkpoint.magic, minikey_checkpoint_magic,
+			sizeof(checkpoint.magic)) != 0)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" isn't a mini key checkpoint made by this version",
+			filename
+		);
+		fclose(file);
+		return BITCOIN_ERROR_FILE;
+	}
+	fclose(file);
+	if (memcmp(checkpoint.search, recovery->search.data,
+		sizeof(checkpoint.search)) != 0)
+	{
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" is a checkpoint for another key, number of changed"
+			" characters or confusion model", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+	for (i = 0; i < 8; i++) {
+		tried = tried << 8 | checkpoint.tried[i];
+	}
+	if (tried > recovery->progress.total) {
+		applog(APPLOG_ERROR, __func__,
+			"\"%s\" has tried more candidates than there are", filename
+		);
+		return BITCOIN_ERROR_FILE;
+	}
+
+	applog(APPLOG_NOTICE, __func__,
+		"Carrying on after the %llu candidates tried by \"%s\"",
+		(unsigned long long)tried, filename
+	);
+	while (!recovery->done
+		&& tried - recovery->step_first >= recovery->step.size)
+	{
+		if (!MiniKey_nextStep(recovery)) {
+			recovery->done = 1;
+		}
+	}
+	recovery->next = tried - recovery->step_first;
+	recovery->progress.count = tried;
+	return BITCOIN_SUCCESS;
+}
+
+/* Take the next run of candidates for a thread, returning 0 if there are
+   none left. */
+static int MiniKey_takeChunk(struct MiniKeyRecovery *recovery,
+	struct MiniKeyChunk *chunk, unsigned thread_index)
+{
+	int taken = 0;
+
+	pthread_mutex_lock(&recovery->mutex);
+	while (!recovery->done) {
+		if (recovery->next < recovery->step.size) {
+			chunk->step = recovery->step;
+			chunk->first = recovery->next;
+			chunk->number = recovery->step_first + recovery->next;
+			chunk->count = recovery->step.size - recovery->next;
+			if (chunk->count > MINIKEY_CHUNK_SIZE) {
+				chunk->count = MINIKEY_CHUNK_SIZE;
+			}
+			recovery->next += chunk->count;
+			recovery->trying[thread_index] = chunk->number;
+			taken = 1;
+			break;
+		}
+		if (!MiniKey_nextStep(recovery)) {
+			recovery->done = 1;
+		}
+	}
+	pthread_mutex_unlock(&recovery->mutex);
+
+	return taken;
+}
+
+/* Whether the address of a candidate which passed the check is a target,
+   stopping the search if it is. */
+static BitcoinResult MiniKey_try(struct MiniKeyRecovery *recovery,
+	const char *candidate)
+{
+	struct BitcoinPrivateKey private_key;
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	BitcoinResult result;
+
+	memset(&private_key, 0, sizeof(private_key));
+	Bitcoin_SHA256(&sha256, candidate, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+	memcpy(private_key.data, sha256.data, BITCOIN_PRIVATE_KEY_SIZE);
+	private_key.public_key_compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+
+	/* every candidate but one is no secret, and that one is among
+	   thousands of others, so the faster variable time multiplication is
+	   used */
+	result = Bitcoin_MakePublicKeyFromPrivateKeyFast(&public_key,
+		&private_key);
+	Secure_wipe(&private_key, sizeof(private_key));
+	Secure_wipe(&sha256, sizeof(sha256));
+	if (result == BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT) {
+		/* hashed to 0 or the order of the group, so can't be the key */
+		return BITCOIN_SUCCESS;
+	} else if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	/* mini keys are always for uncompressed public keys */
+	Bitcoin_MakeSHA256FromPublicKey(&sha256, &public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+	if (Match_find(recovery->options->targets, &ripemd160, NULL)) {
+		pthread_mutex_lock(&recovery->mutex);
+		if (!recovery->found) {
+			recovery->found = 1;
+			memcpy(recovery->found_key, candidate,
+				BITCOIN_MINI_PRIVATE_KEY_SIZE);
+		}
+		recovery->done = 1;
+		pthread_mutex_unlock(&recovery->mutex);
+	}
+	return BITCOIN_SUCCESS;
+}
+
+/* Count a run of candidates as tried, saving the checkpoint if it's
+   due. */
+static void MiniKey_tried(struct MiniKeyRecovery *recovery,
+	const struct MiniKeyChunk *chunk, uint64_t checked,
+	unsigned thread_index)
+{
+	const struct BitcoinMiniKeyRecoveryOptions *options = recovery->options;
+
+	pthread_mutex_lock(&recovery->mutex);
+	recovery->checked += checked;
+	recovery->progress.count += chunk->count;
+	Progress_update(&recovery->progress, recovery->progress.count,
+		recovery->progress.count);
+	recovery->trying[thread_index] = UINT64_MAX;
+	if (options->checkpoint_filename && !recovery->done) {
+		uint64_t now = Timer_nanoseconds();
+
+		if (now - recovery->checkpoint_nanoseconds
+			>= (uint64_t)options->checkpoint_interval * 1000000000)
+		{
+			recovery->checkpoint_nanoseconds = now;
+			if (MiniKey_save(recovery) != BITCOIN_SUCCESS) {
+				recovery->result = BITCOIN_ERROR_FILE;
+				recovery->done = 1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&recovery->mutex);
+}
+
+static void MiniKey_recoverThread(void *arg, unsigned thread_index)
+{
+	struct MiniKeyRecovery *recovery = arg;
+	const unsigned lanes = MiniKey_lanes();
+	char candidates[MINIKEY_MAX_LANES * BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	char key[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	uint8_t valid[MINIKEY_MAX_LANES];
+	unsigned digits[BITCOIN_MINI_PRIVATE_KEY_SIZE];
+	struct MiniKeyChunk chunk;
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	while (result == BITCOIN_SUCCESS
+		&& MiniKey_takeChunk(recovery, &chunk, thread_index))
+	{
+		const struct MiniKeyStep *step = &chunk.step;
+		uint64_t n, index = chunk.first, checked = 0;
+		unsigned i, pending = 0;
+
+		/* the first candidate, with the last changed character fastest */
+		memcpy(key, recovery->key, sizeof(key));
+		for (i = step->count; i-- > 0;) {
+			const struct MiniKeyRange *range = &step->ranges[i];
+
+			digits[i] = (unsigned)(index % range->count);
+			index /= range->count;
+			key[range->position] = recovery->positions[range->position]
+				.candidates[range->first + digits[i]];
+		}
+
+		for (n = 0; n < chunk.count && result == BITCOIN_SUCCESS; n++) {
+			memcpy(candidates + pending * BITCOIN_MINI_PRIVATE_KEY_SIZE, key,
+				BITCOIN_MINI_PRIVATE_KEY_SIZE);
+			if (++pending == lanes || n + 1 == chunk.count) {
+				MiniKey_check(candidates, pending, valid);
+				for (i = 0; i < pending && result == BITCOIN_SUCCESS; i++) {
+					if (valid[i]) {
+						checked++;
+						result = MiniKey_try(recovery,
+							candidates + i * BITCOIN_MINI_PRIVATE_KEY_SIZE);
+					}
+				}
+				pending = 0;
+			}
+			for (i = step->count; i-- > 0;) {
+				const struct MiniKeyRange *range = &step->ranges[i];
+
+				if (++digits[i] == range->count) {
+					digits[i] = 0;
+				}
+				key[range->position] = recovery->positions[range->position]
+					.candidates[range->first + digits[i]];
+				if (digits[i]) {
+					break;
+				}
+			}
+		}
+		MiniKey_tried(recovery, &chunk, checked, thread_index);
+	}
+
+	if (result != BITCOIN_SUCCESS) {
+		pthread_mutex_lock(&recovery->mutex);
+		recovery->result = result;
+		recovery->done = 1;
+		pthread_mutex_unlock(&recovery->mutex);
+	}
+	Secure_wipe(key, sizeof(key));
+	Secure_wipe(candidates, sizeof(candidates));
+
+	/* messages from this thread come out before the summary */
+	applog_flush();
+}
+
+BitcoinResult MiniKey_recover(char *key, const char *text, size_t size,
+	const struct BitcoinMiniKeyRecoveryOptions *options)
+{
+	const unsigned threads = options->threads ? options->threads : 1;
+	struct MiniKeyRecovery *recovery = calloc(1, sizeof(*recovery));
+	BitcoinResult result;
+	unsigned i;
+
+	if (!recovery) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate recovery");
+		return BITCOIN_ERROR;
+	}
+	recovery->options = options;
+	recovery->result = BITCOIN_SUCCESS;
+	recovery->trying = malloc(threads * sizeof(*recovery->trying));
+	if (!recovery->trying) {
+		free(recovery);
+		applog(APPLOG_ERROR, __func__, "Failed to allocate recovery");
+		return BITCOIN_ERROR;
+	}
+	for (i = 0; i < threads; i++) {
+		recovery->trying[i] = UINT64_MAX;
+	}
+
+	result = MiniKey_parse(recovery, text, size);
+	if (result == BITCOIN_SUCCESS && !MiniKey_makeStep(recovery,
+		&recovery->step))
+	{
+		result = BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (result == BITCOIN_SUCCESS) {
+		uint64_t total = MiniKey_countCandidates(recovery);
+
+		if (total == UINT64_MAX) {
+			applog(APPLOG_ERROR, __func__,
+				"Too many candidates to search, with %u unknown characters"
+				" and up to %u more changed", recovery->unknown_count,
+				options->change_chars
+			);
+			result = BITCOIN_ERROR_INVALID_FORMAT;
+		} else {
+			applog(APPLOG_NOTICE, __func__,
+				"Search space is %llu candidates", (unsigned long long)total);
+			Progress_init(&recovery->progress, stderr, "candidates",
+				options->progress_interval);
+			recovery->progress.total = total;
+		}
+	}
+	if (result == BITCOIN_SUCCESS && options->checkpoint_filename) {
+		result = MiniKey_load(recovery);
+	}
+
+	if (result == BITCOIN_SUCCESS) {
+		recovery->checkpoint_nanoseconds = Timer_nanoseconds();
+		pthread_mutex_init(&recovery->mutex, NULL);
+		result = Parallel_run(threads, MiniKey_recoverThread, recovery);
+		pthread_mutex_destroy(&recovery->mutex);
+		if (recovery->changed) {
+			Combination_destroy(&recovery->combination);
+		}
+		if (result == BITCOIN_SUCCESS) {
+			result = recovery->result;
+		}
+		if (recovery->progress.interval) {
+			Progress_report(&recovery->progress);
+		}
+		/* a search which found nothing is saved as finished, but one
+		   which found the key is left to be run again */
+		if (result == BITCOIN_SUCCESS && options->checkpoint_filename
+			&& !recovery->found)
+		{
+			result = MiniKey_save(recovery);
+		}
+	}
+
+	if (result == BITCOIN_SUCCESS && recovery->found) {
+		memcpy(key, recovery->found_key, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+		applog(APPLOG_NOTICE, __func__,
+			"Mini private key has been recovered after %llu candidates, %llu"
+			" of which passed the check.",
+			(unsigned long long)recovery->progress.count,
+			(unsigned long long)recovery->checked
+		);
+		for (i = 0; i < BITCOIN_MINI_PRIVATE_KEY_SIZE; i++) {
+			if (i < size && text[i] != key[i]) {
+				applog(APPLOG_NOTICE, __func__, "character %u: %c -> %c",
+					i + 1, text[i], key[i]);
+			}
+		}
+	} else if (result == BITCOIN_SUCCESS) {
+		applog(APPLOG_ERROR, __func__,
+			"No mini private key found with an address in --match-file,"
+			" after %llu candidates, %llu of which passed the check.",
+			(unsigned long long)recovery->progress.count,
+			(unsigned long long)recovery->checked
+		);
+		if (!options->change_chars) {
+			applog(APPLOG_NOTICE, __func__,
+				"Characters which were read may be wrong too, which"
+				" --fix-mini-private-key-change-chars tries."
+			);
+		}
+		result = BITCOIN_ERROR_NOT_FOUND;
+	}
+
+	free(recovery->trying);
+	Secure_wipe(recovery, sizeof(*recovery));
+	free(recovery);
+	return result;
+}
@@ -0,0 +1,124 @@
+#ifndef BITCOIN_INCLUDE_MINIKEY_H
+#define BITCOIN_INCLUDE_MINIKEY_H
+
+/** @file minikey.h
+ *  @brief Casascius mini private keys: checking candidates, several at
+ *         once, and generating new keys.
+ *
+ *  A mini key is 'S' and 29 more Base58 characters, and is only valid if
+ *  the first byte of SHA256(key + "?") is zero, so one random candidate in
+ *  256 is a key.  The private key is SHA256(key).  Both key and "?" fit in
+ *  one SHA256 block, so checking a candidate costs one compression, and
+ *  with AVX2 eight candidates are checked side by side, one in each 32 bit
+ *  lane.
+ *
+ *  The same check makes a damaged key quick to recover: of the candidates
+ *  for its unreadable characters, only one in 256 needs its address made
+ *  and compared with the address printed alongside it.
+ *
+ *  https://en.bitcoin.it/wiki/Mini_private_key_format
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t, uint64_t */
+
+#include "keys.h" /* BITCOIN_MINI_PRIVATE_KEY_SIZE */
+#include "match.h" /* struct BitcoinMatchSet */
+#include "result.h" /* BitcoinResult */
+
+struct BitcoinConfusion;
+
+/* most candidates checked side by side */
+#define MINIKEY_MAX_LANES 8
+
+/* character written for one which can't be read */
+#define MINIKEY_UNKNOWN_CHAR '?'
+
+/** @brief Number of candidates MiniKey_check() checks side by side on this
+ *         processor, so callers can hand it that many at once.
+ */
+unsigned MiniKey_lanes(void);
+
+/** @brief Check 'count' candidates of BITCOIN_MINI_PRIVATE_KEY_SIZE
+ *         characters, one after another in 'keys', setting valid[i] to 1 if
+ *         the i'th is a mini key, and to 0 if not.  The characters aren't
+ *         checked, only the hash.
+ */
+void MiniKey_check(const char *keys, size_t count, uint8_t *valid);
+
+/** Called with each batch of keys generated, one after another in 'keys'.
+ *  Calls may be made by several threads at once, each with its own
+ *  'thread_index' below the number of threads. */
+typedef BitcoinResult (*BitcoinMiniKeyFound)(void *arg, unsigned thread_index,
+	const char *keys, size_t count
+);
+
+struct BitcoinMiniKeyOptions {
+	/* number of keys to generate */
+	uint64_t count;
+
+	unsigned threads;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+
+	BitcoinMiniKeyFound found;
+	void *found_arg;
+};
+
+/** @brief Generate random mini keys from OpenSSL's random generator, on
+ *         several threads, handing them to 'found' in batches.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if every key was generated.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ *          Or the first error returned by 'found', which stops the rest.
+ */
+BitcoinResult MiniKey_generate(const struct BitcoinMiniKeyOptions *options);
+
+struct BitcoinMiniKeyRecoveryOptions {
+	/* number of readable characters which may have been misread too */
+	unsigned change_chars;
+
+	/* likelihood of each misreading, or NULL for the built-in model */
+	const struct BitcoinConfusion *confusion;
+
+	/* addresses, one of which the key's must be */
+	const struct BitcoinMatchSet *targets;
+
+	unsigned threads;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+
+	/* file recording how far the search has got, to carry on from if it
+	   exists, or NULL for none, and seconds between saving it */
+	const char *checkpoint_filename;
+	unsigned checkpoint_interval;
+};
+
+/** @brief Search for the mini key meant by 'text' whose address is in the
+ *         targets, trying fewest changed characters first.
+ *
+ *  Characters written as MINIKEY_UNKNOWN_CHAR could be anything, and those
+ *  which aren't Base58 are tried most likely first by the confusion model,
+ *  as are the readable characters changed.
+ *
+ *  @param[out] key The BITCOIN_MINI_PRIVATE_KEY_SIZE characters found.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if found.
+ *          BITCOIN_ERROR_NOT_FOUND if no candidate's address is a target.
+ *          BITCOIN_ERROR_INVALID_FORMAT if 'text' is the wrong length or has
+ *          too many candidates to count.
+ *          BITCOIN_ERROR_FILE if the checkpoint can't be read or written.
+ *          BITCOIN_ERROR or BITCOIN_ERROR_LIBRARY_FAILURE if out of memory
+ *          or OpenSSL failed.
+ */
+BitcoinResult MiniKey_recover(char *key, const char *text, size_t size,
+	const struct BitcoinMiniKeyRecoveryOptions *options
+);
+
+#endif
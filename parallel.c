@@ -0,0 +1,376 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads, sysconf */
+
+#include "parallel.h"
+#include "applog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+struct ParallelThread {
+	pthread_t thread;
+	ParallelFunction fn;
+	void *arg;
+	unsigned thread_index;
+};
+
+static void *Parallel_threadMain(void *p)
+{
+	struct ParallelThread *t = (struct ParallelThread *)p;
+	t->fn(t->arg, t->thread_index);
+	return NULL;
+}
+
+BitcoinResult Parallel_run(unsigned thread_count, ParallelFunction fn,
+	void *arg
+)
+{
+	struct ParallelThread *threads = NULL;
+	BitcoinResult result = BITCOIN_SUCCESS;
+	unsigned i, started = 1;
+
+	if (thread_count <= 1) {
+		fn(arg, 0);
+		return BITCOIN_SUCCESS;
+	}
+
+	threads = calloc(thread_count, sizeof(*threads));
+	if (!threads) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %u threads",
+			thread_count);
+		return BITCOIN_ERROR;
+	}
+
+	for (i = 1; i < thread_count; i++) {
+		int error;
+		threads[i].fn = fn;
+		threads[i].arg = arg;
+		threads[i].thread_index = i;
+		error = pthread_create(&threads[i].thread, NULL,
+			Parallel_threadMain, &threads[i]);
+		if (error) {
+			applog(APPLOG_ERROR, __func__,
+				"pthread_create failed for thread %u (%s)",
+				i, strerror(error)
+			);
+			result = BITCOIN_ERROR;
+			break;
+		}
+		started++;
+	}
+
+	/* the calling thread does its share rather than sit idle */
+	fn(arg, 0);
+
+	for (i = 1; i < started; i++) {
+		pthread_join(threads[i].thread, NULL);
+	}
+
+	free(threads);
+	return result;
+}
+
+unsigned Parallel_processors(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > 0) {
+		return (unsigned)n;
+	}
+#endif
+	return 1;
+}
+
+struct ParallelTask {
+	ParallelFunction fn;
+	void *arg;
+	struct ParallelGroup *group;
+};
+
+/* circular queue of tasks, the owner pushes and pops at the tail, thieves
+   take from the head */
+struct ParallelDeque {
+	pthread_mutex_t mutex;
+	struct ParallelTask *tasks;
+	size_t head, size, capacity;
+};
+
+struct ParallelWorker {
+	struct ParallelPool *pool;
+	pthread_t thread;
+	unsigned index;
+	struct ParallelDeque deque;
+};
+
+struct ParallelPool {
+	unsigned thread_count;
+	struct ParallelWorker *workers;
+
+	/* protects everything below, and 'pending' of every group */
+	pthread_mutex_t mutex;
+
+	/* signalled when tasks are queued, a group finishes or on shutdown */
+	pthread_cond_t cond;
+
+	/* tasks queued but not yet taken by a thread */
+	unsigned long queued;
+
+	/* next worker to give a task submitted from outside the pool */
+	unsigned next_worker;
+
+	int shutdown;
+};
+
+static pthread_once_t parallel_worker_once = PTHREAD_ONCE_INIT;
+static pthread_key_t parallel_worker_key;
+
+static void Parallel_createWorkerKey(void)
+{
+	pthread_key_create(&parallel_worker_key, NULL);
+}
+
+static int ParallelDeque_push(struct ParallelDeque *deque,
+	const struct ParallelTask *task)
+{
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->size == deque->capacity) {
+		size_t capacity = deque->capacity ? deque->capacity * 2 : 64, i;
+		struct ParallelTask *tasks = malloc(capacity * sizeof(*tasks));
+		if (!tasks) {
+			pthread_mutex_unlock(&deque->mutex);
+			return 0;
+		}
+		for (i = 0; i < deque->size; i++) {
+			tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+		}
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->head = 0;
+		deque->capacity = capacity;
+	}
+	deque->tasks[(deque->head + deque->size++) % deque->capacity] = *task;
+	pthread_mutex_unlock(&deque->mutex);
+	return 1;
+}
+
+/* take the newest task if 'newest', otherwise the oldest */
+static int ParallelDeque_take(struct ParallelDeque *deque,
+	struct ParallelTask *task, int newest)
+{
+	int taken = 0;
+
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->size > 0) {
+		if (newest) {
+			*task = deque->tasks[(deque->head + deque->size - 1) % deque->capacity];
+		} else {
+			*task = deque->tasks[deque->head];
+			deque->head = (deque->head + 1) % deque->capacity;
+		}
+		deque->size--;
+		taken = 1;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	return taken;
+}
+
+/* find a task for 'worker' (NULL for threads outside the pool), from its
+   own queue first, then from the others */
+static int ParallelPool_take(struct ParallelPool *pool,
+	struct ParallelWorker *worker, struct ParallelTask *task)
+{
+	const unsigned start = worker ? worker->index : 0;
+	unsigned i;
+	int taken = worker && ParallelDeque_take(&worker->deque, task, 1);
+
+	for (i = 0; !taken && i < pool->thread_count; i++) {
+		struct ParallelWorker *victim =
+			&pool->workers[(start + i) % pool->thread_count];
+		if (victim != worker) {
+			taken = ParallelDeque_take(&victim->deque, task, 0);
+		}
+	}
+
+	if (taken) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->queued--;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return taken;
+}
+
+static void ParallelPool_run(struct ParallelPool *pool,
+	const struct ParallelTask *task, unsigned thread_index)
+{
+	task->fn(task->arg, thread_index);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (--task->group->pending == 0) {
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *ParallelPool_workerMain(void *p)
+{
+	struct ParallelWorker *worker = (struct ParallelWorker *)p;
+	struct ParallelPool *pool = worker->pool;
+	struct ParallelTask task;
+
+	pthread_setspecific(parallel_worker_key, worker);
+
+	for (;;) {
+		if (ParallelPool_take(pool, worker, &task)) {
+			ParallelPool_run(pool, &task, worker->index);
+			continue;
+		}
+		pthread_mutex_lock(&pool->mutex);
+		while (!pool->shutdown && pool->queued == 0) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->shutdown && pool->queued == 0) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return NULL;
+}
+
+struct ParallelPool *ParallelPool_create(unsigned thread_count)
+{
+	struct ParallelPool *pool = calloc(1, sizeof(*pool));
+	unsigned i;
+
+	if (!pool) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate thread pool");
+		return NULL;
+	}
+	pthread_once(&parallel_worker_once, Parallel_createWorkerKey);
+
+	pool->workers = calloc(thread_count ? thread_count : 1, sizeof(*pool->workers));
+	if (!pool->workers) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %u threads",
+			thread_count);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	for (i = 0; i < thread_count; i++) {
+		struct ParallelWorker *worker = &pool->workers[i];
+		int error;
+
+		worker->pool = pool;
+		worker->index = i;
+		pthread_mutex_init(&worker->deque.mutex, NULL);
+		error = pthread_create(&worker->thread, NULL,
+			ParallelPool_workerMain, worker);
+		if (error) {
+			applog(APPLOG_ERROR, __func__,
+				"pthread_create failed for thread %u (%s)",
+				i, strerror(error)
+			);
+			pthread_mutex_destroy(&worker->deque.mutex);
+			break;
+		}
+		pool->thread_count++;
+	}
+
+	if (pool->thread_count == 0) {
+		ParallelPool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void ParallelPool_destroy(struct ParallelPool *pool)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->thread_count; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+		pthread_mutex_destroy(&pool->workers[i].deque.mutex);
+		free(pool->workers[i].deque.tasks);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->workers);
+	free(pool);
+}
+
+BitcoinResult ParallelPool_submit(struct ParallelPool *pool,
+	struct ParallelGroup *group, ParallelFunction fn, void *arg)
+{
+	struct ParallelWorker *worker = pthread_getspecific(parallel_worker_key);
+	struct ParallelTask task;
+
+	task.fn = fn;
+	task.arg = arg;
+	task.group = group;
+
+	/* count the task first, so it can't finish before it's counted */
+	pthread_mutex_lock(&pool->mutex);
+	group->pending++;
+	pool->queued++;
+	if (!worker || worker->pool != pool) {
+		worker = &pool->workers[pool->next_worker++ % pool->thread_count];
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!ParallelDeque_push(&worker->deque, &task)) {
+		/* no memory to queue it, so run it now */
+		pthread_mutex_lock(&pool->mutex);
+		pool->queued--;
+		pthread_mutex_unlock(&pool->mutex);
+		ParallelPool_run(pool, &task, pool->thread_count);
+		return BITCOIN_SUCCESS;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	return BITCOIN_SUCCESS;
+}
+
+void ParallelPool_wait(struct ParallelPool *pool, struct ParallelGroup *group)
+{
+	struct ParallelWorker *worker = pthread_getspecific(parallel_worker_key);
+	struct ParallelTask task;
+
+	if (worker && worker->pool != pool) {
+		worker = NULL;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&pool->mutex);
+		if (group->pending == 0) {
+			pthread_mutex_unlock(&pool->mutex);
+			return;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (ParallelPool_take(pool, worker, &task)) {
+			ParallelPool_run(pool, &task,
+				worker ? worker->index : pool->thread_count
+			);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->mutex);
+		while (group->pending != 0 && pool->queued == 0) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef BITCOIN_INCLUDE_PARALLEL_H
+#define BITCOIN_INCLUDE_PARALLEL_H
+
+/** @file parallel.h
+ *  @brief Running work on more than one thread.
+ *
+ *  @author Matthew Anger
+ */
+
+#include "result.h" /* BitcoinResult */
+
+/** Function run by each thread.  'thread_index' is 0 to thread_count-1. */
+typedef void (*ParallelFunction)(void *arg, unsigned thread_index);
+
+/** @brief Run a function on a number of threads at once, and wait for them
+ *         all to finish.  Thread 0 runs on the calling thread.
+ *
+ *  @param[in] thread_count Number of threads to run 'fn' on.
+ *  @param[in] fn Function to run.
+ *  @param[in] arg Argument passed to every call of 'fn'.
+ *
+ *  @return BITCOIN_SUCCESS if every thread was started.
+ */
+BitcoinResult Parallel_run(unsigned thread_count, ParallelFunction fn,
+	void *arg
+);
+
+/** @brief Return the number of processors available, or 1 if unknown. */
+unsigned Parallel_processors(void);
+
+/** A set of tasks which can be waited for together.  Initialise 'pending'
+ *  to 0 before submitting the first task. */
+struct ParallelGroup {
+	unsigned pending;
+};
+
+/** Work-stealing pool of threads.  Each worker runs tasks from its own
+ *  queue newest first, and when that is empty steals the oldest task from
+ *  another worker, so tasks which split themselves into sub-tasks keep idle
+ *  workers busy. */
+struct ParallelPool;
+
+/** @brief Start a pool of 'thread_count' workers.
+ *
+ *  @return The pool, or NULL if it couldn't be started.
+ */
+struct ParallelPool *ParallelPool_create(unsigned thread_count);
+
+/** @brief Wait for every task to finish, and stop the workers. */
+void ParallelPool_destroy(struct ParallelPool *pool);
+
+/** @brief Queue a task as part of 'group'.  Tasks submitted by a worker go
+ *         on its own queue, others are shared out between the workers.
+ *         'fn' is passed the index of the thread running it, from 0 to
+ *         thread_count-1 for workers, or thread_count for any other thread
+ *         helping in ParallelPool_wait().
+ */
+BitcoinResult ParallelPool_submit(struct ParallelPool *pool,
+	struct ParallelGroup *group, ParallelFunction fn, void *arg
+);
+
+/** @brief Run queued tasks on the calling thread until every task in
+ *         'group' has finished.
+ */
+void ParallelPool_wait(struct ParallelPool *pool, struct ParallelGroup *group);
+
+#endif
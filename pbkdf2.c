@@ -0,0 +1,301 @@
+#include "pbkdf2.h"
+#include "secure.h"
+
+#include <string.h>
+
+#include <openssl/sha.h>
+
+/* Four lanes of SHA512 need AVX2, checked for at run time. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ >= 5)
+#define BITCOIN_PBKDF2_AVX2
+#include <immintrin.h>
+#endif
+
+/* The block hashed by each inner or outer HMAC of an iteration is the 64
+   byte message, then padding, then the length in bits including the padded
+   key's block before it. */
+#define PBKDF2_BLOCK_SIZE SHA512_CBLOCK
+#define PBKDF2_MESSAGE_WORDS (BITCOIN_SHA512_SIZE / 8)
+#define PBKDF2_BIT_LENGTH ((PBKDF2_BLOCK_SIZE + BITCOIN_SHA512_SIZE) * 8)
+
+/* HMAC states after the padded key, and the running result, of one job */
+struct PBKDF2Lane {
+	SHA512_CTX inner, outer;
+	uint64_t u[PBKDF2_MESSAGE_WORDS], t[PBKDF2_MESSAGE_WORDS];
+};
+
+static void PBKDF2_store64(uint8_t *bytes, uint64_t value)
+{
+	unsigned i;
+
+	for (i = 0; i < 8; i++) {
+		bytes[i] = (uint8_t)(value >> (56 - 8 * i));
+	}
+}
+
+static uint64_t PBKDF2_load64(const uint8_t *bytes)
+{
+	uint64_t value = 0;
+	unsigned i;
+
+	for (i = 0; i < 8; i++) {
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+/* Set up the HMAC key of a job, and its first iteration, the HMAC of the
+   salt and the block number 1. */
+static void PBKDF2_start(struct PBKDF2Lane *lane,
+	const struct BitcoinPBKDF2Job *job)
+{
+	static const uint8_t block_number[4] = { 0, 0, 0, 1 };
+	struct BitcoinHMACSHA512Key key;
+	struct BitcoinSHA512 hash;
+	SHA512_CTX ctx;
+	unsigned i;
+
+	Bitcoin_HMACSHA512Init(&key, job->password, job->password_size);
+	lane->inner = key.inner;
+	lane->outer = key.outer;
+
+	ctx = key.inner;
+	SHA512_Update(&ctx, job->salt, job->salt_size);
+	SHA512_Update(&ctx, block_number, sizeof(block_number));
+	SHA512_Final(hash.data, &ctx);
+	ctx = key.outer;
+	SHA512_Update(&ctx, hash.data, BITCOIN_SHA512_SIZE);
+	SHA512_Final(hash.data, &ctx);
+
+	for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+		lane->u[i] = lane->t[i] = PBKDF2_load64(hash.data + 8 * i);
+	}
+	Secure_wipe(&key, sizeof(key));
+	Secure_wipe(&hash, sizeof(hash));
+	Secure_wipe(&ctx, sizeof(ctx));
+}
+
+static void PBKDF2_finish(struct BitcoinPBKDF2Job *job,
+	struct PBKDF2Lane *lane)
+{
+	unsigned i;
+
+	for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+		PBKDF2_store64(job->output + 8 * i, lane->t[i]);
+	}
+	Secure_wipe(lane, sizeof(*lane));
+}
+
+/* The rest of the iterations of one job, each block hashed from the HMAC
+   states by SHA512_Transform(), skipping the buffering of SHA512_Update()
+   and SHA512_Final(). */
+static void PBKDF2_iterate1(struct PBKDF2Lane *lane, unsigned iterations)
+{
+	uint8_t block[PBKDF2_BLOCK_SIZE];
+	SHA512_CTX ctx;
+	unsigned n, i;
+
+	memset(block, 0, sizeof(block));
+	block[BITCOIN_SHA512_SIZE] = 0x80;
+	PBKDF2_store64(block + PBKDF2_BLOCK_SIZE - 8, PBKDF2_BIT_LENGTH);
+
+	for (n = 1; n < iterations; n++) {
+		for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+			PBKDF2_store64(block + 8 * i, lane->u[i]);
+		}
+		ctx = lane->inner;
+		SHA512_Transform(&ctx, block);
+		for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+			PBKDF2_store64(block + 8 * i, ctx.h[i]);
+		}
+		ctx = lane->outer;
+		SHA512_Transform(&ctx, block);
+		for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+			lane->u[i] = ctx.h[i];
+			lane->t[i] ^= ctx.h[i];
+		}
+	}
+	Secure_wipe(block, sizeof(block));
+	Secure_wipe(&ctx, sizeof(ctx));
+}
+
+#if defined(BITCOIN_PBKDF2_AVX2)
+
+static const uint64_t pbkdf2_sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+#define PBKDF2_ROTR4(x, n) \
+	_mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define PBKDF2_XOR3(a, b, c) \
+	_mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+/* One SHA512 block of an iteration for four lanes, 'state' being where
+   each lane's HMAC key left off, and 'message' the 64 bytes being hashed,
+   as words. */
+__attribute__((target("avx2")))
+static void PBKDF2_compress4(__m256i *out, const __m256i *state,
+	const __m256i *message)
+{
+	__m256i w[80];
+	__m256i a, b, c, d, e, f, g, h;
+	unsigned t;
+
+	for (t = 0; t < PBKDF2_MESSAGE_WORDS; t++) {
+		w[t] = message[t];
+	}
+	w[8] = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+	for (t = 9; t < 15; t++) {
+		w[t] = _mm256_setzero_si256();
+	}
+	w[15] = _mm256_set1_epi64x(PBKDF2_BIT_LENGTH);
+	for (t = 16; t < 80; t++) {
+		const __m256i s0 = PBKDF2_XOR3(PBKDF2_ROTR4(w[t - 15], 1),
+			PBKDF2_ROTR4(w[t - 15], 8), _mm256_srli_epi64(w[t - 15], 7));
+		const __m256i s1 = PBKDF2_XOR3(PBKDF2_ROTR4(w[t - 2], 19),
+			PBKDF2_ROTR4(w[t - 2], 61), _mm256_srli_epi64(w[t - 2], 6));
+
+		w[t] = _mm256_add_epi64(_mm256_add_epi64(s0, s1),
+			_mm256_add_epi64(w[t - 16], w[t - 7]));
+	}
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (t = 0; t < 80; t++) {
+		const __m256i s1 = PBKDF2_XOR3(PBKDF2_ROTR4(e, 14),
+			PBKDF2_ROTR4(e, 18), PBKDF2_ROTR4(e, 41));
+		const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+			_mm256_andnot_si256(e, g));
+		const __m256i t1 = _mm256_add_epi64(
+			_mm256_add_epi64(_mm256_add_epi64(h, s1), ch),
+			_mm256_add_epi64(
+				_mm256_set1_epi64x((long long)pbkdf2_sha512_k[t]), w[t]));
+		const __m256i s0 = PBKDF2_XOR3(PBKDF2_ROTR4(a, 28),
+			PBKDF2_ROTR4(a, 34), PBKDF2_ROTR4(a, 39));
+		const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b),
+			_mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+		h = g; g = f; f = e;
+		e = _mm256_add_epi64(d, t1);
+		d = c; c = b; b = a;
+		a = _mm256_add_epi64(t1, _mm256_add_epi64(s0, maj));
+	}
+
+	out[0] = _mm256_add_epi64(state[0], a);
+	out[1] = _mm256_add_epi64(state[1], b);
+	out[2] = _mm256_add_epi64(state[2], c);
+	out[3] = _mm256_add_epi64(state[3], d);
+	out[4] = _mm256_add_epi64(state[4], e);
+	out[5] = _mm256_add_epi64(state[5], f);
+	out[6] = _mm256_add_epi64(state[6], g);
+	out[7] = _mm256_add_epi64(state[7], h);
+}
+
+/* The rest of the iterations of four jobs side by side. */
+__attribute__((target("avx2")))
+static void PBKDF2_iterate4(struct PBKDF2Lane *lanes, unsigned iterations)
+{
+	__m256i inner[PBKDF2_MESSAGE_WORDS], outer[PBKDF2_MESSAGE_WORDS];
+	__m256i u[PBKDF2_MESSAGE_WORDS], t[PBKDF2_MESSAGE_WORDS];
+	__m256i hashed[PBKDF2_MESSAGE_WORDS];
+	uint64_t words[4];
+	unsigned n, i;
+
+	for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+		inner[i] = _mm256_set_epi64x(
+			(long long)lanes[3].inner.h[i], (long long)lanes[2].inner.h[i],
+			(long long)lanes[1].inner.h[i], (long long)lanes[0].inner.h[i]);
+		outer[i] = _mm256_set_epi64x(
+			(long long)lanes[3].outer.h[i], (long long)lanes[2].outer.h[i],
+			(long long)lanes[1].outer.h[i], (long long)lanes[0].outer.h[i]);
+		u[i] = t[i] = _mm256_set_epi64x(
+			(long long)lanes[3].u[i], (long long)lanes[2].u[i],
+			(long long)lanes[1].u[i], (long long)lanes[0].u[i]);
+	}
+
+	for (n = 1; n < iterations; n++) {
+		PBKDF2_compress4(hashed, inner, u);
+		PBKDF2_compress4(u, outer, hashed);
+		for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+			t[i] = _mm256_xor_si256(t[i], u[i]);
+		}
+	}
+
+	for (i = 0; i < PBKDF2_MESSAGE_WORDS; i++) {
+		_mm256_storeu_si256((__m256i *)words, t[i]);
+		lanes[0].t[i] = words[0];
+		lanes[1].t[i] = words[1];
+		lanes[2].t[i] = words[2];
+		lanes[3].t[i] = words[3];
+	}
+	Secure_wipe(words, sizeof(words));
+}
+
+#endif
+
+unsigned PBKDF2_lanes(void)
+{
+#if defined(BITCOIN_PBKDF2_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		return 4;
+	}
+#endif
+	return 1;
+}
+
+void PBKDF2_HMACSHA512(struct BitcoinPBKDF2Job *jobs, size_t count,
+	unsigned iterations)
+{
+	struct PBKDF2Lane lanes[PBKDF2_MAX_LANES];
+	size_t i = 0;
+	unsigned j;
+
+#if defined(BITCOIN_PBKDF2_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		/* a short last group fills its spare lanes with copies, whose
+		   results are thrown away */
+		for (; i + 1 < count; i += 4) {
+			for (j = 0; j < 4; j++) {
+				PBKDF2_start(&lanes[j], &jobs[i + j < count ? i + j : i]);
+			}
+			PBKDF2_iterate4(lanes, iterations);
+			for (j = 0; j < 4 && i + j < count; j++) {
+				PBKDF2_finish(&jobs[i + j], &lanes[j]);
+			}
+		}
+		Secure_wipe(lanes, sizeof(lanes));
+	}
+#endif
+	for (; i < count; i++) {
+		PBKDF2_start(&lanes[0], &jobs[i]);
+		PBKDF2_iterate1(&lanes[0], iterations);
+		PBKDF2_finish(&jobs[i], &lanes[0]);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef BITCOIN_INCLUDE_PBKDF2_H
+#define BITCOIN_INCLUDE_PBKDF2_H
+
+/** @file pbkdf2.h
+ *  @brief PBKDF2-HMAC-SHA512, for several passwords at once.
+ *
+ *  Each iteration is an HMAC of the last 64 byte result, which with the
+ *  padded key hashed once up front is one SHA512 block for the inner hash
+ *  and one for the outer.  Those blocks depend on the iteration before, so
+ *  a password can't be spread over SIMD lanes, but different passwords can:
+ *  with AVX2 four passwords are run side by side, one in each 64 bit lane.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "hash.h" /* BITCOIN_SHA512_SIZE */
+
+/* most passwords run side by side */
+#define PBKDF2_MAX_LANES 4
+
+struct BitcoinPBKDF2Job {
+	const void *password;
+	size_t password_size;
+	const void *salt;
+	size_t salt_size;
+
+	/* the first block of the derived key */
+	uint8_t output[BITCOIN_SHA512_SIZE];
+};
+
+/** @brief Number of jobs PBKDF2_HMACSHA512() runs side by side on this
+ *         processor, so callers can hand it that many at once.
+ */
+unsigned PBKDF2_lanes(void);
+
+/** @brief Derive the first 64 bytes of PBKDF2-HMAC-SHA512 for each job,
+ *         which is all of the key for BIP39 seeds.
+ *
+ *  @param[in,out] jobs Passwords and salts to read, and outputs to write.
+ *  @param[in] count Number of jobs.
+ *  @param[in] iterations Number of iterations, at least 1.
+ */
+void PBKDF2_HMACSHA512(struct BitcoinPBKDF2Job *jobs, size_t count,
+	unsigned iterations
+);
+
+#endif
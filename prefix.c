@@ -10,14 +10,18 @@ static const struct BitcoinNetworkType network_types[] = {
 		.hrp                     = "bc", /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L138 */
 		.public_key_prefix       = 0,    /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L132 */
 		.script_prefix           = 5,    /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L133 */
-		.private_key_prefix      = 128   /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L134 */
+		.private_key_prefix      = 128,  /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L134 */
+		.extended_public_key_prefix  = 0x0488B21E, /* https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki#serialization-format */
+		.extended_private_key_prefix = 0x0488ADE4  /* https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki#serialization-format */
 	},
 	{
 		.name                    = "bitcoin-testnet",
 		.hrp                     = "tb", /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L244 */
 		.public_key_prefix       = 111,  /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L238 */
 		.script_prefix           = 196,  /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L239 */
-		.private_key_prefix      = 239   /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L240 */
+		.private_key_prefix      = 239,  /* https://github.com/bitcoin/bitcoin/blob/v0.18.1/src/chainparams.cpp#L240 */
+		.extended_public_key_prefix  = 0x043587CF, /* https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki#serialization-format */
+		.extended_private_key_prefix = 0x04358394  /* https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki#serialization-format */
 	},
 	/* Litecoin */
 	{
@@ -25,14 +29,18 @@ static const struct BitcoinNetworkType network_types[] = {
 		.hrp                     = "ltc", /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L145 */
 		.public_key_prefix       = 48,    /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L138 */
 		.script_prefix           = 5,     /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L139 */
-		.private_key_prefix      = 48+128 /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L141 */
+		.private_key_prefix      = 48+128, /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L141 */
+		.extended_public_key_prefix  = 0x0488B21E, /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp */
+		.extended_private_key_prefix = 0x0488ADE4  /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp */
 	},
 	{
 		.name                    = "litecoin-testnet",
 		.hrp                     = "tltc", /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L252 */
 		.public_key_prefix       = 111,    /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L345 */
 		.script_prefix           = 196,    /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L346 */
-		.private_key_prefix      = 111+128 /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L348 */
+		.private_key_prefix      = 111+128, /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp#L348 */
+		.extended_public_key_prefix  = 0x043587CF, /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp */
+		.extended_private_key_prefix = 0x04358394  /* https://github.com/litecoin-project/litecoin/blob/v0.17.1/src/chainparams.cpp */
 	},
 	/* Feathercoin */
 	{
@@ -55,14 +63,18 @@ static const struct BitcoinNetworkType network_types[] = {
 		.hrp                     = "dc",   /* TODO: Add reference. */
 		.public_key_prefix       = 30,     /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L167 */
 		.script_prefix           = 22,     /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L168 */
-		.private_key_prefix      = 30+128  /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L169 */
+		.private_key_prefix      = 30+128, /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L169 */
+		.extended_public_key_prefix  = 0x02FACAFD, /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp */
+		.extended_private_key_prefix = 0x02FAC398  /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp */
 	},
 	{
 		.name                    = "dogecoin-testnet",
 		.hrp                     = "tdc",  /* TODO: Add reference. */
 		.public_key_prefix       = 113,    /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L320 */
 		.script_prefix           = 196,    /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L321 */
-		.private_key_prefix      = 113+128 /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L322 */
+		.private_key_prefix      = 113+128, /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp#L322 */
+		.extended_public_key_prefix  = 0x043587CF, /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp */
+		.extended_private_key_prefix = 0x04358394  /* https://github.com/dogecoin/dogecoin/blob/v1.14.1/src/chainparams.cpp */
 	},
 	/* Quarkcoin */
 	{
@@ -201,6 +213,49 @@ const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByPrivateKeyPrefix(const
 	return NULL;
 }
 
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByPublicKeyPrefix(const BitcoinKeyPrefix prefix)
+{
+	const struct BitcoinNetworkType *pn = network_types;
+
+	while (pn != network_types + (sizeof(network_types)/sizeof(network_types[0]))) {
+		if (prefix == pn->public_key_prefix) {
+			return pn;
+		}
+		pn++;
+	}
+
+	return NULL;
+}
+
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByExtendedKeyPrefix(const BitcoinExtendedKeyPrefix prefix)
+{
+	const struct BitcoinNetworkType *pn = network_types;
+
+	/* networks with no extended keys have 0 for both */
+	if (prefix == 0) {
+		return NULL;
+	}
+	while (pn != network_types + (sizeof(network_types)/sizeof(network_types[0]))) {
+		if (prefix == pn->extended_public_key_prefix
+			|| prefix == pn->extended_private_key_prefix)
+		{
+			return pn;
+		}
+		pn++;
+	}
+
+	return NULL;
+}
+
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByIndex(size_t index)
+{
+	if (index >= sizeof(network_types)/sizeof(network_types[0])) {
+		return NULL;
+	}
+
+	return &network_types[index];
+}
+
 void Bitcoin_ListNetworks(FILE *output)
 {
 	const struct BitcoinNetworkType *pn = network_types;
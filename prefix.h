@@ -6,6 +6,9 @@
 /* prefix byte for addresses, public keys and private keys, to identify network */
 typedef unsigned BitcoinKeyPrefix;
 
+/* 4 byte version of BIP32 extended keys, 0 if the network has none */
+typedef unsigned long BitcoinExtendedKeyPrefix;
+
 struct BitcoinNetworkType
 {
 	const char *name;
@@ -13,12 +16,25 @@ struct BitcoinNetworkType
 	BitcoinKeyPrefix public_key_prefix,
 		script_prefix,
 		private_key_prefix;
+	BitcoinExtendedKeyPrefix extended_public_key_prefix,
+		extended_private_key_prefix;
 };
 
 const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByName(const char *name);
 const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByHrp(const char *hrp);
 const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByPrivateKeyPrefix(const BitcoinKeyPrefix prefix);
 
+/* the first network whose addresses have the prefix, since some networks
+   share them */
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByPublicKeyPrefix(const BitcoinKeyPrefix prefix);
+
+/* the first network using the prefix for either public or private extended
+   keys, since some networks share them */
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByExtendedKeyPrefix(const BitcoinExtendedKeyPrefix prefix);
+
+/* each known network in turn, NULL after the last one */
+const struct BitcoinNetworkType *Bitcoin_GetNetworkTypeByIndex(size_t index);
+
 BitcoinKeyPrefix BitcoinNetworkType_GetPublicKeyPrefix(const struct BitcoinNetworkType *n);
 BitcoinKeyPrefix BitcoinNetworkType_GetPrivateKeyPrefix(const struct BitcoinNetworkType *n);
 
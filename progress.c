@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 200112L /* snprintf */
+
+#include "progress.h"
+#include "timer.h"
+#include "applog.h"
+
+static void Progress_formatDuration(char *output, size_t output_size,
+	double seconds)
+{
+	unsigned long total;
+
+	/* a search can be hopelessly long, don't overflow the conversion */
+	if (seconds >= 3.6e12) {
+		snprintf(output, output_size, ">1000000000h");
+		return;
+	}
+	total = (unsigned long)seconds;
+	if (total >= 3600) {
+		snprintf(output, output_size, "%luh%02lum%02lus",
+			total / 3600, (total / 60) % 60, total % 60);
+	} else if (total >= 60) {
+		snprintf(output, output_size, "%lum%02lus", total / 60, total % 60);
+	} else {
+		snprintf(output, output_size, "%lus", total);
+	}
+}
+
+void Progress_init(struct BitcoinProgress *progress, FILE *output,
+	const char *unit, unsigned interval)
+{
+	progress->output = output;
+	progress->unit = unit;
+	progress->interval = interval;
+	progress->count = 0;
+	progress->position = 0;
+	progress->total = 0;
+	progress->start_nanoseconds = Timer_nanoseconds();
+	progress->last_report_nanoseconds = progress->start_nanoseconds;
+	progress->last_report_count = 0;
+}
+
+static void Progress_write(struct BitcoinProgress *progress, uint64_t now)
+{
+	double elapsed = (now - progress->start_nanoseconds) / 1e9;
+	double since_last = (now - progress->last_report_nanoseconds) / 1e9;
+	/* rate since the last report follows changes in speed, the average
+	   rate since the start gives a steadier estimate of time remaining */
+	double rate = since_last > 0 ?
+		(progress->count - progress->last_report_count) / since_last : 0.0;
+	char elapsed_string[32], eta_string[32];
+
+	/* keep log messages in order with the report */
+	applog_flush();
+
+	Progress_formatDuration(elapsed_string, sizeof(elapsed_string), elapsed);
+
+	if (progress->total) {
+		double fraction = (double)progress->position / progress->total;
+		if (fraction > 0) {
+			Progress_formatDuration(eta_string, sizeof(eta_string),
+				elapsed / fraction - elapsed);
+		} else {
+			snprintf(eta_string, sizeof(eta_string), "unknown");
+		}
+		fprintf(progress->output,
+			"progress: %llu %s, %.0f %s/sec, %.2f%% done, elapsed %s,"
+			" ETA %s\n",
+			(unsigned long long)progress->count, progress->unit,
+			rate, progress->unit,
+			fraction * 100,
+			elapsed_string, eta_string
+		);
+	} else {
+		fprintf(progress->output,
+			"progress: %llu %s, %.0f %s/sec, elapsed %s\n",
+			(unsigned long long)progress->count, progress->unit,
+			rate, progress->unit,
+			elapsed_string
+		);
+	}
+	fflush(progress->output);
+
+	progress->last_report_nanoseconds = now;
+	progress->last_report_count = progress->count;
+}
+
+void Progress_update(struct BitcoinProgress *progress,
+	uint64_t count, uint64_t position)
+{
+	uint64_t now;
+
+	progress->count = count;
+	progress->position = position;
+	if (!progress->interval) {
+		return;
+	}
+	now = Timer_nanoseconds();
+	if (now - progress->last_report_nanoseconds
+		>= (uint64_t)progress->interval * 1000000000)
+	{
+		Progress_write(progress, now);
+	}
+}
+
+void Progress_report(struct BitcoinProgress *progress)
+{
+	Progress_write(progress, Timer_nanoseconds());
+}
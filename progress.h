@@ -0,0 +1,62 @@
+#ifndef BITCOIN_INCLUDE_PROGRESS_H
+#define BITCOIN_INCLUDE_PROGRESS_H
+
+/** @file progress.h
+ *  @brief Periodic progress reports for long running jobs, with the rate,
+ *         percentage complete and estimated time remaining.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stdio.h> /* FILE */
+#include <stdint.h> /* uint64_t */
+
+struct BitcoinProgress {
+	FILE *output;
+
+	/* what is being counted, for example "records" or "candidates" */
+	const char *unit;
+
+	/* seconds between reports, 0 to never report */
+	unsigned interval;
+
+	/* items processed so far */
+	uint64_t count;
+
+	/* how far through the job we are, out of 'total', in whatever unit
+	   measures the job best (items, or bytes of input).  'total' is 0 if
+	   the size of the job is unknown. */
+	uint64_t position, total;
+
+	uint64_t start_nanoseconds,
+		last_report_nanoseconds,
+		last_report_count;
+};
+
+/** @brief Start the clock for a job.
+ *
+ *  @param[out] progress Progress to initialise.
+ *  @param[in] output File to write reports to.
+ *  @param[in] unit Name of the items being counted.
+ *  @param[in] interval Seconds between reports, 0 to never report.
+ */
+void Progress_init(struct BitcoinProgress *progress, FILE *output,
+	const char *unit, unsigned interval
+);
+
+/** @brief Record progress, writing a report if 'interval' seconds have passed
+ *         since the last one.  This reads the clock on each call, so callers
+ *         with very cheap items should call it every few thousand items
+ *         rather than for each one.
+ *
+ *  @param[in] count Total items processed so far.
+ *  @param[in] position Total progress through the job so far.
+ */
+void Progress_update(struct BitcoinProgress *progress,
+	uint64_t count, uint64_t position
+);
+
+/** @brief Write a report now, regardless of the interval. */
+void Progress_report(struct BitcoinProgress *progress);
+
+#endif
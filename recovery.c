@@ -0,0 +1,682 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "recovery.h"
+#include "applog.h"
+#include "combination.h"
+#include "hash.h"
+#include "keys.h"
+#include "parallel.h"
+#include "pbkdf2.h"
+#include "progress.h"
+#include "secure.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* candidates each thread takes at a time */
+#define RECOVERY_CHUNK_SIZE 4096
+
+/* longest mistyped word compared with the wordlist */
+#define RECOVERY_MAX_TYPED_SIZE 32
+
+/* Words tried at each changed position, and how many */
+struct RecoveryPosition {
+	uint16_t *candidates;
+	unsigned count;
+};
+
+/* The positions changing in one step of the search, each combination of
+   words on the list being changed making one step, and the number of
+   candidates it has */
+struct RecoveryStep {
+	unsigned positions[BIP39_MAX_WORDS];
+	unsigned count;
+	uint64_t size;
+};
+
+struct Recovery {
+	const struct BitcoinRecoveryOptions *options;
+
+	/* the words as given, -1 for those not on the list */
+	int words[BIP39_MAX_WORDS];
+	unsigned word_count;
+
+	/* the words which could be anything else */
+	struct RecoveryPosition positions[BIP39_MAX_WORDS];
+
+	/* words which are wrong, and those which might be */
+	unsigned unknown[BIP39_MAX_WORDS], unknown_count;
+	unsigned known[BIP39_MAX_WORDS], known_count;
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* which known words are changed in this step, how many, and the next
+	   candidate of the step to hand out */
+	struct Combination combination;
+	unsigned changed;
+	struct RecoveryStep step;
+	uint64_t next;
+
+	/* set once every candidate is taken, one is found, or on error */
+	int done, found;
+	BitcoinResult result;
+	struct BitcoinBIP39Mnemonic mnemonic;
+	uint64_t checked;
+
+	struct BitcoinProgress progress;
+};
+
+/* A run of candidates from one step */
+struct RecoveryChunk {
+	struct RecoveryStep step;
+	uint64_t first, count;
+};
+
+/* A word of the wordlist and how far it is from what was typed */
+struct RecoveryDistance {
+	unsigned distance;
+	unsigned index;
+};
+
+static unsigned Recovery_editDistance(const char *a, size_t a_size,
+	const char *b, size_t b_size)
+{
+	unsigned row[RECOVERY_MAX_TYPED_SIZE + 1];
+	size_t i, j;
+
+	for (j = 0; j <= b_size; j++) {
+		row[j] = (unsigned)j;
+	}
+	for (i = 1; i <= a_size; i++) {
+		unsigned diagonal = row[0];
+
+		row[0] = (unsigned)i;
+		for (j = 1; j <= b_size; j++) {
+			const unsigned above = row[j];
+			unsigned best = diagonal + (a[i - 1] != b[j - 1]);
+
+			if (above + 1 < best) {
+				best = above + 1;
+			}
+			if (row[j - 1] + 1 < best) {
+				best = row[j - 1] + 1;
+			}
+			diagonal = above;
+			row[j] = best;
+		}
+	}
+	return row[b_size];
+}
+
+static int Recovery_compareDistance(const void *a, const void *b)
+{
+	const struct RecoveryDistance *x = a, *y = b;
+
+	if (x->distance != y->distance) {
+		return x->distance < y->distance ? -1 : 1;
+	}
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Fill in the words to try at a position, every word for "?", or the words
+   closest to what was typed first, leaving out what was typed. */
+static BitcoinResult Recovery_initPosition(struct RecoveryPosition *position,
+	const char *typed, size_t size)
+{
+	struct RecoveryDistance *distances;
+	unsigned i, n = 0;
+	const int unknown = size == sizeof(RECOVERY_UNKNOWN_WORD) - 1
+		&& memcmp(typed, RECOVERY_UNKNOWN_WORD, size) == 0;
+
+	position->candidates = malloc(BIP39_WORDLIST_SIZE
+		* sizeof(*position->candidates));
+	distances = malloc(BIP39_WORDLIST_SIZE * sizeof(*distances));
+	if (!position->candidates || !distances) {
+		free(distances);
+		applog(APPLOG_ERROR, __func__, "Failed to allocate candidate words");
+		return BITCOIN_ERROR;
+	}
+	if (size > RECOVERY_MAX_TYPED_SIZE) {
+		size = RECOVERY_MAX_TYPED_SIZE;
+	}
+	for (i = 0; i < BIP39_WORDLIST_SIZE; i++) {
+		const char *word = BIP39_word(i);
+		const size_t word_size = strlen(word);
+
+		if (word_size == size && memcmp(word, typed, size) == 0) {
+			continue;
+		}
+		distances[n].index = i;
+		distances[n].distance = unknown ? 0 :
+			Recovery_editDistance(typed, size, word, word_size);
+		n++;
+	}
+	qsort(distances, n, sizeof(*distances), Recovery_compareDistance);
+	for (i = 0; i < n; i++) {
+		position->candidates[i] = (uint16_t)distances[i].index;
+	}
+	position->count = n;
+	free(distances);
+	return BITCOIN_SUCCESS;
+}
+
+/* Split 'text' into words, and set up the words to try where they're
+   wrong or might be. */
+static BitcoinResult Recovery_parse(struct Recovery *recovery,
+	const char *text, size_t size)
+{
+	size_t i = 0;
+	unsigned n;
+
+	while (i < size) {
+		char typed[RECOVERY_MAX_TYPED_SIZE];
+		size_t typed_size = 0;
+		BitcoinResult result;
+
+		if (text[i] == ' ' || text[i] == '\t' || text[i] == '\r'
+			|| text[i] == '\n')
+		{
+			i++;
+			continue;
+		}
+		for (; i < size && text[i] != ' ' && text[i] != '\t'
+			&& text[i] != '\r' && text[i] != '\n'; i++)
+		{
+			if (typed_size < sizeof(typed)) {
+				const char c = text[i];
+				typed[typed_size++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+			}
+		}
+		if (recovery->word_count == BIP39_MAX_WORDS) {
+			recovery->word_count++;
+			break;
+		}
+		n = recovery->word_count++;
+		recovery->words[n] = BIP39_findWord(typed, typed_size);
+		if (recovery->words[n] < 0) {
+			recovery->unknown[recovery->unknown_count++] = n;
+		} else {
+			recovery->known[recovery->known_count++] = n;
+			if (!recovery->options->change_words) {
+				continue;
+			}
+		}
+		result = Recovery_initPosition(&recovery->positions[n],
+			typed, typed_size);
+		if (result != BITCOIN_SUCCESS) {
+			return result;
+		}
+	}
+
+	n = recovery->word_count;
+	if (n < BIP39_MIN_WORDS || n > BIP39_MAX_WORDS || n % 3) {
+		applog(APPLOG_ERROR, __func__,
+			"Mnemonic has %s%u words, but should have 12, 15, 18, 21 or 24",
+			n > BIP39_MAX_WORDS ? "over " : "",
+			n > BIP39_MAX_WORDS ? BIP39_MAX_WORDS : n
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	return BITCOIN_SUCCESS;
+}
+
+static int Recovery_compareUnsigned(const void *a, const void *b)
+{
+	const unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Set up the step for the unknown words and the known words chosen by the
+   current combination, returning 0 if it has too many candidates. */
+static int Recovery_makeStep(struct Recovery *recovery,
+	struct RecoveryStep *step)
+{
+	unsigned i;
+
+	step->count = 0;
+	for (i = 0; i < recovery->unknown_count; i++) {
+		step->positions[step->count++] = recovery->unknown[i];
+	}
+	for (i = 0; i < recovery->changed; i++) {
+		step->positions[step->count++] =
+			recovery->known[recovery->combination.k[i]];
+	}
+	qsort(step->positions, step->count, sizeof(step->positions[0]),
+		Recovery_compareUnsigned);
+
+	step->size = 1;
+	for (i = 0; i < step->count; i++) {
+		const unsigned count = recovery->positions[step->positions[i]].count;
+
+		if (step->size > UINT64_MAX / count) {
+			return 0;
+		}
+		step->size *= count;
+	}
+	return 1;
+}
+
+/* Move on to the next combination of known words to change, more of them
+   once every combination of this many is done.  Returns 0 at the end. */
+static int Recovery_nextStep(struct Recovery *recovery)
+{
+	if (recovery->changed == 0
+		|| !Combination_next(&recovery->combination))
+	{
+		if (recovery->changed) {
+			Combination_destroy(&recovery->combination);
+		}
+		if (recovery->changed == recovery->options->change_words
+			|| recovery->changed == recovery->known_count)
+		{
+			recovery->changed = 0;
+			return 0;
+		}
+		recovery->changed++;
+		Combination_create(&recovery->combination,
+			(int)recovery->known_count, (int)recovery->changed);
+		if (!recovery->combination.k) {
+			recovery->changed = 0;
+			return 0;
+		}
+	}
+	recovery->next = 0;
+	return Recovery_makeStep(recovery, &recovery->step);
+}
+
+/* Number of candidates in every step, or UINT64_MAX if too many. */
+static uint64_t Recovery_countCandidates(struct Recovery *recovery)
+{
+	uint64_t total = recovery->step.size, count;
+	unsigned changed, i;
+
+	/* every combination of the same number of changed words has the same
+	   number of candidates, as every changed known word has one fewer
+	   candidate than the wordlist */
+	for (changed = 1; changed <= recovery->options->change_words
+		&& changed <= recovery->known_count; changed++)
+	{
+		count = Combination_count((int)recovery->known_count, (int)changed);
+		for (i = 0; i < changed && count != UINT64_MAX; i++) {
+			count = count > UINT64_MAX / (BIP39_WORDLIST_SIZE - 1) ?
+				UINT64_MAX : count * (BIP39_WORDLIST_SIZE - 1);
+		}
+		if (count == UINT64_MAX || recovery->step.size == 0
+			|| count > UINT64_MAX / recovery->step.size)
+		{
+			return UINT64_MAX;
+		}
+		count *= recovery->step.size;
+		if (total > UINT64_MAX - count) {
+			return UINT64_MAX;
+		}
+		total += count;
+	}
+	return total;
+}
+
+/* Take the next run of candidates, returning 0 if there are none left. */
+static int Recovery_take(struct Recovery *recovery,
+	struct RecoveryChunk *chunk)
+{
+	int taken = 0;
+
+	pthread_mutex_lock(&recovery->mutex);
+	while (!recovery->done) {
+		if (recovery->next < recovery->step.size) {
+			chunk->step = recovery->step;
+			chunk->first = recovery->next;
+			chunk->count = recovery->step.size - recovery->next;
+			if (chunk->count > RECOVERY_CHUNK_SIZE) {
+				chunk->count = RECOVERY_CHUNK_SIZE;
+			}
+			recovery->next += chunk->count;
+			taken = 1;
+			break;
+		}
+		if (!Recovery_nextStep(recovery)) {
+			recovery->done = 1;
+		}
+	}
+	pthread_mutex_unlock(&recovery->mutex);
+
+	return taken;
+}
+
+/* Check the checksum of the candidate 'words', writing it out as a
+   sentence if it passes. */
+static int Recovery_checksum(const int *words, unsigned word_count,
+	struct BitcoinBIP39Mnemonic *mnemonic)
+{
+	uint8_t bits[(BIP39_MAX_WORDS * BIP39_BITS_PER_WORD + 7) / 8];
+	const unsigned entropy_bytes = word_count / 3 * 4;
+	const unsigned checksum_bits = word_count / 3;
+	struct BitcoinSHA256 hash;
+	unsigned i, bit;
+
+	memset(bits, 0, sizeof(bits));
+	for (i = 0; i < word_count; i++) {
+		for (bit = 0; bit < BIP39_BITS_PER_WORD; bit++) {
+			if (words[i] & (1 << (BIP39_BITS_PER_WORD - 1 - bit))) {
+				const unsigned n = i * BIP39_BITS_PER_WORD + bit;
+				bits[n / 8] |= (uint8_t)(0x80 >> (n % 8));
+			}
+		}
+	}
+	Bitcoin_SHA256(&hash, bits, entropy_bytes);
+	if (bits[entropy_bytes] >> (8 - checksum_bits)
+		!= hash.data[0] >> (8 - checksum_bits))
+	{
+		return 0;
+	}
+
+	mnemonic->size = 0;
+	for (i = 0; i < word_count; i++) {
+		const char *word = BIP39_word((unsigned)words[i]);
+		const size_t size = strlen(word);
+
+		if (i) {
+			mnemonic->text[mnemonic->size++] = ' ';
+		}
+		memcpy(mnemonic->text + mnemonic->size, word, size);
+		mnemonic->size += size;
+	}
+	return 1;
+}
+
+/* Whether any key derived from the seed of 'mnemonic' has an address in
+   the targets. */
+static BitcoinResult Recovery_derive(struct Recovery *recovery,
+	const struct BitcoinBIP39Mnemonic *mnemonic, int *matched)
+{
+	const struct BitcoinDerivationPath *path = recovery->options->path;
+	struct BitcoinExtendedKey parent, child;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	BitcoinResult result;
+	uint64_t index;
+	size_t i;
+
+	*matched = 0;
+	result = BIP32_makeMasterKey(&parent, mnemonic->seed, BIP39_SEED_SIZE,
+		NULL);
+	for (i = 0; i + 1 < path->levels && result == BITCOIN_SUCCESS; i++) {
+		result = BIP32_deriveChild(&parent, &parent, path->indexes[i]);
+	}
+	if (path->levels == 0 && result == BITCOIN_SUCCESS) {
+		Bitcoin_MakeSHA256FromPublicKey(&sha256, &parent.public_key);
+		Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+		*matched = Match_find(recovery->options->targets, &ripemd160, NULL);
+	}
+	for (index = path->first; path->levels > 0 && index <= path->last
+		&& result == BITCOIN_SUCCESS && !*matched; index++)
+	{
+		result = BIP32_deriveChild(&child, &parent, (uint32_t)index);
+		if (result == BITCOIN_SUCCESS) {
+			Bitcoin_MakeSHA256FromPublicKey(&sha256, &child.public_key);
+			Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+			*matched = Match_find(recovery->options->targets, &ripemd160,
+				NULL);
+		}
+	}
+	if (result == BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT) {
+		/* a candidate BIP32 can't use, which can't be the one wanted */
+		result = BITCOIN_SUCCESS;
+	}
+	Secure_wipe(&parent, sizeof(parent));
+	Secure_wipe(&child, sizeof(child));
+	return result;
+}
+
+/* Make the seeds of candidates which passed the checksum, and look for
+   their addresses. */
+static BitcoinResult Recovery_check(struct Recovery *recovery,
+	struct BitcoinBIP39Mnemonic *mnemonics, unsigned count)
+{
+	BitcoinResult result = BITCOIN_SUCCESS;
+	unsigned i;
+	int matched = 0, done;
+
+	/* the rest of a chunk is skipped once another thread finds it */
+	pthread_mutex_lock(&recovery->mutex);
+	done = recovery->done;
+	pthread_mutex_unlock(&recovery->mutex);
+	if (!done) {
+		result = BIP39_makeSeeds(mnemonics, count,
+			recovery->options->passphrase);
+	} else {
+		count = 0;
+	}
+
+	for (i = 0; i < count && result == BITCOIN_SUCCESS && !matched; i++) {
+		result = Recovery_derive(recovery, &mnemonics[i], &matched);
+		if (matched) {
+			pthread_mutex_lock(&recovery->mutex);
+			if (!recovery->found) {
+				recovery->found = 1;
+				recovery->mnemonic = mnemonics[i];
+			}
+			recovery->done = 1;
+			pthread_mutex_unlock(&recovery->mutex);
+		}
+	}
+	Secure_wipe(mnemonics, count * sizeof(*mnemonics));
+	return result;
+}
+
+static void Recovery_thread(void *arg, unsigned thread_index)
+{
+	struct Recovery *recovery = arg;
+	struct BitcoinBIP39Mnemonic mnemonics[PBKDF2_MAX_LANES];
+	struct RecoveryChunk chunk;
+	BitcoinResult result = BITCOIN_SUCCESS;
+	int words[BIP39_MAX_WORDS];
+	unsigned digits[BIP39_MAX_WORDS];
+
+	(void)thread_index;
+	while (result == BITCOIN_SUCCESS && Recovery_take(recovery, &chunk)) {
+		const struct RecoveryStep *step = &chunk.step;
+		uint64_t n, index = chunk.first, checked = 0;
+		unsigned i, pending = 0;
+
+		/* the first candidate, with the last changed word fastest */
+		memcpy(words, recovery->words, sizeof(words));
+		for (i = step->count; i-- > 0;) {
+			const struct RecoveryPosition *position =
+				&recovery->positions[step->positions[i]];
+
+			digits[i] = (unsigned)(index % position->count);
+			index /= position->count;
+			words[step->positions[i]] = position->candidates[digits[i]];
+		}
+
+		for (n = 0; n < chunk.count && result == BITCOIN_SUCCESS; n++) {
+			if (Recovery_checksum(words, recovery->word_count,
+				&mnemonics[pending]))
+			{
+				checked++;
+				if (++pending == PBKDF2_MAX_LANES) {
+					result = Recovery_check(recovery, mnemonics, pending);
+					pending = 0;
+				}
+			}
+			for (i = step->count; i-- > 0;) {
+				const struct RecoveryPosition *position =
+					&recovery->positions[step->positions[i]];
+
+				if (++digits[i] == position->count) {
+					digits[i] = 0;
+				}
+				words[step->positions[i]] = position->candidates[digits[i]];
+				if (digits[i]) {
+					break;
+				}
+			}
+		}
+		if (pending && result == BITCOIN_SUCCESS) {
+			result = Recovery_check(recovery, mnemonics, pending);
+		}
+
+		pthread_mutex_lock(&recovery->mutex);
+		recovery->checked += checked;
+		recovery->progress.count += chunk.count;
+		Progress_update(&recovery->progress, recovery->progress.count,
+			recovery->progress.count);
+		pthread_mutex_unlock(&recovery->mutex);
+	}
+
+	if (result != BITCOIN_SUCCESS) {
+		pthread_mutex_lock(&recovery->mutex);
+		recovery->result = result;
+		recovery->done = 1;
+		pthread_mutex_unlock(&recovery->mutex);
+	}
+	Secure_wipe(words, sizeof(words));
+
+	/* messages from this thread come out before the summary */
+	applog_flush();
+}
+
+/* Say which words were changed to make the mnemonic found. */
+static void Recovery_report(const struct Recovery *recovery,
+	const char *text, size_t size)
+{
+	const char *found = recovery->mnemonic.text;
+	const char *found_end = found + recovery->mnemonic.size;
+	size_t i = 0;
+	unsigned n;
+
+	for (n = 0; n < recovery->word_count; n++) {
+		size_t start, word_size = 0;
+
+		while (i < size && (text[i] == ' ' || text[i] == '\t'
+			|| text[i] == '\r' || text[i] == '\n'))
+		{
+			i++;
+		}
+		start = i;
+		while (i < size && text[i] != ' ' && text[i] != '\t'
+			&& text[i] != '\r' && text[i] != '\n')
+		{
+			i++;
+		}
+		while (found + word_size < found_end && found[word_size] != ' ') {
+			word_size++;
+		}
+		if (recovery->words[n] < 0
+			|| strncmp(BIP39_word((unsigned)recovery->words[n]), found,
+				word_size) != 0
+			|| BIP39_word((unsigned)recovery->words[n])[word_size] != '\0')
+		{
+			applog(APPLOG_NOTICE, __func__, "word %u: %.*s -> %.*s", n + 1,
+				(int)(i - start), text + start, (int)word_size, found);
+		}
+		found += word_size + (found + word_size < found_end);
+	}
+}
+
+BitcoinResult Recovery_mnemonic(struct BitcoinBIP39Mnemonic *mnemonic,
+	const char *text, size_t size,
+	const struct BitcoinRecoveryOptions *options)
+{
+	struct Recovery *recovery = calloc(1, sizeof(*recovery));
+	struct ParallelGroup group;
+	BitcoinResult result;
+	unsigned i;
+
+	if (!recovery) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate recovery");
+		return BITCOIN_ERROR;
+	}
+	recovery->options = options;
+	recovery->result = BITCOIN_SUCCESS;
+
+	result = Recovery_parse(recovery, text, size);
+	if (result == BITCOIN_SUCCESS && !Recovery_makeStep(recovery,
+		&recovery->step))
+	{
+		result = BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (result == BITCOIN_SUCCESS) {
+		uint64_t total = Recovery_countCandidates(recovery);
+
+		if (total == UINT64_MAX) {
+			applog(APPLOG_ERROR, __func__,
+				"Too many candidates to search, with %u unknown words and"
+				" up to %u more changed", recovery->unknown_count,
+				options->change_words
+			);
+			result = BITCOIN_ERROR_INVALID_FORMAT;
+		} else {
+			applog(APPLOG_NOTICE, __func__,
+				"Search space is %llu candidates", (unsigned long long)total);
+			Progress_init(&recovery->progress, stderr, "candidates",
+				options->progress_interval);
+			recovery->progress.total = total;
+		}
+	}
+
+	if (result == BITCOIN_SUCCESS) {
+		unsigned tasks = options->pool && options->threads > 1 ?
+			options->threads : 1;
+
+		pthread_mutex_init(&recovery->mutex, NULL);
+		group.pending = 0;
+		for (i = 0; i < tasks; i++) {
+			if (i + 1 == tasks || ParallelPool_submit(options->pool, &group,
+				Recovery_thread, recovery) != BITCOIN_SUCCESS)
+			{
+				/* the calling thread takes its share too */
+				Recovery_thread(recovery, 0);
+				break;
+			}
+		}
+		if (options->pool) {
+			ParallelPool_wait(options->pool, &group);
+		}
+		pthread_mutex_destroy(&recovery->mutex);
+		if (recovery->changed) {
+			Combination_destroy(&recovery->combination);
+		}
+
+		if (recovery->progress.interval) {
+			Progress_report(&recovery->progress);
+		}
+		result = recovery->result;
+	}
+
+	if (result == BITCOIN_SUCCESS && recovery->found) {
+		*mnemonic = recovery->mnemonic;
+		applog(APPLOG_NOTICE, __func__,
+			"Mnemonic has been recovered after %llu candidates, %llu of"
+			" which passed the checksum.",
+			(unsigned long long)recovery->progress.count,
+			(unsigned long long)recovery->checked
+		);
+		Recovery_report(recovery, text, size);
+	} else if (result == BITCOIN_SUCCESS) {
+		applog(APPLOG_ERROR, __func__,
+			"No mnemonic found deriving an address in --match-file, after"
+			" %llu candidates, %llu of which passed the checksum.",
+			(unsigned long long)recovery->progress.count,
+			(unsigned long long)recovery->checked
+		);
+		if (!options->change_words) {
+			applog(APPLOG_NOTICE, __func__,
+				"Words which are on the wordlist may be wrong too, which"
+				" --fix-mnemonic-change-words tries."
+			);
+		}
+		result = BITCOIN_ERROR_NOT_FOUND;
+	}
+
+	for (i = 0; i < BIP39_MAX_WORDS; i++) {
+		free(recovery->positions[i].candidates);
+	}
+	Secure_wipe(recovery, sizeof(*recovery));
+	free(recovery);
+	return result;
+}
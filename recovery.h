@@ -0,0 +1,72 @@
+#ifndef BITCOIN_INCLUDE_RECOVERY_H
+#define BITCOIN_INCLUDE_RECOVERY_H
+
+/** @file recovery.h
+ *  @brief Recover a BIP39 mnemonic with missing or mistyped words, by
+ *         trying the words they could be until one derives a known
+ *         address.
+ *
+ *  Words written as "?" could be any word, and words not on the wordlist
+ *  are tried closest spelling first.  Up to a given number of words which
+ *  are on the list can be wrong too, chosen with the Combination
+ *  enumerator as Bitcoin_FixBase58Check() chooses characters.  Most
+ *  candidates fail the mnemonic's checksum, 15/16 of them for 12 words or
+ *  255/256 for 24, which costs a SHA256 hash.  Only those left have their
+ *  seeds made, four at a time where the processor can, and their keys
+ *  derived and looked up in the targets.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+
+#include "bip32.h" /* struct BitcoinDerivationPath */
+#include "bip39.h" /* struct BitcoinBIP39Mnemonic */
+#include "match.h" /* struct BitcoinMatchSet */
+#include "result.h" /* BitcoinResult */
+
+struct ParallelPool;
+
+/* word written for one which is missing */
+#define RECOVERY_UNKNOWN_WORD "?"
+
+struct BitcoinRecoveryOptions {
+	/* number of words on the wordlist which may be wrong as well */
+	unsigned change_words;
+
+	/* BIP39 passphrase, or NULL for none */
+	const char *passphrase;
+
+	/* keys derived from each candidate's master key, whose addresses are
+	   looked for in 'targets' */
+	const struct BitcoinDerivationPath *path;
+	const struct BitcoinMatchSet *targets;
+
+	/* workers to share the search with, or NULL to search on the calling
+	   thread, and how many of them to use */
+	struct ParallelPool *pool;
+	unsigned threads;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+};
+
+/** @brief Search for the mnemonic meant by 'text' which derives an address
+ *         in the targets, trying fewest changed words first.
+ *
+ *  @param[out] mnemonic The mnemonic found, with its seed.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if found.
+ *          BITCOIN_ERROR_NOT_FOUND if no candidate derives a target.
+ *          BITCOIN_ERROR_INVALID_FORMAT if 'text' doesn't have 12, 15, 18,
+ *          21 or 24 words, or has too many candidates to count.
+ *          BITCOIN_ERROR or BITCOIN_ERROR_LIBRARY_FAILURE if out of memory
+ *          or OpenSSL failed.
+ */
+BitcoinResult Recovery_mnemonic(struct BitcoinBIP39Mnemonic *mnemonic,
+	const char *text, size_t size,
+	const struct BitcoinRecoveryOptions *options
+);
+
+#endif
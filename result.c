@@ -5,6 +5,7 @@ const char *Bitcoin_ResultString(BitcoinResult result)
 	const char *m = "";
 	switch (result) {
 		case BITCOIN_SUCCESS: m = "success"; break;
+		case BITCOIN_ERROR: m = "error"; break;
 		case BITCOIN_ERROR_NOT_IMPLEMENTED: m = "not implemented"; break;
 		case BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT: m = "invalid private key format"; break;
 		case BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT: m = "invalid public key format"; break;
@@ -12,6 +13,11 @@ const char *Bitcoin_ResultString(BitcoinResult result)
 		case BITCOIN_ERROR_CHECKSUM_FAILURE: m = "checksum failure"; break;
 		case BITCOIN_ERROR_INVALID_FORMAT: m = "invalid format"; break;
 		case BITCOIN_ERROR_IMPOSSIBLE_CONVERSION: m = "impossible conversion from input type to output type"; break;
+		case BITCOIN_ERROR_FILE: m = "file error"; break;
+		case BITCOIN_ERROR_LIBRARY_FAILURE: m = "library failure"; break;
+		case BITCOIN_ERROR_END_OF_FILE: m = "end of file"; break;
+		case BITCOIN_ERROR_NOT_FOUND: m = "not found"; break;
+		case BITCOIN_ERROR_INVALID_SIGNATURE: m = "invalid signature"; break;
 		default : m = "unknown result code"; break;
 	}
 	return m;
@@ -20,9 +20,14 @@ typedef enum BitcoinResult {
 	BITCOIN_ERROR_IMPOSSIBLE_CONVERSION,
 	BITCOIN_ERROR_FILE,
 	BITCOIN_ERROR_LIBRARY_FAILURE,
-	BITCOIN_ERROR_END_OF_FILE
+	BITCOIN_ERROR_END_OF_FILE,
+	BITCOIN_ERROR_NOT_FOUND, /* a search finished without finding anything */
+	BITCOIN_ERROR_INVALID_SIGNATURE /* a signature wasn't made by the key */
 } BitcoinResult;
 
+/** Number of different BitcoinResult values */
+#define BITCOIN_RESULT_COUNT (BITCOIN_ERROR_INVALID_SIGNATURE + 1)
+
 /** @brief Return the text message corresponding to a BitcoinResult.
  *
  *  @param[in] result BitcoinResult returned from a previous function.
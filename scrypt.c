@@ -0,0 +1,383 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "scrypt.h"
+#include "applog.h"
+#include "secure.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+
+/* SSE2 mixes the four diagonals of a Salsa20 block at once.  It's always
+   there on x86-64, so no need to check for it at run time. */
+#if defined(__SSE2__)
+#define BITCOIN_SCRYPT_SSE2
+#include <emmintrin.h>
+#endif
+
+/* words in each of the 2*r Salsa20/8 blocks of a mixed block */
+#define SCRYPT_SALSA_WORDS 16
+
+struct BitcoinScryptPool {
+	pthread_mutex_t mutex;
+
+	/* signalled when a buffer is given back */
+	pthread_cond_t cond;
+
+	size_t size;
+	unsigned limit, allocated;
+
+	/* buffers allocated but not in use, up to 'limit' of them */
+	uint32_t **free;
+	unsigned free_count;
+};
+
+#define SCRYPT_ROTATE(value, bits) \
+	(((value) << (bits)) | ((value) >> (32 - (bits))))
+
+/* Word of a mixed block kept in word 'k' of a state.  With SSE2, each 16
+   word block is kept as its diagonals, words 0, 5, 10, 15 then 4, 9, 14, 3
+   and so on, which lines them up for the column and row rounds. */
+#if defined(BITCOIN_SCRYPT_SSE2)
+#define SCRYPT_WORD(k) (((k) & ~(size_t)15) | ((k) * 5 & 15))
+#else
+#define SCRYPT_WORD(k) (k)
+#endif
+
+static uint32_t Scrypt_load32(const uint8_t *bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8)
+		| ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void Scrypt_store32(uint8_t *bytes, uint32_t value)
+{
+	bytes[0] = (uint8_t)value;
+	bytes[1] = (uint8_t)(value >> 8);
+	bytes[2] = (uint8_t)(value >> 16);
+	bytes[3] = (uint8_t)(value >> 24);
+}
+
+#if defined(BITCOIN_SCRYPT_SSE2)
+
+#define SCRYPT_ROTATE_XOR(out, a, b, bits) do { \
+	__m128i sum = _mm_add_epi32(a, b); \
+	out = _mm_xor_si128(out, _mm_slli_epi32(sum, bits)); \
+	out = _mm_xor_si128(out, _mm_srli_epi32(sum, 32 - (bits))); \
+} while (0)
+
+/* Four double rounds of the Salsa20 core on a block kept as diagonals,
+   added to its input. */
+static void Scrypt_salsa20_8(__m128i b[4])
+{
+	__m128i x0 = b[0], x1 = b[1], x2 = b[2], x3 = b[3];
+	unsigned i;
+
+	for (i = 0; i < 8; i += 2) {
+		/* columns */
+		SCRYPT_ROTATE_XOR(x1, x0, x3, 7);
+		SCRYPT_ROTATE_XOR(x2, x1, x0, 9);
+		SCRYPT_ROTATE_XOR(x3, x2, x1, 13);
+		SCRYPT_ROTATE_XOR(x0, x3, x2, 18);
+		x1 = _mm_shuffle_epi32(x1, 0x93);
+		x2 = _mm_shuffle_epi32(x2, 0x4e);
+		x3 = _mm_shuffle_epi32(x3, 0x39);
+
+		/* rows */
+		SCRYPT_ROTATE_XOR(x3, x0, x1, 7);
+		SCRYPT_ROTATE_XOR(x2, x3, x0, 9);
+		SCRYPT_ROTATE_XOR(x1, x2, x3, 13);
+		SCRYPT_ROTATE_XOR(x0, x1, x2, 18);
+		x1 = _mm_shuffle_epi32(x1, 0x39);
+		x2 = _mm_shuffle_epi32(x2, 0x4e);
+		x3 = _mm_shuffle_epi32(x3, 0x93);
+	}
+	b[0] = _mm_add_epi32(b[0], x0);
+	b[1] = _mm_add_epi32(b[1], x1);
+	b[2] = _mm_add_epi32(b[2], x2);
+	b[3] = _mm_add_epi32(b[3], x3);
+}
+
+/* BlockMix of the 2*r Salsa20/8 blocks of 'input' into 'output', with the
+   even numbered results first and the odd ones after. */
+static void Scrypt_blockMix(const uint32_t *input, uint32_t *output,
+	uint32_t r)
+{
+	const __m128i *in = (const __m128i *)input;
+	__m128i *out = (__m128i *)output;
+	__m128i x[4];
+	size_t i, k;
+
+	for (k = 0; k < 4; k++) {
+		x[k] = _mm_loadu_si128(in + (2 * r - 1) * 4 + k);
+	}
+	for (i = 0; i < 2 * r; i++) {
+		for (k = 0; k < 4; k++) {
+			x[k] = _mm_xor_si128(x[k], _mm_loadu_si128(in + i * 4 + k));
+		}
+		Scrypt_salsa20_8(x);
+		for (k = 0; k < 4; k++) {
+			_mm_storeu_si128(out + (i / 2 + (i & 1) * r) * 4 + k, x[k]);
+		}
+	}
+}
+
+#else
+
+/* Four double rounds of the Salsa20 core, added to its input. */
+static void Scrypt_salsa20_8(uint32_t block[SCRYPT_SALSA_WORDS])
+{
+	uint32_t x[SCRYPT_SALSA_WORDS];
+	unsigned i;
+
+	memcpy(x, block, sizeof(x));
+	for (i = 0; i < 8; i += 2) {
+		/* columns */
+		x[ 4] ^= SCRYPT_ROTATE(x[ 0] + x[12],  7);
+		x[ 8] ^= SCRYPT_ROTATE(x[ 4] + x[ 0],  9);
+		x[12] ^= SCRYPT_ROTATE(x[ 8] + x[ 4], 13);
+		x[ 0] ^= SCRYPT_ROTATE(x[12] + x[ 8], 18);
+		x[ 9] ^= SCRYPT_ROTATE(x[ 5] + x[ 1],  7);
+		x[13] ^= SCRYPT_ROTATE(x[ 9] + x[ 5],  9);
+		x[ 1] ^= SCRYPT_ROTATE(x[13] + x[ 9], 13);
+		x[ 5] ^= SCRYPT_ROTATE(x[ 1] + x[13], 18);
+		x[14] ^= SCRYPT_ROTATE(x[10] + x[ 6],  7);
+		x[ 2] ^= SCRYPT_ROTATE(x[14] + x[10],  9);
+		x[ 6] ^= SCRYPT_ROTATE(x[ 2] + x[14], 13);
+		x[10] ^= SCRYPT_ROTATE(x[ 6] + x[ 2], 18);
+		x[ 3] ^= SCRYPT_ROTATE(x[15] + x[11],  7);
+		x[ 7] ^= SCRYPT_ROTATE(x[ 3] + x[15],  9);
+		x[11] ^= SCRYPT_ROTATE(x[ 7] + x[ 3], 13);
+		x[15] ^= SCRYPT_ROTATE(x[11] + x[ 7], 18);
+
+		/* rows */
+		x[ 1] ^= SCRYPT_ROTATE(x[ 0] + x[ 3],  7);
+		x[ 2] ^= SCRYPT_ROTATE(x[ 1] + x[ 0],  9);
+		x[ 3] ^= SCRYPT_ROTATE(x[ 2] + x[ 1], 13);
+		x[ 0] ^= SCRYPT_ROTATE(x[ 3] + x[ 2], 18);
+		x[ 6] ^= SCRYPT_ROTATE(x[ 5] + x[ 4],  7);
+		x[ 7] ^= SCRYPT_ROTATE(x[ 6] + x[ 5],  9);
+		x[ 4] ^= SCRYPT_ROTATE(x[ 7] + x[ 6], 13);
+		x[ 5] ^= SCRYPT_ROTATE(x[ 4] + x[ 7], 18);
+		x[11] ^= SCRYPT_ROTATE(x[10] + x[ 9],  7);
+		x[ 8] ^= SCRYPT_ROTATE(x[11] + x[10],  9);
+		x[ 9] ^= SCRYPT_ROTATE(x[ 8] + x[11], 13);
+		x[10] ^= SCRYPT_ROTATE(x[ 9] + x[ 8], 18);
+		x[12] ^= SCRYPT_ROTATE(x[15] + x[14],  7);
+		x[13] ^= SCRYPT_ROTATE(x[12] + x[15],  9);
+		x[14] ^= SCRYPT_ROTATE(x[13] + x[12], 13);
+		x[15] ^= SCRYPT_ROTATE(x[14] + x[13], 18);
+	}
+	for (i = 0; i < SCRYPT_SALSA_WORDS; i++) {
+		block[i] += x[i];
+	}
+}
+
+/* BlockMix of the 2*r Salsa20/8 blocks of 'input' into 'output', with the
+   even numbered results first and the odd ones after. */
+static void Scrypt_blockMix(const uint32_t *input, uint32_t *output,
+	uint32_t r)
+{
+	uint32_t x[SCRYPT_SALSA_WORDS];
+	size_t i, k;
+
+	memcpy(x, &input[(2 * r - 1) * SCRYPT_SALSA_WORDS], sizeof(x));
+	for (i = 0; i < 2 * r; i++) {
+		for (k = 0; k < SCRYPT_SALSA_WORDS; k++) {
+			x[k] ^= input[i * SCRYPT_SALSA_WORDS + k];
+		}
+		Scrypt_salsa20_8(x);
+		memcpy(&output[(i / 2 + (i & 1) * r) * SCRYPT_SALSA_WORDS], x,
+			sizeof(x));
+	}
+}
+
+#endif
+
+/* ROMix one 128*r byte block in place, filling the table 'v' with its
+   first 'n' states, then mixing in the entries its states pick.  'xy' is
+   room for two states. */
+static void Scrypt_mix(uint8_t *block, uint32_t r, uint64_t n,
+	uint32_t *v, uint32_t *xy)
+{
+	const size_t words = 2 * (size_t)r * SCRYPT_SALSA_WORDS;
+	const size_t last = (2 * (size_t)r - 1) * SCRYPT_SALSA_WORDS;
+	uint32_t *x = xy, *y = xy + words;
+	uint64_t i;
+	size_t j, k;
+
+	for (k = 0; k < words; k++) {
+		x[k] = Scrypt_load32(block + 4 * SCRYPT_WORD(k));
+	}
+
+	/* two states a time, so they swap back and forth without copying */
+	for (i = 0; i < n; i += 2) {
+		memcpy(&v[i * words], x, words * sizeof(*x));
+		Scrypt_blockMix(x, y, r);
+		memcpy(&v[(i + 1) * words], y, words * sizeof(*y));
+		Scrypt_blockMix(y, x, r);
+	}
+	for (i = 0; i < n; i += 2) {
+		j = (size_t)(x[last] & (n - 1));
+		for (k = 0; k < words; k++) {
+			x[k] ^= v[j * words + k];
+		}
+		Scrypt_blockMix(x, y, r);
+		j = (size_t)(y[last] & (n - 1));
+		for (k = 0; k < words; k++) {
+			y[k] ^= v[j * words + k];
+		}
+		Scrypt_blockMix(y, x, r);
+	}
+
+	for (k = 0; k < words; k++) {
+		Scrypt_store32(block + 4 * SCRYPT_WORD(k), x[k]);
+	}
+}
+
+size_t Scrypt_scratchSize(uint64_t n, uint32_t r, uint32_t p)
+{
+	/* the table, two states being mixed, and the p blocks */
+	return 128 * (size_t)r * ((size_t)n + 2 + p);
+}
+
+struct BitcoinScryptPool *ScryptPool_create(size_t size, unsigned limit)
+{
+	struct BitcoinScryptPool *pool = calloc(1, sizeof(*pool));
+
+	if (!limit) {
+		limit = 1;
+	}
+	if (pool) {
+		pool->free = calloc(limit, sizeof(*pool->free));
+	}
+	if (!pool || !pool->free) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate scrypt pool");
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->size = size;
+	pool->limit = limit;
+	return pool;
+}
+
+void ScryptPool_destroy(struct BitcoinScryptPool *pool)
+{
+	unsigned i;
+
+	if (!pool) {
+		return;
+	}
+	for (i = 0; i < pool->free_count; i++) {
+		Secure_wipe(pool->free[i], pool->size);
+		free(pool->free[i]);
+	}
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->free);
+	free(pool);
+}
+
+/* Take a free buffer, or allocate one if the pool isn't at its limit, or
+   wait for one to be given back. */
+static uint32_t *ScryptPool_acquire(struct BitcoinScryptPool *pool)
+{
+	uint32_t *buffer = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->free_count && pool->allocated == pool->limit) {
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+	}
+	if (pool->free_count) {
+		buffer = pool->free[--pool->free_count];
+		pthread_mutex_unlock(&pool->mutex);
+		return buffer;
+	}
+	pool->allocated++;
+	pthread_mutex_unlock(&pool->mutex);
+
+	buffer = malloc(pool->size);
+	if (!buffer) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->allocated--;
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return buffer;
+}
+
+static void ScryptPool_release(struct BitcoinScryptPool *pool,
+	uint32_t *buffer)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->free[pool->free_count++] = buffer;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+BitcoinResult Scrypt_derive(uint8_t *output, size_t output_size,
+	const void *password, size_t password_size,
+	const void *salt, size_t salt_size,
+	uint64_t n, uint32_t r, uint32_t p,
+	struct BitcoinScryptPool *pool)
+{
+	const size_t size = Scrypt_scratchSize(n, r, p);
+	const size_t block_size = 128 * (size_t)r;
+	BitcoinResult result = BITCOIN_SUCCESS;
+	uint32_t *scratch, *xy;
+	uint8_t *blocks;
+	uint32_t i;
+
+	if (n < 2 || (n & (n - 1)) || n > 0xffffffffu || !r || !p) {
+		applog(APPLOG_BUG, __func__, "Invalid scrypt parameters");
+		return BITCOIN_ERROR;
+	}
+	if (!pool || pool->size < size) {
+		pool = NULL;
+		scratch = malloc(size);
+	} else {
+		scratch = ScryptPool_acquire(pool);
+	}
+	if (!scratch) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate scrypt memory");
+		return BITCOIN_ERROR;
+	}
+	xy = scratch + (size_t)n * block_size / 4;
+	blocks = (uint8_t *)(xy + 2 * block_size / 4);
+
+	if (!PKCS5_PBKDF2_HMAC(password, (int)password_size, salt,
+		(int)salt_size, 1, EVP_sha256(), (int)(p * block_size), blocks))
+	{
+		result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	}
+	for (i = 0; i < p && result == BITCOIN_SUCCESS; i++) {
+		Scrypt_mix(blocks + i * block_size, r, n, scratch, xy);
+	}
+	if (result == BITCOIN_SUCCESS && !PKCS5_PBKDF2_HMAC(password,
+		(int)password_size, blocks, (int)(p * block_size), 1, EVP_sha256(),
+		(int)output_size, output))
+	{
+		result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	}
+	if (result == BITCOIN_ERROR_LIBRARY_FAILURE) {
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+	}
+
+	/* the table is overwritten by the next key, but the blocks and the
+	   last states are as good as the key */
+	Secure_wipe(xy, 2 * block_size + p * block_size);
+	if (pool) {
+		ScryptPool_release(pool, scratch);
+	} else {
+		Secure_wipe(scratch, size);
+		free(scratch);
+	}
+	return result;
+}
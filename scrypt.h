@@ -0,0 +1,62 @@
+#ifndef BITCOIN_INCLUDE_SCRYPT_H
+#define BITCOIN_INCLUDE_SCRYPT_H
+
+/** @file scrypt.h
+ *  @brief The scrypt key derivation function, with its scratch memory taken
+ *         from a pool of buffers which are reused rather than allocated for
+ *         each key.
+ *
+ *  scrypt(N, r, p) runs p mixes of 128*r byte blocks, each filling an
+ *  N entry table and then reading it back in an order decided by its
+ *  contents, so each needs 128*r*N bytes at once: 16MB for BIP38's
+ *  N=16384 and r=8.  Keys made on several threads at once each need their
+ *  own table, so the pool keeps up to a given number of them and makes
+ *  threads wait for one to be given back rather than go over it.
+ *
+ *  https://www.tarsnap.com/scrypt/scrypt.pdf
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "result.h" /* BitcoinResult */
+
+/** Scratch buffers shared by the threads making keys. */
+struct BitcoinScryptPool;
+
+/** @brief Bytes of scratch memory used by scrypt(n, r, p).
+ */
+size_t Scrypt_scratchSize(uint64_t n, uint32_t r, uint32_t p);
+
+/** @brief Make a pool of at most 'limit' buffers of 'size' bytes, which
+ *         are allocated as they're first needed.
+ *
+ *  @return The pool, or NULL if out of memory.
+ */
+struct BitcoinScryptPool *ScryptPool_create(size_t size, unsigned limit);
+
+/** @brief Free the pool and its buffers, none of which may be in use.
+ */
+void ScryptPool_destroy(struct BitcoinScryptPool *pool);
+
+/** @brief Derive 'output_size' bytes of key from a password and salt.
+ *         'n' must be a power of 2 greater than 1.  Scratch memory comes
+ *         from 'pool' if it's not NULL and its buffers are large enough,
+ *         waiting for one to be free if the pool is at its limit, and is
+ *         allocated for this call otherwise.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR if out of memory.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Scrypt_derive(uint8_t *output, size_t output_size,
+	const void *password, size_t password_size,
+	const void *salt, size_t salt_size,
+	uint64_t n, uint32_t r, uint32_t p,
+	struct BitcoinScryptPool *pool
+);
+
+#endif
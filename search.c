@@ -0,0 +1,426 @@
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "search.h"
+#include "applog.h"
+#include "ecbatch.h"
+#include "hash.h"
+#include "parallel.h"
+#include "progress.h"
+#include "secure.h"
+#include "utility.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+/* points made affine together, sharing one field inversion, and the number
+   of keys each thread takes from the range at a time */
+#define SEARCH_BATCH_SIZE 1024
+
+struct Search {
+	const struct BitcoinSearchOptions *options;
+	const EC_GROUP *group;
+	BIGNUM *p, *order;
+
+	/* beta and beta^2 mod p, lambda and lambda^2 mod n */
+	BIGNUM *beta[2], *lambda[2];
+
+	/* everything below is shared between threads, under 'mutex' */
+	pthread_mutex_t mutex;
+
+	/* next key to hand out, and the last key of the range */
+	BIGNUM *next, *end;
+
+	/* set once the range is used up, every target is found, or on error */
+	int done;
+	BitcoinResult result;
+
+	/* which targets have been found */
+	char *target_found;
+	size_t found_count;
+
+	struct BitcoinProgress progress;
+};
+
+static int Search_parseKey(uint8_t *key, const char *text, size_t size)
+{
+	size_t i;
+
+	if (size == 0 || size > BITCOIN_PRIVATE_KEY_SIZE * 2) {
+		return 0;
+	}
+	memset(key, 0, BITCOIN_PRIVATE_KEY_SIZE);
+	for (i = 0; i < size; i++) {
+		/* digits counted from the right, so short keys are zero padded */
+		size_t digit = size - 1 - i;
+		uint_fast8_t value;
+
+		if (!Bitcoin_DecodeHexChar(&value, text[i])) {
+			return 0;
+		}
+		key[BITCOIN_PRIVATE_KEY_SIZE - 1 - digit / 2] |=
+			(digit & 1) ? value << 4 : value;
+	}
+	return 1;
+}
+
+BitcoinResult Search_parseRange(struct BitcoinKeyRange *range,
+	const char *text)
+{
+	const char *colon = strchr(text, ':');
+
+	if (!colon
+		|| !Search_parseKey(range->start, text, colon - text)
+		|| !Search_parseKey(range->end, colon + 1, strlen(colon + 1)))
+	{
+		applog(APPLOG_ERROR, __func__,
+			"Expected a range of private keys as START:END in hex, not \"%s\"",
+			text
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	if (memcmp(range->start, range->end, BITCOIN_PRIVATE_KEY_SIZE) > 0) {
+		applog(APPLOG_ERROR, __func__,
+			"The end of the range \"%s\" is before the start", text
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+	return BITCOIN_SUCCESS;
+}
+
+static void Search_fail(struct Search *search, const char *function_name)
+{
+	applog(APPLOG_ERROR, function_name, "OpenSSL failed: %s",
+		ERR_error_string(ERR_get_error(), NULL)
+	);
+	pthread_mutex_lock(&search->mutex);
+	search->result = BITCOIN_ERROR_LIBRARY_FAILURE;
+	search->done = 1;
+	pthread_mutex_unlock(&search->mutex);
+}
+
+/* The key 'first' + 'offset', times lambda^variant, negated if 'negate', has
+   the public key which matched target 'index'. */
+static void Search_found(struct Search *search, BN_CTX *ctx,
+	const BIGNUM *first, unsigned offset, unsigned variant, int negate,
+	enum BitcoinPublicKeyCompression compression,
+	const struct BitcoinRIPEMD160 *hash, size_t index)
+{
+	const struct BitcoinSearchOptions *options = search->options;
+	struct BitcoinPrivateKey private_key;
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 check_sha256;
+	struct BitcoinRIPEMD160 check_ripemd160;
+	BIGNUM *k = BN_new();
+
+	if (!k
+		|| !BN_copy(k, first)
+		|| !BN_add_word(k, offset)
+		|| (variant && !BN_mod_mul(k, k, search->lambda[variant - 1],
+			search->order, ctx))
+		|| (negate && !BN_sub(k, search->order, k))
+		|| BN_bn2binpad(k, private_key.data, sizeof(private_key.data)) < 0)
+	{
+		BN_free(k);
+		Search_fail(search, __func__);
+		return;
+	}
+	BN_clear_free(k);
+
+	private_key.public_key_compression = compression;
+	private_key.network_type = options->network_type;
+
+	/* the key was worked out from which variant of the point matched, so
+	   make sure it really is the key of that public key */
+	if (Bitcoin_MakePublicKeyFromPrivateKey(&public_key, &private_key)
+		!= BITCOIN_SUCCESS)
+	{
+		Search_fail(search, __func__);
+		return;
+	}
+	Bitcoin_MakeSHA256FromPublicKey(&check_sha256, &public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&check_ripemd160, &check_sha256);
+	if (memcmp(check_ripemd160.data, hash->data, BITCOIN_RIPEMD160_SIZE) != 0) {
+		applog(APPLOG_BUG, __func__,
+			"Key derived for a match (variant %u%s) has a different public key",
+			variant, negate ? ", negated" : ""
+		);
+		return;
+	}
+
+	pthread_mutex_lock(&search->mutex);
+	if (!search->target_found[index]) {
+		search->target_found[index] = 1;
+		search->found_count++;
+		if (options->found) {
+			options->found(options->found_arg, &private_key);
+		}
+		if (search->found_count == options->targets->count) {
+			search->done = 1;
+		}
+	}
+	pthread_mutex_unlock(&search->mutex);
+
+	Secure_wipe(&private_key, sizeof(private_key));
+}
+
+/* Hash the public keys of one variant of a point, 'point' holding 0x04, x
+   and y, and look for them in the targets. */
+static void Search_check(struct Search *search, BN_CTX *ctx,
+	const uint8_t *point, const BIGNUM *first, unsigned offset,
+	unsigned variant, int negate)
+{
+	const struct BitcoinSearchOptions *options = search->options;
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+	uint8_t compressed[BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE];
+	size_t index;
+
+	if (options->compression != BITCOIN_PUBLIC_KEY_UNCOMPRESSED) {
+		compressed[0] = 0x02 | (point[BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE - 1] & 1);
+		memcpy(compressed + 1, point + 1, ECBATCH_FIELD_SIZE);
+		Bitcoin_SHA256(&sha256, compressed, sizeof(compressed));
+		Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+		if (Match_find(options->targets, &ripemd160, &index)) {
+			Search_found(search, ctx, first, offset, variant, negate,
+				BITCOIN_PUBLIC_KEY_COMPRESSED, &ripemd160, index);
+		}
+	}
+	if (options->compression != BITCOIN_PUBLIC_KEY_COMPRESSED) {
+		Bitcoin_SHA256(&sha256, point, BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE);
+		Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+		if (Match_find(options->targets, &ripemd160, &index)) {
+			Search_found(search, ctx, first, offset, variant, negate,
+				BITCOIN_PUBLIC_KEY_UNCOMPRESSED, &ripemd160, index);
+		}
+	}
+}
+
+/* Check every key given by the affine point (x, y) of 'first' + 'offset'. */
+static int Search_point(struct Search *search, BN_CTX *ctx,
+	const BIGNUM *first, unsigned offset, const BIGNUM *x, const BIGNUM *y,
+	BIGNUM *scratch)
+{
+	const unsigned variants = search->options->endomorphism ? 3 : 1;
+	uint8_t point[BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE];
+	uint8_t y_negated[ECBATCH_FIELD_SIZE];
+	uint8_t *point_x = point + 1, *point_y = point + 1 + ECBATCH_FIELD_SIZE;
+	unsigned variant;
+
+	point[0] = 0x04;
+	if (search->options->endomorphism
+		&& (!BN_sub(scratch, search->p, y)
+			|| BN_bn2binpad(scratch, y_negated, ECBATCH_FIELD_SIZE) < 0))
+	{
+		return 0;
+	}
+
+	for (variant = 0; variant < variants; variant++) {
+		const BIGNUM *x_variant = x;
+
+		if (variant) {
+			if (!BN_mod_mul(scratch, x, search->beta[variant - 1], search->p,
+				ctx))
+			{
+				return 0;
+			}
+			x_variant = scratch;
+		}
+		if (BN_bn2binpad(x_variant, point_x, ECBATCH_FIELD_SIZE) < 0) {
+			return 0;
+		}
+		if (BN_bn2binpad(y, point_y, ECBATCH_FIELD_SIZE) < 0) {
+			return 0;
+		}
+		Search_check(search, ctx, point, first, offset, variant, 0);
+
+		if (search->options->endomorphism) {
+			memcpy(point_y, y_negated, ECBATCH_FIELD_SIZE);
+			Search_check(search, ctx, point, first, offset, variant, 1);
+		}
+	}
+	return 1;
+}
+
+/* Take the next batch of keys from the range, returning how many keys it
+   has, or 0 if there are none left. */
+static unsigned Search_take(struct Search *search, BIGNUM *first,
+	BIGNUM *scratch)
+{
+	unsigned count = 0;
+
+	pthread_mutex_lock(&search->mutex);
+	if (!search->done && BN_cmp(search->next, search->end) <= 0) {
+		count = SEARCH_BATCH_SIZE;
+		if (!BN_sub(scratch, search->end, search->next)
+			|| !BN_copy(first, search->next))
+		{
+			count = 0;
+		} else if (BN_num_bits(scratch) <= 16
+			&& BN_get_word(scratch) < SEARCH_BATCH_SIZE)
+		{
+			count = (unsigned)BN_get_word(scratch) + 1;
+		}
+		if (count && !BN_add_word(search->next, count)) {
+			count = 0;
+		}
+	}
+	if (!count) {
+		search->done = 1;
+	}
+	pthread_mutex_unlock(&search->mutex);
+
+	return count;
+}
+
+static void Search_thread(void *arg, unsigned thread_index)
+{
+	struct Search *search = arg;
+	const EC_GROUP *group = search->group;
+	const EC_POINT *generator = EC_GROUP_get0_generator(group);
+	EC_POINT *points[SEARCH_BATCH_SIZE];
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *first = BN_new(), *x = BN_new(), *y = BN_new(),
+		*scratch = BN_new();
+	unsigned i, count;
+	int ok = ctx && first && x && y && scratch;
+
+	for (i = 0; i < SEARCH_BATCH_SIZE; i++) {
+		points[i] = EC_POINT_new(group);
+		ok = ok && points[i];
+	}
+
+	while (ok && (count = Search_take(search, first, scratch)) > 0) {
+		ok = EC_POINT_mul(group, points[0], first, NULL, NULL, ctx)
+			&& ECBatch_walk(group, points, count, generator, ctx);
+		for (i = 0; ok && i < count; i++) {
+			ok = EC_POINT_get_affine_coordinates(group, points[i], x, y, ctx)
+				&& Search_point(search, ctx, first, i, x, y, scratch);
+		}
+		if (ok) {
+			pthread_mutex_lock(&search->mutex);
+			search->progress.count += count;
+			Progress_update(&search->progress, search->progress.count,
+				search->progress.count);
+			pthread_mutex_unlock(&search->mutex);
+		}
+	}
+	if (!ok) {
+		Search_fail(search, __func__);
+	}
+
+	for (i = 0; i < SEARCH_BATCH_SIZE; i++) {
+		EC_POINT_free(points[i]);
+	}
+	BN_free(first);
+	BN_free(x);
+	BN_free(y);
+	BN_free(scratch);
+	BN_CTX_free(ctx);
+
+	/* messages from this thread come out before the summary */
+	applog_flush();
+}
+
+BitcoinResult Search_range(const struct BitcoinSearchOptions *options,
+	size_t *found_count)
+{
+	struct Search search;
+	BN_CTX *ctx = BN_CTX_new();
+	const struct BitcoinSecp256k1Endomorphism *endomorphism =
+		Bitcoin_GetSecp256k1Endomorphism();
+	BitcoinResult result = BITCOIN_SUCCESS;
+	unsigned i;
+
+	memset(&search, 0, sizeof(search));
+	search.options = options;
+	search.group = Bitcoin_GetSecp256k1Group();
+	search.p = BN_new();
+	search.order = BN_new();
+	search.next = BN_bin2bn(options->range.start, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	search.end = BN_bin2bn(options->range.end, BITCOIN_PRIVATE_KEY_SIZE, NULL);
+	search.result = BITCOIN_SUCCESS;
+	*found_count = 0;
+	for (i = 0; i < 2; i++) {
+		search.beta[i] = BN_new();
+		search.lambda[i] = BN_new();
+	}
+
+	if (!ctx || !search.group || !endomorphism || !search.p || !search.order
+		|| !search.next || !search.end
+		|| !search.beta[0] || !search.beta[1]
+		|| !search.lambda[0] || !search.lambda[1]
+		|| !EC_GROUP_get_curve(search.group, search.p, NULL, NULL, ctx)
+		|| !EC_GROUP_get_order(search.group, search.order, ctx)
+		|| !BN_copy(search.beta[0], endomorphism->beta)
+		|| !BN_copy(search.lambda[0], endomorphism->lambda)
+		|| !BN_mod_sqr(search.beta[1], search.beta[0], search.p, ctx)
+		|| !BN_mod_sqr(search.lambda[1], search.lambda[0], search.order, ctx))
+	{
+		applog(APPLOG_ERROR, __func__, "OpenSSL failed: %s",
+			ERR_error_string(ERR_get_error(), NULL)
+		);
+		result = BITCOIN_ERROR_LIBRARY_FAILURE;
+		goto done;
+	}
+
+	if (BN_is_zero(search.next) || BN_cmp(search.end, search.order) >= 0) {
+		applog(APPLOG_ERROR, __func__,
+			"Private keys to search must be from 1 to the order of the group"
+			" minus 1"
+		);
+		result = BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+		goto done;
+	}
+
+	search.target_found = calloc(options->targets->count + 1, 1);
+	if (!search.target_found) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate search");
+		result = BITCOIN_ERROR;
+		goto done;
+	}
+
+	Progress_init(&search.progress, stderr, "keys", options->progress_interval);
+	if (search.progress.interval) {
+		BIGNUM *size = BN_new();
+
+		if (size && BN_sub(size, search.end, search.next)
+			&& BN_num_bits(size) < 64)
+		{
+			search.progress.total = (uint64_t)BN_get_word(size) + 1;
+		}
+		BN_free(size);
+	}
+
+	pthread_mutex_init(&search.mutex, NULL);
+	if (options->targets->count > 0) {
+		result = Parallel_run(options->threads ? options->threads : 1,
+			Search_thread, &search);
+	}
+	pthread_mutex_destroy(&search.mutex);
+	if (result == BITCOIN_SUCCESS) {
+		result = search.result;
+	}
+	if (search.progress.interval) {
+		Progress_report(&search.progress);
+	}
+	*found_count = search.found_count;
+
+done:
+	free(search.target_found);
+	BN_free(search.p);
+	BN_free(search.order);
+	BN_free(search.next);
+	BN_free(search.end);
+	for (i = 0; i < 2; i++) {
+		BN_free(search.beta[i]);
+		BN_free(search.lambda[i]);
+	}
+	BN_CTX_free(ctx);
+
+	return result;
+}
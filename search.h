@@ -0,0 +1,92 @@
+#ifndef BITCOIN_INCLUDE_SEARCH_H
+#define BITCOIN_INCLUDE_SEARCH_H
+
+/** @file search.h
+ *  @brief Search a range of private keys for any whose address is in a set
+ *         of targets.
+ *
+ *  Consecutive keys differ by the generator, so each point is one point
+ *  addition from the last, and a batch of points shares one field inversion
+ *  to make them affine.  With the endomorphism option each point also gives
+ *  five more keys almost for free: secp256k1 has a cube root of unity beta
+ *  mod p and lambda mod n with lambda*(x, y) = (beta*x, y), and negating a
+ *  key negates y.  So (x, y) gives the public keys of k, lambda*k,
+ *  lambda^2*k and the negation of each, for two field multiplications.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#include "keys.h" /* struct BitcoinPrivateKey, BITCOIN_PRIVATE_KEY_SIZE */
+#include "match.h" /* struct BitcoinMatchSet */
+#include "result.h" /* BitcoinResult */
+
+struct BitcoinNetworkType;
+
+/** A range of private keys, including both ends, as big-endian numbers */
+struct BitcoinKeyRange {
+	uint8_t start[BITCOIN_PRIVATE_KEY_SIZE];
+	uint8_t end[BITCOIN_PRIVATE_KEY_SIZE];
+};
+
+/** @brief Parse a range written as "START:END", each up to 64 hex digits.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if success.
+ *          BITCOIN_ERROR_INVALID_FORMAT if 'text' isn't a range, or END is
+ *          before START.
+ */
+BitcoinResult Search_parseRange(struct BitcoinKeyRange *range,
+	const char *text
+);
+
+/** Called for each target found, with the private key which matched it,
+ *  its public key compression and network type set.  Calls are never made
+ *  by two threads at once. */
+typedef void (*BitcoinSearchFound)(void *arg,
+	const struct BitcoinPrivateKey *private_key
+);
+
+struct BitcoinSearchOptions {
+	struct BitcoinKeyRange range;
+
+	/* addresses to look for */
+	const struct BitcoinMatchSet *targets;
+
+	/* also check lambda*k, lambda^2*k and the negations of all three */
+	int endomorphism;
+
+	/* public keys to check, or BITCOIN_PUBLIC_KEY_EMPTY for both */
+	enum BitcoinPublicKeyCompression compression;
+
+	/* network type set on keys passed to 'found' */
+	const struct BitcoinNetworkType *network_type;
+
+	unsigned threads;
+
+	/* seconds between progress reports on stderr, 0 for none */
+	unsigned progress_interval;
+
+	BitcoinSearchFound found;
+	void *found_arg;
+};
+
+/** @brief Search every key in the range for the targets, stopping early if
+ *         every target is found.
+ *
+ *  @param[out] found_count Number of targets found.
+ *
+ *  @return BitcoinResult indicating error state :
+ *          BITCOIN_SUCCESS if the search finished, whether or not anything
+ *          was found.
+ *          BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT if the range includes 0
+ *          or keys past the order of the group.
+ *          BITCOIN_ERROR_LIBRARY_FAILURE if OpenSSL failed.
+ */
+BitcoinResult Search_range(const struct BitcoinSearchOptions *options,
+	size_t *found_count
+);
+
+#endif
@@ -0,0 +1,205 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise() */
+#define _BSD_SOURCE
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
+#include "secure.h"
+#include "applog.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(OS_WINDOWS_NT)
+#include <windows.h>
+#elif defined(OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* alignment of everything taken from an arena */
+#define SECURE_ALIGNMENT 16
+
+struct BitcoinSecureArena {
+	unsigned char *data;
+	size_t size, used;
+	int locked;
+};
+
+/* set once locking has failed and been warned about */
+static pthread_mutex_t secure_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int secure_warned = 0;
+
+/* called through a volatile pointer, so the compiler can't tell it's
+   memset and leave it out */
+static void *(*volatile secure_memset)(void *, int, size_t) = memset;
+
+void Secure_wipe(void *data, size_t size)
+{
+	if (data && size) {
+		secure_memset(data, 0, size);
+	}
+}
+
+static size_t Secure_pageSize(void)
+{
+#if defined(OS_WINDOWS_NT)
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#elif defined(OS_UNIX)
+	long size = sysconf(_SC_PAGESIZE);
+
+	return size > 0 ? (size_t)size : 4096;
+#else
+	return 4096;
+#endif
+}
+
+/* Map 'size' bytes, or return NULL. */
+static void *Secure_map(size_t size)
+{
+#if defined(OS_WINDOWS_NT)
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#elif defined(OS_UNIX) && defined(MAP_ANONYMOUS)
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+#if defined(MADV_DONTDUMP)
+	/* keep keys out of core dumps too */
+	madvise(data, size, MADV_DONTDUMP);
+#endif
+	return data;
+#else
+	return calloc(1, size);
+#endif
+}
+
+static void Secure_unmap(void *data, size_t size)
+{
+#if defined(OS_WINDOWS_NT)
+	(void)size;
+	VirtualFree(data, 0, MEM_RELEASE);
+#elif defined(OS_UNIX) && defined(MAP_ANONYMOUS)
+	munmap(data, size);
+#else
+	(void)size;
+	free(data);
+#endif
+}
+
+/* Lock 'size' bytes in memory, returning 1 if they are, or 0 having warned
+   the first time it fails. */
+static int Secure_lock(void *data, size_t size)
+{
+	int ok;
+
+#if defined(OS_WINDOWS_NT)
+	ok = VirtualLock(data, size) != 0;
+#elif defined(OS_UNIX)
+	ok = mlock(data, size) == 0;
+#else
+	(void)data;
+	(void)size;
+	ok = 0;
+	errno = ENOSYS;
+#endif
+	if (!ok) {
+		const int error = errno;
+
+		pthread_mutex_lock(&secure_mutex);
+		if (!secure_warned) {
+			secure_warned = 1;
+			applog(APPLOG_WARNING, __func__,
+				"Failed to lock %lu bytes of memory for private keys (%s),"
+				" so they may be written to swap.  Raising the locked memory"
+				" limit (ulimit -l) would allow it.",
+				(unsigned long)size, strerror(error)
+			);
+		}
+		pthread_mutex_unlock(&secure_mutex);
+	}
+	return ok;
+}
+
+static void Secure_unlock(void *data, size_t size)
+{
+#if defined(OS_WINDOWS_NT)
+	VirtualUnlock(data, size);
+#elif defined(OS_UNIX)
+	munlock(data, size);
+#else
+	(void)data;
+	(void)size;
+#endif
+}
+
+struct BitcoinSecureArena *SecureArena_create(size_t size)
+{
+	struct BitcoinSecureArena *arena = malloc(sizeof(*arena));
+	const size_t page = Secure_pageSize();
+
+	if (!arena) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate arena");
+		return NULL;
+	}
+	if (size == 0 || size > (size_t)-1 - page) {
+		size = page;
+	}
+	arena->size = (size + page - 1) / page * page;
+	arena->used = 0;
+	arena->data = Secure_map(arena->size);
+	if (!arena->data) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to map %lu bytes of memory for private keys",
+			(unsigned long)arena->size
+		);
+		free(arena);
+		return NULL;
+	}
+	arena->locked = Secure_lock(arena->data, arena->size);
+	return arena;
+}
+
+void *SecureArena_alloc(struct BitcoinSecureArena *arena, size_t size)
+{
+	unsigned char *data;
+
+	size = (size + SECURE_ALIGNMENT - 1) / SECURE_ALIGNMENT * SECURE_ALIGNMENT;
+	if (size > arena->size - arena->used) {
+		return NULL;
+	}
+	data = arena->data + arena->used;
+	arena->used += size;
+
+	/* fresh mappings are zero, and reset ones have been wiped */
+	return data;
+}
+
+void SecureArena_reset(struct BitcoinSecureArena *arena)
+{
+	Secure_wipe(arena->data, arena->used);
+	arena->used = 0;
+}
+
+int SecureArena_locked(const struct BitcoinSecureArena *arena)
+{
+	return arena->locked;
+}
+
+void SecureArena_destroy(struct BitcoinSecureArena *arena)
+{
+	if (!arena) {
+		return;
+	}
+	Secure_wipe(arena->data, arena->used);
+	if (arena->locked) {
+		Secure_unlock(arena->data, arena->size);
+	}
+	Secure_unmap(arena->data, arena->size);
+	free(arena);
+}
@@ -0,0 +1,49 @@
+#ifndef BITCOIN_INCLUDE_SECURE_H
+#define BITCOIN_INCLUDE_SECURE_H
+
+/** @file secure.h
+ *  @brief Memory for private keys, locked so that it isn't written to swap,
+ *         and wiped before it's reused or given back.
+ *
+ *  An arena is one locked mapping handed out in pieces and reset all at
+ *  once, so records which are converted one after another reuse the same
+ *  memory with nothing allocated in between.  Locking can fail where the
+ *  locked memory limit (ulimit -l) is low, in which case a warning is
+ *  logged once and the memory is used unlocked, still being wiped.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stddef.h> /* size_t */
+
+struct BitcoinSecureArena;
+
+/** @brief Wipe 'size' bytes of 'data', in a way the compiler can't leave
+ *         out because the memory isn't read again.
+ */
+void Secure_wipe(void *data, size_t size);
+
+/** @brief Map and lock an arena of at least 'size' bytes.
+ *
+ *  @return The arena, or NULL if out of memory, having logged why.
+ */
+struct BitcoinSecureArena *SecureArena_create(size_t size);
+
+/** @brief Take 'size' zeroed bytes from the arena, aligned for any type.
+ *
+ *  @return The memory, or NULL if the arena doesn't have that much left.
+ */
+void *SecureArena_alloc(struct BitcoinSecureArena *arena, size_t size);
+
+/** @brief Wipe everything taken from the arena, and start again from the
+ *         beginning.
+ */
+void SecureArena_reset(struct BitcoinSecureArena *arena);
+
+/** @brief Whether the arena's memory is locked. */
+int SecureArena_locked(const struct BitcoinSecureArena *arena);
+
+/** @brief Wipe, unlock and unmap the arena.  NULL is ignored. */
+void SecureArena_destroy(struct BitcoinSecureArena *arena);
+
+#endif
@@ -18,9 +18,12 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "segwit_addr.h"
 
@@ -34,6 +37,214 @@ uint32_t bech32_polymod_step(uint32_t pre) {
         (-((b >> 4) & 1) & 0x2a1462b3UL);
 }
 
+/* Two symbols (10 bits) at a time: feeding symbols v1 then v2 into the
+ * checksum 'chk' gives
+ *   ((chk & 0xFFFFF) << 10) ^ polymod_table[chk >> 20] ^ (v1 << 5) ^ v2
+ * since the generator terms of both steps depend only on the top 10 bits
+ * of 'chk'. */
+static const uint32_t polymod_table[1024] = {
+    0x00000000UL, 0x3b6a57b2UL, 0x26508e6dUL, 0x1d3ad9dfUL, 0x1ea119faUL, 0x25cb4e48UL,
+    0x38f19797UL, 0x039bc025UL, 0x3d4233ddUL, 0x0628646fUL, 0x1b12bdb0UL, 0x2078ea02UL,
+    0x23e32a27UL, 0x18897d95UL, 0x05b3a44aUL, 0x3ed9f3f8UL, 0x2a1462b3UL, 0x117e3501UL,
+    0x0c44ecdeUL, 0x372ebb6cUL, 0x34b57b49UL, 0x0fdf2cfbUL, 0x12e5f524UL, 0x298fa296UL,
+    0x1756516eUL, 0x2c3c06dcUL, 0x3106df03UL, 0x0a6c88b1UL, 0x09f74894UL, 0x329d1f26UL,
+    0x2fa7c6f9UL, 0x14cd914bUL, 0x1fd7e966UL, 0x24bdbed4UL, 0x3987670bUL, 0x02ed30b9UL,
+    0x0176f09cUL, 0x3a1ca72eUL, 0x27267ef1UL, 0x1c4c2943UL, 0x2295dabbUL, 0x19ff8d09UL,
+    0x04c554d6UL, 0x3faf0364UL, 0x3c34c341UL, 0x075e94f3UL, 0x1a644d2cUL, 0x210e1a9eUL,
+    0x35c38bd5UL, 0x0ea9dc67UL, 0x139305b8UL, 0x28f9520aUL, 0x2b62922fUL, 0x1008c59dUL,
+    0x0d321c42UL, 0x36584bf0UL, 0x0881b808UL, 0x33ebefbaUL, 0x2ed13665UL, 0x15bb61d7UL,
+    0x1620a1f2UL, 0x2d4af640UL, 0x30702f9fUL, 0x0b1a782dUL, 0x3d3f76ccUL, 0x0655217eUL,
+    0x1b6ff8a1UL, 0x2005af13UL, 0x239e6f36UL, 0x18f43884UL, 0x05cee15bUL, 0x3ea4b6e9UL,
+    0x007d4511UL, 0x3b1712a3UL, 0x262dcb7cUL, 0x1d479cceUL, 0x1edc5cebUL, 0x25b60b59UL,
+    0x388cd286UL, 0x03e68534UL, 0x172b147fUL, 0x2c4143cdUL, 0x317b9a12UL, 0x0a11cda0UL,
+    0x098a0d85UL, 0x32e05a37UL, 0x2fda83e8UL, 0x14b0d45aUL, 0x2a6927a2UL, 0x11037010UL,
+    0x0c39a9cfUL, 0x3753fe7dUL, 0x34c83e58UL, 0x0fa269eaUL, 0x1298b035UL, 0x29f2e787UL,
+    0x22e89faaUL, 0x1982c818UL, 0x04b811c7UL, 0x3fd24675UL, 0x3c498650UL, 0x0723d1e2UL,
+    0x1a19083dUL, 0x21735f8fUL, 0x1faaac77UL, 0x24c0fbc5UL, 0x39fa221aUL, 0x029075a8UL,
+    0x010bb58dUL, 0x3a61e23fUL, 0x275b3be0UL, 0x1c316c52UL, 0x08fcfd19UL, 0x3396aaabUL,
+    0x2eac7374UL, 0x15c624c6UL, 0x165de4e3UL, 0x2d37b351UL, 0x300d6a8eUL, 0x0b673d3cUL,
+    0x35becec4UL, 0x0ed49976UL, 0x13ee40a9UL, 0x2884171bUL, 0x2b1fd73eUL, 0x1075808cUL,
+    0x0d4f5953UL, 0x36250ee1UL, 0x2afaccb8UL, 0x11909b0aUL, 0x0caa42d5UL, 0x37c01567UL,
+    0x345bd542UL, 0x0f3182f0UL, 0x120b5b2fUL, 0x29610c9dUL, 0x17b8ff65UL, 0x2cd2a8d7UL,
+    0x31e87108UL, 0x0a8226baUL, 0x0919e69fUL, 0x3273b12dUL, 0x2f4968f2UL, 0x14233f40UL,
+    0x00eeae0bUL, 0x3b84f9b9UL, 0x26be2066UL, 0x1dd477d4UL, 0x1e4fb7f1UL, 0x2525e043UL,
+    0x381f399cUL, 0x03756e2eUL, 0x3dac9dd6UL, 0x06c6ca64UL, 0x1bfc13bbUL, 0x20964409UL,
+    0x230d842cUL, 0x1867d39eUL, 0x055d0a41UL, 0x3e375df3UL, 0x352d25deUL, 0x0e47726cUL,
+    0x137dabb3UL, 0x2817fc01UL, 0x2b8c3c24UL, 0x10e66b96UL, 0x0ddcb249UL, 0x36b6e5fbUL,
+    0x086f1603UL, 0x330541b1UL, 0x2e3f986eUL, 0x1555cfdcUL, 0x16ce0ff9UL, 0x2da4584bUL,
+    0x309e8194UL, 0x0bf4d626UL, 0x1f39476dUL, 0x245310dfUL, 0x3969c900UL, 0x02039eb2UL,
+    0x01985e97UL, 0x3af20925UL, 0x27c8d0faUL, 0x1ca28748UL, 0x227b74b0UL, 0x19112302UL,
+    0x042bfaddUL, 0x3f41ad6fUL, 0x3cda6d4aUL, 0x07b03af8UL, 0x1a8ae327UL, 0x21e0b495UL,
+    0x17c5ba74UL, 0x2cafedc6UL, 0x31953419UL, 0x0aff63abUL, 0x0964a38eUL, 0x320ef43cUL,
+    0x2f342de3UL, 0x145e7a51UL, 0x2a8789a9UL, 0x11edde1bUL, 0x0cd707c4UL, 0x37bd5076UL,
+    0x34269053UL, 0x0f4cc7e1UL, 0x12761e3eUL, 0x291c498cUL, 0x3dd1d8c7UL, 0x06bb8f75UL,
+    0x1b8156aaUL, 0x20eb0118UL, 0x2370c13dUL, 0x181a968fUL, 0x05204f50UL, 0x3e4a18e2UL,
+    0x0093eb1aUL, 0x3bf9bca8UL, 0x26c36577UL, 0x1da932c5UL, 0x1e32f2e0UL, 0x2558a552UL,
+    0x38627c8dUL, 0x03082b3fUL, 0x08125312UL, 0x337804a0UL, 0x2e42dd7fUL, 0x15288acdUL,
+    0x16b34ae8UL, 0x2dd91d5aUL, 0x30e3c485UL, 0x0b899337UL, 0x355060cfUL, 0x0e3a377dUL,
+    0x1300eea2UL, 0x286ab910UL, 0x2bf17935UL, 0x109b2e87UL, 0x0da1f758UL, 0x36cba0eaUL,
+    0x220631a1UL, 0x196c6613UL, 0x0456bfccUL, 0x3f3ce87eUL, 0x3ca7285bUL, 0x07cd7fe9UL,
+    0x1af7a636UL, 0x219df184UL, 0x1f44027cUL, 0x242e55ceUL, 0x39148c11UL, 0x027edba3UL,
+    0x01e51b86UL, 0x3a8f4c34UL, 0x27b595ebUL, 0x1cdfc259UL, 0x07e1bd59UL, 0x3c8beaebUL,
+    0x21b13334UL, 0x1adb6486UL, 0x1940a4a3UL, 0x222af311UL, 0x3f102aceUL, 0x047a7d7cUL,
+    0x3aa38e84UL, 0x01c9d936UL, 0x1cf300e9UL, 0x2799575bUL, 0x2402977eUL, 0x1f68c0ccUL,
+    0x02521913UL, 0x39384ea1UL, 0x2df5dfeaUL, 0x169f8858UL, 0x0ba55187UL, 0x30cf0635UL,
+    0x3354c610UL, 0x083e91a2UL, 0x1504487dUL, 0x2e6e1fcfUL, 0x10b7ec37UL, 0x2bddbb85UL,
+    0x36e7625aUL, 0x0d8d35e8UL, 0x0e16f5cdUL, 0x357ca27fUL, 0x28467ba0UL, 0x132c2c12UL,
+    0x1836543fUL, 0x235c038dUL, 0x3e66da52UL, 0x050c8de0UL, 0x06974dc5UL, 0x3dfd1a77UL,
+    0x20c7c3a8UL, 0x1bad941aUL, 0x257467e2UL, 0x1e1e3050UL, 0x0324e98fUL, 0x384ebe3dUL,
+    0x3bd57e18UL, 0x00bf29aaUL, 0x1d85f075UL, 0x26efa7c7UL, 0x3222368cUL, 0x0948613eUL,
+    0x1472b8e1UL, 0x2f18ef53UL, 0x2c832f76UL, 0x17e978c4UL, 0x0ad3a11bUL, 0x31b9f6a9UL,
+    0x0f600551UL, 0x340a52e3UL, 0x29308b3cUL, 0x125adc8eUL, 0x11c11cabUL, 0x2aab4b19UL,
+    0x379192c6UL, 0x0cfbc574UL, 0x3adecb95UL, 0x01b49c27UL, 0x1c8e45f8UL, 0x27e4124aUL,
+    0x247fd26fUL, 0x1f1585ddUL, 0x022f5c02UL, 0x39450bb0UL, 0x079cf848UL, 0x3cf6affaUL,
+    0x21cc7625UL, 0x1aa62197UL, 0x193de1b2UL, 0x2257b600UL, 0x3f6d6fdfUL, 0x0407386dUL,
+    0x10caa926UL, 0x2ba0fe94UL, 0x369a274bUL, 0x0df070f9UL, 0x0e6bb0dcUL, 0x3501e76eUL,
+    0x283b3eb1UL, 0x13516903UL, 0x2d889afbUL, 0x16e2cd49UL, 0x0bd81496UL, 0x30b24324UL,
+    0x33298301UL, 0x0843d4b3UL, 0x15790d6cUL, 0x2e135adeUL, 0x250922f3UL, 0x1e637541UL,
+    0x0359ac9eUL, 0x3833fb2cUL, 0x3ba83b09UL, 0x00c26cbbUL, 0x1df8b564UL, 0x2692e2d6UL,
+    0x184b112eUL, 0x2321469cUL, 0x3e1b9f43UL, 0x0571c8f1UL, 0x06ea08d4UL, 0x3d805f66UL,
+    0x20ba86b9UL, 0x1bd0d10bUL, 0x0f1d4040UL, 0x347717f2UL, 0x294dce2dUL, 0x1227999fUL,
+    0x11bc59baUL, 0x2ad60e08UL, 0x37ecd7d7UL, 0x0c868065UL, 0x325f739dUL, 0x0935242fUL,
+    0x140ffdf0UL, 0x2f65aa42UL, 0x2cfe6a67UL, 0x17943dd5UL, 0x0aaee40aUL, 0x31c4b3b8UL,
+    0x2d1b71e1UL, 0x16712653UL, 0x0b4bff8cUL, 0x3021a83eUL, 0x33ba681bUL, 0x08d03fa9UL,
+    0x15eae676UL, 0x2e80b1c4UL, 0x1059423cUL, 0x2b33158eUL, 0x3609cc51UL, 0x0d639be3UL,
+    0x0ef85bc6UL, 0x35920c74UL, 0x28a8d5abUL, 0x13c28219UL, 0x070f1352UL, 0x3c6544e0UL,
+    0x215f9d3fUL, 0x1a35ca8dUL, 0x19ae0aa8UL, 0x22c45d1aUL, 0x3ffe84c5UL, 0x0494d377UL,
+    0x3a4d208fUL, 0x0127773dUL, 0x1c1daee2UL, 0x2777f950UL, 0x24ec3975UL, 0x1f866ec7UL,
+    0x02bcb718UL, 0x39d6e0aaUL, 0x32cc9887UL, 0x09a6cf35UL, 0x149c16eaUL, 0x2ff64158UL,
+    0x2c6d817dUL, 0x1707d6cfUL, 0x0a3d0f10UL, 0x315758a2UL, 0x0f8eab5aUL, 0x34e4fce8UL,
+    0x29de2537UL, 0x12b47285UL, 0x112fb2a0UL, 0x2a45e512UL, 0x377f3ccdUL, 0x0c156b7fUL,
+    0x18d8fa34UL, 0x23b2ad86UL, 0x3e887459UL, 0x05e223ebUL, 0x0679e3ceUL, 0x3d13b47cUL,
+    0x20296da3UL, 0x1b433a11UL, 0x259ac9e9UL, 0x1ef09e5bUL, 0x03ca4784UL, 0x38a01036UL,
+    0x3b3bd013UL, 0x005187a1UL, 0x1d6b5e7eUL, 0x260109ccUL, 0x1024072dUL, 0x2b4e509fUL,
+    0x36748940UL, 0x0d1edef2UL, 0x0e851ed7UL, 0x35ef4965UL, 0x28d590baUL, 0x13bfc708UL,
+    0x2d6634f0UL, 0x160c6342UL, 0x0b36ba9dUL, 0x305ced2fUL, 0x33c72d0aUL, 0x08ad7ab8UL,
+    0x1597a367UL, 0x2efdf4d5UL, 0x3a30659eUL, 0x015a322cUL, 0x1c60ebf3UL, 0x270abc41UL,
+    0x24917c64UL, 0x1ffb2bd6UL, 0x02c1f209UL, 0x39aba5bbUL, 0x07725643UL, 0x3c1801f1UL,
+    0x2122d82eUL, 0x1a488f9cUL, 0x19d34fb9UL, 0x22b9180bUL, 0x3f83c1d4UL, 0x04e99666UL,
+    0x0ff3ee4bUL, 0x3499b9f9UL, 0x29a36026UL, 0x12c93794UL, 0x1152f7b1UL, 0x2a38a003UL,
+    0x370279dcUL, 0x0c682e6eUL, 0x32b1dd96UL, 0x09db8a24UL, 0x14e153fbUL, 0x2f8b0449UL,
+    0x2c10c46cUL, 0x177a93deUL, 0x0a404a01UL, 0x312a1db3UL, 0x25e78cf8UL, 0x1e8ddb4aUL,
+    0x03b70295UL, 0x38dd5527UL, 0x3b469502UL, 0x002cc2b0UL, 0x1d161b6fUL, 0x267c4cddUL,
+    0x18a5bf25UL, 0x23cfe897UL, 0x3ef53148UL, 0x059f66faUL, 0x0604a6dfUL, 0x3d6ef16dUL,
+    0x205428b2UL, 0x1b3e7f00UL, 0x0d537a9bUL, 0x36392d29UL, 0x2b03f4f6UL, 0x1069a344UL,
+    0x13f26361UL, 0x289834d3UL, 0x35a2ed0cUL, 0x0ec8babeUL, 0x30114946UL, 0x0b7b1ef4UL,
+    0x1641c72bUL, 0x2d2b9099UL, 0x2eb050bcUL, 0x15da070eUL, 0x08e0ded1UL, 0x338a8963UL,
+    0x27471828UL, 0x1c2d4f9aUL, 0x01179645UL, 0x3a7dc1f7UL, 0x39e601d2UL, 0x028c5660UL,
+    0x1fb68fbfUL, 0x24dcd80dUL, 0x1a052bf5UL, 0x216f7c47UL, 0x3c55a598UL, 0x073ff22aUL,
+    0x04a4320fUL, 0x3fce65bdUL, 0x22f4bc62UL, 0x199eebd0UL, 0x128493fdUL, 0x29eec44fUL,
+    0x34d41d90UL, 0x0fbe4a22UL, 0x0c258a07UL, 0x374fddb5UL, 0x2a75046aUL, 0x111f53d8UL,
+    0x2fc6a020UL, 0x14acf792UL, 0x09962e4dUL, 0x32fc79ffUL, 0x3167b9daUL, 0x0a0dee68UL,
+    0x173737b7UL, 0x2c5d6005UL, 0x3890f14eUL, 0x03faa6fcUL, 0x1ec07f23UL, 0x25aa2891UL,
+    0x2631e8b4UL, 0x1d5bbf06UL, 0x006166d9UL, 0x3b0b316bUL, 0x05d2c293UL, 0x3eb89521UL,
+    0x23824cfeUL, 0x18e81b4cUL, 0x1b73db69UL, 0x20198cdbUL, 0x3d235504UL, 0x064902b6UL,
+    0x306c0c57UL, 0x0b065be5UL, 0x163c823aUL, 0x2d56d588UL, 0x2ecd15adUL, 0x15a7421fUL,
+    0x089d9bc0UL, 0x33f7cc72UL, 0x0d2e3f8aUL, 0x36446838UL, 0x2b7eb1e7UL, 0x1014e655UL,
+    0x138f2670UL, 0x28e571c2UL, 0x35dfa81dUL, 0x0eb5ffafUL, 0x1a786ee4UL, 0x21123956UL,
+    0x3c28e089UL, 0x0742b73bUL, 0x04d9771eUL, 0x3fb320acUL, 0x2289f973UL, 0x19e3aec1UL,
+    0x273a5d39UL, 0x1c500a8bUL, 0x016ad354UL, 0x3a0084e6UL, 0x399b44c3UL, 0x02f11371UL,
+    0x1fcbcaaeUL, 0x24a19d1cUL, 0x2fbbe531UL, 0x14d1b283UL, 0x09eb6b5cUL, 0x32813ceeUL,
+    0x311afccbUL, 0x0a70ab79UL, 0x174a72a6UL, 0x2c202514UL, 0x12f9d6ecUL, 0x2993815eUL,
+    0x34a95881UL, 0x0fc30f33UL, 0x0c58cf16UL, 0x373298a4UL, 0x2a08417bUL, 0x116216c9UL,
+    0x05af8782UL, 0x3ec5d030UL, 0x23ff09efUL, 0x18955e5dUL, 0x1b0e9e78UL, 0x2064c9caUL,
+    0x3d5e1015UL, 0x063447a7UL, 0x38edb45fUL, 0x0387e3edUL, 0x1ebd3a32UL, 0x25d76d80UL,
+    0x264cada5UL, 0x1d26fa17UL, 0x001c23c8UL, 0x3b76747aUL, 0x27a9b623UL, 0x1cc3e191UL,
+    0x01f9384eUL, 0x3a936ffcUL, 0x3908afd9UL, 0x0262f86bUL, 0x1f5821b4UL, 0x24327606UL,
+    0x1aeb85feUL, 0x2181d24cUL, 0x3cbb0b93UL, 0x07d15c21UL, 0x044a9c04UL, 0x3f20cbb6UL,
+    0x221a1269UL, 0x197045dbUL, 0x0dbdd490UL, 0x36d78322UL, 0x2bed5afdUL, 0x10870d4fUL,
+    0x131ccd6aUL, 0x28769ad8UL, 0x354c4307UL, 0x0e2614b5UL, 0x30ffe74dUL, 0x0b95b0ffUL,
+    0x16af6920UL, 0x2dc53e92UL, 0x2e5efeb7UL, 0x1534a905UL, 0x080e70daUL, 0x33642768UL,
+    0x387e5f45UL, 0x031408f7UL, 0x1e2ed128UL, 0x2544869aUL, 0x26df46bfUL, 0x1db5110dUL,
+    0x008fc8d2UL, 0x3be59f60UL, 0x053c6c98UL, 0x3e563b2aUL, 0x236ce2f5UL, 0x1806b547UL,
+    0x1b9d7562UL, 0x20f722d0UL, 0x3dcdfb0fUL, 0x06a7acbdUL, 0x126a3df6UL, 0x29006a44UL,
+    0x343ab39bUL, 0x0f50e429UL, 0x0ccb240cUL, 0x37a173beUL, 0x2a9baa61UL, 0x11f1fdd3UL,
+    0x2f280e2bUL, 0x14425999UL, 0x09788046UL, 0x3212d7f4UL, 0x318917d1UL, 0x0ae34063UL,
+    0x17d999bcUL, 0x2cb3ce0eUL, 0x1a96c0efUL, 0x21fc975dUL, 0x3cc64e82UL, 0x07ac1930UL,
+    0x0437d915UL, 0x3f5d8ea7UL, 0x22675778UL, 0x190d00caUL, 0x27d4f332UL, 0x1cbea480UL,
+    0x01847d5fUL, 0x3aee2aedUL, 0x3975eac8UL, 0x021fbd7aUL, 0x1f2564a5UL, 0x244f3317UL,
+    0x3082a25cUL, 0x0be8f5eeUL, 0x16d22c31UL, 0x2db87b83UL, 0x2e23bba6UL, 0x1549ec14UL,
+    0x087335cbUL, 0x33196279UL, 0x0dc09181UL, 0x36aac633UL, 0x2b901fecUL, 0x10fa485eUL,
+    0x1361887bUL, 0x280bdfc9UL, 0x35310616UL, 0x0e5b51a4UL, 0x05412989UL, 0x3e2b7e3bUL,
+    0x2311a7e4UL, 0x187bf056UL, 0x1be03073UL, 0x208a67c1UL, 0x3db0be1eUL, 0x06dae9acUL,
+    0x38031a54UL, 0x03694de6UL, 0x1e539439UL, 0x2539c38bUL, 0x26a203aeUL, 0x1dc8541cUL,
+    0x00f28dc3UL, 0x3b98da71UL, 0x2f554b3aUL, 0x143f1c88UL, 0x0905c557UL, 0x326f92e5UL,
+    0x31f452c0UL, 0x0a9e0572UL, 0x17a4dcadUL, 0x2cce8b1fUL, 0x121778e7UL, 0x297d2f55UL,
+    0x3447f68aUL, 0x0f2da138UL, 0x0cb6611dUL, 0x37dc36afUL, 0x2ae6ef70UL, 0x118cb8c2UL,
+    0x0ab2c7c2UL, 0x31d89070UL, 0x2ce249afUL, 0x17881e1dUL, 0x1413de38UL, 0x2f79898aUL,
+    0x32435055UL, 0x092907e7UL, 0x37f0f41fUL, 0x0c9aa3adUL, 0x11a07a72UL, 0x2aca2dc0UL,
+    0x2951ede5UL, 0x123bba57UL, 0x0f016388UL, 0x346b343aUL, 0x20a6a571UL, 0x1bccf2c3UL,
+    0x06f62b1cUL, 0x3d9c7caeUL, 0x3e07bc8bUL, 0x056deb39UL, 0x185732e6UL, 0x233d6554UL,
+    0x1de496acUL, 0x268ec11eUL, 0x3bb418c1UL, 0x00de4f73UL, 0x03458f56UL, 0x382fd8e4UL,
+    0x2515013bUL, 0x1e7f5689UL, 0x15652ea4UL, 0x2e0f7916UL, 0x3335a0c9UL, 0x085ff77bUL,
+    0x0bc4375eUL, 0x30ae60ecUL, 0x2d94b933UL, 0x16feee81UL, 0x28271d79UL, 0x134d4acbUL,
+    0x0e779314UL, 0x351dc4a6UL, 0x36860483UL, 0x0dec5331UL, 0x10d68aeeUL, 0x2bbcdd5cUL,
+    0x3f714c17UL, 0x041b1ba5UL, 0x1921c27aUL, 0x224b95c8UL, 0x21d055edUL, 0x1aba025fUL,
+    0x0780db80UL, 0x3cea8c32UL, 0x02337fcaUL, 0x39592878UL, 0x2463f1a7UL, 0x1f09a615UL,
+    0x1c926630UL, 0x27f83182UL, 0x3ac2e85dUL, 0x01a8bfefUL, 0x378db10eUL, 0x0ce7e6bcUL,
+    0x11dd3f63UL, 0x2ab768d1UL, 0x292ca8f4UL, 0x1246ff46UL, 0x0f7c2699UL, 0x3416712bUL,
+    0x0acf82d3UL, 0x31a5d561UL, 0x2c9f0cbeUL, 0x17f55b0cUL, 0x146e9b29UL, 0x2f04cc9bUL,
+    0x323e1544UL, 0x095442f6UL, 0x1d99d3bdUL, 0x26f3840fUL, 0x3bc95dd0UL, 0x00a30a62UL,
+    0x0338ca47UL, 0x38529df5UL, 0x2568442aUL, 0x1e021398UL, 0x20dbe060UL, 0x1bb1b7d2UL,
+    0x068b6e0dUL, 0x3de139bfUL, 0x3e7af99aUL, 0x0510ae28UL, 0x182a77f7UL, 0x23402045UL,
+    0x285a5868UL, 0x13300fdaUL, 0x0e0ad605UL, 0x356081b7UL, 0x36fb4192UL, 0x0d911620UL,
+    0x10abcfffUL, 0x2bc1984dUL, 0x15186bb5UL, 0x2e723c07UL, 0x3348e5d8UL, 0x0822b26aUL,
+    0x0bb9724fUL, 0x30d325fdUL, 0x2de9fc22UL, 0x1683ab90UL, 0x024e3adbUL, 0x39246d69UL,
+    0x241eb4b6UL, 0x1f74e304UL, 0x1cef2321UL, 0x27857493UL, 0x3abfad4cUL, 0x01d5fafeUL,
+    0x3f0c0906UL, 0x04665eb4UL, 0x195c876bUL, 0x2236d0d9UL, 0x21ad10fcUL, 0x1ac7474eUL,
+    0x07fd9e91UL, 0x3c97c923UL, 0x20480b7aUL, 0x1b225cc8UL, 0x06188517UL, 0x3d72d2a5UL,
+    0x3ee91280UL, 0x05834532UL, 0x18b99cedUL, 0x23d3cb5fUL, 0x1d0a38a7UL, 0x26606f15UL,
+    0x3b5ab6caUL, 0x0030e178UL, 0x03ab215dUL, 0x38c176efUL, 0x25fbaf30UL, 0x1e91f882UL,
+    0x0a5c69c9UL, 0x31363e7bUL, 0x2c0ce7a4UL, 0x1766b016UL, 0x14fd7033UL, 0x2f972781UL,
+    0x32adfe5eUL, 0x09c7a9ecUL, 0x371e5a14UL, 0x0c740da6UL, 0x114ed479UL, 0x2a2483cbUL,
+    0x29bf43eeUL, 0x12d5145cUL, 0x0fefcd83UL, 0x34859a31UL, 0x3f9fe21cUL, 0x04f5b5aeUL,
+    0x19cf6c71UL, 0x22a53bc3UL, 0x213efbe6UL, 0x1a54ac54UL, 0x076e758bUL, 0x3c042239UL,
+    0x02ddd1c1UL, 0x39b78673UL, 0x248d5facUL, 0x1fe7081eUL, 0x1c7cc83bUL, 0x27169f89UL,
+    0x3a2c4656UL, 0x014611e4UL, 0x158b80afUL, 0x2ee1d71dUL, 0x33db0ec2UL, 0x08b15970UL,
+    0x0b2a9955UL, 0x3040cee7UL, 0x2d7a1738UL, 0x1610408aUL, 0x28c9b372UL, 0x13a3e4c0UL,
+    0x0e993d1fUL, 0x35f36aadUL, 0x3668aa88UL, 0x0d02fd3aUL, 0x103824e5UL, 0x2b527357UL,
+    0x1d777db6UL, 0x261d2a04UL, 0x3b27f3dbUL, 0x004da469UL, 0x03d6644cUL, 0x38bc33feUL,
+    0x2586ea21UL, 0x1eecbd93UL, 0x20354e6bUL, 0x1b5f19d9UL, 0x0665c006UL, 0x3d0f97b4UL,
+    0x3e945791UL, 0x05fe0023UL, 0x18c4d9fcUL, 0x23ae8e4eUL, 0x37631f05UL, 0x0c0948b7UL,
+    0x11339168UL, 0x2a59c6daUL, 0x29c206ffUL, 0x12a8514dUL, 0x0f928892UL, 0x34f8df20UL,
+    0x0a212cd8UL, 0x314b7b6aUL, 0x2c71a2b5UL, 0x171bf507UL, 0x14803522UL, 0x2fea6290UL,
+    0x32d0bb4fUL, 0x09baecfdUL, 0x02a094d0UL, 0x39cac362UL, 0x24f01abdUL, 0x1f9a4d0fUL,
+    0x1c018d2aUL, 0x276bda98UL, 0x3a510347UL, 0x013b54f5UL, 0x3fe2a70dUL, 0x0488f0bfUL,
+    0x19b22960UL, 0x22d87ed2UL, 0x2143bef7UL, 0x1a29e945UL, 0x0713309aUL, 0x3c796728UL,
+    0x28b4f663UL, 0x13dea1d1UL, 0x0ee4780eUL, 0x358e2fbcUL, 0x3615ef99UL, 0x0d7fb82bUL,
+    0x104561f4UL, 0x2b2f3646UL, 0x15f6c5beUL, 0x2e9c920cUL, 0x33a64bd3UL, 0x08cc1c61UL,
+    0x0b57dc44UL, 0x303d8bf6UL, 0x2d075229UL, 0x166d059bUL
+};
+
+static uint32_t bech32_polymod_step2(uint32_t pre, int v1, int v2) {
+    return ((pre & 0xFFFFF) << 10) ^ polymod_table[pre >> 20] ^ (v1 << 5) ^ v2;
+}
+
+/* Feed 'len' symbols into the checksum, two at a time. */
+static uint32_t bech32_polymod_symbols(uint32_t chk, const uint8_t *v, size_t len) {
+    size_t i;
+    for (i = 0; i + 2 <= len; i += 2) {
+        chk = bech32_polymod_step2(chk, v[i], v[i + 1]);
+    }
+    if (i < len) {
+        chk = bech32_polymod_step(chk) ^ v[i];
+    }
+    return chk;
+}
+
+/* Checksum of the expanded human readable part: the high bits of each
+ * character, a zero, then the low bits of each character. */
+static uint32_t bech32_polymod_hrp(const char *hrp, size_t hrp_len) {
+    uint8_t expanded[84 * 2 + 1];
+    size_t i;
+    for (i = 0; i < hrp_len; ++i) {
+        expanded[i] = (uint8_t)hrp[i] >> 5;
+        expanded[hrp_len + 1 + i] = hrp[i] & 0x1f;
+    }
+    expanded[hrp_len] = 0;
+    return bech32_polymod_symbols(1, expanded, hrp_len * 2 + 1);
+}
+
 static const char* charset = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
 
 static const int8_t charset_rev[128] = {
@@ -48,8 +259,8 @@ static const int8_t charset_rev[128] = {
 };
 
 int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t data_len) {
-    uint32_t chk = 1;
-    size_t i = 0;
+    uint32_t chk;
+    size_t i = 0, hrp_len;
     while (hrp[i] != 0) {
         int ch = hrp[i];
         if (ch < 33 || ch > 126) {
@@ -57,24 +268,23 @@ int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t dat
         }
 
         if (ch >= 'A' && ch <= 'Z') return 0;
-        chk = bech32_polymod_step(chk) ^ (ch >> 5);
         ++i;
     }
-    if (i + 7 + data_len > 90) return 0;
-    chk = bech32_polymod_step(chk);
-    while (*hrp != 0) {
-        chk = bech32_polymod_step(chk) ^ (*hrp & 0x1f);
-        *(output++) = *(hrp++);
-    }
+    hrp_len = i;
+    if (hrp_len > 83 || hrp_len + 7 + data_len > 90) return 0;
+    chk = bech32_polymod_hrp(hrp, hrp_len);
+    memcpy(output, hrp, hrp_len);
+    output += hrp_len;
     *(output++) = '1';
     for (i = 0; i < data_len; ++i) {
-        if (*data >> 5) return 0;
-        chk = bech32_polymod_step(chk) ^ (*data);
-        *(output++) = charset[*(data++)];
-    }
-    for (i = 0; i < 6; ++i) {
-        chk = bech32_polymod_step(chk);
+        if (data[i] >> 5) return 0;
+        *(output++) = charset[data[i]];
     }
+    chk = bech32_polymod_symbols(chk, data, data_len);
+    /* six zero symbols for the checksum itself */
+    chk = bech32_polymod_step2(chk, 0, 0);
+    chk = bech32_polymod_step2(chk, 0, 0);
+    chk = bech32_polymod_step2(chk, 0, 0);
     chk ^= 1;
     for (i = 0; i < 6; ++i) {
         *(output++) = charset[(chk >> ((5 - i) * 5)) & 0x1f];
@@ -84,10 +294,11 @@ int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t dat
 }
 
 int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input) {
-    uint32_t chk = 1;
+    uint32_t chk;
     size_t i;
     size_t input_len = strlen(input);
     size_t hrp_len;
+    uint8_t values[90];
     int have_lower = 0, have_upper = 0;
     if (input_len < 8 || input_len > 90) {
         return 0;
@@ -113,13 +324,8 @@ int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input)
             ch = (ch - 'A') + 'a';
         }
         hrp[i] = ch;
-        chk = bech32_polymod_step(chk) ^ (ch >> 5);
     }
     hrp[i] = 0;
-    chk = bech32_polymod_step(chk);
-    for (i = 0; i < hrp_len; ++i) {
-        chk = bech32_polymod_step(chk) ^ (input[i] & 0x1f);
-    }
     ++i;
     while (i < input_len) {
         int v = (input[i] & 0x80) ? -1 : charset_rev[(int)input[i]];
@@ -128,18 +334,150 @@ int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input)
         if (v == -1) {
             return 0;
         }
-        chk = bech32_polymod_step(chk) ^ v;
-        if (i + 6 < input_len) {
-            data[i - (1 + hrp_len)] = v;
-        }
+        values[i - (1 + hrp_len)] = v;
         ++i;
     }
     if (have_lower && have_upper) {
         return 0;
     }
+    memcpy(data, values, *data_len);
+    chk = bech32_polymod_hrp(hrp, hrp_len);
+    chk = bech32_polymod_symbols(chk, values, *data_len + 6);
     return chk == 1;
 }
 
+/* Error correction: the checksum is a BCH code with minimum distance 5, so
+ * up to two substituted symbols can be located and corrected.  The checksum
+ * is linear, so an error of value e, d symbols from the end, changes the
+ * residue (final checksum ^ 1) by the checksum of e followed by d zeros.
+ * The residue of the received string is the syndrome: it is zero if there
+ * are no errors, equals one such term for one error, or the XOR of two
+ * terms for two errors. */
+
+struct bech32_error {
+    uint32_t syndrome;
+    uint8_t distance;
+    uint8_t value;
+};
+
+static int bech32_error_compare(const void *a, const void *b) {
+    uint32_t x = ((const struct bech32_error *)a)->syndrome;
+    uint32_t y = ((const struct bech32_error *)b)->syndrome;
+    return x < y ? -1 : x > y;
+}
+
+/* The syndrome of an error depends only on its value and distance from the
+ * end, so one table of every single symbol error, sorted by syndrome, serves
+ * every length, ignoring errors further from the end than the data. */
+#define BECH32_MAX_DATA_LEN 90
+
+static struct bech32_error bech32_errors[BECH32_MAX_DATA_LEN * 31];
+static pthread_once_t bech32_errors_once = PTHREAD_ONCE_INIT;
+
+static void bech32_errors_init(void) {
+    uint32_t basis[5];
+    size_t d;
+    int bit, e;
+
+    for (bit = 0; bit < 5; ++bit) {
+        basis[bit] = 1 << bit;
+    }
+    for (d = 0; d < BECH32_MAX_DATA_LEN; ++d) {
+        for (e = 1; e < 32; ++e) {
+            struct bech32_error *error = &bech32_errors[d * 31 + (e - 1)];
+            error->syndrome = 0;
+            for (bit = 0; bit < 5; ++bit) {
+                if ((e >> bit) & 1) error->syndrome ^= basis[bit];
+            }
+            error->distance = d;
+            error->value = e;
+        }
+        for (bit = 0; bit < 5; ++bit) {
+            basis[bit] = bech32_polymod_step(basis[bit]);
+        }
+    }
+    qsort(bech32_errors, BECH32_MAX_DATA_LEN * 31, sizeof(bech32_errors[0]), bech32_error_compare);
+}
+
+/* the single error within data_len symbols with this syndrome, or NULL */
+static const struct bech32_error *bech32_find_error(uint32_t syndrome, size_t data_len) {
+    struct bech32_error key;
+    const struct bech32_error *found;
+
+    key.syndrome = syndrome;
+    found = bsearch(&key, bech32_errors, BECH32_MAX_DATA_LEN * 31, sizeof(bech32_errors[0]), bech32_error_compare);
+    return found && found->distance < data_len ? found : NULL;
+}
+
+int bech32_correct(char *output, size_t *error_positions, size_t *error_count, const char *input) {
+    uint8_t values[90];
+    const struct bech32_error *found;
+    uint32_t residue;
+    size_t input_len, hrp_len, data_len, i, solutions = 0;
+
+    *error_count = 0;
+    for (input_len = 0; input_len <= 90 && input[input_len] != 0; ++input_len) {
+    }
+    if (input_len < 8 || input_len > 90) return 0;
+    for (hrp_len = input_len - 1; hrp_len > 0 && input[hrp_len] != '1'; --hrp_len) {
+    }
+    data_len = input_len - (1 + hrp_len);
+    if (hrp_len == 0 || data_len < 6) return 0;
+
+    for (i = 0; i < input_len; ++i) {
+        int ch = input[i];
+        if (ch < 33 || ch > 126) return 0;
+        output[i] = (ch >= 'A' && ch <= 'Z') ? (ch - 'A') + 'a' : ch;
+    }
+    output[input_len] = 0;
+    /* characters outside the charset are errors too, start them at zero */
+    for (i = 0; i < data_len; ++i) {
+        int v = charset_rev[(int)output[hrp_len + 1 + i]];
+        values[i] = v == -1 ? 0 : v;
+    }
+
+    residue = bech32_polymod_symbols(bech32_polymod_hrp(output, hrp_len), values, data_len) ^ 1;
+
+    if (residue != 0) {
+        pthread_once(&bech32_errors_once, bech32_errors_init);
+
+        /* one error? */
+        found = bech32_find_error(residue, data_len);
+        if (found) {
+            values[data_len - 1 - found->distance] ^= found->value;
+        } else {
+            /* two errors?  distance 5 means there is at most one pair, but
+             * don't trust a second one if there is */
+            struct bech32_error first = { 0, 0, 0 }, second = { 0, 0, 0 };
+            for (i = 0; i < BECH32_MAX_DATA_LEN * 31; ++i) {
+                const struct bech32_error *error = &bech32_errors[i];
+                if (error->distance >= data_len) continue;
+                found = bech32_find_error(residue ^ error->syndrome, data_len);
+                if (found && found->distance > error->distance) {
+                    first = *error;
+                    second = *found;
+                    ++solutions;
+                }
+            }
+            if (solutions != 1) return 0;
+            values[data_len - 1 - first.distance] ^= first.value;
+            values[data_len - 1 - second.distance] ^= second.value;
+        }
+    }
+
+    /* characters outside the charset count as changed even if they were
+     * meant to be the zero they started as */
+    for (i = 0; i < data_len; ++i) {
+        char ch = charset[values[i]];
+        if (output[hrp_len + 1 + i] != ch) {
+            if (*error_count == 2) return 0;
+            error_positions[(*error_count)++] = hrp_len + 1 + i;
+            output[hrp_len + 1 + i] = ch;
+        }
+    }
+    return 1;
+}
+
 static int convert_bits(uint8_t* out, size_t* outlen, int outbits, const uint8_t* in, size_t inlen, int inbits, int pad) {
     uint32_t val = 0;
     int bits = 0;
@@ -174,18 +512,75 @@ int segwit_addr_encode(char *output, const char *hrp, int witver, const uint8_t
     return bech32_encode(output, hrp, data, datalen);
 }
 
+int segwit_addr_decode_any(char *hrp, int *witver, uint8_t *witdata, size_t *witdata_len, const char *addr) {
+    uint8_t values[90];
+    size_t input_len, hrp_len, data_len, i;
+    int have_lower = 0, have_upper = 0;
+    uint32_t chk, val = 0;
+    int bits = 0;
+
+    /* find the separator, the last '1' */
+    for (input_len = 0; input_len <= 90 && addr[input_len] != 0; ++input_len) {
+    }
+    if (input_len < 8 || input_len > 90) return 0;
+    for (hrp_len = input_len - 1; hrp_len > 0 && addr[hrp_len] != '1'; --hrp_len) {
+    }
+    data_len = input_len - (1 + hrp_len);
+    /* version, at least 2 bytes of program (4 symbols), and checksum */
+    if (hrp_len == 0 || data_len < 1 + 6) return 0;
+    data_len -= 6;
+    if (data_len > 65) return 0;
+
+    for (i = 0; i < hrp_len; ++i) {
+        int ch = addr[i];
+        if (ch < 33 || ch > 126) return 0;
+        if (ch >= 'a' && ch <= 'z') {
+            have_lower = 1;
+        } else if (ch >= 'A' && ch <= 'Z') {
+            have_upper = 1;
+            ch = (ch - 'A') + 'a';
+        }
+        hrp[i] = ch;
+    }
+    hrp[hrp_len] = 0;
+
+    /* map the data part to symbols, and regroup the program (everything
+     * after the version) from 5 bit symbols into bytes as we go */
+    *witdata_len = 0;
+    for (i = 0; i < data_len + 6; ++i) {
+        int ch = addr[hrp_len + 1 + i];
+        int v = (ch & 0x80) ? -1 : charset_rev[ch];
+        if (v == -1) return 0;
+        if (ch >= 'a' && ch <= 'z') have_lower = 1;
+        if (ch >= 'A' && ch <= 'Z') have_upper = 1;
+        values[i] = v;
+        if (i > 0 && i < data_len) {
+            val = (val << 5) | v;
+            bits += 5;
+            if (bits >= 8) {
+                bits -= 8;
+                if (*witdata_len >= 40) return 0;
+                witdata[(*witdata_len)++] = (val >> bits) & 0xff;
+            }
+        }
+    }
+    if (have_lower && have_upper) return 0;
+    /* no more than 4 bits of zero padding */
+    if (bits >= 5 || ((val << (8 - bits)) & 0xff)) return 0;
+
+    chk = bech32_polymod_hrp(hrp, hrp_len);
+    if (bech32_polymod_symbols(chk, values, data_len + 6) != 1) return 0;
+
+    if (values[0] > 16) return 0;
+    if (*witdata_len < 2 || *witdata_len > 40) return 0;
+    if (values[0] == 0 && *witdata_len != 20 && *witdata_len != 32) return 0;
+    *witver = values[0];
+    return 1;
+}
+
 int segwit_addr_decode(int* witver, uint8_t* witdata, size_t* witdata_len, const char* hrp, const char* addr) {
-    uint8_t data[84];
     char hrp_actual[84];
-    size_t data_len;
-    if (!bech32_decode(hrp_actual, data, &data_len, addr)) return 0;
-    if (data_len == 0 || data_len > 65) return 0;
+    if (!segwit_addr_decode_any(hrp_actual, witver, witdata, witdata_len, addr)) return 0;
     if (strncmp(hrp, hrp_actual, 84) != 0) return 0;
-    if (data[0] > 16) return 0;
-    *witdata_len = 0;
-    if (!convert_bits(witdata, witdata_len, 8, data + 1, data_len - 1, 5, 0)) return 0;
-    if (*witdata_len < 2 || *witdata_len > 40) return 0;
-    if (data[0] == 0 && *witdata_len != 20 && *witdata_len != 32) return 0;
-    *witver = data[0];
     return 1;
 }
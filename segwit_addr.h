@@ -22,6 +22,7 @@
 #ifndef _SEGWIT_ADDR_H_
 #define _SEGWIT_ADDR_H_ 1
 
+#include <stddef.h>
 #include <stdint.h>
 
 /** Encode a SegWit address
@@ -64,6 +65,52 @@ int segwit_addr_decode(
     const char* addr
 );
 
+/** Decode a SegWit address with any human readable part, in one pass which
+ *  checks the checksum, human readable part, witness version and program
+ *  together.
+ *
+ *  Out: hrp:      Pointer to a buffer of size 84 that will be updated to
+ *                 contain the null-terminated, lower case, human readable part.
+ *       ver:      Pointer to an int that will be updated to contain the witness
+ *                 program version (between 0 and 16 inclusive).
+ *       prog:     Pointer to a buffer of size 40 that will be updated to
+ *                 contain the witness program bytes.
+ *       prog_len: Pointer to a size_t that will be updated to contain the length
+ *                 of bytes in prog.
+ *  In:  addr:     Pointer to the null-terminated address.
+ *  Returns 1 if successful.
+ */
+int segwit_addr_decode_any(
+    char *hrp,
+    int *ver,
+    uint8_t *prog,
+    size_t *prog_len,
+    const char *addr
+);
+
+/** Correct up to two substituted characters in the data part of a Bech32
+ *  string, using its checksum.  This only finds a string with a valid
+ *  checksum, the caller should still decode it, and show the changes to the
+ *  user rather than trusting the result blindly.
+ *
+ *  Out: output:          Pointer to a buffer of size strlen(input) + 1 that
+ *                        will be updated to contain the null-terminated, lower
+ *                        case, corrected string.
+ *       error_positions: Pointer to an array of 2 that will be updated to
+ *                        contain the indexes of the corrected characters, in
+ *                        increasing order.
+ *       error_count:     Pointer to a size_t that will be updated to contain
+ *                        the number of corrected characters (0, 1 or 2).
+ *  In:  input:           Pointer to a null-terminated Bech32 string.
+ *  Returns 1 if the string was valid or has been corrected.
+ */
+int bech32_correct(
+    char *output,
+    size_t *error_positions,
+    size_t *error_count,
+    const char *input
+);
+
 /** Encode a Bech32 string
  *
  *  Out: output:  Pointer to a buffer of size strlen(hrp) + data_len + 8 that
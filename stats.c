@@ -0,0 +1,238 @@
+#include "stats.h"
+#include "timer.h"
+#include "applog.h"
+
+#include <string.h>
+
+static const char *stage_names[BITCOIN_STATS_STAGE_COUNT] = {
+	"parse-input",
+	"check-input",
+	"convert",
+	"  ec",
+	"  hash",
+	"format-output",
+	"write-output"
+};
+
+void Stats_init(struct BitcoinStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->start_nanoseconds = Timer_nanoseconds();
+	stats->start_cycles = Timer_cycles();
+	stats->last_report_nanoseconds = stats->start_nanoseconds;
+}
+
+uint64_t Stats_begin(const struct BitcoinStats *stats)
+{
+	return stats ? Timer_cycles() : 0;
+}
+
+void Stats_end(struct BitcoinStats *stats, enum BitcoinStatsStage stage,
+	uint64_t begin)
+{
+	if (!stats) {
+		return;
+	}
+	stats->stage_calls[stage]++;
+	stats->stage_cycles[stage] += Timer_cycles() - begin;
+}
+
+void Stats_add(struct BitcoinStats *stats, enum BitcoinStatsStage stage,
+	uint64_t begin)
+{
+	if (!stats) {
+		return;
+	}
+	stats->stage_cycles[stage] += Timer_cycles() - begin;
+}
+
+static unsigned Stats_latencyBucket(uint64_t nanoseconds)
+{
+	unsigned exponent = 0;
+	uint64_t v = nanoseconds;
+
+	if (nanoseconds < BITCOIN_STATS_LATENCY_SUB_BUCKETS) {
+		return (unsigned)nanoseconds;
+	}
+	while (v >>= 1) {
+		exponent++;
+	}
+	/* the two bits below the leading one pick the sub-bucket */
+	return exponent * BITCOIN_STATS_LATENCY_SUB_BUCKETS
+		+ (unsigned)((nanoseconds >> (exponent - 2)) & 3);
+}
+
+static uint64_t Stats_latencyBucketStart(unsigned bucket)
+{
+	unsigned exponent = bucket / BITCOIN_STATS_LATENCY_SUB_BUCKETS;
+	unsigned sub = bucket % BITCOIN_STATS_LATENCY_SUB_BUCKETS;
+
+	if (bucket < BITCOIN_STATS_LATENCY_SUB_BUCKETS) {
+		return bucket;
+	}
+	return (uint64_t)(4 | sub) << (exponent - 2);
+}
+
+void Stats_recordLatency(struct BitcoinStats *stats, uint64_t nanoseconds)
+{
+	if (!stats) {
+		return;
+	}
+	stats->latency[Stats_latencyBucket(nanoseconds)]++;
+	if (nanoseconds > stats->latency_max) {
+		stats->latency_max = nanoseconds;
+	}
+}
+
+void Stats_recordError(struct BitcoinStats *stats, BitcoinResult result)
+{
+	if (!stats) {
+		return;
+	}
+	stats->records_failed++;
+	if ((unsigned)result < BITCOIN_RESULT_COUNT) {
+		stats->errors[result]++;
+	}
+}
+
+void Stats_merge(struct BitcoinStats *stats, const struct BitcoinStats *source)
+{
+	unsigned i;
+
+	stats->records_read += source->records_read;
+	stats->records_converted += source->records_converted;
+	stats->records_written += source->records_written;
+	stats->records_failed += source->records_failed;
+	for (i = 0; i < BITCOIN_STATS_STAGE_COUNT; i++) {
+		stats->stage_calls[i] += source->stage_calls[i];
+		stats->stage_cycles[i] += source->stage_cycles[i];
+	}
+	for (i = 0; i < BITCOIN_RESULT_COUNT; i++) {
+		stats->errors[i] += source->errors[i];
+	}
+	for (i = 0; i < BITCOIN_STATS_LATENCY_BUCKETS; i++) {
+		stats->latency[i] += source->latency[i];
+	}
+	if (source->latency_max > stats->latency_max) {
+		stats->latency_max = source->latency_max;
+	}
+}
+
+/* Approximate latency percentile, as the start of the bucket it falls in. */
+static uint64_t Stats_latencyPercentile(const struct BitcoinStats *stats,
+	double percentile)
+{
+	uint64_t total = 0, target, seen = 0;
+	unsigned i;
+
+	for (i = 0; i < BITCOIN_STATS_LATENCY_BUCKETS; i++) {
+		total += stats->latency[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	target = (uint64_t)(total * percentile / 100.0);
+	if (target >= total) {
+		target = total - 1;
+	}
+	for (i = 0; i < BITCOIN_STATS_LATENCY_BUCKETS; i++) {
+		seen += stats->latency[i];
+		if (seen > target) {
+			return Stats_latencyBucketStart(i);
+		}
+	}
+	return stats->latency_max;
+}
+
+void Stats_report(FILE *output, const struct BitcoinStats *stats)
+{
+	uint64_t elapsed_nanoseconds = Timer_nanoseconds() - stats->start_nanoseconds;
+	uint64_t elapsed_cycles = Timer_cycles() - stats->start_cycles;
+	double seconds = elapsed_nanoseconds / 1e9;
+	uint64_t total_cycles = 0;
+	unsigned i;
+
+	/* keep log messages in order with the report */
+	applog_flush();
+
+	for (i = 0; i < BITCOIN_STATS_STAGE_COUNT; i++) {
+		/* sub-stages are already included in their parent stage */
+		if (i != BITCOIN_STATS_EC && i != BITCOIN_STATS_HASH) {
+			total_cycles += stats->stage_cycles[i];
+		}
+	}
+
+	fprintf(output,
+		"stats: records read %llu, converted %llu, written %llu, failed %llu\n",
+		(unsigned long long)stats->records_read,
+		(unsigned long long)stats->records_converted,
+		(unsigned long long)stats->records_written,
+		(unsigned long long)stats->records_failed
+	);
+	fprintf(output,
+		"stats: elapsed %.3f s, %.1f records/sec\n",
+		seconds,
+		seconds > 0 ? stats->records_read / seconds : 0.0
+	);
+
+	fprintf(output, "stats: %-14s %12s %14s %9s %8s\n",
+		"stage", "calls", "cycles/call", "us/call", "cycles%");
+	for (i = 0; i < BITCOIN_STATS_STAGE_COUNT; i++) {
+		uint64_t calls = stats->stage_calls[i];
+		double cycles_per_call = calls ?
+			(double)stats->stage_cycles[i] / calls : 0.0;
+		/* convert cycles to time using the clock rate seen over the run */
+		double us_per_call = elapsed_cycles ?
+			cycles_per_call * elapsed_nanoseconds / elapsed_cycles / 1000 : 0.0;
+
+		fprintf(output, "stats: %-14s %12llu %14.0f %9.2f %7.1f%%\n",
+			stage_names[i],
+			(unsigned long long)calls,
+			cycles_per_call,
+			us_per_call,
+			total_cycles ? stats->stage_cycles[i] * 100.0 / total_cycles : 0.0
+		);
+	}
+
+	for (i = 0; i < BITCOIN_RESULT_COUNT; i++) {
+		if (stats->errors[i]) {
+			fprintf(output, "stats: errors: %s: %llu\n",
+				Bitcoin_ResultString((BitcoinResult)i),
+				(unsigned long long)stats->errors[i]
+			);
+		}
+	}
+
+	fprintf(output,
+		"stats: record latency us: p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f,"
+		" max %.2f\n",
+		Stats_latencyPercentile(stats, 50) / 1e3,
+		Stats_latencyPercentile(stats, 90) / 1e3,
+		Stats_latencyPercentile(stats, 99) / 1e3,
+		Stats_latencyPercentile(stats, 99.9) / 1e3,
+		stats->latency_max / 1e3
+	);
+}
+
+int Stats_reportDue(struct BitcoinStats *stats, unsigned interval)
+{
+	uint64_t now;
+
+	if (!stats || !interval) {
+		return 0;
+	}
+	now = Timer_nanoseconds();
+	if (now - stats->last_report_nanoseconds < (uint64_t)interval * 1000000000) {
+		return 0;
+	}
+	stats->last_report_nanoseconds = now;
+	return 1;
+}
+
+void Stats_reportPeriodically(FILE *output, struct BitcoinStats *stats,
+	unsigned interval)
+{
+	if (Stats_reportDue(stats, interval)) {
+		Stats_report(output, stats);
+	}
+}
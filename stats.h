@@ -0,0 +1,112 @@
+#ifndef BITCOIN_INCLUDE_STATS_H
+#define BITCOIN_INCLUDE_STATS_H
+
+/** @file stats.h
+ *  @brief Counters and timers for each stage of converting records, and a
+ *         summary report of them.
+ *
+ *  Stages are timed with the CPU cycle counter, which is cheap enough to read
+ *  around every stage of every record.  Each thread keeps its own counters,
+ *  which can be merged for the report.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stdio.h> /* FILE */
+#include <stdint.h> /* uint64_t */
+
+#include "result.h" /* BitcoinResult, BITCOIN_RESULT_COUNT */
+
+enum BitcoinStatsStage {
+	BITCOIN_STATS_PARSE_INPUT,   /* read and decode input format */
+	BITCOIN_STATS_CHECK_INPUT,   /* check and load input type */
+	BITCOIN_STATS_CONVERT,       /* all of input type to output type... */
+	BITCOIN_STATS_EC,            /* ...of which EC public key derivation */
+	BITCOIN_STATS_HASH,          /* ...of which SHA256 / RIPEMD160 */
+	BITCOIN_STATS_FORMAT_OUTPUT, /* encode output format */
+	BITCOIN_STATS_WRITE_OUTPUT,  /* write to output */
+	BITCOIN_STATS_STAGE_COUNT
+};
+
+/* latency histogram: 4 buckets per power of two nanoseconds */
+#define BITCOIN_STATS_LATENCY_SUB_BUCKETS 4
+#define BITCOIN_STATS_LATENCY_BUCKETS (64 * BITCOIN_STATS_LATENCY_SUB_BUCKETS)
+
+struct BitcoinStats {
+	uint64_t records_read,
+		records_converted,
+		records_written,
+		records_failed;
+
+	uint64_t stage_calls[BITCOIN_STATS_STAGE_COUNT];
+	uint64_t stage_cycles[BITCOIN_STATS_STAGE_COUNT];
+
+	/* failed records, by the result code that made them fail */
+	uint64_t errors[BITCOIN_RESULT_COUNT];
+
+	/* time from starting to read a record to finishing writing it */
+	uint64_t latency[BITCOIN_STATS_LATENCY_BUCKETS];
+	uint64_t latency_max;
+
+	uint64_t start_nanoseconds,
+		start_cycles,
+		last_report_nanoseconds;
+};
+
+/** @brief Reset all counters and start the clock. */
+void Stats_init(struct BitcoinStats *stats);
+
+/** @brief Start timing a stage.
+ *
+ *  @param[in] stats Counters, or NULL if not collecting statistics, in which
+ *                   case this does nothing.
+ *  @return Value to pass to Stats_end().
+ */
+uint64_t Stats_begin(const struct BitcoinStats *stats);
+
+/** @brief Finish timing a stage started with Stats_begin(). */
+void Stats_end(struct BitcoinStats *stats, enum BitcoinStatsStage stage,
+	uint64_t begin
+);
+
+/** @brief Add the time since Stats_begin() to a stage without counting a
+ *         call, for a stage done partly on one thread and partly on another,
+ *         whose call is counted by Stats_end() on the other.
+ */
+void Stats_add(struct BitcoinStats *stats, enum BitcoinStatsStage stage,
+	uint64_t begin
+);
+
+/** @brief Record how long a record took from start to finish.
+ *
+ *  @param[in] nanoseconds Time taken by the record.
+ */
+void Stats_recordLatency(struct BitcoinStats *stats, uint64_t nanoseconds);
+
+/** @brief Count a failed record. */
+void Stats_recordError(struct BitcoinStats *stats, BitcoinResult result);
+
+/** @brief Add the counters of 'source' to 'stats'. */
+void Stats_merge(struct BitcoinStats *stats, const struct BitcoinStats *source);
+
+/** @brief Write a summary of the counters.
+ *
+ *  @param[in] output File to write to.
+ *  @param[in] stats Counters to summarise.
+ */
+void Stats_report(FILE *output, const struct BitcoinStats *stats);
+
+/** @brief Whether at least 'interval' seconds have passed since the last
+ *         summary, in which case the next is counted from now.  'interval'
+ *         of 0 is never due.
+ */
+int Stats_reportDue(struct BitcoinStats *stats, unsigned interval);
+
+/** @brief Write a summary if at least 'interval' seconds have passed since
+ *         the last one.  'interval' of 0 never writes anything.
+ */
+void Stats_reportPeriodically(FILE *output, struct BitcoinStats *stats,
+	unsigned interval
+);
+
+#endif
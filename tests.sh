@@ -306,6 +306,405 @@ ffffffffffffffffffffffffffffffffffffffff
 ffffffffffffffffffffffffffffffffffffffff'
 check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
 # -----------------------------------------------------------------------------
+TEST="18 - benchmark runs every selected benchmark without errors"
+EXPECTED="encode-hex decode-hex"
+OUTPUT=$($BITCOIN_TOOL \
+	--benchmark \
+	--benchmark-filter hex \
+	--threads 2 | awk 'NR > 1 { printf "%s%s", sep, $1; sep=" " }')
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="19 - batch mode succeeds at end of input"
+$BITCOIN_TOOL \
+	--batch \
+	--input-type public-key-rmd \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input-file <(echo 62e907b15cbf27d5425399ebf6f0fb50ebb88f18) > /dev/null
+check "${TEST}" "$?" "0" || exit 1
+# -----------------------------------------------------------------------------
+TEST="20 - stats count read, written and failed records"
+EXPECTED="stats: records read 3, converted 2, written 2, failed 1"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--ignore-input-errors \
+	--stats \
+	--input-type public-key-rmd \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input-file <(printf '62e907b15cbf27d5425399ebf6f0fb50ebb88f18\nzz\n62e907b15cbf27d5425399ebf6f0fb50ebb88f18\n') \
+	2>&1 >/dev/null | grep "records read")
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="21 - progress reports records processed"
+EXPECTED="progress: 2 records"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--progress \
+	--input-type public-key-rmd \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input-file <(printf '62e907b15cbf27d5425399ebf6f0fb50ebb88f18\n62e907b15cbf27d5425399ebf6f0fb50ebb88f18\n') \
+	2>&1 >/dev/null | grep -o "progress: [0-9]* records")
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="22 - error file records line, offset and result of rejected input"
+EXPECTED=$(printf '2\t41\t7\tinvalid format')
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--ignore-input-errors \
+	--log-level fatal \
+	--error-file /dev/stderr \
+	--input-type public-key-rmd \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input-file <(printf '62e907b15cbf27d5425399ebf6f0fb50ebb88f18\nzz\n') \
+	2>&1 >/dev/null | grep -v '^#')
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="23 - mixed case hex input"
+EXPECTED="1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type public-key-rmd \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input 62E907b15CBF27d5425399EBF6F0fb50ebb88F18)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="24 - upper case testnet bech32 address round trip"
+EXPECTED="tb1qw508d6qejxtdg4y5r3zarvary0c5xw7kxpjzsx"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type address \
+	--input-format bech32 \
+	--output-type address \
+	--output-format bech32 \
+	--input TB1QW508D6QEJXTDG4Y5R3ZARVARY0C5XW7KXPJZSX)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="25 - fix bech32 address with two mistyped characters"
+EXPECTED="bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type address \
+	--input-format bech32 \
+	--output-type address \
+	--output-format bech32 \
+	--fix-bech32 \
+	--input bc1qw5o8d6qejxtdg4y5r3zarvary0c5xw7kv8f3t5)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="26 - fix base58check with three lookalike characters, most likely first"
+EXPECTED="1NaqSiNC4tfbyX42NGca24pBWvJ5L4Bd5J"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type private-key-wif \
+	--input-format base58check \
+	--output-type address \
+	--output-format base58check \
+	--input 5J5sKGFlpZ4bQXEHiEmDp9Fuf7K36FqF3w0aNKHKDHnLfJYnkUR \
+	--fix-base58check )
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="27 - fix base58check address of a given network, by changing 2 characters"
+EXPECTED="ecc0ce80ea6a5dcd03cc82451ad136162e49d56c"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type address \
+	--input-format base58check \
+	--output-type public-key-rmd \
+	--output-format hex \
+	--network bitcoin \
+	--input 1NaqSiNC4tfbyX42NGcaZ4pBWvJ5L4Bd5j \
+	--fix-base58check )
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="28 - batch with threads keeps output in input order"
+EXPECTED=$(printf '1NaqSiNC4tfbyX42NGca24pBWvJ5L4Bd5J\n1NFeCVtA3zuCUAmYheRvfyABnSZCHfrR3j\n1NaqSiNC4tfbyX42NGca24pBWvJ5L4Bd5J')
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--threads 4 \
+	--input-type private-key-wif \
+	--input-format base58check \
+	--output-type address \
+	--output-format base58check \
+	--fix-base58check \
+	--input-file <(printf '5J5sKGFlpZ4bQXEHiEmDp9Fuf7K36FqF3w0aNKHKDHnLfJYnkUR\nKx4VFK8gXu4qBv73x9b1KFnWYqKekkprYyfX9QhFUMQhrTUooXKc\n5J5sKGFlpZ4bQXEHiEmDp9Fuf7K36FqF3w0aNKHKDHnLfJYnkUR\n'))
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="29 - search range finds a key through the endomorphism"
+EXPECTED="c3558ead6adab86cc4b7052d408ca60ebd7d7097175ed95130f9eac9b58f6058"
+OUTPUT=$($BITCOIN_TOOL \
+	--search-range 1:100 \
+	--search-endomorphism \
+	--match-file <(echo 13txCxgpJRfMTWQrjm2gkiEZj56nqWfbUf) \
+	--output-type private-key \
+	--output-format hex)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="30 - solve range finds the private key of a public key"
+EXPECTED="0000000000000000000000000000000000000000000000000000000123456789"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type public-key \
+	--input-format hex \
+	--input 025004d7d9c2a3b2d675ada618d9ceda55d1f6a9fdf263e24daa8cbea586af2b2b \
+	--solve-range 100000000:1ffffffff \
+	--solve-memory 1 \
+	--output-type private-key \
+	--output-format hex)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="31 - kangaroo solve finds the private key of a public key"
+EXPECTED="0000000000000000000000000000000000000000000000000000000123456789"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type public-key \
+	--input-format hex \
+	--input 025004d7d9c2a3b2d675ada618d9ceda55d1f6a9fdf263e24daa8cbea586af2b2b \
+	--solve-range 100000000:1ffffffff \
+	--solve-method kangaroo \
+	--output-type private-key \
+	--output-format hex)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="32 - passphrases matching either address compression"
+EXPECTED=$(printf '5KJvsngHeMpm884wtkJNzQGaCErckhHJBGFsvd3VyK5qMZXj3hS\nL4XnHhvLC1b4ag9L2PM9kRicQxUoYT1Q36PQ21YtLNkrAdWZNos6')
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type passphrase \
+	--input-format raw \
+	--network bitcoin \
+	--output-type private-key-wif \
+	--output-format base58check \
+	--match-file <(printf '1JwSSubhmg6iPtRjtyqhUYYH7bZg3Lfy1T\n1xm4vFerV3pSgvBFkyzLgT1Ew3HQYrS1V\n') \
+	--input-file <(printf 'correct horse battery staple\nsatoshi\npassword\n'))
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="33 - derive a range of children of a BIP32 extended public key"
+EXPECTED=$(printf '02fc9e5af0ac8d9b3cecfe2a888e2117ba3d089d8585886c9c826b6b22a98d12ea\n03c6300a6eafa84663efc570ee5ad0b320b8c9669d6795ddc33c6ffeb5500719fe')
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type xpub \
+	--input-format base58check \
+	--input xpub661MyMwAqRbcFW31YEwpkMuc5THy2PSt5bDMsktWQcFF8syAmRUapSCGu8ED9W6oDMSgv6Zz8idoc4a6mr8BDzTJY47LJhkJ8UB7WEGuduB \
+	--derive m/0-1 \
+	--output-type public-key \
+	--output-format hex)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="34 - BIP39 mnemonics with a passphrase to master private keys"
+EXPECTED=$(printf '%s\n%s\n%s\n%s\n%s' \
+	cbedc75b0d6412c85c79bc13875112ef912fd1e756631b5a00330866f22ff184 \
+	dddda5cdef032caf0b966bb1c7d2a8836e827aaa6480e9067080a075656d3228 \
+	2fd0c70b975d9a38f84fba956ed795075fe43a85a45336143fe855551f1356db \
+	e1330e46e88f1c65cc1e228a16e3f0b94a316ae4fcfda1df4996b85c70d7b909 \
+	4ff56dc2209441bb4be12a366816727c343d5fd0e12c004505fe270ae3819e10)
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type mnemonic \
+	--input-format raw \
+	--mnemonic-passphrase TREZOR \
+	--network bitcoin \
+	--output-type private-key \
+	--output-format hex \
+	--input-file <(printf '%s\n' \
+		'abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about' \
+		'legal winner thank year wave sausage worth useful legal winner thank yellow' \
+		'letter advice cage absurd amount doctor acoustic avoid letter advice cage above' \
+		'zoo zoo zoo zoo zoo zoo zoo zoo zoo zoo zoo wrong' \
+		'scheme spot photo card baby mountain device kick cradle pact join borrow'))
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="35 - recover a mnemonic with a missing and a mistyped word"
+EXPECTED="1LqBGSKuX5yYUonjxT5qGfpUsXKYYWeabA"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type mnemonic \
+	--input-format raw \
+	--input "abandon abandn abandon abandon abandon abandon abandon abandon abandon abandon ? about" \
+	--network bitcoin \
+	--fix-mnemonic \
+	--match-file <(echo 1LqBGSKuX5yYUonjxT5qGfpUsXKYYWeabA) \
+	--derive "m/44'/0'/0'/0/0" \
+	--output-type address \
+	--output-format base58check)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="36 - decrypt BIP38 private keys of both methods"
+EXPECTED=$(printf '%s\n%s\n%s' \
+	5KN7MzqK5wt2TP1fQCYyHBtDrXdJuXbUzm4A9rKAteGu3Qi5CVR \
+	L44B5gGEpqEDRS9vVPz7QT35jcBG2r3CZwSwQ4fCewXAhAhqGVpP \
+	5K4caxezwjGCGfnoPTZ8tMcJBLB7Jvyjv4xxeacadhq8nLisLR2)
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type private-key-bip38 \
+	--input-format base58check \
+	--bip38-passphrase TestingOneTwoThree \
+	--threads 2 \
+	--output-type private-key-wif \
+	--output-format base58check \
+	--input-file <(printf '%s\n' \
+		6PRVWUbkzzsbcVac2qwfssoUJAN1Xhrg6bNk8J7Nzm5H7kxEbn2Nh2ZoGg \
+		6PYNKZ1EAgYgmQfmNVamxyXVWHzK5s6DGhwP4J5o44cvXdoY7sRzhtpUeo \
+		6PfQu77ygVyJLZjfvMLyhLMQbYnu5uguoJJ4kMCLqWwPEdfpwANVS76gTX))
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="37 - BIP38 encrypt a batch of private keys within a memory budget"
+EXPECTED=$(printf '%s\n%s\n%s' \
+	6PRVWUbkzzsbcVac2qwfssoUJAN1Xhrg6bNk8J7Nzm5H7kxEbn2Nh2ZoGg \
+	6PYNKZ1EAgYgmQfmNVamxyXVWHzK5s6DGhwP4J5o44cvXdoY7sRzhtpUeo \
+	6PRVWUbkzzsbcVac2qwfssoUJAN1Xhrg6bNk8J7Nzm5H7kxEbn2Nh2ZoGg)
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type private-key-wif \
+	--input-format base58check \
+	--bip38-passphrase TestingOneTwoThree \
+	--bip38-memory 20 \
+	--threads 3 \
+	--output-type private-key-bip38 \
+	--output-format base58check \
+	--input-file <(printf '%s\n' \
+		5KN7MzqK5wt2TP1fQCYyHBtDrXdJuXbUzm4A9rKAteGu3Qi5CVR \
+		L44B5gGEpqEDRS9vVPz7QT35jcBG2r3CZwSwQ4fCewXAhAhqGVpP \
+		5KN7MzqK5wt2TP1fQCYyHBtDrXdJuXbUzm4A9rKAteGu3Qi5CVR))
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="38 - generate mini private keys which read back as valid input"
+EXPECTED=$(printf '%s\n%s' 200 200)
+KEYS=$($BITCOIN_TOOL \
+	--generate mini-private-key \
+	--count 200 \
+	--threads 2 \
+	--output-type address \
+	--output-format base58check)
+OUTPUT=$(printf '%s\n' "${KEYS}" | cut -d' ' -f1 | $BITCOIN_TOOL \
+	--batch \
+	--input-type mini-private-key \
+	--input-format raw \
+	--output-type address \
+	--output-format base58check \
+	--input-file - \
+	| diff - <(printf '%s\n' "${KEYS}" | cut -d' ' -f2) >/dev/null \
+	&& printf '%s\n' "${KEYS}" | wc -l \
+	&& printf '%s\n' "${KEYS}" | cut -d' ' -f1 | sort -u | wc -l)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="39 - fix a mini private key with unreadable and misread characters"
+EXPECTED=S6c56bnXQiBjk9mqSYE7ykVQ7NzrRy
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type mini-private-key \
+	--input-format raw \
+	--input "S6c56bnXQ?Bjk9mqSYE7y?VQ7NzrRY" \
+	--fix-mini-private-key \
+	--fix-mini-private-key-change-chars 1 \
+	--match-file <(echo 1CciesT23BNionJeXrbxmjc7ywfiyM4oLW) \
+	--threads 2 \
+	--output-type mini-private-key \
+	--output-format raw)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="40 - threaded batch records with more output than their locked buffers"
+XPUB=xpub661MyMwAqRbcFW31YEwpkMuc5THy2PSt5bDMsktWQcFF8syAmRUapSCGu8ED9W6oDMSgv6Zz8idoc4a6mr8BDzTJY47LJhkJ8UB7WEGuduB
+EXPECTED=$(printf '%s\n%s\n' "${XPUB}" "${XPUB}" | $BITCOIN_TOOL \
+	--batch \
+	--input-type xpub \
+	--input-format base58check \
+	--derive m/0-49 \
+	--output-type address \
+	--output-format base58check \
+	--input-file -)
+OUTPUT=$(printf '%s\n%s\n' "${XPUB}" "${XPUB}" | $BITCOIN_TOOL \
+	--batch \
+	--input-type xpub \
+	--input-format base58check \
+	--derive m/0-49 \
+	--threads 2 \
+	--output-type address \
+	--output-format base58check \
+	--input-file -)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="41 - public keys off the curve are rejected, the rest converted"
+G=79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798
+EXPECTED=$(printf '%s\n%s\n%s\n%s' \
+	1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH \
+	1EHNa6Q4Jz2uvNExL497mE43ikXhwF6kZm \
+	"2	4	invalid public key format" \
+	"4	4	invalid public key format")
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--ignore-input-errors \
+	--log-level fatal \
+	--error-file /dev/stderr \
+	--input-type public-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--network bitcoin \
+	--input-file <(printf '%s\n' \
+		02${G} \
+		020000000000000000000000000000000000000000000000000000000000000005 \
+		04${G}483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8 \
+		04${G}483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B9) \
+	2>&1 | grep -v '^#' | cut -f1,3,4 | sort)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="42 - verify signed messages, rejecting one whose message was changed"
+EXPECTED=$(printf '%s\n%s\n%s\n%s' \
+	1ABFQUbXspksvrQLxm8zQ3KLnyDUDVhf4P \
+	1LUrSFFkW5w7fWcfZKEJ57DdruqRqcQ1e2 \
+	"4	13	invalid signature" \
+	mpLQjfK79b7CCV4VMJWEWAj5Mpx8Up5zxB)
+OUTPUT=$($BITCOIN_TOOL \
+	--verify-message \
+	--batch \
+	--threads 2 \
+	--ignore-input-errors \
+	--log-level fatal \
+	--error-file /dev/stderr \
+	--input-file <(printf '%s\n' \
+		"mpLQjfK79b7CCV4VMJWEWAj5Mpx8Up5zxB This is just a test message INbVnW4e6PeRmsv2Qgu8NuopvrVjkcxob+sX8OcZG0SALhWybUjzMLPdAsXI46YZGb0KQTRii+wWIQzRpG/U+S0=" \
+		"1LUrSFFkW5w7fWcfZKEJ57DdruqRqcQ1e2 proof of reserves G5/6ND7XlI2YeRi6p4Sozg1Rf8/nQ/NP2p7pYMjFfCu0VJ4rgL+mfnjt6CMaUO/QCKC+YwXIKEUW1B3ScMycrC8=" \
+		"1ABFQUbXspksvrQLxm8zQ3KLnyDUDVhf4P  IN3XUbm8i1Zm6cNSSwRkOacxQjwFfZ6xyLQfO6eg3ZKDQ/qa5knBWoCGMun9xEz/D6UXwpCvl5Fe0RQ1YfYkUTA=" \
+		"1LUrSFFkW5w7fWcfZKEJ57DdruqRqcQ1e2 proof of reserve G5/6ND7XlI2YeRi6p4Sozg1Rf8/nQ/NP2p7pYMjFfCu0VJ4rgL+mfnjt6CMaUO/QCKC+YwXIKEUW1B3ScMycrC8=") \
+	2>&1 | grep -v '^#' | cut -f1,3,4 | sort)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="43 - generating a negative count of mini private keys should fail"
+OUTPUT=$($BITCOIN_TOOL \
+	--generate mini-private-key \
+	--count -1 \
+	--output-type address \
+	--output-format base58check)
+checkfail "${TEST}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="44 - every fixed batch record is reported, past the repeat limit"
+EXPECTED="12"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type address \
+	--input-format bech32 \
+	--output-type address \
+	--output-format bech32 \
+	--fix-bech32 \
+	--input-file <(for i in $(seq 12) ; do \
+		echo bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t5 ; done) \
+	2>&1 >/dev/null | grep -c '^from: ')
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="45 - a negative number of threads should fail"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type private-key-wif \
+	--input-format base58check \
+	--input Kx4VFK8gXu4qBv73x9b1KFnWYqKekkprYyfX9QhFUMQhrTUooXKc \
+	--threads -1 \
+	--output-type address \
+	--output-format base58check)
+checkfail "${TEST}" || exit 1
+# -----------------------------------------------------------------------------
 # Test various different network prefixes
 # -----------------------------------------------------------------------------
 TEST="prefix1 - WIF compressed private key to address (bitcoin)"
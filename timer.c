@@ -0,0 +1,31 @@
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include "timer.h"
+
+#include <time.h>
+
+uint64_t Timer_nanoseconds(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+	return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+uint64_t Timer_cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__GNUC__) && defined(__aarch64__)
+	uint64_t v;
+	__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (v));
+	return v;
+#else
+	return 0;
+#endif
+}
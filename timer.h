@@ -0,0 +1,26 @@
+#ifndef BITCOIN_INCLUDE_TIMER_H
+#define BITCOIN_INCLUDE_TIMER_H
+
+/** @file timer.h
+ *  @brief Cheap clocks for measuring how long things take.
+ *
+ *  @author Matthew Anger
+ */
+
+#include <stdint.h> /* uint64_t */
+
+/** @brief Read a monotonic wall clock.
+ *
+ *  @return Nanoseconds since an arbitrary fixed point in the past.
+ */
+uint64_t Timer_nanoseconds(void);
+
+/** @brief Read the CPU timestamp counter, where the platform has one.
+ *         The counter is not serialising, so only use it to time sections
+ *         that are long compared to the pipeline depth.
+ *
+ *  @return Cycle count, or 0 if the platform has no cycle counter.
+ */
+uint64_t Timer_cycles(void);
+
+#endif
@@ -5,59 +5,257 @@
 #include <unistd.h>
 #include <stdint.h>
 
+/* Hex encoding and decoding use SSE2 where available, which is every x86-64
+   processor, and AVX2 too when the processor supports it. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__SSE2__))
+#define BITCOIN_HEX_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ >= 5
+#define BITCOIN_HEX_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/* hex digit values, -1 for characters which aren't hex digits */
+static const signed char hex_decode_table[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 int Bitcoin_DecodeHexChar(uint_fast8_t *output, char c)
 {
 	/* convert hex char 0-9,a-f,A-F to 0-15 decimal value and return 1,
 	or return 0 if char invalid */
-	if (c >= '0' && c <= '9') {
-		*output = c - '0';
-		return 1;
-	} else if (c >= 'A' && c <= 'F') {
-		*output = c - 'A' + 10;
-		return 1;
-	} else if (c >= 'a' && c <= 'f') {
-		*output = c - 'a' + 10;
-		return 1;
-	}
-	return 0;
+	signed char value = hex_decode_table[(unsigned char)c];
+	if (value < 0) {
+		return 0;
+	}
+	*output = value;
+	return 1;
+}
+
+#if defined(BITCOIN_HEX_SSE2)
+
+/* Decode 16 hex digits to 8 bytes, returning 0 without writing anything if
+   any of them are not hex digits. */
+static int Bitcoin_DecodeHex16(uint8_t *output, const char *source)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c = _mm_loadu_si128((const __m128i *)source);
+	/* '0'-'9' -> 0-9, and 'a'-'f' or 'A'-'F' -> 0-5, anything else is out
+	   of range (bytes over 127 wrap to negative or large values) */
+	const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	const __m128i alpha = _mm_sub_epi8(
+		_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a')
+	);
+	const __m128i not_digit = _mm_or_si128(
+		_mm_cmpgt_epi8(zero, digit), _mm_cmpgt_epi8(digit, _mm_set1_epi8(9))
+	);
+	const __m128i not_alpha = _mm_or_si128(
+		_mm_cmpgt_epi8(zero, alpha), _mm_cmpgt_epi8(alpha, _mm_set1_epi8(5))
+	);
+	__m128i value, pairs;
+
+	if (_mm_movemask_epi8(_mm_and_si128(not_digit, not_alpha))) {
+		return 0;
+	}
+	value = _mm_or_si128(
+		_mm_andnot_si128(not_digit, digit),
+		_mm_andnot_si128(not_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10)))
+	);
+	/* each 16 bit lane holds the high nibble in its low byte and the low
+	   nibble in its high byte */
+	pairs = _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(value, _mm_set1_epi16(0x00ff)), 4),
+		_mm_srli_epi16(value, 8)
+	);
+	_mm_storel_epi64((__m128i *)output, _mm_packus_epi16(pairs, pairs));
+	return 1;
+}
+
+/* Encode 16 bytes as 32 hex digits. */
+static void Bitcoin_EncodeHex16(char *output, const uint8_t *source,
+	int lower_case)
+{
+	const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+	const __m128i letter_offset = _mm_set1_epi8(lower_case ?
+		'a' - '0' - 10 : 'A' - '0' - 10);
+	const __m128i b = _mm_loadu_si128((const __m128i *)source);
+	const __m128i high = _mm_and_si128(_mm_srli_epi16(b, 4), nibble_mask);
+	const __m128i low = _mm_and_si128(b, nibble_mask);
+	__m128i n[2];
+	unsigned i;
+
+	n[0] = _mm_unpacklo_epi8(high, low);
+	n[1] = _mm_unpackhi_epi8(high, low);
+	for (i = 0; i < 2; i++) {
+		const __m128i letters = _mm_and_si128(
+			_mm_cmpgt_epi8(n[i], _mm_set1_epi8(9)), letter_offset
+		);
+		_mm_storeu_si128((__m128i *)(output + 16 * i), _mm_add_epi8(
+			_mm_add_epi8(n[i], _mm_set1_epi8('0')), letters
+		));
+	}
+}
+
+#endif
+
+#if defined(BITCOIN_HEX_AVX2)
+
+/* AVX2 versions of the above, twice as wide.  These are only called if the
+   processor supports AVX2. */
+
+__attribute__((target("avx2")))
+static int Bitcoin_DecodeHex32(uint8_t *output, const char *source)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c = _mm256_loadu_si256((const __m256i *)source);
+	const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	const __m256i alpha = _mm256_sub_epi8(
+		_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a')
+	);
+	const __m256i not_digit = _mm256_or_si256(
+		_mm256_cmpgt_epi8(zero, digit),
+		_mm256_cmpgt_epi8(digit, _mm256_set1_epi8(9))
+	);
+	const __m256i not_alpha = _mm256_or_si256(
+		_mm256_cmpgt_epi8(zero, alpha),
+		_mm256_cmpgt_epi8(alpha, _mm256_set1_epi8(5))
+	);
+	__m256i value, pairs, packed;
+
+	if (_mm256_movemask_epi8(_mm256_and_si256(not_digit, not_alpha))) {
+		return 0;
+	}
+	value = _mm256_or_si256(
+		_mm256_andnot_si256(not_digit, digit),
+		_mm256_andnot_si256(not_alpha,
+			_mm256_add_epi8(alpha, _mm256_set1_epi8(10)))
+	);
+	pairs = _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_and_si256(value, _mm256_set1_epi16(0x00ff)), 4),
+		_mm256_srli_epi16(value, 8)
+	);
+	/* packing works within each 128 bit lane, so gather the low 8 bytes of
+	   each lane into the low half */
+	packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+	_mm_storeu_si128((__m128i *)output, _mm256_castsi256_si128(packed));
+	return 1;
 }
 
+__attribute__((target("avx2")))
+static void Bitcoin_EncodeHex32(char *output, const uint8_t *source,
+	int lower_case)
+{
+	const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+	const __m256i letter_offset = _mm256_set1_epi8(lower_case ?
+		'a' - '0' - 10 : 'A' - '0' - 10);
+	const __m256i b = _mm256_loadu_si256((const __m256i *)source);
+	const __m256i high = _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble_mask);
+	const __m256i low = _mm256_and_si256(b, nibble_mask);
+	/* unpacking also works within each lane : the low unpack has bytes 0-7
+	   and 16-23, the high unpack has bytes 8-15 and 24-31 */
+	const __m256i unpacked_low = _mm256_unpacklo_epi8(high, low);
+	const __m256i unpacked_high = _mm256_unpackhi_epi8(high, low);
+	__m256i n[2];
+	unsigned i;
+
+	n[0] = _mm256_permute2x128_si256(unpacked_low, unpacked_high, 0x20);
+	n[1] = _mm256_permute2x128_si256(unpacked_low, unpacked_high, 0x31);
+	for (i = 0; i < 2; i++) {
+		const __m256i letters = _mm256_and_si256(
+			_mm256_cmpgt_epi8(n[i], _mm256_set1_epi8(9)), letter_offset
+		);
+		_mm256_storeu_si256((__m256i *)(output + 32 * i), _mm256_add_epi8(
+			_mm256_add_epi8(n[i], _mm256_set1_epi8('0')), letters
+		));
+	}
+}
+
+#endif
+
 BitcoinResult Bitcoin_DecodeHex(void *output, size_t output_size,
 	size_t *decoded_output_size,
 	const char *source, size_t source_size
 )
 {
 	unsigned char *output_bytes = (unsigned char *)output;
-	const char *source_copy = source;
+	int invalid = 0;
+	size_t i = 0;
 
 	*decoded_output_size = 0;
 
-	while (source_size) {
-		uint_fast8_t high, low;
+	if (source_size % 2) {
+		applog(APPLOG_ERROR, __func__,
+			"Odd number of hex digits (%u), expected two per byte",
+			(unsigned)source_size
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	if (source_size / 2 > output_size) {
+		applog(APPLOG_ERROR, __func__,
+			"Output buffer (%u bytes) too small to decode %u hex digits",
+			(unsigned)output_size,
+			(unsigned)source_size
+		);
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
 
-		if (!Bitcoin_DecodeHexChar(&high, *source)) {
-			applog(APPLOG_ERROR, __func__,
-				"Invalid character (ASCII=%u) at offset %u",
-				(unsigned)*source, source - source_copy
-			);
-			return BITCOIN_ERROR_INVALID_FORMAT;
+	/* vector decoding stops at the first block with an invalid character,
+	   which the scalar loop then finds */
+#if defined(BITCOIN_HEX_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		for (; i + 32 <= source_size; i += 32) {
+			if (!Bitcoin_DecodeHex32(output_bytes + i / 2, source + i)) {
+				break;
+			}
 		}
-		source++;
-
-		if (!Bitcoin_DecodeHexChar(&low, *source)) {
-			applog(APPLOG_ERROR, __func__,
-				"Invalid character (ASCII=%u) at offset %u",
-				(unsigned)*source, source - source_copy
-			);
-			return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+#endif
+#if defined(BITCOIN_HEX_SSE2)
+	for (; i + 16 <= source_size; i += 16) {
+		if (!Bitcoin_DecodeHex16(output_bytes + i / 2, source + i)) {
+			break;
 		}
-		source++;
+	}
+#endif
 
-		*output_bytes++ = (high << 4) | low;
-		source_size -= 2;
-		(*decoded_output_size)++;
+	/* invalid characters decode as -1, which sets the sign bit of
+	   'invalid', so there is no branch per character */
+	for (; i < source_size; i += 2) {
+		int high = hex_decode_table[(unsigned char)source[i]];
+		int low = hex_decode_table[(unsigned char)source[i + 1]];
+		invalid |= high | low;
+		output_bytes[i / 2] = (unsigned char)(((high & 0xf) << 4) | (low & 0xf));
 	}
 
+	if (invalid < 0) {
+		for (i = 0; hex_decode_table[(unsigned char)source[i]] >= 0; i++) {
+		}
+		applog(APPLOG_ERROR, __func__,
+			"Invalid character (ASCII=%u) at offset %u",
+			(unsigned)(unsigned char)source[i], (unsigned)i
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	*decoded_output_size = source_size / 2;
+
 	return BITCOIN_SUCCESS;
 }
 
@@ -73,19 +271,33 @@ BitcoinResult Bitcoin_EncodeHex(
 
 	const uint8_t *source_bytes = (const uint8_t *)source;
 	const char *hex_chars = lower_case ? hex_chars_lower : hex_chars_upper;
-	size_t output_bytes_left = output_size;
+	size_t i = 0;
+
+	/* encode as much as fits in the output */
+	if (source_size > output_size / 2) {
+		source_size = output_size / 2;
+	}
 
-	*encoded_output_size = 0;
+#if defined(BITCOIN_HEX_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		for (; i + 32 <= source_size; i += 32) {
+			Bitcoin_EncodeHex32(output + i * 2, source_bytes + i, lower_case);
+		}
+	}
+#endif
+#if defined(BITCOIN_HEX_SSE2)
+	for (; i + 16 <= source_size; i += 16) {
+		Bitcoin_EncodeHex16(output + i * 2, source_bytes + i, lower_case);
+	}
+#endif
 
-	while (source_size-- && output_bytes_left >= 2) {
-		output[0] = hex_chars[(*source_bytes >> 4) & 0xf];
-		output[1] = hex_chars[(*source_bytes) & 0xf];
-		output += 2;
-		*encoded_output_size += 2;
-		output_bytes_left -= 2;
-		source_bytes++;
+	for (; i < source_size; i++) {
+		output[i * 2] = hex_chars[(source_bytes[i] >> 4) & 0xf];
+		output[i * 2 + 1] = hex_chars[source_bytes[i] & 0xf];
 	}
 
+	*encoded_output_size = source_size * 2;
+
 	return BITCOIN_SUCCESS;
 }
 